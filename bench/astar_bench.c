@@ -0,0 +1,418 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* Compares the dense-array A* searches in 'navigation/a_star.c' against the
+ * earlier implementation, which kept the search state in hash tables. The
+ * portal graph search is additionally guided by the landmark distances from
+ * 'navigation/landmarks.c', whereas the reference is a plain Dijkstra search.
+ *
+ * Usage: astar_bench [PFMAP path] [iterations]
+ */
+
+#include "bench_common.h"
+#include "../src/navigation/a_star.h"
+#include "../src/navigation/nav_private.h"
+#include "../src/navigation/public/nav.h"
+#include "../src/lib/public/pqueue.h"
+#include "../src/lib/public/khash.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#define DEFAULT_MAP         "./assets/maps/demo.pfmap"
+#define DEFAULT_ITERATIONS  (10)
+#define PORTAL_QUERIES      (2048)
+#define COST_EPSILON        (1.0f / 64)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+
+PQUEUE_TYPE(coord, struct coord)
+PQUEUE_IMPL(static, coord, struct coord)
+
+PQUEUE_TYPE(portal, const struct portal*)
+PQUEUE_IMPL(static, portal, const struct portal*)
+
+KHASH_MAP_INIT_INT64(key_coord, struct coord)
+KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
+KHASH_MAP_INIT_INT64(key_float, float)
+
+#define kh_put_val(name, table, key, val)               \
+    do{                                                 \
+        int ret;                                        \
+        khiter_t k = kh_put(name, table, key, &ret);    \
+        assert(ret != -1);                              \
+        kh_value(table, k) = val;                       \
+    }while(0)
+
+struct result{
+    size_t queries;
+    size_t mismatches;
+    double ref_us;
+    double dense_us;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static unsigned s_seed = 1;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static unsigned bench_rand(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8);
+}
+
+static uint64_t coord_to_key(struct coord c)
+{
+    return (((uint64_t)c.r) << 32) | (((uint64_t)c.c) & ~((uint32_t)0));
+}
+
+static uint64_t portal_to_key(const struct portal *p)
+{
+    return (((uint64_t)p->chunk.r & 0xffff)      << 48)
+         | (((uint64_t)p->chunk.c & 0xffff)      << 32)
+         | (((uint64_t)p->endpoints[0].r & 0xff) << 24)
+         | (((uint64_t)p->endpoints[0].c & 0xff) << 16)
+         | (((uint64_t)p->endpoints[1].r & 0xff) <<  8)
+         | (((uint64_t)p->endpoints[1].c & 0xff) <<  0);
+}
+
+static float heuristic(struct coord a, struct coord b)
+{
+    const float D = 1.0f;
+    const float D2 = sqrt(2) * D;
+
+    int dx = abs(a.r - b.r);
+    int dy = abs(a.c - b.c);
+
+    return D * (dx + dy) + (D2 - 2 * D) * MIN(dx, dy);
+}
+
+static float portal_node_penalty(void)
+{
+    return sqrt(pow(FIELD_RES_R, 2.0f) + pow(FIELD_RES_C, 2.0f));
+}
+
+/* The hash table-based grid search, as it was before the dense-array one */
+static bool ref_grid_path(struct coord start, struct coord finish,
+                          const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], float *out_cost)
+{
+    pq_coord_t frontier;
+    khash_t(key_coord) *came_from = kh_init(key_coord);
+    khash_t(key_float) *running_cost = kh_init(key_float);
+    bool ret = false;
+
+    pq_coord_init(&frontier);
+    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
+    pq_coord_push(&frontier, 0.0f, start);
+
+    while(pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(&frontier, &curr);
+
+        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+            break;
+
+        struct coord neighbours[8];
+        float neighbour_costs[8];
+        int num_neighbours = N_GridNeighbours(cost_field, curr, neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            struct coord *next = &neighbours[i];
+            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
+            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+
+            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
+                pq_coord_push(&frontier, new_cost + heuristic(finish, *next), *next);
+                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
+            }
+        }
+    }
+
+    if(kh_get(key_coord, came_from, coord_to_key(finish)) != kh_end(came_from)) {
+        *out_cost = kh_value(running_cost, kh_get(key_float, running_cost, coord_to_key(finish)));
+        ret = true;
+    }
+
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_coord, came_from);
+    return ret;
+}
+
+/* The hash table-based portal graph search, as it was before the dense-array one */
+static bool ref_portal_graph_path(struct tile_desc start_tile, const struct portal *finish, 
+                                  const struct nav_private *priv, float *out_cost)
+{
+    pq_portal_t frontier;
+    khash_t(key_portal) *came_from = kh_init(key_portal);
+    khash_t(key_float) *running_cost = kh_init(key_float);
+    bool ret = false;
+
+    pq_portal_init(&frontier);
+    const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        struct coord tile_coord = (struct coord){start_tile.tile_r, start_tile.tile_c};
+
+        if(N_PortalReachableFromTile(port, tile_coord, chunk)) {
+
+            float cost = N_PortalTravelCost(chunk, i, tile_coord);
+            if(cost != FLT_MAX) {
+                kh_put_val(key_float, running_cost, portal_to_key(port), cost);
+                pq_portal_push(&frontier, cost, port);
+            }
+        }
+    }
+
+    while(pq_size(&frontier) > 0) {
+
+        const struct portal *curr;
+        pq_portal_pop(&frontier, &curr);
+
+        if(curr == finish)
+            break;
+
+        const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
+        float neighbour_costs[MAX_PORTALS_PER_CHUNK];
+        int num_neighbours = 0;
+
+        for(int i = 0; i < curr->num_neighbours; i++) {
+            if(curr->edges[i].es == EDGE_STATE_BLOCKED)
+                continue;
+            neighbours[num_neighbours] = curr->edges[i].neighbour;
+            neighbour_costs[num_neighbours++] = curr->edges[i].cost;
+        }
+        neighbours[num_neighbours] = curr->connected;
+        neighbour_costs[num_neighbours++] = 1;
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            const struct portal *next = neighbours[i];
+            khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
+            float new_cost = kh_value(running_cost, k) + neighbour_costs[i] + portal_node_penalty();
+
+            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
+                pq_portal_push(&frontier, new_cost, next);
+                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
+            }
+        }
+    }
+
+    if(kh_get(key_portal, came_from, portal_to_key(finish)) != kh_end(came_from)) {
+        *out_cost = kh_value(running_cost, kh_get(key_float, running_cost, portal_to_key(finish)));
+        ret = true;
+    }
+
+    pq_portal_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_portal, came_from);
+    return ret;
+}
+
+static bool same_result(bool a_found, float a_cost, bool b_found, float b_cost)
+{
+    if(a_found != b_found)
+        return false;
+    return !a_found || fabs(a_cost - b_cost) < COST_EPSILON;
+}
+
+static struct coord portal_center(const struct portal *port)
+{
+    return (struct coord){
+        (port->endpoints[0].r + port->endpoints[1].r) / 2,
+        (port->endpoints[0].c + port->endpoints[1].c) / 2,
+    };
+}
+
+/* Search between the centers of every pair of portals in every chunk - the 
+ * same queries that are made when linking the portals of a chunk. */
+static struct result bench_grid_paths(const struct nav_private *priv, int iterations)
+{
+    struct result ret = {0};
+    vec_coord_t path;
+    vec_coord_init(&path);
+
+    for(int it = 0; it < iterations; it++) {
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        for(int a = 0; a < chunk->num_portals; a++) {
+        for(int b = 0; b < chunk->num_portals; b++) {
+
+            if(a == b)
+                continue;
+
+            struct coord start = portal_center(&chunk->portals[a]);
+            struct coord finish = portal_center(&chunk->portals[b]);
+            float ref_cost = 0.0f, dense_cost = 0.0f;
+
+            uint64_t begin = SDL_GetPerformanceCounter();
+            bool ref_found = ref_grid_path(start, finish, chunk->cost_base, &ref_cost);
+            ret.ref_us += Bench_ElapsedUS(begin);
+
+            begin = SDL_GetPerformanceCounter();
+            bool dense_found = AStar_GridPathUncached(start, finish, chunk->cost_base, &path, &dense_cost);
+            ret.dense_us += Bench_ElapsedUS(begin);
+
+            ret.queries++;
+            ret.mismatches += !same_result(ref_found, ref_cost, dense_found, dense_cost);
+        }}
+    }}
+
+    vec_coord_destroy(&path);
+    return ret;
+}
+
+/* Search from random pathable tiles to random portals on the map */
+static struct result bench_portal_paths(const struct nav_private *priv, int iterations)
+{
+    struct result ret = {0};
+    vec_portal_t path;
+    vec_portal_init(&path);
+
+    size_t nchunks = priv->width * priv->height;
+    size_t nqueries = PORTAL_QUERIES * iterations;
+
+    for(int i = 0; i < nqueries; i++) {
+
+        const struct nav_chunk *dst_chunk = &priv->chunks[bench_rand() % nchunks];
+        if(dst_chunk->num_portals == 0)
+            continue;
+        const struct portal *finish = &dst_chunk->portals[bench_rand() % dst_chunk->num_portals];
+
+        struct tile_desc start = (struct tile_desc){
+            .chunk_r = bench_rand() % priv->height,
+            .chunk_c = bench_rand() % priv->width,
+            .tile_r = bench_rand() % FIELD_RES_R,
+            .tile_c = bench_rand() % FIELD_RES_C,
+        };
+        const struct nav_chunk *src_chunk = &priv->chunks[start.chunk_r * priv->width + start.chunk_c];
+        if(src_chunk->islands[start.tile_r][start.tile_c] == ISLAND_NONE)
+            continue;
+
+        float ref_cost = 0.0f, dense_cost = 0.0f;
+
+        uint64_t begin = SDL_GetPerformanceCounter();
+        bool ref_found = ref_portal_graph_path(start, finish, priv, &ref_cost);
+        ret.ref_us += Bench_ElapsedUS(begin);
+
+        begin = SDL_GetPerformanceCounter();
+        bool dense_found = AStar_PortalGraphPath(start, finish, priv, &path, &dense_cost);
+        ret.dense_us += Bench_ElapsedUS(begin);
+
+        ret.queries++;
+        ret.mismatches += !same_result(ref_found, ref_cost, dense_found, dense_cost);
+    }
+
+    vec_portal_destroy(&path);
+    return ret;
+}
+
+static void print_result(const char *name, struct result res)
+{
+    if(res.queries == 0) {
+        printf("%-12s no queries\n", name);
+        return;
+    }
+    printf("%-12s queries: %8zu  hash tables: %8.3f us/query  dense: %8.3f us/query  speedup: %5.2fx  mismatches: %zu\n",
+        name, res.queries, res.ref_us / res.queries, res.dense_us / res.queries, 
+        res.ref_us / res.dense_us, res.mismatches);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : DEFAULT_MAP;
+    int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+    int ret = EXIT_FAILURE;
+
+    struct bench_map map;
+    if(!Bench_LoadMap(path, &map)) {
+        fprintf(stderr, "Failed to load map: %s\n", path);
+        goto fail_map;
+    }
+
+    if(!Bench_InitNav()) {
+        fprintf(stderr, "Failed to initialize navigation subsystem\n");
+        goto fail_init;
+    }
+
+    void *nav_private = Bench_BuildNav(&map);
+    if(!nav_private) {
+        fprintf(stderr, "Failed to build navigation data\n");
+        goto fail_build;
+    }
+
+    printf("%s: %zux%zu chunks, %d iterations\n", path, map.width, map.height, iterations);
+    struct result grid = bench_grid_paths(nav_private, iterations);
+    struct result portal = bench_portal_paths(nav_private, iterations);
+    print_result("grid", grid);
+    print_result("portal graph", portal);
+
+    if(grid.mismatches == 0 && portal.mismatches == 0)
+        ret = EXIT_SUCCESS;
+
+    N_FreePrivate(nav_private);
+fail_build:
+    Bench_ShutdownNav();
+fail_init:
+    Bench_FreeMap(&map);
+fail_map:
+    return ret;
+}
+
@@ -0,0 +1,254 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "bench_common.h"
+#include "../src/navigation/public/nav.h"
+#include "../src/game/public/game.h"
+#include "../src/render/public/render.h"
+#include "../src/render/public/render_ctrl.h"
+#include "../src/task.h"
+#include "../src/lib/public/pf_string.h"
+#include "../src/settings.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define A2I(_a)         ((_a) - '0')
+#define MAX_LINE_LEN    (256)
+#define CHUNK_TILES     (TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT)
+
+/*****************************************************************************/
+/* ENGINE STUBS                                                              */
+/*****************************************************************************/
+
+/* Unused, since the navigation data cache is turned off in 'Bench_InitNav' */
+const char *g_basepath = ".";
+
+/* The navigation subsystem only uses the following to render debug overlays
+ * and to query entities, neither of which happen in the benchmarks. */
+
+void Perf_Push(const char *name) {}
+void Perf_Pop(void) {}
+
+/* There is no settings file, so every setting keeps its' default value */
+
+ss_e Settings_Create(struct setting sett)
+{
+    return SS_OKAY;
+}
+
+ss_e Settings_Get(const char *name, struct sval *out)
+{
+    return SS_NO_SETTING;
+}
+
+const struct map *G_GetPrevTickMap(void)
+{
+    return NULL;
+}
+
+bool G_GetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state *out)
+{
+    return false;
+}
+
+vec2_t G_Pos_GetXZ(uint32_t uid)
+{
+    return (vec2_t){0.0f, 0.0f};
+}
+
+int G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout)
+{
+    return 0;
+}
+
+int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout,
+                             bool (*predicate)(const struct entity *ent, void *arg), void *arg)
+{
+    return 0;
+}
+
+struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
+                                     bool (*predicate)(const struct entity *ent, void *arg), void *arg)
+{
+    return NULL;
+}
+
+void *R_PushArg(const void *src, size_t size)
+{
+    return NULL;
+}
+
+void R_PushCmd(struct rcmd cmd) {}
+
+void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, const size_t *count, mat4x4_t *model, 
+                              const struct map *map) {}
+
+void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, const size_t *count,
+                        mat4x4_t *model, const struct map *map) {}
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool bench_parse_tile(const char *str, struct tile *out)
+{
+    if(strlen(str) != 24)
+        return false;
+
+    char type_hexstr[2] = {str[0], '\0'};
+
+    memset(out, 0, sizeof(struct tile));
+    out->type          = (enum tiletype) strtol(type_hexstr, NULL, 16);
+    out->base_height   = (int)           (str[1] == '-' ? -1 : 1) * (10  * A2I(str[2]) + A2I(str[3]));
+    out->ramp_height   = (int)           (10  * A2I(str[4]) + A2I(str[5]));
+    out->top_mat_idx   = (int)           (100 * A2I(str[6]) + 10 * A2I(str[7 ]) + A2I(str[8 ]));
+    out->sides_mat_idx = (int)           (100 * A2I(str[9]) + 10 * A2I(str[10]) + A2I(str[11]));
+    out->pathable      = (bool)          A2I(str[12]);
+    out->blend_mode    = (int)           A2I(str[13]);
+    out->blend_normals = (bool)          A2I(str[14]);
+
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Bench_LoadMap(const char *path, struct bench_map *out)
+{
+    char line[MAX_LINE_LEN];
+    int num_materials, num_rows, num_cols;
+    float version;
+
+    FILE *file = fopen(path, "r");
+    if(!file)
+        goto fail_open;
+
+    if(!fgets(line, sizeof(line), file) || !sscanf(line, "version %f", &version))
+        goto fail_parse;
+    if(!fgets(line, sizeof(line), file) || !sscanf(line, "num_materials %d", &num_materials))
+        goto fail_parse;
+    if(!fgets(line, sizeof(line), file) || !sscanf(line, "num_rows %d", &num_rows))
+        goto fail_parse;
+    if(!fgets(line, sizeof(line), file) || !sscanf(line, "num_cols %d", &num_cols))
+        goto fail_parse;
+
+    for(int i = 0; i < num_materials; i++) {
+        if(!fgets(line, sizeof(line), file))
+            goto fail_parse;
+    }
+
+    out->width = num_cols;
+    out->height = num_rows;
+    out->tiles = malloc(num_rows * num_cols * CHUNK_TILES * sizeof(struct tile));
+    if(!out->tiles)
+        goto fail_parse;
+
+    size_t ntiles = 0;
+    while(ntiles < num_rows * num_cols * CHUNK_TILES) {
+
+        if(!fgets(line, sizeof(line), file))
+            goto fail_tiles;
+
+        char *saveptr;
+        char *string = pf_strtok_r(line, " \t\n", &saveptr);
+        while(string && ntiles < num_rows * num_cols * CHUNK_TILES) {
+
+            if(!bench_parse_tile(string, out->tiles + ntiles))
+                goto fail_tiles;
+            ntiles++;
+            string = pf_strtok_r(NULL, " \t\n", &saveptr);
+        }
+    }
+
+    fclose(file);
+    return true;
+
+fail_tiles:
+    free(out->tiles);
+fail_parse:
+    fclose(file);
+fail_open:
+    return false;
+}
+
+void Bench_FreeMap(struct bench_map *map)
+{
+    free(map->tiles);
+}
+
+bool Bench_InitNav(void)
+{
+    if(!Task_Init())
+        goto fail_task;
+    if(!N_Init())
+        goto fail_nav;
+    /* Every run builds the navigation data from scratch, without leaving 
+     * behind cache entries in the working directory */
+    N_SetDiskCacheEnabled(false);
+    return true;
+
+fail_nav:
+    Task_Shutdown();
+fail_task:
+    return false;
+}
+
+void Bench_ShutdownNav(void)
+{
+    N_Shutdown();
+    Task_Shutdown();
+}
+
+void *Bench_BuildNav(const struct bench_map *map)
+{
+    const struct tile *chunk_tiles[map->width * map->height];
+    for(int i = 0; i < map->width * map->height; i++) {
+        chunk_tiles[i] = map->tiles + i * CHUNK_TILES;
+    }
+
+    return N_BuildForMapData(map->width, map->height, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles, true);
+}
+
+double Bench_ElapsedUS(uint64_t start_pc)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - start_pc;
+    return delta * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
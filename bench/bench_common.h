@@ -0,0 +1,71 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+/* Shared helpers for the headless benchmark tools. These run parts of the 
+ * engine (such as the navigation subsystem) without a window, renderer or 
+ * scripting, using the map tiles parsed directly from a PFMAP file.
+ */
+
+#include "../src/map/public/tile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bench_map{
+    size_t       width, height; /* in chunks */
+    /* TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT tiles for every chunk,
+     * with chunks in row-major order */
+    struct tile *tiles;
+};
+
+bool     Bench_LoadMap(const char *path, struct bench_map *out);
+void     Bench_FreeMap(struct bench_map *map);
+
+/* Initializes the subsystems needed for running navigation queries */
+bool     Bench_InitNav(void);
+void     Bench_ShutdownNav(void);
+
+/* Returns a navigation context built from the map's tiles, to be freed 
+ * with 'N_FreePrivate' */
+void    *Bench_BuildNav(const struct bench_map *map);
+
+double   Bench_ElapsedUS(uint64_t start_pc);
+
+#endif
+
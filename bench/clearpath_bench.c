@@ -0,0 +1,391 @@
+/*
+ *  This file is part of Permafrost Engine.
+ *  Copyright (C) 2020 Eduard Permyakov
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Linking this software statically or dynamically with other modules is making
+ *  a combined work based on this software. Thus, the terms and conditions of
+ *  the GNU General Public License cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Permafrost Engine give
+ *  you permission to link Permafrost Engine with independent modules to produce
+ *  an executable, regardless of the license terms of these independent
+ *  modules, and to copy and distribute the resulting executable under
+ *  terms of your choice, provided that you also meet, for each linked
+ *  independent module, the terms and conditions of the license of that
+ *  module. An independent module is a module which is not derived from
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may
+ *  extend this exception to your version of Permafrost Engine, but you are not
+ *  obliged to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ */
+
+/* Compares the velocities chosen by the ClearPath solver when it considers
+ * all of an entity's neighbours against the ones chosen when it considers
+ * only the ones with the soonest time-to-collision, along with the time taken
+ * to choose them. The neighbourhoods are generated from the seed: a flock
+ * moving in roughly the same direction with some stationary entities mixed
+ * in, for increasing numbers of neighbours. The results are printed as JSON.
+ *
+ * Usage: clearpath_bench [samples] [seed] [max neighbours]
+ */
+
+#include "../src/game/clearpath.h"
+#include "../src/game/public/game.h"
+#include "../src/map/public/map.h"
+#include "../src/render/public/render.h"
+#include "../src/render/public/render_ctrl.h"
+#include "../src/event.h"
+#include "../src/settings.h"
+#include "../src/ui.h"
+#include "../src/config.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_SAMPLES     (100)
+#define DEFAULT_SEED        (1)
+
+#define AGENT_RADIUS        (0.25f)
+#define AGENT_SPEED         (0.25f) /* OpenGL coordinates per tick */
+#define STATIC_FRACTION     (8)    /* every n-th neighbour is stationary */
+#define VEL_NOISE           (0.5f) /* relative to the agent speed */
+#define COLLISION_HORIZON   (20.0f) /* ticks */
+#define MAX_PLACE_TRIES     (256)
+
+struct neighbourhood{
+    struct cp_ent ent;
+    vec2_t        des_v;
+    vec_cp_ent_t  dyn;
+    vec_cp_ent_t  stat;
+};
+
+struct solve_result{
+    double us;
+    vec2_t vnew;
+};
+
+struct totals{
+    double us_all, us_bounded;
+    double max_us_all, max_us_bounded;
+    double dv_sum, dv_max;
+    size_t identical;
+    size_t safe_all, safe_bounded;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static unsigned       s_seed = DEFAULT_SEED;
+/* The value of the 'pf.game.clearpath_max_neighbours' setting */
+static int            s_max_neighbours = 0;
+static vec_pentity_t  s_empty_sel;
+static const size_t   s_neighbour_counts[] = {8, 16, 32, 64, 128, 256};
+
+/*****************************************************************************/
+/* STUBS                                                                     */
+/*****************************************************************************/
+
+/* The solver only uses the following for its' settings and its' debug rendering, 
+ * which is off */
+
+void Perf_Push(const char *name) {}
+void Perf_Pop(void) {}
+
+bool E_Global_Register(enum eventtype event, handler_t handler, void *user_arg,
+                       int simmask)
+{
+    return true;
+}
+
+bool E_Global_Unregister(enum eventtype event, handler_t handler)
+{
+    return true;
+}
+
+ss_e Settings_Get(const char *name, struct sval *out)
+{
+    if(!strcmp(name, "pf.game.clearpath_max_neighbours")) {
+        *out = (struct sval){ .type = ST_TYPE_INT, .as_int = s_max_neighbours };
+        return SS_OKAY;
+    }
+    *out = (struct sval){ .type = ST_TYPE_BOOL, .as_bool = false };
+    return SS_OKAY;
+}
+
+const vec_pentity_t *G_Sel_Get(enum selection_type *out_type)
+{
+    return &s_empty_sel;
+}
+
+const struct map *G_GetPrevTickMap(void)
+{
+    return NULL;
+}
+
+float M_HeightAtPoint(const struct map *map, vec2_t xz)
+{
+    return 0.0f;
+}
+
+void *R_PushArg(const void *src, size_t size)
+{
+    return NULL;
+}
+
+void R_PushCmd(struct rcmd cmd) {}
+
+void R_GL_DrawRay(const vec3_t *origin, const vec3_t *dir, mat4x4_t *model,
+                  const vec3_t *color, const float *t) {}
+void R_GL_DrawSelectionCircle(const vec2_t *xz, const float *radius, const float *width,
+                              const vec3_t *color, const struct map *map) {}
+void R_GL_DrawCombinedHRVO(vec2_t *apexes, vec2_t *left_rays, vec2_t *right_rays,
+                           const size_t *num_vos, const struct map *map) {}
+void UI_DrawText(const char *text, struct rect rect, struct rgba rgba) {}
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static unsigned bench_rand(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8);
+}
+
+static float bench_randf(void)
+{
+    return (bench_rand() & 0xffff) / (float)0xffff;
+}
+
+static vec2_t random_dir(void)
+{
+    float angle = bench_randf() * 2.0f * M_PI;
+    return (vec2_t){cosf(angle), sinf(angle)};
+}
+
+static double elapsed_us(uint64_t start_pc)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - start_pc;
+    return delta * 1000000.0 / SDL_GetPerformanceFrequency();
+}
+
+static bool overlaps(vec2_t xz_pos, const vec_cp_ent_t *ents)
+{
+    for(int i = 0; i < vec_size(ents); i++) {
+
+        vec2_t diff;
+        PFM_Vec2_Sub(&xz_pos, &vec_AT(ents, i).xz_pos, &diff);
+        if(PFM_Vec2_Len(&diff) < 2.0f * AGENT_RADIUS)
+            return true;
+    }
+    return false;
+}
+
+/* The neighbours are spread uniformly over the neighbour radius, without
+ * overlapping each other or the entity itself. */
+static void neighbourhood_gen(struct neighbourhood *out, size_t nneighbs)
+{
+    vec2_t flock_dir = random_dir();
+
+    out->ent = (struct cp_ent){
+        .xz_pos = (vec2_t){0.0f, 0.0f},
+        .xz_vel = (vec2_t){flock_dir.x * AGENT_SPEED, flock_dir.z * AGENT_SPEED},
+        .radius = AGENT_RADIUS,
+    };
+    vec2_t des_dir = random_dir();
+    out->des_v = (vec2_t){
+        (flock_dir.x + des_dir.x * VEL_NOISE) * AGENT_SPEED,
+        (flock_dir.z + des_dir.z * VEL_NOISE) * AGENT_SPEED,
+    };
+
+    vec_cp_ent_reset(&out->dyn);
+    vec_cp_ent_reset(&out->stat);
+
+    for(int i = 0; i < nneighbs; i++) {
+
+        const float min_dist = 2.0f * AGENT_RADIUS;
+        vec2_t pos;
+        int tries = 0;
+
+        do{
+            float dist = min_dist + sqrtf(bench_randf()) * (CLEARPATH_NEIGHBOUR_RADIUS - min_dist);
+            vec2_t dir = random_dir();
+            pos = (vec2_t){dir.x * dist, dir.z * dist};
+
+        }while((overlaps(pos, &out->dyn) || overlaps(pos, &out->stat)) 
+            && ++tries < MAX_PLACE_TRIES);
+
+        struct cp_ent nb = (struct cp_ent){
+            .xz_pos = pos,
+            .xz_vel = (vec2_t){0.0f, 0.0f},
+            .radius = AGENT_RADIUS,
+        };
+
+        if(i % STATIC_FRACTION == 0) {
+            vec_cp_ent_push(&out->stat, nb);
+            continue;
+        }
+
+        vec2_t noise = random_dir();
+        nb.xz_vel = (vec2_t){
+            (flock_dir.x + noise.x * VEL_NOISE) * AGENT_SPEED,
+            (flock_dir.z + noise.z * VEL_NOISE) * AGENT_SPEED,
+        };
+        vec_cp_ent_push(&out->dyn, nb);
+    }
+}
+
+static struct solve_result solve(const struct neighbourhood *nh, int max_neighbours)
+{
+    s_max_neighbours = max_neighbours;
+    G_ClearPath_BeginTick();
+
+    /* The solver may reorder the neighbours, so it is given copies */
+    vec_cp_ent_t dyn, stat;
+    vec_cp_ent_init(&dyn);
+    vec_cp_ent_init(&stat);
+    vec_cp_ent_copy(&dyn, (vec_cp_ent_t*)&nh->dyn);
+    vec_cp_ent_copy(&stat, (vec_cp_ent_t*)&nh->stat);
+
+    struct solve_result ret;
+    uint64_t start = SDL_GetPerformanceCounter();
+    ret.vnew = G_ClearPath_NewVelocity(nh->ent, 0, nh->des_v, dyn, stat);
+    ret.us = elapsed_us(start);
+
+    vec_cp_ent_destroy(&dyn);
+    vec_cp_ent_destroy(&stat);
+    return ret;
+}
+
+static bool collides(struct cp_ent ent, vec2_t vel, const vec_cp_ent_t *neighbs)
+{
+    for(int i = 0; i < vec_size(neighbs); i++) {
+
+        const struct cp_ent *nb = &vec_AT(neighbs, i);
+        float rx = nb->xz_pos.x - ent.xz_pos.x, rz = nb->xz_pos.z - ent.xz_pos.z;
+        float vx = vel.x - nb->xz_vel.x, vz = vel.z - nb->xz_vel.z;
+        float radius = ent.radius + nb->radius;
+
+        /* The closest approach within the horizon */
+        float a = vx * vx + vz * vz;
+        float t = (a > 0.0f) ? (rx * vx + rz * vz) / a : 0.0f;
+        t = (t < 0.0f) ? 0.0f : (t > COLLISION_HORIZON) ? COLLISION_HORIZON : t;
+
+        float dx = rx - vx * t, dz = rz - vz * t;
+        if(dx * dx + dz * dz < radius * radius)
+            return true;
+    }
+    return false;
+}
+
+/* Whether moving with the velocity keeps the entity clear of all its'
+ * neighbours over the horizon, assuming they keep their velocities. */
+static bool safe(const struct neighbourhood *nh, vec2_t vel)
+{
+    return !collides(nh->ent, vel, &nh->dyn)
+        && !collides(nh->ent, vel, &nh->stat);
+}
+
+static void run_count(size_t nneighbs, int samples, int max_neighbours, 
+                      struct neighbourhood *nh, const char *sep)
+{
+    struct totals tot = {0};
+
+    for(int i = 0; i < samples; i++) {
+
+        neighbourhood_gen(nh, nneighbs);
+        struct solve_result all = solve(nh, 0);
+        struct solve_result bounded = solve(nh, max_neighbours);
+
+        tot.us_all += all.us;
+        tot.us_bounded += bounded.us;
+        tot.max_us_all = (all.us > tot.max_us_all) ? all.us : tot.max_us_all;
+        tot.max_us_bounded = (bounded.us > tot.max_us_bounded) ? bounded.us : tot.max_us_bounded;
+
+        vec2_t diff;
+        PFM_Vec2_Sub(&all.vnew, &bounded.vnew, &diff);
+        double dv = PFM_Vec2_Len(&diff) / AGENT_SPEED;
+
+        tot.dv_sum += dv;
+        tot.dv_max = (dv > tot.dv_max) ? dv : tot.dv_max;
+        tot.identical += (dv == 0.0);
+        tot.safe_all += safe(nh, all.vnew);
+        tot.safe_bounded += safe(nh, bounded.vnew);
+    }
+
+    printf("    {\"neighbours\": %zu, "
+        "\"all_us\": {\"mean\": %.3f, \"max\": %.3f}, "
+        "\"bounded_us\": {\"mean\": %.3f, \"max\": %.3f}, "
+        "\"speedup\": %.2f, "
+        "\"identical\": %.4f, "
+        "\"mean_rel_dv\": %.4f, \"max_rel_dv\": %.4f, "
+        "\"all_safe\": %.4f, \"bounded_safe\": %.4f}%s\n",
+        nneighbs,
+        tot.us_all / samples, tot.max_us_all,
+        tot.us_bounded / samples, tot.max_us_bounded,
+        tot.us_all / tot.us_bounded,
+        (double)tot.identical / samples,
+        tot.dv_sum / samples, tot.dv_max,
+        (double)tot.safe_all / samples, (double)tot.safe_bounded / samples, sep);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : DEFAULT_SAMPLES;
+    s_seed = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : DEFAULT_SEED;
+    int max_neighbours = argc > 3 ? atoi(argv[3]) : CONFIG_CLEARPATH_MAX_NEIGHBOURS;
+    unsigned seed = s_seed;
+
+    if(samples <= 0 || max_neighbours <= 0) {
+        fprintf(stderr, "Usage: %s [samples] [seed] [max neighbours]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    vec_pentity_init(&s_empty_sel);
+    struct neighbourhood nh;
+    vec_cp_ent_init(&nh.dyn);
+    vec_cp_ent_init(&nh.stat);
+
+    printf("{\n");
+    printf("  \"samples\": %d,\n", samples);
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"max_neighbours\": %d,\n", max_neighbours);
+    printf("  \"horizon_ticks\": %.1f,\n", COLLISION_HORIZON);
+    printf("  \"results\": [\n");
+
+    const size_t ncounts = sizeof(s_neighbour_counts) / sizeof(s_neighbour_counts[0]);
+    for(int i = 0; i < ncounts; i++) {
+        run_count(s_neighbour_counts[i], samples, max_neighbours, &nh, 
+            (i < ncounts - 1) ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    vec_cp_ent_destroy(&nh.dyn);
+    vec_cp_ent_destroy(&nh.stat);
+    vec_pentity_destroy(&s_empty_sel);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,479 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* Replays a workload against the navigation subsystem the same way that the
+ * game drives it on every simulation tick: groups of agents request paths to
+ * random destinations and steer along the flow fields towards them, while
+ * stationary entities come and go, adding and removing blockers. Groups with
+ * no more agents than the corridor size are guided by corridors instead of 
+ * flow fields (a size of 0 turns this off). The workload is generated from 
+ * the seed, so runs with the same arguments are repeatable. The latencies of 
+ * the calls, the field cache hit rates and the memory usage are printed as 
+ * JSON, to be compared between changes to the navigation code.
+ *
+ * Usage: nav_bench [PFMAP path] [ticks] [seed] [corridor size]
+ */
+
+#include "bench_common.h"
+#include "../src/navigation/public/nav.h"
+#include "../src/config.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_MAP         "./assets/maps/demo.pfmap"
+#define DEFAULT_TICKS       (1000)
+#define DEFAULT_SEED        (1)
+
+#define NUM_GROUPS          (16)
+#define AGENTS_PER_GROUP    (16)
+#define SMALL_GROUP_SIZE    (3)    /* every other group */
+#define NUM_BLOCKERS        (64)
+#define BLOCKER_MOVES       (4)    /* per tick */
+#define BLOCKER_RADIUS      (8.0f)
+#define AGENT_SPEED         (2.0f) /* OpenGL coordinates per tick */
+#define ARRIVE_DIST         (16.0f)
+#define REPATH_TICKS        (300)
+#define MAX_PLACE_TRIES     (256)
+
+enum op{
+    OP_REQUEST_PATH,
+    OP_POINT_SEEK,
+    OP_BLOCKERS,
+    OP_ARRIVAL_CHECK,
+    OP_UPDATE,
+    OP_TICK,
+    NUM_OPS
+};
+
+struct samples{
+    double *us;
+    size_t  size, capacity;
+};
+
+struct group{
+    int       nagents;
+    bool      has_path;
+    dest_id_t dest_id;
+    vec2_t    dest;
+    int       repath_tick;
+    vec2_t    agents[AGENTS_PER_GROUP];
+};
+
+struct workload{
+    void          *nav_private;
+    vec3_t         map_pos;
+    float          width, height; /* in OpenGL coordinates */
+    struct group   groups[NUM_GROUPS];
+    vec2_t         blockers[NUM_BLOCKERS];
+    size_t         paths_unreachable;
+    size_t         arrivals;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static unsigned       s_seed = DEFAULT_SEED;
+static int            s_corridor_size = CONFIG_CORRIDOR_MAX_FLOCK_SIZE;
+static struct samples s_samples[NUM_OPS];
+static const char    *s_op_names[NUM_OPS] = {
+    [OP_REQUEST_PATH]  = "request_path",
+    [OP_POINT_SEEK]    = "point_seek_velocity",
+    [OP_BLOCKERS]      = "blockers_update",
+    [OP_ARRIVAL_CHECK] = "arrival_check",
+    [OP_UPDATE]        = "nav_update",
+    [OP_TICK]          = "tick",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static unsigned bench_rand(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8);
+}
+
+static float bench_randf(void)
+{
+    return (bench_rand() & 0xffff) / (float)0xffff;
+}
+
+static bool samples_push(struct samples *smp, double us)
+{
+    if(smp->size == smp->capacity) {
+
+        size_t new_cap = smp->capacity ? smp->capacity * 2 : 1024;
+        double *new_us = realloc(smp->us, new_cap * sizeof(double));
+        if(!new_us)
+            return false;
+
+        smp->us = new_us;
+        smp->capacity = new_cap;
+    }
+    smp->us[smp->size++] = us;
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static double samples_percentile(const struct samples *smp, double pct)
+{
+    size_t idx = (size_t)(pct / 100.0 * (smp->size - 1) + 0.5);
+    return smp->us[idx];
+}
+
+static double samples_mean(const struct samples *smp)
+{
+    double sum = 0.0;
+    for(size_t i = 0; i < smp->size; i++)
+        sum += smp->us[i];
+    return sum / smp->size;
+}
+
+static void record(enum op op, uint64_t start_pc)
+{
+    if(!samples_push(&s_samples[op], Bench_ElapsedUS(start_pc)))
+        fprintf(stderr, "Failed to record a sample\n");
+}
+
+static vec2_t random_pathable_pos(const struct workload *wl)
+{
+    vec2_t ret;
+    for(int i = 0; i < MAX_PLACE_TRIES; i++) {
+
+        ret = (vec2_t){
+            wl->map_pos.x - bench_randf() * wl->width,
+            wl->map_pos.z + bench_randf() * wl->height
+        };
+        if(N_PositionPathable(ret, wl->nav_private, wl->map_pos))
+            break;
+    }
+    return ret;
+}
+
+static void workload_init(struct workload *wl, void *nav_private, const struct bench_map *map)
+{
+    memset(wl, 0, sizeof(*wl));
+    wl->nav_private = nav_private;
+    wl->map_pos = (vec3_t){0.0f, 0.0f, 0.0f};
+    wl->width = map->width * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
+    wl->height = map->height * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
+
+    for(int i = 0; i < NUM_GROUPS; i++) {
+
+        vec2_t start = random_pathable_pos(wl);
+        wl->groups[i].nagents = (i % 2) ? SMALL_GROUP_SIZE : AGENTS_PER_GROUP;
+        for(int j = 0; j < wl->groups[i].nagents; j++)
+            wl->groups[i].agents[j] = start;
+    }
+
+    for(int i = 0; i < NUM_BLOCKERS; i++) {
+        wl->blockers[i] = random_pathable_pos(wl);
+        N_BlockersIncref(wl->blockers[i], BLOCKER_RADIUS, wl->map_pos, nav_private);
+    }
+}
+
+static void workload_free(struct workload *wl)
+{
+    for(int i = 0; i < NUM_BLOCKERS; i++) {
+        N_BlockersDecref(wl->blockers[i], BLOCKER_RADIUS, wl->map_pos, wl->nav_private);
+    }
+}
+
+static void tick_blockers(struct workload *wl)
+{
+    for(int i = 0; i < BLOCKER_MOVES; i++) {
+
+        int idx = bench_rand() % NUM_BLOCKERS;
+        vec2_t new_pos = random_pathable_pos(wl);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        N_BlockersQueueDecref(wl->blockers[idx], BLOCKER_RADIUS, wl->map_pos, wl->nav_private);
+        N_BlockersQueueIncref(new_pos, BLOCKER_RADIUS, wl->map_pos, wl->nav_private);
+        record(OP_BLOCKERS, start);
+
+        wl->blockers[idx] = new_pos;
+    }
+}
+
+static bool group_arrived(const struct workload *wl, const struct group *grp)
+{
+    /* Same as the arrival check of the movement code: agents that can't get
+     * any closer to the destination are also done */
+    for(int i = 0; i < grp->nagents; i++) {
+
+        float dx = grp->agents[i].x - grp->dest.x;
+        float dz = grp->agents[i].z - grp->dest.z;
+        if(sqrt(dx * dx + dz * dz) <= ARRIVE_DIST)
+            continue;
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        bool close = N_IsMaximallyClose(wl->nav_private, wl->map_pos, grp->agents[i], 
+            grp->dest, ARRIVE_DIST);
+        record(OP_ARRIVAL_CHECK, start);
+
+        if(!close)
+            return false;
+    }
+    return true;
+}
+
+static void tick_group(struct workload *wl, struct group *grp, int tick)
+{
+    /* Groups that arrived head off to a new destination right away, while
+     * the ones that couldn't get to theirs wait before trying another one */
+    if(grp->has_path && group_arrived(wl, grp)) {
+        wl->arrivals++;
+        grp->has_path = false;
+        grp->repath_tick = tick;
+    }
+
+    if(tick >= grp->repath_tick) {
+
+        grp->dest = random_pathable_pos(wl);
+        grp->repath_tick = tick + REPATH_TICKS;
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        grp->dest = N_ClosestReachableDest(wl->nav_private, wl->map_pos, 
+            grp->agents[0], grp->dest);
+        grp->has_path = (grp->nagents <= s_corridor_size
+            && N_RequestCorridor(wl->nav_private, grp->agents[0], grp->dest, 
+                wl->map_pos, &grp->dest_id))
+            || N_RequestPath(wl->nav_private, grp->agents[0], grp->dest, 
+                wl->map_pos, &grp->dest_id);
+        record(OP_REQUEST_PATH, start);
+
+        if(!grp->has_path)
+            wl->paths_unreachable++;
+    }
+
+    if(!grp->has_path)
+        return;
+
+    for(int i = 0; i < grp->nagents; i++) {
+
+        vec2_t *pos = &grp->agents[i];
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        vec2_t vel = N_DesiredPointSeekVelocity(grp->dest_id, *pos, grp->dest, 
+            wl->nav_private, wl->map_pos);
+        record(OP_POINT_SEEK, start);
+
+        vec2_t new_pos = (vec2_t){
+            pos->x + vel.x * AGENT_SPEED,
+            pos->z + vel.z * AGENT_SPEED
+        };
+        if(N_PositionPathable(new_pos, wl->nav_private, wl->map_pos))
+            *pos = new_pos;
+    }
+}
+
+static void run_tick(struct workload *wl, int tick)
+{
+    uint64_t tick_start = SDL_GetPerformanceCounter();
+
+    tick_blockers(wl);
+    for(int i = 0; i < NUM_GROUPS; i++)
+        tick_group(wl, &wl->groups[i], tick);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    N_Update(wl->nav_private);
+    record(OP_UPDATE, start);
+
+    record(OP_TICK, tick_start);
+}
+
+static void print_json_string(const char *str)
+{
+    putchar('"');
+    for(; *str; str++) {
+        if(*str == '"' || *str == '\\')
+            putchar('\\');
+        putchar(*str);
+    }
+    putchar('"');
+}
+
+static void print_latencies(void)
+{
+    printf("  \"latency_us\": {\n");
+    for(int i = 0; i < NUM_OPS; i++) {
+
+        struct samples *smp = &s_samples[i];
+        const char *sep = (i < NUM_OPS - 1) ? "," : "";
+
+        if(smp->size == 0) {
+            printf("    \"%s\": {\"count\": 0}%s\n", s_op_names[i], sep);
+            continue;
+        }
+
+        qsort(smp->us, smp->size, sizeof(double), compare_doubles);
+        printf("    \"%s\": {\"count\": %zu, \"mean\": %.3f, \"p50\": %.3f, "
+            "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+            s_op_names[i], smp->size, samples_mean(smp),
+            samples_percentile(smp, 50.0), samples_percentile(smp, 90.0),
+            samples_percentile(smp, 99.0), smp->us[smp->size - 1], sep);
+    }
+    printf("  },\n");
+}
+
+static void print_cache_stats(const struct fc_stats *stats)
+{
+    unsigned evictions = 0;
+    size_t bytes_used = 0;
+
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+        bytes_used += stats->bytes_used[i];
+        for(int j = 0; j < FC_NUM_EVICT_REASONS; j++)
+            evictions += stats->evictions[i][j];
+    }
+
+    printf("  \"field_cache\": {\n");
+    printf("    \"los_hit_rate\": %.4f,\n", stats->los_hit_rate);
+    printf("    \"flow_hit_rate\": %.4f,\n", stats->flow_hit_rate);
+    printf("    \"ffid_hit_rate\": %.4f,\n", stats->ffid_hit_rate);
+    printf("    \"grid_path_hit_rate\": %.4f,\n", stats->grid_path_hit_rate);
+    printf("    \"closest_hit_rate\": %.4f,\n", stats->closest_hit_rate);
+    printf("    \"fields_built\": %u,\n", stats->fields_built);
+    printf("    \"flow_invalidated\": %u,\n", stats->flow_invalidated);
+    printf("    \"flow_repaired\": %u,\n", stats->flow_repaired);
+    printf("    \"los_invalidated\": %u,\n", stats->los_invalidated);
+    printf("    \"evictions\": %u,\n", evictions);
+    printf("    \"bytes_used\": %zu\n", bytes_used);
+    printf("  },\n");
+}
+
+static void print_blocker_stats(const struct blocker_stats *stats)
+{
+    printf("  \"blockers\": {\n");
+    printf("    \"queued\": %u,\n", stats->queued);
+    printf("    \"cancelled\": %u,\n", stats->cancelled);
+    printf("    \"coalesced\": %u,\n", stats->coalesced);
+    printf("    \"applied\": %u,\n", stats->applied);
+    printf("    \"tiles_touched\": %u,\n", stats->tiles_touched);
+    printf("    \"tiles_changed\": %u,\n", stats->tiles_changed);
+    printf("    \"tiles_flipped\": %u,\n", stats->tiles_flipped);
+    printf("    \"chunk_passes\": %u,\n", stats->chunk_passes);
+    printf("    \"flushes\": %u\n", stats->flushes);
+    printf("  },\n");
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : DEFAULT_MAP;
+    int ticks = argc > 2 ? atoi(argv[2]) : DEFAULT_TICKS;
+    s_seed = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : DEFAULT_SEED;
+    s_corridor_size = argc > 4 ? atoi(argv[4]) : CONFIG_CORRIDOR_MAX_FLOCK_SIZE;
+    unsigned seed = s_seed;
+    int ret = EXIT_FAILURE;
+
+    struct bench_map map;
+    if(!Bench_LoadMap(path, &map)) {
+        fprintf(stderr, "Failed to load map: %s\n", path);
+        goto fail_map;
+    }
+
+    if(!Bench_InitNav()) {
+        fprintf(stderr, "Failed to initialize navigation subsystem\n");
+        goto fail_init;
+    }
+
+    uint64_t build_start = SDL_GetPerformanceCounter();
+    void *nav_private = Bench_BuildNav(&map);
+    double build_us = Bench_ElapsedUS(build_start);
+
+    if(!nav_private) {
+        fprintf(stderr, "Failed to build navigation data\n");
+        goto fail_build;
+    }
+
+    struct workload wl;
+    workload_init(&wl, nav_private, &map);
+    N_FC_ClearStats();
+    N_ClearBlockerStats();
+
+    for(int i = 0; i < ticks; i++)
+        run_tick(&wl, i);
+
+    struct fc_stats stats;
+    N_FC_GetStats(&stats);
+
+    struct blocker_stats bstats;
+    N_GetBlockerStats(&bstats);
+
+    printf("{\n");
+    printf("  \"map\": ");
+    print_json_string(path);
+    printf(",\n");
+    printf("  \"chunks\": [%zu, %zu],\n", map.width, map.height);
+    printf("  \"ticks\": %d,\n", ticks);
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"corridor_size\": %d,\n", s_corridor_size);
+    printf("  \"build_ms\": %.3f,\n", build_us / 1000.0);
+    printf("  \"paths_unreachable\": %zu,\n", wl.paths_unreachable);
+    printf("  \"arrivals\": %zu,\n", wl.arrivals);
+    print_latencies();
+    print_cache_stats(&stats);
+    print_blocker_stats(&bstats);
+    printf("  \"nav_memory_bytes\": %zu\n", N_MemoryUsage(nav_private));
+    printf("}\n");
+
+    workload_free(&wl);
+    ret = EXIT_SUCCESS;
+
+    for(int i = 0; i < NUM_OPS; i++)
+        free(s_samples[i].us);
+    N_FreePrivate(nav_private);
+fail_build:
+    Bench_ShutdownNav();
+fail_init:
+    Bench_FreeMap(&map);
+fail_map:
+    return ret;
+}
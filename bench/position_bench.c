@@ -0,0 +1,414 @@
+/*
+ *  This file is part of Permafrost Engine.
+ *  Copyright (C) 2020 Eduard Permyakov
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Linking this software statically or dynamically with other modules is making
+ *  a combined work based on this software. Thus, the terms and conditions of
+ *  the GNU General Public License cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Permafrost Engine give
+ *  you permission to link Permafrost Engine with independent modules to produce
+ *  an executable, regardless of the license terms of these independent
+ *  modules, and to copy and distribute the resulting executable under
+ *  terms of your choice, provided that you also meet, for each linked
+ *  independent module, the terms and conditions of the license of that
+ *  module. An independent module is a module which is not derived from
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may
+ *  extend this exception to your version of Permafrost Engine, but you are not
+ *  obliged to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ */
+
+/* Compares the update and query throughput of the two spatial indices behind
+ * the 'G_Pos_*' API: the quadtree and the uniform grid. Groups of units are
+ * spread over a map of the given size and moved every tick, after which every
+ * unit queries its' surroundings, as the movement code does. Both indices see
+ * the same sequence of positions, and the results of their queries are checked
+ * against each other. The same queries are then issued through the batched API
+ * and checked against the one-by-one results, along with a k-nearest query for
+ * every unit. The results are printed as JSON.
+ *
+ * Usage: position_bench [ticks] [seed] [query radius in tiles]
+ */
+
+#include "../src/game/game_private.h"
+#include "../src/game/movement.h"
+#include "../src/game/position.h"
+#include "../src/game/public/game.h"
+#include "../src/map/public/map.h"
+#include "../src/map/public/tile.h"
+#include "../src/entity.h"
+#include "../src/settings.h"
+#include "../src/main.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_TICKS       (20)
+#define DEFAULT_SEED        (1)
+#define DEFAULT_RADIUS      (3.0f)  /* tiles */
+
+#define MAP_CHUNKS          (8)
+#define GROUP_SIZE          (64)
+#define UNIT_SPACING        (3.0f)  /* OpenGL coordinates */
+#define UNIT_SPEED          (0.7f)  /* OpenGL coordinates per tick */
+#define MAX_RESULTS         (1024)
+#define BATCH_SIZE          (256)
+#define KNN_K               (8)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+
+struct unit{
+    vec2_t pos;
+    vec2_t dir;
+};
+
+/* The results of a single query, summarized */
+struct digest{
+    int      count;
+    uint64_t uid_sum;
+};
+
+/* The results of a single k-nearest query, summarized. As units in a block
+ * are equidistant from one another, ties make the exact entities unstable. */
+struct knn_digest{
+    int      count;
+    float    max_dist;
+};
+
+struct run_result{
+    double update_ns;
+    double query_ns;
+    double batch_ns;
+    double knn_ns;
+    double results_mean;
+    size_t batch_mismatches;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+SDL_threadID          g_main_thread_id;
+
+static unsigned       s_seed = DEFAULT_SEED;
+/* The value of the 'pf.game.position_index' setting */
+static int            s_index = POS_INDEX_QUADTREE;
+static const size_t   s_unit_counts[] = {1024, 4096, 16384};
+
+/*****************************************************************************/
+/* STUBS                                                                     */
+/*****************************************************************************/
+
+void Perf_Push(const char *name) {}
+void Perf_Pop(void) {}
+
+ss_e Settings_Get(const char *name, struct sval *out)
+{
+    if(!strcmp(name, "pf.game.position_index")) {
+        *out = (struct sval){ .type = ST_TYPE_INT, .as_int = s_index };
+        return SS_OKAY;
+    }
+    return SS_NO_SETTING;
+}
+
+void G_Move_UpdatePos(const struct entity *ent, vec2_t pos) {}
+
+void M_GetResolution(const struct map *map, struct map_resolution *out)
+{
+    *out = (struct map_resolution){
+        MAP_CHUNKS, MAP_CHUNKS,
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT
+    };
+}
+
+vec3_t M_GetCenterPos(const struct map *map)
+{
+    return (vec3_t){0.0f, 0.0f, 0.0f};
+}
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static unsigned bench_rand(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return (s_seed >> 8);
+}
+
+static float bench_randf(void)
+{
+    return (bench_rand() & 0xffff) / (float)0xffff;
+}
+
+static vec2_t random_dir(void)
+{
+    float angle = bench_randf() * 2.0f * M_PI;
+    return (vec2_t){cosf(angle), sinf(angle)};
+}
+
+static double elapsed_ns(uint64_t start_pc)
+{
+    uint64_t delta = SDL_GetPerformanceCounter() - start_pc;
+    return delta * 1000000000.0 / SDL_GetPerformanceFrequency();
+}
+
+static float map_half_len(void)
+{
+    return MAP_CHUNKS * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE / 2.0f;
+}
+
+/* The units are placed in square blocks, each of which moves in its' own
+ * direction, turning back when it reaches the edge of the map. */
+static void units_gen(struct unit *units, size_t nunits)
+{
+    const int side = sqrtf(GROUP_SIZE);
+    const float margin = side * UNIT_SPACING;
+    const float half = map_half_len() - margin;
+
+    for(int i = 0; i < nunits; i += GROUP_SIZE) {
+
+        vec2_t origin = (vec2_t){
+            (bench_randf() * 2.0f - 1.0f) * half,
+            (bench_randf() * 2.0f - 1.0f) * half
+        };
+        vec2_t dir = random_dir();
+
+        for(int j = 0; j < GROUP_SIZE && i + j < nunits; j++) {
+            units[i + j] = (struct unit){
+                .pos = (vec2_t){
+                    origin.x + (j % side) * UNIT_SPACING,
+                    origin.z + (j / side) * UNIT_SPACING
+                },
+                .dir = dir,
+            };
+        }
+    }
+}
+
+static void units_step(struct unit *units, size_t nunits)
+{
+    const float half = map_half_len();
+
+    for(int i = 0; i < nunits; i++) {
+
+        struct unit *curr = &units[i];
+        curr->pos.x += curr->dir.x * UNIT_SPEED;
+        curr->pos.z += curr->dir.z * UNIT_SPEED;
+
+        if(fabsf(curr->pos.x) > half)
+            curr->dir.x = -curr->dir.x;
+        if(fabsf(curr->pos.z) > half)
+            curr->dir.z = -curr->dir.z;
+    }
+}
+
+static struct digest digest_make(struct entity *const *results, int nres)
+{
+    struct digest ret = (struct digest){ .count = nres };
+    for(int i = 0; i < nres; i++)
+        ret.uid_sum += results[i]->uid;
+    return ret;
+}
+
+static void run_batches(const struct unit *units, size_t nunits, float radius,
+                        const struct digest *digests, struct knn_digest *knn_digests,
+                        struct run_result *inout)
+{
+    static struct entity *s_batch_results[BATCH_SIZE * MAX_RESULTS];
+    static struct entity *s_knn_results[BATCH_SIZE * KNN_K];
+    vec2_t points[BATCH_SIZE];
+    int counts[BATCH_SIZE];
+
+    for(int base = 0; base < nunits; base += BATCH_SIZE) {
+
+        int npoints = MIN(BATCH_SIZE, nunits - base);
+        for(int i = 0; i < npoints; i++)
+            points[i] = units[base + i].pos;
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        G_Pos_EntsInCircleBatch(points, npoints, radius, NULL, 0,
+            s_batch_results, MAX_RESULTS, counts);
+        inout->batch_ns += elapsed_ns(start);
+
+        for(int i = 0; i < npoints; i++) {
+            struct digest dg = digest_make(s_batch_results + i * MAX_RESULTS, counts[i]);
+            inout->batch_mismatches += (dg.count != digests[base + i].count)
+                                    || (dg.uid_sum != digests[base + i].uid_sum);
+        }
+
+        start = SDL_GetPerformanceCounter();
+        G_Pos_KNearestBatch(points, npoints, radius, NULL, 0,
+            s_knn_results, KNN_K, counts);
+        inout->knn_ns += elapsed_ns(start);
+
+        for(int i = 0; i < npoints; i++) {
+
+            struct knn_digest *kdg = &knn_digests[base + i];
+            kdg->count = counts[i];
+            kdg->max_dist = 0.0f;
+            if(counts[i] == 0)
+                continue;
+
+            vec2_t pos = G_Pos_GetXZ(s_knn_results[i * KNN_K + counts[i] - 1]->uid);
+            float dx = pos.x - points[i].x, dz = pos.z - points[i].z;
+            kdg->max_dist = sqrtf(dx * dx + dz * dz);
+        }
+    }
+}
+
+static struct run_result run_index(enum pos_index index, struct entity *ents,
+                                   size_t nunits, int ticks, float radius, unsigned seed,
+                                   struct digest *digests, struct knn_digest *knn_digests)
+{
+    struct run_result ret = {0};
+    struct unit *units = malloc(nunits * sizeof(struct unit));
+    struct entity *results[MAX_RESULTS];
+    size_t nresults = 0;
+
+    s_seed = seed;
+    units_gen(units, nunits);
+
+    s_index = index;
+    G_Pos_Init(NULL);
+
+    for(int i = 0; i < nunits; i++) {
+        vec3_t pos = (vec3_t){units[i].pos.x, 0.0f, units[i].pos.z};
+        G_Pos_Set(&ents[i], pos);
+    }
+
+    for(int t = 0; t < ticks; t++) {
+
+        units_step(units, nunits);
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nunits; i++) {
+            vec3_t pos = (vec3_t){units[i].pos.x, 0.0f, units[i].pos.z};
+            G_Pos_Set(&ents[i], pos);
+        }
+        ret.update_ns += elapsed_ns(start);
+
+        start = SDL_GetPerformanceCounter();
+        for(int i = 0; i < nunits; i++) {
+
+            int nres = G_Pos_EntsInCircle(units[i].pos, radius, results, ARR_SIZE(results));
+            digests[t * nunits + i] = digest_make(results, nres);
+            nresults += nres;
+        }
+        ret.query_ns += elapsed_ns(start);
+
+        run_batches(units, nunits, radius, digests + t * nunits, knn_digests + t * nunits, &ret);
+    }
+
+    G_Pos_Shutdown();
+    free(units);
+
+    ret.update_ns /= (double)ticks * nunits;
+    ret.query_ns /= (double)ticks * nunits;
+    ret.batch_ns /= (double)ticks * nunits;
+    ret.knn_ns /= (double)ticks * nunits;
+    ret.results_mean = (double)nresults / ((double)ticks * nunits);
+    return ret;
+}
+
+static void run_count(size_t nunits, int ticks, float radius, const char *sep)
+{
+    struct entity *ents = calloc(nunits, sizeof(struct entity));
+    struct digest *qt_digests = malloc(ticks * nunits * sizeof(struct digest));
+    struct digest *grid_digests = malloc(ticks * nunits * sizeof(struct digest));
+    struct knn_digest *qt_knn = malloc(ticks * nunits * sizeof(struct knn_digest));
+    struct knn_digest *grid_knn = malloc(ticks * nunits * sizeof(struct knn_digest));
+    unsigned seed = s_seed;
+
+    for(int i = 0; i < nunits; i++) {
+        ents[i].uid = i + 1;
+    }
+
+    struct run_result qt = run_index(POS_INDEX_QUADTREE, ents, nunits, ticks, radius, seed,
+        qt_digests, qt_knn);
+    struct run_result grid = run_index(POS_INDEX_GRID, ents, nunits, ticks, radius, seed,
+        grid_digests, grid_knn);
+
+    size_t mismatches = qt.batch_mismatches + grid.batch_mismatches;
+    for(int i = 0; i < ticks * nunits; i++) {
+        mismatches += (qt_digests[i].count != grid_digests[i].count)
+                   || (qt_digests[i].uid_sum != grid_digests[i].uid_sum);
+        mismatches += (qt_knn[i].count != grid_knn[i].count)
+                   || (fabsf(qt_knn[i].max_dist - grid_knn[i].max_dist) > 1e-4f);
+    }
+
+    printf("    {\"units\": %zu, \"results_mean\": %.1f, "
+        "\"quadtree_ns\": {\"update\": %.1f, \"query\": %.1f, \"batch\": %.1f, \"knn\": %.1f}, "
+        "\"grid_ns\": {\"update\": %.1f, \"query\": %.1f, \"batch\": %.1f, \"knn\": %.1f}, "
+        "\"speedup\": {\"update\": %.2f, \"query\": %.2f, \"batch\": %.2f, \"knn\": %.2f}, "
+        "\"mismatches\": %zu}%s\n",
+        nunits, qt.results_mean,
+        qt.update_ns, qt.query_ns, qt.batch_ns, qt.knn_ns,
+        grid.update_ns, grid.query_ns, grid.batch_ns, grid.knn_ns,
+        qt.update_ns / grid.update_ns, qt.query_ns / grid.query_ns,
+        qt.batch_ns / grid.batch_ns, qt.knn_ns / grid.knn_ns,
+        mismatches, sep);
+
+    free(grid_knn);
+    free(qt_knn);
+    free(grid_digests);
+    free(qt_digests);
+    free(ents);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    int ticks = argc > 1 ? atoi(argv[1]) : DEFAULT_TICKS;
+    s_seed = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : DEFAULT_SEED;
+    float radius_tiles = argc > 3 ? atof(argv[3]) : DEFAULT_RADIUS;
+    unsigned seed = s_seed;
+
+    if(ticks <= 0 || radius_tiles <= 0.0f) {
+        fprintf(stderr, "Usage: %s [ticks] [seed] [query radius in tiles]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_main_thread_id = SDL_ThreadID();
+
+    const float radius = radius_tiles * X_COORDS_PER_TILE;
+
+    printf("{\n");
+    printf("  \"ticks\": %d,\n", ticks);
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"query_radius\": %.1f,\n", radius);
+    printf("  \"results\": [\n");
+
+    const size_t ncounts = ARR_SIZE(s_unit_counts);
+    for(int i = 0; i < ncounts; i++) {
+        s_seed = seed;
+        run_count(s_unit_counts[i], ticks, radius, (i < ncounts - 1) ? "," : "");
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    return EXIT_SUCCESS;
+}
+
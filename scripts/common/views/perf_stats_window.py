@@ -91,6 +91,11 @@ class PerfStatsWindow(pf.Window):
             hr=nav_stats["flow_hit_rate"], inv=nav_stats["flow_invalidated"]), \
             (0, 255, 0))
 
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Flow Field Repair]   Repaired: {rep:04d}   Hits Saved: {saved:04d}" \
+            .format(rep=nav_stats["flow_repaired"], saved=nav_stats["flow_repair_hits"]), \
+            (0, 255, 0))
+
         self.layout_row_dynamic(20, 1)
         self.label_colored_wrap("[Dest:Field Mapping Cache] Used: {used:04d}/{cap:04d}   Hit Rate: {hr:02.03f}" \
             .format(used=nav_stats["ffid_used"], cap=nav_stats["ffid_max"], hr=nav_stats["ffid_hit_rate"]), \
@@ -101,6 +106,23 @@ class PerfStatsWindow(pf.Window):
             .format(used=nav_stats["grid_path_used"], cap=nav_stats["grid_path_max"], hr=nav_stats["grid_path_hit_rate"]), \
             (0, 255, 0))
 
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Field Builder] Built: {built:04d}   Throughput: {rate:.0f} fields/s" \
+            .format(built=nav_stats["fields_built"], rate=nav_stats["field_build_rate"]), \
+            (0, 255, 0))
+
+        for name, cache in sorted(nav_stats["caches"].items()):
+            self.layout_row_dynamic(20, 1)
+            self.label_colored_wrap("[{name} Memory] {used:.1f}/{cap:.1f} KiB   Evicted: {ev:04d} (Invalidated: {inv:04d})   Avg. Age: {age:.1f} s" \
+                .format(name=name, used=cache["bytes_used"] / 1024.0, cap=cache["bytes_max"] / 1024.0,
+                ev=cache["evicted_budget"], inv=cache["evicted_invalidated"], age=cache["avg_evict_age"]), \
+                (0, 255, 0))
+
+        self.layout_row_dynamic(20, 1)
+        self.label_colored_wrap("[Navigation Data] Memory: {kib:.1f} KiB" \
+            .format(kib=nav_stats["nav_mem_bytes"] / 1024.0), \
+            (0, 255, 0))
+
     def on_chart_click(self, index):
         self.selected_perfstats = self.frame_perfstats[index]
 
@@ -58,10 +58,45 @@
 
 #define CONFIG_SETTINGS_FILENAME    "pf.conf"
 
-#define CONFIG_LOS_CACHE_SZ         (512)
-#define CONFIG_FLOW_CAHCE_SZ        (512)
-#define CONFIG_MAPPING_CACHE_SZ     (512)
-#define CONFIG_GRID_PATH_CACHE_SZ   (8192)
+/* The default memory budgets of the navigation caches, in KiB. These can be
+ * changed at runtime through the 'pf.nav.*_cache_kb' settings. The flow and
+ * LOS fields are packed to 4 and 2 bits per tile, respectively, so the defaults
+ * hold 4096 of each. There is room for 512 of the integration fields kept for 
+ * repairing flow fields, which take 8 KiB each. Grid paths and the lists of
+ * tiles closest to a destination own a buffer, so the number of them that fit 
+ * varies. */
+#define CONFIG_LOS_CACHE_KB         (4224)
+#define CONFIG_FLOW_CACHE_KB        (8448)
+#define CONFIG_INTEGRATION_CACHE_KB (4108)
+#define CONFIG_MAPPING_CACHE_KB     (128)
+#define CONFIG_GRID_PATH_CACHE_KB   (2048)
+#define CONFIG_CLOSEST_CACHE_KB     (256)
+/* Number of the least recently used entries which are considered when choosing 
+ * the entry to evict from a cache with entries of varying cost */
+#define CONFIG_FC_EVICT_WINDOW      (8)
+/* Number of the most recently used corridors (waypoint paths used in place of 
+ * the fields for small groups) that are kept around by the navigation data */
+#define CONFIG_NAV_MAX_CORRIDORS    (256)
+/* Groups of up to this many entities are guided by corridors, unless changed 
+ * at runtime through the 'pf.game.corridor_max_flock_size' setting */
+#define CONFIG_CORRIDOR_MAX_FLOCK_SIZE (3)
+/* The new velocity of an entity is found by considering only this many of its' 
+ * neighbours that it will collide with the soonest, unless changed at runtime 
+ * through the 'pf.game.clearpath_max_neighbours' setting (0 considers all) */
+#define CONFIG_CLEARPATH_MAX_NEIGHBOURS (24)
+/* The spatial index for entity positions ('enum pos_index'): 0 for the 
+ * quadtree, 1 for the uniform grid. Can be changed through the 
+ * 'pf.game.position_index' setting and takes effect on the next map load */
+#define CONFIG_POS_INDEX            (1)
+/* Whether entities with no others around them are steered at a lower rate,
+ * unless changed at runtime through the 'pf.game.movement_lod' setting */
+#define CONFIG_MOVE_LOD             (true)
+/* Directory (relative to the base path) holding the navigation data built for
+ * previously loaded maps, keyed by the contents of their cost fields */
+#define CONFIG_NAV_CACHE_DIR        "navcache"
+/* The least recently used entries of the navigation data cache are deleted 
+ * beyond this many */
+#define CONFIG_NAV_CACHE_MAX_ENTRIES (16)
 
 #define CONFIG_FRAME_STEP_HOTKEY    (SDL_SCANCODE_SPACE)
 
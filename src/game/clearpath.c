@@ -53,9 +53,11 @@
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
 #include "../map/public/map.h"
+#include "../config.h"
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -96,11 +98,37 @@ struct saved_ctx{
     bool          valid;
 };
 
+/* The ranking of a neighbour by how soon the entity will collide with it */
+struct nb_rank{
+    float ttc;
+    float dist;
+    int   idx; /* Indexes the dynamic neighbours, followed by the static ones */
+};
+
+/* The search for the candidate velocity closest to the desired velocity, 
+ * among the points outside of the combined velocity obstacle. */
+struct vnew_search{
+    vec2_t      ent_xz_pos;
+    vec2_t      des_v;
+    float       min_dist;
+    vec2_t      best;
+    /* When not NULL, every candidate point outside of the combined velocity 
+     * obstacle is considered and saved here. Otherwise, the candidates that 
+     * are no closer than the best one so far are skipped without testing them 
+     * against the velocity obstacles. */
+    vec_vec2_t *outside;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static struct saved_ctx s_debug_saved;
+/* The entity whose velocity obstacles are saved during the current tick */
+static bool             s_debug_ent_valid = false;
+static uint32_t         s_debug_ent_uid;
+/* The maximum number of neighbours considered for the current tick (0 for all) */
+static size_t           s_max_neighbours = CONFIG_CLEARPATH_MAX_NEIGHBOURS;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -287,11 +315,36 @@ static void rays_repr(const struct HRVO *hrvos, size_t n_hrvos,
     }
 }
 
-static size_t compute_vo_xpoints(struct line_2d *rays, size_t n_rays,
-                                 vec_vec2_t *inout)
+static void consider_point(const struct line_2d *rays, size_t n_rays, vec2_t point, 
+                           struct vnew_search *search)
 {
-    size_t ret = 0;
+    /* The points are in worldspace coordinates. Convert them to the entity's 
+     * local space to get the adimissible velocities. */
+    vec2_t curr, diff;
+    PFM_Vec2_Sub(&point, &search->ent_xz_pos, &curr);
+    PFM_Vec2_Sub(&search->des_v, &curr, &diff);
+    float len = PFM_Vec2_Len(&diff);
+
+    /* Testing a point against all the velocity obstacles is the expensive 
+     * part, so it is skipped when the point can't be the new best one. */
+    if(!search->outside && !(len < search->min_dist))
+        return;
+
+    if(inside_pcr(rays, n_rays, point))
+        return;
+
+    if(search->outside)
+        vec_vec2_push(search->outside, point);
+
+    if(len < search->min_dist) {
+        search->min_dist = len;
+        search->best = curr;
+    }
+}
 
+static void compute_vo_xpoints(struct line_2d *rays, size_t n_rays,
+                               struct vnew_search *search)
+{
     for(int i = 0; i < n_rays; i++) {
         for(int j = 0; j < n_rays; j++) {
 
@@ -302,22 +355,15 @@ static size_t compute_vo_xpoints(struct line_2d *rays, size_t n_rays,
             if(!C_RayRayIntersection2D(rays[i], rays[j], &isec_point))
                 continue;
 
-            if(inside_pcr(rays, n_rays, isec_point))
-                continue;
-
-            vec_vec2_push(inout, isec_point);
-            ret++;
+            consider_point(rays, n_rays, isec_point, search);
         }
     }
-
-    return ret;
 }
 
-static size_t compute_vdes_proj_points(struct line_2d *rays, size_t n_rays,
-                                       vec2_t des_v, vec_vec2_t *inout)
+static void compute_vdes_proj_points(struct line_2d *rays, size_t n_rays,
+                                     vec2_t des_v, struct vnew_search *search)
 {
     vec2_t proj;
-    size_t ret = 0;
 
     for(int i = 0; i < n_rays; i++) {
     
@@ -327,38 +373,8 @@ static size_t compute_vdes_proj_points(struct line_2d *rays, size_t n_rays,
         PFM_Vec2_Scale(&rays[i].dir, len, &proj);
         PFM_Vec2_Add(&rays[i].point, &proj, &proj);
 
-        if(!inside_pcr(rays, n_rays, proj)) {
-        
-            vec_vec2_push(inout, proj);
-            ret++;
-        }
-    }
-
-    return ret;
-}
-
-static vec2_t compute_vnew(const vec_vec2_t *outside_points, vec2_t des_v, vec2_t ent_xz_pos)
-{
-    float min_dist = INFINITY, len;
-    vec2_t ret;
-
-    for(int i = 0; i < vec_size(outside_points); i++) {
-
-        /* The points are in worldspace coordinates. Convert them to the entity's 
-         * local space to get the adimissible velocities. */
-        vec2_t curr = vec_AT(outside_points, i), diff;
-        PFM_Vec2_Sub(&curr, &ent_xz_pos, &curr);
-
-        PFM_Vec2_Sub(&des_v, &curr, &diff);
-        if((len = PFM_Vec2_Len(&diff)) < min_dist) {
-
-            min_dist = len;
-            ret = curr;
-        }
+        consider_point(rays, n_rays, proj, search);
     }
-
-    assert(min_dist < INFINITY);
-    return ret;
 }
 
 static void remove_furthest(vec2_t xz_pos, vec_cp_ent_t *dyn_inout, vec_cp_ent_t *stat_inout)
@@ -391,23 +407,101 @@ static void remove_furthest(vec2_t xz_pos, vec_cp_ent_t *dyn_inout, vec_cp_ent_t
     }
 }
 
-/* Save the combined HRVO of the first selected entity for debug rendering */
-static bool should_save_debug(uint32_t ent_uid)
+/* The time until the entity, moving with the velocity 'ent_vel', will collide 
+ * with the neighbour. Zero if they are already overlapping and infinity if 
+ * they will never collide. */
+static float time_to_collision(struct cp_ent ent, vec2_t ent_vel, struct cp_ent neighb)
 {
-    struct sval setting;
-    ss_e status = Settings_Get("pf.debug.show_first_sel_combined_hrvo", &setting);
-    assert(status == SS_OKAY);
+    vec2_t rel_pos, rel_vel;
+    PFM_Vec2_Sub(&neighb.xz_pos, &ent.xz_pos, &rel_pos);
+    PFM_Vec2_Sub(&ent_vel, &neighb.xz_vel, &rel_vel);
+    float radius = neighb.radius + ent.radius + CLEARPATH_BUFFER_RADIUS;
+
+    float c = PFM_Vec2_Dot(&rel_pos, &rel_pos) - radius * radius;
+    if(c <= 0.0f)
+        return 0.0f;
+
+    /* Moving apart */
+    float b = PFM_Vec2_Dot(&rel_pos, &rel_vel);
+    if(b <= 0.0f)
+        return INFINITY;
+
+    float a = PFM_Vec2_Dot(&rel_vel, &rel_vel);
+    float disc = b * b - a * c;
+    if(disc < 0.0f)
+        return INFINITY;
+
+    return (b - sqrtf(disc)) / a;
+}
 
-    if(!setting.as_bool)
-        return false;
+static int compare_rank(const void *a, const void *b)
+{
+    const struct nb_rank *ra = a, *rb = b;
 
-    enum selection_type seltype;
-    const vec_pentity_t *sel = G_Sel_Get(&seltype);
+    if(ra->ttc != rb->ttc)
+        return (ra->ttc < rb->ttc) ? -1 : 1;
+    if(ra->dist != rb->dist)
+        return (ra->dist < rb->dist) ? -1 : 1;
+    return ra->idx - rb->idx;
+}
 
-    if(vec_size(sel) == 0)
-        return false; 
+/* Keep only the 'max' neighbours that the entity will collide with the soonest 
+ * when moving with its' desired velocity, followed by the closest ones. The 
+ * combined velocity obstacle has O(n^2) boundary intersections, each of which 
+ * is tested against all O(n) obstacles, so this bounds the cost of finding the 
+ * new velocity in dense groups. The neighbours that are kept stay in their 
+ * original order. 
+ */
+static void keep_most_imminent(struct cp_ent ent, vec2_t des_v, size_t max, 
+                               vec_cp_ent_t *dyn_inout, vec_cp_ent_t *stat_inout)
+{
+    const size_t ndyn = vec_size(dyn_inout);
+    const size_t nstat = vec_size(stat_inout);
+    const size_t ntotal = ndyn + nstat;
 
-    return true;
+    if(ntotal <= max)
+        return;
+
+    struct nb_rank ranks[ntotal];
+    for(int i = 0; i < ntotal; i++) {
+
+        struct cp_ent *nb = (i < ndyn) ? &vec_AT(dyn_inout, i) 
+                                       : &vec_AT(stat_inout, i - ndyn);
+        vec2_t diff;
+        PFM_Vec2_Sub(&nb->xz_pos, &ent.xz_pos, &diff);
+
+        ranks[i] = (struct nb_rank){
+            .ttc = time_to_collision(ent, des_v, *nb),
+            .dist = PFM_Vec2_Len(&diff),
+            .idx = i,
+        };
+    }
+    qsort(ranks, ntotal, sizeof(struct nb_rank), compare_rank);
+
+    bool keep[ntotal];
+    memset(keep, 0, sizeof(keep));
+    for(int i = 0; i < max; i++)
+        keep[ranks[i].idx] = true;
+
+    size_t nkept = 0;
+    for(int i = 0; i < ndyn; i++) {
+        if(keep[i])
+            vec_AT(dyn_inout, nkept++) = vec_AT(dyn_inout, i);
+    }
+    dyn_inout->size = nkept;
+
+    nkept = 0;
+    for(int i = 0; i < nstat; i++) {
+        if(keep[ndyn + i])
+            vec_AT(stat_inout, nkept++) = vec_AT(stat_inout, i);
+    }
+    stat_inout->size = nkept;
+}
+
+/* Save the combined HRVO of the first selected entity for debug rendering */
+static bool should_save_debug(uint32_t ent_uid)
+{
+    return s_debug_ent_valid && (ent_uid == s_debug_ent_uid);
 }
 
 static void on_render_3d(void *user, void *event)
@@ -584,43 +678,45 @@ static bool clearpath_new_velocity(struct cp_ent cpent,
     PFM_Vec2_Add(&cpent.xz_pos, &ent_des_v, &des_v_ws);
     if(!inside_pcr(rays, n_rays, des_v_ws)) {
 
-        s_debug_saved.des_v_in_pcr = false;
+        if(should_save_debug(ent_uid))
+            s_debug_saved.des_v_in_pcr = false;
         *out = ent_des_v;
         return true;
     }
 
-    vec_vec2_t xpoints;
-    vec_vec2_init(&xpoints);
+    const bool save_debug = should_save_debug(ent_uid);
+    struct vnew_search search = (struct vnew_search){
+        .ent_xz_pos = cpent.xz_pos,
+        .des_v = ent_des_v,
+        .min_dist = INFINITY,
+        .outside = save_debug ? &s_debug_saved.xpoints : NULL,
+    };
 
     /* The line segments are intersected pairwise and the intersection points 
      * inside the combined hybrid reciprocal velocity obstacle are discarded. 
      * The remaining intersection points are permissible new velocities on the 
      * boundary of the combined hybrid reciprocal velocity obstacle.
      */
-    compute_vo_xpoints(rays, n_rays, &xpoints); 
+    compute_vo_xpoints(rays, n_rays, &search); 
 
     /* In addition we project the preferred velocity (des_v) on to the line 
      * segments (xz_left_side and xz_right_side of each hrvo) and also retain 
      * those points that are outside the combined hybrid reciprocal velocity 
      * obstacle.
      */
-    compute_vdes_proj_points(rays, n_rays, ent_des_v, &xpoints);
-
-    if(vec_size(&xpoints) == 0) {
-        return false;    
-    }
+    compute_vdes_proj_points(rays, n_rays, ent_des_v, &search);
 
-    vec2_t ret = compute_vnew(&xpoints, ent_des_v, cpent.xz_pos);
+    /* The new velocity is the permissible one closest to the desired velocity */
+    if(!(search.min_dist < INFINITY))
+        return false;
 
-    if(should_save_debug(ent_uid)) {
+    if(save_debug) {
     
-        vec_vec2_copy(&s_debug_saved.xpoints, &xpoints);
-        s_debug_saved.v_new = ret;
+        s_debug_saved.v_new = search.best;
         s_debug_saved.des_v_in_pcr = true;
     }
 
-    vec_vec2_destroy(&xpoints);
-    *out = ret;
+    *out = search.best;
     return true;
 }
 
@@ -641,6 +737,32 @@ void G_ClearPath_Shutdown(void)
     vec_vec2_destroy(&s_debug_saved.xpoints);
 }
 
+void G_ClearPath_BeginTick(void)
+{
+    s_debug_ent_valid = false;
+
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.clearpath_max_neighbours", &setting);
+    assert(status == SS_OKAY);
+    s_max_neighbours = setting.as_int;
+
+    status = Settings_Get("pf.debug.show_first_sel_combined_hrvo", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+
+    if(!setting.as_bool)
+        return;
+
+    enum selection_type seltype;
+    const vec_pentity_t *sel = G_Sel_Get(&seltype);
+
+    if(vec_size(sel) == 0)
+        return; 
+
+    s_debug_ent_valid = true;
+    s_debug_ent_uid = vec_AT(sel, 0)->uid;
+}
+
 vec2_t G_ClearPath_NewVelocity(struct cp_ent cpent,
                                uint32_t ent_uid,
                                vec2_t ent_des_v,
@@ -649,6 +771,9 @@ vec2_t G_ClearPath_NewVelocity(struct cp_ent cpent,
 {
     PERF_ENTER();
 
+    if(s_max_neighbours > 0)
+        keep_most_imminent(cpent, ent_des_v, s_max_neighbours, &dyn_neighbs, &stat_neighbs);
+
     do{
         vec2_t ret;
         bool found = clearpath_new_velocity(cpent, ent_uid, ent_des_v, dyn_neighbs, stat_neighbs, &ret);
@@ -60,6 +60,15 @@ VEC_IMPL(static inline, cp_ent, struct cp_ent)
 void G_ClearPath_Init(const struct map *map);
 void G_ClearPath_Shutdown(void);
 
+/* Must be called from the main thread before computing the new velocities for 
+ * a tick. 'G_ClearPath_NewVelocity' may then be called from any thread. 
+ */
+void G_ClearPath_BeginTick(void);
+
+/* Only the neighbours that the entity will collide with the soonest are taken 
+ * into account, up to the limit set by the 'pf.game.clearpath_max_neighbours' 
+ * setting. The neighbour arrays may be reordered. 
+ */
 vec2_t G_ClearPath_NewVelocity(struct cp_ent ent,
                                uint32_t ent_uid,
                                vec2_t ent_des_v,
@@ -41,15 +41,22 @@
 #include "../main.h"
 #include "../perf.h"
 #include "public/game.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/attr.h"
 
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 #define ENEMY_TARGET_ACQUISITION_RANGE (50.0f)
 #define ENEMY_MELEE_ATTACK_RANGE       (5.0f)
+#define MAX_ENEMY_CANDIDATES           (128)
+#define TARGET_GRID_CELL_SIZE          (ENEMY_TARGET_ACQUISITION_RANGE / 2.0f)
 #define EPSILON                        (1.0f/1024)
 #define MAX(a, b)                      ((a) > (b) ? (a) : (b))
 #define MIN(a, b)                      ((a) < (b) ? (a) : (b))
@@ -106,15 +113,48 @@ struct combatstate{
     vec2_t             move_cmd_xz;
 };
 
+/* A live combatable entity, as it was at the start of the current tick */
+struct target{
+    vec2_t         xz_pos;
+    float          radius;
+    int            faction_id;
+    struct entity *ent;
+};
+
+/* The entities which may be targeted during the current tick, bucketed by 
+ * position. The targets in cell 'i' are the ones in the range 
+ * [cell_start[i], cell_start[i + 1]). Each cell also holds a bit for every 
+ * faction with targets in it, so that cells without any enemies can be 
+ * skipped over without looking inside. */
+struct target_grid{
+    float          xmin, zmin;
+    float          cell_size;
+    int            nrows, ncols;
+    uint32_t      *cell_start;
+    uint16_t      *cell_factions;
+    struct target *targets;
+    struct target *scratch;
+    size_t         ntargets, capacity;
+    /* The largest selection radius of any target */
+    float          max_radius;
+    /* Set when the grid holds the targets of the current tick */
+    bool           valid;
+};
+
 KHASH_MAP_INIT_INT(state, struct combatstate)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static khash_t(state) *s_entity_state_table;
+static const struct map *s_map;
+static khash_t(state)   *s_entity_state_table;
 /* For saving/restoring state */
 static vec_pentity_t   s_dying_ents;
+static struct target_grid  s_target_grid;
+/* Entry 'i' holds the bits of the factions at war with faction 'i' */
+static uint16_t            s_war_masks[MAX_FACTIONS];
+static struct combat_stats s_stats;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -165,18 +205,6 @@ static void dying_remove(const struct entity *ent)
     vec_pentity_del(&s_dying_ents, idx);
 }
 
-static bool enemies(const struct entity *a, const struct entity *b)
-{
-    if(a->faction_id == b->faction_id)
-        return false;
-
-    enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(a->faction_id, b->faction_id, &ds);
-
-    assert(result);
-    return (ds == DIPLOMACY_STATE_WAR);
-}
-
 static float ents_distance(const struct entity *a, const struct entity *b)
 {
     vec2_t dist;
@@ -186,32 +214,303 @@ static float ents_distance(const struct entity *a, const struct entity *b)
     return PFM_Vec2_Len(&dist) - a->selection_radius - b->selection_radius;
 }
 
-static struct entity *closest_enemy_in_range(const struct entity *ent)
+static bool not_dying(const struct entity *ent, void *arg)
+{
+    struct combatstate *cs = combatstate_get(ent->uid);
+    assert(cs);
+    return (cs->state != STATE_DEATH_ANIM_PLAYING);
+}
+
+/* Bit 'i' of the result is set when faction 'i' is at war with 'faction_id' */
+static uint16_t war_mask(int faction_id)
+{
+    uint16_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+
+        enum diplomacy_state ds;
+        if(G_GetDiplomacyState(faction_id, i, &ds) && ds == DIPLOMACY_STATE_WAR)
+            ret |= (0x1 << i);
+    }
+    return ret;
+}
+
+/* Lets through the live combatable entities of the factions in 'war_mask'. 
+ * The flags and the faction are checked against the copy of them held by 
+ * the spatial index. */
+static struct pos_filter enemy_filter(uint16_t war_mask)
+{
+    return (struct pos_filter){
+        .flags_all = ENTITY_FLAG_COMBATABLE,
+        .flags_none = ENTITY_FLAG_ZOMBIE,
+        .faction_mask = war_mask,
+        .predicate = not_dying,
+    };
+}
+
+static bool target_grid_init(struct target_grid *grid, const struct map *map)
+{
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+    vec3_t center = M_GetCenterPos(map);
+
+    assert(X_COORDS_PER_TILE == Z_COORDS_PER_TILE);
+    const float xlen = res.tile_w * res.chunk_w * X_COORDS_PER_TILE;
+    const float zlen = res.tile_h * res.chunk_h * Z_COORDS_PER_TILE;
+
+    *grid = (struct target_grid){
+        .xmin = center.x - xlen / 2.0f,
+        .zmin = center.z - zlen / 2.0f,
+        .cell_size = TARGET_GRID_CELL_SIZE,
+        .nrows = MAX(1, (int)ceilf(zlen / TARGET_GRID_CELL_SIZE)),
+        .ncols = MAX(1, (int)ceilf(xlen / TARGET_GRID_CELL_SIZE)),
+    };
+
+    const size_t ncells = grid->nrows * grid->ncols;
+    if(NULL == (grid->cell_start = malloc((ncells + 1) * sizeof(uint32_t))))
+        goto fail_start;
+    if(NULL == (grid->cell_factions = malloc(ncells * sizeof(uint16_t))))
+        goto fail_factions;
+    return true;
+
+fail_factions:
+    free(grid->cell_start);
+fail_start:
+    return false;
+}
+
+static void target_grid_destroy(struct target_grid *grid)
+{
+    free(grid->scratch);
+    free(grid->targets);
+    free(grid->cell_factions);
+    free(grid->cell_start);
+    *grid = (struct target_grid){0};
+}
+
+static bool target_grid_reserve(struct target_grid *grid, size_t size)
+{
+    if(grid->capacity >= size)
+        return true;
+
+    size_t new_cap = MAX(grid->capacity * 2, size);
+    struct target *targets = realloc(grid->targets, new_cap * sizeof(struct target));
+    if(!targets)
+        return false;
+    grid->targets = targets;
+
+    struct target *scratch = realloc(grid->scratch, new_cap * sizeof(struct target));
+    if(!scratch)
+        return false;
+    grid->scratch = scratch;
+
+    grid->capacity = new_cap;
+    return true;
+}
+
+/* Positions outside the map are clamped to the cells at its' edge. */
+static int target_grid_row(const struct target_grid *grid, float z)
+{
+    int ret = floorf((z - grid->zmin) / grid->cell_size);
+    return MIN(MAX(ret, 0), grid->nrows - 1);
+}
+
+static int target_grid_col(const struct target_grid *grid, float x)
+{
+    int ret = floorf((x - grid->xmin) / grid->cell_size);
+    return MIN(MAX(ret, 0), grid->ncols - 1);
+}
+
+static int target_grid_cell(const struct target_grid *grid, vec2_t xz_pos)
+{
+    return target_grid_row(grid, xz_pos.z) * grid->ncols + target_grid_col(grid, xz_pos.x);
+}
+
+/* Bucket all the live combatable entities by cell, with a counting sort. 
+ * Entities only die or leave the game in event handlers, which run outside 
+ * of the combat tick, so the grid stays exact for the whole tick. */
+static void target_grid_build(struct target_grid *grid)
+{
+    uint32_t key;
+    struct combatstate curr;
+
+    grid->valid = false;
+    grid->ntargets = 0;
+    grid->max_radius = 0.0f;
+
+    if(!target_grid_reserve(grid, kh_size(s_entity_state_table)))
+        return;
+
+    const size_t ncells = grid->nrows * grid->ncols;
+    memset(grid->cell_start, 0, (ncells + 1) * sizeof(uint32_t));
+    memset(grid->cell_factions, 0, ncells * sizeof(uint16_t));
+
+    kh_foreach(s_entity_state_table, key, curr, {
+
+        if(curr.state == STATE_DEATH_ANIM_PLAYING)
+            continue;
+
+        struct entity *ent = G_EntityForUID(key);
+        if(!ent || (ent->flags & ENTITY_FLAG_ZOMBIE))
+            continue;
+
+        struct target *tg = &grid->scratch[grid->ntargets++];
+        *tg = (struct target){
+            .xz_pos = G_Pos_GetXZ(key),
+            .radius = ent->selection_radius,
+            .faction_id = ent->faction_id,
+            .ent = ent,
+        };
+
+        int cell = target_grid_cell(grid, tg->xz_pos);
+        grid->cell_start[cell + 1]++;
+        grid->cell_factions[cell] |= (0x1 << tg->faction_id);
+        grid->max_radius = MAX(grid->max_radius, tg->radius);
+    });
+
+    for(int i = 0; i < ncells; i++)
+        grid->cell_start[i + 1] += grid->cell_start[i];
+
+    /* Use the start of every cell as its' write cursor. Once all the targets
+     * are placed, each cursor is left at the start of the next cell. */
+    for(int i = 0; i < grid->ntargets; i++) {
+        int cell = target_grid_cell(grid, grid->scratch[i].xz_pos);
+        grid->targets[grid->cell_start[cell]++] = grid->scratch[i];
+    }
+    memmove(grid->cell_start + 1, grid->cell_start, ncells * sizeof(uint32_t));
+    grid->cell_start[0] = 0;
+
+    grid->valid = true;
+}
+
+/* Returns the last target of the entity if it's still an enemy within the 
+ * target acquisition range, along with its' distance. */
+static struct entity *last_target(const struct entity *ent, vec2_t xz_pos, 
+                                  uint16_t enemies, float *out_dist)
+{
+    struct combatstate *cs = combatstate_get(ent->uid);
+    assert(cs);
+
+    struct entity *target = G_EntityForUID(cs->target_uid);
+    if(!target 
+    || !(target->flags & ENTITY_FLAG_COMBATABLE) 
+    ||  (target->flags & ENTITY_FLAG_ZOMBIE)
+    || !(enemies & (0x1 << target->faction_id)))
+        return NULL;
+
+    struct combatstate *target_cs = combatstate_get(target->uid);
+    if(!target_cs || target_cs->state == STATE_DEATH_ANIM_PLAYING)
+        return NULL;
+
+    vec2_t delta;
+    vec2_t target_pos = G_Pos_GetXZ(target->uid);
+    PFM_Vec2_Sub(&target_pos, &xz_pos, &delta);
+
+    float len = PFM_Vec2_Len(&delta);
+    if(len > ENEMY_TARGET_ACQUISITION_RANGE)
+        return NULL;
+
+    *out_dist = len - ent->selection_radius - target->selection_radius;
+    return target;
+}
+
+/* Search the cells in rings of increasing size around the entity's own. The 
+ * last target, if it's still valid, bounds the search from the start. Ties 
+ * are resolved in favour of it, so that entities don't switch between 
+ * equally close enemies. */
+static struct entity *closest_enemy_in_grid(const struct target_grid *grid, 
+                                            const struct entity *ent, uint16_t enemies)
+{
+    vec2_t xz_pos = G_Pos_GetXZ(ent->uid);
+    float min_dist = FLT_MAX;
+    struct entity *last = last_target(ent, xz_pos, enemies, &min_dist);
+    struct entity *ret = last;
+
+    const int r0 = target_grid_row(grid, xz_pos.z);
+    const int c0 = target_grid_col(grid, xz_pos.x);
+    const int max_ring = MAX(MAX(r0, grid->nrows - 1 - r0), MAX(c0, grid->ncols - 1 - c0));
+
+    for(int ring = 0; ring <= max_ring; ring++) {
+
+        /* The closest any position in the ring can be to the entity */
+        const float bound = MAX(0, ring - 1) * grid->cell_size;
+        if(bound > ENEMY_TARGET_ACQUISITION_RANGE)
+            break;
+
+        if(bound - ent->selection_radius - grid->max_radius >= min_dist) {
+            s_stats.early_outs++;
+            break;
+        }
+
+        for(int r = r0 - ring; r <= r0 + ring; r++) {
+
+            if(r < 0 || r >= grid->nrows)
+                continue;
+
+            /* Only the first and last cell of the rows in between are on the ring */
+            const bool edge = (r == r0 - ring || r == r0 + ring);
+            const int step = edge ? 1 : 2 * ring;
+
+            for(int c = c0 - ring; c <= c0 + ring; c += step) {
+
+                if(c < 0 || c >= grid->ncols)
+                    continue;
+
+                const int cell = r * grid->ncols + c;
+                s_stats.cells_visited++;
+
+                if(!(grid->cell_factions[cell] & enemies)) {
+                    s_stats.cells_skipped++;
+                    continue;
+                }
+
+                for(int i = grid->cell_start[cell]; i < grid->cell_start[cell + 1]; i++) {
+
+                    const struct target *curr = &grid->targets[i];
+                    if(!(enemies & (0x1 << curr->faction_id)))
+                        continue;
+                    assert(curr->ent != ent);
+
+                    vec2_t delta, target_pos = curr->xz_pos;
+                    PFM_Vec2_Sub(&target_pos, &xz_pos, &delta);
+                    float len = PFM_Vec2_Len(&delta);
+                    if(len > ENEMY_TARGET_ACQUISITION_RANGE)
+                        continue;
+
+                    s_stats.candidates++;
+                    float dist = len - ent->selection_radius - curr->radius;
+                    if(dist < min_dist) {
+                        min_dist = dist;
+                        ret = curr->ent;
+                    }
+                }
+            }
+        }
+    }
+
+    if(last && ret == last)
+        s_stats.targets_kept++;
+    return ret;
+}
+
+/* Used when the target grid could not be built for the current tick */
+static struct entity *closest_enemy_queried(const struct entity *ent, uint16_t enemies)
 {
     float min_dist = FLT_MAX;
     struct entity *ret = NULL;
 
-    struct entity *near_ents[128];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
-        ENEMY_TARGET_ACQUISITION_RANGE, near_ents, ARR_SIZE(near_ents));
+    int num_near;
+    struct entity *near_ents[MAX_ENEMY_CANDIDATES];
+    vec2_t xz_pos = G_Pos_GetXZ(ent->uid);
+    struct pos_filter filter = enemy_filter(enemies);
+
+    G_Pos_EntsInCircleBatch(&xz_pos, 1, ENEMY_TARGET_ACQUISITION_RANGE, 
+        &filter, 1, near_ents, ARR_SIZE(near_ents), &num_near);
 
     for(int i = 0; i < num_near; i++) {
 
         struct entity *curr = near_ents[i];
-        if(curr == ent)
-            continue;
-        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
-            continue;
-        if(curr->flags & ENTITY_FLAG_ZOMBIE)
-            continue;
-        if(!enemies(ent, curr))
-            continue;
+        assert(curr != ent);
 
-        struct combatstate *cs = combatstate_get(curr->uid);
-        assert(cs);
-        if(cs->state == STATE_DEATH_ANIM_PLAYING)
-            continue;
-   
         float dist = ents_distance(ent, curr);
         if(dist < min_dist) {
             min_dist = dist; 
@@ -221,6 +520,21 @@ static struct entity *closest_enemy_in_range(const struct entity *ent)
     return ret;
 }
 
+static struct entity *closest_enemy_in_range(const struct entity *ent)
+{
+    uint16_t enemies = s_war_masks[ent->faction_id];
+    if(!enemies)
+        return NULL;
+
+    if(!s_target_grid.valid) {
+        s_stats.fallbacks++;
+        return closest_enemy_queried(ent, enemies);
+    }
+
+    s_stats.searches++;
+    return closest_enemy_in_grid(&s_target_grid, ent, enemies);
+}
+
 static quat_t quat_from_vec(vec2_t dir)
 {
     assert(PFM_Vec2_Len(&dir) > EPSILON);
@@ -306,6 +620,17 @@ static void on_30hz_tick(void *user, void *event)
     struct entity *curr;
     (void)key;
 
+    bool any_war = false;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        s_war_masks[i] = war_mask(i);
+        any_war |= !!s_war_masks[i];
+    }
+
+    /* Without any factions at war, there is nobody to look for */
+    if(any_war)
+        target_grid_build(&s_target_grid);
+    s_stats.ticks++;
+
     kh_foreach(G_GetDynamicEntsSet(), key, curr, {
 
         if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
@@ -423,6 +748,32 @@ static void on_30hz_tick(void *user, void *event)
         };
     
     });
+
+    s_stats.targets = s_target_grid.valid ? s_target_grid.ntargets : 0;
+    s_target_grid.valid = false;
+    PERF_RETURN_VOID();
+}
+
+/* Let the navigation subsystem know which chunks the combatable entities 
+ * of every faction are in, so that it can guide entities towards their 
+ * enemies. Entities that stayed in the same chunk are skipped over by it. */
+static void on_10hz_tick(void *user, void *event)
+{
+    PERF_ENTER();
+
+    uint32_t key;
+    struct combatstate curr;
+    (void)curr;
+
+    kh_foreach(s_entity_state_table, key, curr, {
+
+        const struct entity *ent = G_EntityForUID(key);
+        if(!ent || (ent->flags & ENTITY_FLAG_ZOMBIE)) {
+            M_NavRemoveFactionPresence(s_map, key);
+            continue;
+        }
+        M_NavUpdateFactionPresence(s_map, key, ent->faction_id, G_Pos_GetXZ(key));
+    });
     PERF_RETURN_VOID();
 }
 
@@ -430,20 +781,35 @@ static void on_30hz_tick(void *user, void *event)
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-bool G_Combat_Init(void)
+bool G_Combat_Init(const struct map *map)
 {
+    assert(map);
     if(NULL == (s_entity_state_table = kh_init(state)))
-        return false;
+        goto fail_state_table;
+    if(!target_grid_init(&s_target_grid, map))
+        goto fail_target_grid;
 
     vec_pentity_init(&s_dying_ents);
     E_Global_Register(EVENT_30HZ_TICK, on_30hz_tick, NULL, G_RUNNING);
+    E_Global_Register(EVENT_10HZ_TICK, on_10hz_tick, NULL, G_RUNNING);
+
+    s_map = map;
     return true;
+
+fail_target_grid:
+    kh_destroy(state, s_entity_state_table);
+fail_state_table:
+    return false;
 }
 
 void G_Combat_Shutdown(void)
 {
+    s_map = NULL;
+
+    E_Global_Unregister(EVENT_10HZ_TICK, on_10hz_tick);
     E_Global_Unregister(EVENT_30HZ_TICK, on_30hz_tick);
     vec_pentity_destroy(&s_dying_ents);
+    target_grid_destroy(&s_target_grid);
     kh_destroy(state, s_entity_state_table);
 }
 
@@ -479,6 +845,7 @@ void G_Combat_RemoveEntity(const struct entity *ent)
     }
     dying_remove(ent);
     combatstate_remove(ent);
+    M_NavRemoveFactionPresence(s_map, ent->uid);
 }
 
 bool G_Combat_SetStance(const struct entity *ent, enum combat_stance stance)
@@ -578,6 +945,16 @@ void G_Combat_SetHP(const struct entity *ent, int hp)
     cs->current_hp = MIN(hp, ent->max_hp);
 }
 
+void G_Combat_GetStats(struct combat_stats *out_stats)
+{
+    *out_stats = s_stats;
+}
+
+void G_Combat_ClearStats(void)
+{
+    memset(&s_stats, 0, sizeof(s_stats));
+}
+
 bool G_Combat_SaveState(struct SDL_RWops *stream)
 {
     struct attr num_ents = (struct attr){
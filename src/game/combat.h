@@ -40,10 +40,11 @@
 #include <stdbool.h>
 
 struct entity;
+struct map;
 struct SDL_RWops;
 
 
-bool G_Combat_Init(void);
+bool G_Combat_Init(const struct map *map);
 void G_Combat_Shutdown(void);
 
 void G_Combat_AddEntity(const struct entity *ent, enum combat_stance initial);
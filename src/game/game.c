@@ -133,11 +133,14 @@ static void g_init_map(void)
     M_Raycast_Install(s_gs.map, ACTIVE_CAM);
     M_InitMinimap(s_gs.map, g_default_minimap_pos());
     G_Move_Init(s_gs.map);
-    G_Combat_Init();
+    G_Combat_Init(s_gs.map);
     G_ClearPath_Init(s_gs.map);
     G_Pos_Init(s_gs.map);
     N_FC_ClearAll();
     N_FC_ClearStats();
+    N_ClearBlockerStats();
+    G_Move_ClearStats();
+    G_Combat_ClearStats();
 }
 
 static void g_shadow_pass(const struct camera *cam, const struct map *map, 
@@ -388,6 +391,33 @@ static bool faction_id_validate(const struct sval *new_val)
     return true;
 }
 
+static bool flock_size_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    if(new_val->as_int < 0)
+        return false;
+    return true;
+}
+
+static bool max_neighbours_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    if(new_val->as_int < 0)
+        return false;
+    return true;
+}
+
+static bool pos_index_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    if(new_val->as_int != POS_INDEX_QUADTREE && new_val->as_int != POS_INDEX_GRID)
+        return false;
+    return true;
+}
+
 static void shadows_en_commit(const struct sval *new_val)
 {
     bool on = new_val->as_bool;
@@ -567,6 +597,54 @@ bool G_Init(void)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.game.corridor_max_flock_size",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_CORRIDOR_MAX_FLOCK_SIZE
+        },
+        .prio = 0,
+        .validate = flock_size_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.clearpath_max_neighbours",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_CLEARPATH_MAX_NEIGHBOURS
+        },
+        .prio = 0,
+        .validate = max_neighbours_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.movement_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = CONFIG_MOVE_LOD
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.position_index",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_POS_INDEX
+        },
+        .prio = 0,
+        .validate = pos_index_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.debug.show_navigation_cost_base",
         .val = (struct sval) {
@@ -842,7 +920,16 @@ bool G_PointInsideMap(vec2_t xz)
     return M_PointInsideMap(s_gs.map, xz);
 }
 
-void G_BakeNavDataForScene(void)
+size_t G_NavMemoryUsage(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_gs.map)
+        return 0;
+    return M_NavMemoryUsage(s_gs.map);
+}
+
+bool G_BakeNavDataForScene(void)
 {
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
@@ -862,9 +949,16 @@ void G_BakeNavDataForScene(void)
         M_NavCutoutStaticObject(s_gs.map, &obb);
     });
 
-    M_NavUpdatePortals(s_gs.map);
+    if(M_NavLoadCachedData(s_gs.map))
+        PERF_RETURN(true);
+
+    bool ret = M_NavUpdatePortals(s_gs.map);
     M_NavUpdateIslandsField(s_gs.map);
-    PERF_RETURN_VOID();
+
+    /* Incomplete data must not end up in the cache */
+    if(ret)
+        M_NavSaveCachedData(s_gs.map);
+    PERF_RETURN(ret);
 }
 
 bool G_UpdateMinimapChunk(int chunk_r, int chunk_c)
@@ -1138,6 +1232,7 @@ void G_SetStatic(struct entity *ent, bool on)
 
         G_Move_RemoveEntity(ent);
         ent->flags |= ENTITY_FLAG_STATIC;
+        G_Pos_UpdateAttrs(ent);
 
     }else if(!on && (ent->flags & ENTITY_FLAG_STATIC)){
 
@@ -1147,6 +1242,7 @@ void G_SetStatic(struct entity *ent, bool on)
 
         G_Move_AddEntity(ent);
         ent->flags &= ~ENTITY_FLAG_STATIC;
+        G_Pos_UpdateAttrs(ent);
     }
 }
 
@@ -1416,6 +1512,7 @@ void G_Zombiefy(struct entity *ent)
     ent->flags |= ENTITY_FLAG_INVISIBLE;
     ent->flags |= ENTITY_FLAG_STATIC;
     ent->flags |= ENTITY_FLAG_ZOMBIE;
+    G_Pos_UpdateAttrs(ent);
 }
 
 struct entity *G_EntityForUID(uint32_t uid)
@@ -1737,7 +1834,8 @@ bool G_LoadEntityState(SDL_RWops *stream)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    G_BakeNavDataForScene();
+    if(!G_BakeNavDataForScene())
+        return false;
 
     if(!g_load_anim_state(stream))
         return false;
@@ -37,6 +37,7 @@
 #include "game_private.h"
 #include "combat.h"
 #include "clearpath.h"
+#include "position.h"
 #include "public/game.h"
 #include "../config.h"
 #include "../camera.h"
@@ -55,8 +56,10 @@
 #include "../lib/public/vec.h"
 #include "../lib/public/attr.h"
 #include "../anim/public/anim.h"
+#include "../task.h"
 
 #include <assert.h>
+#include <float.h>
 #include <SDL.h>
 
 
@@ -68,6 +71,7 @@
 
 #define SIGNUM(x)    (((x) > 0) - ((x) < 0))
 #define MIN(a, b)    ((a) < (b) ? (a) : (b))
+#define MAX(a, b)    ((a) > (b) ? (a) : (b))
 #define ARR_SIZE(a)  (sizeof(a)/sizeof(a[0]))
 #define STR(a)       #a
 
@@ -84,6 +88,15 @@
     }while(0)
 
 #define VEL_HIST_LEN (14)
+/* The number of entities whose new velocities are computed by a single task */
+#define STEER_BATCH_SIZE (32)
+/* The maximum number of potential ClearPath neighbours considered per entity */
+#define MAX_NEAR_ENTS    (512)
+/* How much further than the ClearPath radius an entity must have no others 
+ * around it to be steered at a lower rate. Two entities can't close this 
+ * distance between two steering updates of either one, so that neither can 
+ * come within the ClearPath radius of the other unseen. */
+#define MOVE_LOD_MARGIN  (10.0f)
 
 enum arrival_state{
     /* Entity is moving towards the flock's destination point */
@@ -97,14 +110,25 @@ enum arrival_state{
     STATE_WAITING,
 };
 
+/* What an entity found around itself when it was last steered */
+enum surroundings{
+    /* No other entities within the LOD margin of the ClearPath radius */
+    SURROUND_CLEAR,
+    /* Other entities within the LOD margin, or not known to be clear */
+    SURROUND_NEAR,
+    /* Other entities within the ClearPath radius. Only that radius is 
+     * searched the next time. */
+    SURROUND_CROWDED,
+};
+
+/* History of the previous ticks' velocities. Used for velocity smoothing. */
+struct vel_hist{
+    vec2_t             entries[VEL_HIST_LEN];
+    int                idx;
+};
+
+/* The rarely accessed part of an entity's movement state */
 struct movestate{
-    enum arrival_state state;
-    /* The desired velocity returned by the navigation system */
-    vec2_t             vdes;
-    /* The newly computed velocity (the desired velocity constrained by flocking forces) */
-    vec2_t             vnew;
-    /* The current velocity */
-    vec2_t             velocity;
     /* Flag to track whether the entiy is currently acting as a 
      * navigation blocker, and the last position where it became a blocker. */
     bool               blocking;
@@ -113,22 +137,77 @@ struct movestate{
     /* Information for waking up from the 'WAITING' state */
     enum arrival_state wait_prev;
     int                wait_ticks_left;
-    /* History of the previous ticks' velocities. Used for velocity smoothing. */
-    vec2_t             vel_hist[VEL_HIST_LEN];
-    int                vel_hist_idx;
 };
 
-KHASH_MAP_INIT_INT(state, struct movestate)
+/* The movement state of all the dynamic entities, kept densely packed. Every 
+ * entity has a 'slot', which indexes all of the arrays. The fields are kept in 
+ * separate arrays so that the passes over all the entities, and the reads of 
+ * the neighbours' velocities and states, only touch the memory they need. A 
+ * slot is only looked up by UID where an entity enters the movement code: in 
+ * the extern functions, and for the results of spatial queries. When an entity 
+ * is removed, the last slot is moved into its' place. 
+ */
+struct movestore{
+    size_t              size;
+    size_t              capacity;
+    struct entity     **ents;
+    enum arrival_state *state;
+    /* A copy of the entity's position, kept up to date by 'G_Move_UpdatePos' */
+    vec2_t             *xz_pos;
+    /* The current velocity */
+    vec2_t             *velocity;
+    /* The desired velocity returned by the navigation system */
+    vec2_t             *vdes;
+    /* Whether the navigation system reported the destination to be 
+     * in line of sight, along with the desired velocity */
+    bool               *dest_los;
+    /* The newly computed velocity (the desired velocity constrained by flocking forces) */
+    vec2_t             *vnew;
+    struct vel_hist    *vel_hist;
+    struct movestate   *ms;
+    /* The index of the entity's flock in 's_flocks', or -1 */
+    int                *flock;
+    /* The rate at which the entity is steered while it is moving */
+    enum move_lod      *lod;
+    enum surroundings  *surround;
+};
+
+KHASH_MAP_INIT_INT(slot, int)
+
+/* The sums of the positions and velocities of the flock members that are 
+ * in a single cell of a uniform grid. Only the members with a non-zero 
+ * velocity are counted towards the velocity sum. 
+ */
+struct flock_cell{
+    int              count;
+    vec2_t           pos_sum;
+    int              nmoving;
+    vec2_t           vel_sum;
+};
+
+KHASH_MAP_INIT_INT64(cell, struct flock_cell)
 
 struct flock{
     khash_t(entity) *ents;
     vec2_t           target_xz; 
     dest_id_t        dest_id;
+    /* Running per-cell sums over the members, updated whenever a member 
+     * moves, changes its' velocity, or joins or leaves the flock. These 
+     * let the flocking forces be computed without visiting every member. 
+     */
+    khash_t(cell)   *cells;
+    /* An upper bound on the selection radius of any member */
+    float            max_radius;
 };
 
+KHASH_MAP_INIT_INT(dest, int)
+
 VEC_TYPE(flock, struct flock)
 VEC_IMPL(static inline, flock, struct flock)
 
+VEC_TYPE(slot, int)
+VEC_IMPL(static inline, slot, int)
+
 /* Parameters controlling steering/flocking behaviours */
 #define SEPARATION_FORCE_SCALE          (0.6f)
 #define MOVE_ARRIVE_FORCE_SCALE         (0.5f)
@@ -140,6 +219,7 @@ VEC_IMPL(static inline, flock, struct flock)
 #define ADJACENCY_SEP_DIST              (5.0f)
 #define ALIGN_NEIGHBOUR_RADIUS          (10.0f)
 #define SEPARATION_NEIGHB_RADIUS        (30.0f)
+#define FLOCK_CELL_SIZE                 (4.0f)
 
 #define COLLISION_MAX_SEE_AHEAD         (10.0f)
 #define WAIT_TICKS                      (60)
@@ -153,13 +233,32 @@ static bool                    s_attack_on_lclick = false;
 static bool                    s_move_on_lclick = false;
 
 static vec_pentity_t           s_move_markers;
+/* The slots of the moving entities, for which new velocities are computed in parallel */
+static vec_slot_t              s_steer_slots;
 static vec_flock_t             s_flocks;
-static khash_t(state)         *s_entity_state_table;
+static struct movestore        s_store;
+/* Maps the UID of every entity in the store to its' slot */
+static khash_t(slot)          *s_slot_table;
+/* Maps a destination ID to the index of the flock heading there */
+static khash_t(dest)          *s_dest_flock_table;
+
+/* The number of 20Hz ticks since initialization, which staggers the steering
+ * of the entities at the lower rates over the ticks */
+static uint32_t                s_move_tick;
+/* The value of the 'pf.game.movement_lod' setting for the current tick */
+static bool                    s_lod_enabled;
+static struct move_stats       s_move_stats;
 
 /* Store the most recently issued move command location for debug rendering */
 static bool                    s_last_cmd_dest_valid = false;
 static dest_id_t               s_last_cmd_dest;
 
+static const int s_lod_period[MOVE_NUM_LODS] = {
+    [MOVE_LOD_FULL]    = 1,
+    [MOVE_LOD_HALF]    = 2,
+    [MOVE_LOD_QUARTER] = 4,
+};
+
 static const char *s_state_str[] = {
     [STATE_MOVING]       = STR(STATE_MOVING),
     [STATE_ARRIVED]      = STR(STATE_ARRIVED),
@@ -171,80 +270,327 @@ static const char *s_state_str[] = {
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-/* The returned pointer is guaranteed to be valid to write to for
- * so long as we don't add anything to the table. At that point, there
- * is a case that a 'realloc' might take place. */
-static struct movestate *movestate_get(const struct entity *ent)
+/* Returns -1 if the entity is not in the store. The slot is valid 
+ * for so long as no entity is removed. */
+static int slot_get(const struct entity *ent)
 {
-    khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k == kh_end(s_entity_state_table))
-        return NULL;
-    return &kh_value(s_entity_state_table, k);
+    khiter_t k = kh_get(slot, s_slot_table, ent->uid);
+    if(k == kh_end(s_slot_table))
+        return -1;
+    return kh_value(s_slot_table, k);
 }
 
-static void flock_try_remove(struct flock *flock, const struct entity *ent)
+static bool store_reserve(size_t new_cap)
 {
-    khiter_t k;
-    if((k = kh_get(entity, flock->ents, ent->uid)) != kh_end(flock->ents))
-        kh_del(entity, flock->ents, k);
+    if(s_store.capacity >= new_cap)
+        return true;
+
+#define STORE_RESIZE(_field)                                                    \
+    do{                                                                         \
+        void *new_arr = realloc(s_store._field, new_cap * sizeof(*s_store._field)); \
+        if(!new_arr)                                                            \
+            return false;                                                       \
+        s_store._field = new_arr;                                               \
+    }while(0)
+
+    STORE_RESIZE(ents);
+    STORE_RESIZE(state);
+    STORE_RESIZE(xz_pos);
+    STORE_RESIZE(velocity);
+    STORE_RESIZE(vdes);
+    STORE_RESIZE(dest_los);
+    STORE_RESIZE(vnew);
+    STORE_RESIZE(vel_hist);
+    STORE_RESIZE(ms);
+    STORE_RESIZE(flock);
+    STORE_RESIZE(lod);
+    STORE_RESIZE(surround);
+
+#undef STORE_RESIZE
+
+    s_store.capacity = new_cap;
+    return true;
 }
 
-static void flock_add(struct flock *flock, const struct entity *ent)
+static void store_free(void)
 {
+    free(s_store.ents);
+    free(s_store.state);
+    free(s_store.xz_pos);
+    free(s_store.velocity);
+    free(s_store.vdes);
+    free(s_store.dest_los);
+    free(s_store.vnew);
+    free(s_store.vel_hist);
+    free(s_store.ms);
+    free(s_store.flock);
+    free(s_store.lod);
+    free(s_store.surround);
+    memset(&s_store, 0, sizeof(s_store));
+}
+
+static int store_add(struct entity *ent)
+{
+    if(s_store.size == s_store.capacity
+    && !store_reserve(s_store.capacity ? s_store.capacity * 2 : 64))
+        return -1;
+
     int ret;
-    khiter_t k = kh_put(entity, flock->ents, ent->uid, &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(flock->ents, k) = (struct entity*)ent;
+    khiter_t k = kh_put(slot, s_slot_table, ent->uid, &ret);
+    if(ret == -1 || ret == 0)
+        return -1;
+
+    const int slot = s_store.size++;
+    kh_value(s_slot_table, k) = slot;
+
+    s_store.ents[slot] = ent;
+    s_store.state[slot] = STATE_ARRIVED;
+    s_store.xz_pos[slot] = G_Pos_GetXZ(ent->uid);
+    s_store.velocity[slot] = (vec2_t){0.0f, 0.0f};
+    s_store.vdes[slot] = (vec2_t){0.0f, 0.0f};
+    s_store.dest_los[slot] = false;
+    s_store.vnew[slot] = (vec2_t){0.0f, 0.0f};
+    memset(&s_store.vel_hist[slot], 0, sizeof(struct vel_hist));
+    s_store.ms[slot] = (struct movestate){
+        .blocking = false,
+    };
+    s_store.flock[slot] = -1;
+    s_store.lod[slot] = MOVE_LOD_FULL;
+    s_store.surround[slot] = SURROUND_NEAR;
+    return slot;
 }
 
-static bool flock_contains(const struct flock *flock, const struct entity *ent)
+static void store_remove(int slot)
 {
-    khiter_t k = kh_get(entity, flock->ents, ent->uid);
-    if(k != kh_end(flock->ents))
-        return true;
-    return false;
+    assert(slot >= 0 && slot < s_store.size);
+
+    khiter_t k = kh_get(slot, s_slot_table, s_store.ents[slot]->uid);
+    assert(k != kh_end(s_slot_table));
+    kh_del(slot, s_slot_table, k);
+
+    const int last = s_store.size - 1;
+    if(slot != last) {
+
+        s_store.ents[slot] = s_store.ents[last];
+        s_store.state[slot] = s_store.state[last];
+        s_store.xz_pos[slot] = s_store.xz_pos[last];
+        s_store.velocity[slot] = s_store.velocity[last];
+        s_store.vdes[slot] = s_store.vdes[last];
+        s_store.dest_los[slot] = s_store.dest_los[last];
+        s_store.vnew[slot] = s_store.vnew[last];
+        s_store.vel_hist[slot] = s_store.vel_hist[last];
+        s_store.ms[slot] = s_store.ms[last];
+        s_store.flock[slot] = s_store.flock[last];
+        s_store.lod[slot] = s_store.lod[last];
+        s_store.surround[slot] = s_store.surround[last];
+
+        k = kh_get(slot, s_slot_table, s_store.ents[slot]->uid);
+        assert(k != kh_end(s_slot_table));
+        kh_value(s_slot_table, k) = slot;
+    }
+    s_store.size--;
 }
 
-static struct flock *flock_for_ent(const struct entity *ent)
+static uint64_t flock_cell_key(vec2_t xz_pos)
 {
-    for(int i = 0; i < vec_size(&s_flocks); i++) {
+    int32_t r = floor(xz_pos.z / FLOCK_CELL_SIZE);
+    int32_t c = floor(xz_pos.x / FLOCK_CELL_SIZE);
+    return (((uint64_t)(uint32_t)r) << 32) | (uint32_t)c;
+}
 
-        struct flock *curr_flock = &vec_AT(&s_flocks, i);            
-        if(flock_contains(curr_flock, ent))
-            return curr_flock;
+static void flock_cell_add(struct flock *flock, int slot)
+{
+    int ret;
+    khiter_t k = kh_put(cell, flock->cells, flock_cell_key(s_store.xz_pos[slot]), &ret);
+    assert(ret != -1);
+    if(ret != 0) {
+        kh_value(flock->cells, k) = (struct flock_cell){0};
+    }
+
+    struct flock_cell *cell = &kh_value(flock->cells, k);
+    cell->count++;
+    PFM_Vec2_Add(&cell->pos_sum, &s_store.xz_pos[slot], &cell->pos_sum);
+
+    if(PFM_Vec2_Len(&s_store.velocity[slot]) >= EPSILON) {
+        cell->nmoving++;
+        PFM_Vec2_Add(&cell->vel_sum, &s_store.velocity[slot], &cell->vel_sum);
     }
-    return NULL;
 }
 
-static struct flock *flock_for_dest(dest_id_t id)
+static void flock_cell_remove(struct flock *flock, int slot)
 {
-    for(int i = 0; i < vec_size(&s_flocks); i++) {
+    khiter_t k = kh_get(cell, flock->cells, flock_cell_key(s_store.xz_pos[slot]));
+    assert(k != kh_end(flock->cells));
+
+    struct flock_cell *cell = &kh_value(flock->cells, k);
+    assert(cell->count > 0);
+
+    /* Drop empty cells so that the rounding errors of the sums don't accumulate */
+    if(--cell->count == 0) {
+        kh_del(cell, flock->cells, k);
+        return;
+    }
+    PFM_Vec2_Sub(&cell->pos_sum, &s_store.xz_pos[slot], &cell->pos_sum);
+
+    if(PFM_Vec2_Len(&s_store.velocity[slot]) >= EPSILON) {
+        cell->nmoving--;
+        PFM_Vec2_Sub(&cell->vel_sum, &s_store.velocity[slot], &cell->vel_sum);
+    }
+}
+
+static void set_velocity(int slot, vec2_t velocity)
+{
+    if(s_store.flock[slot] < 0) {
+        s_store.velocity[slot] = velocity;
+        return;
+    }
+
+    struct flock *flock = &vec_AT(&s_flocks, s_store.flock[slot]);
+    flock_cell_remove(flock, slot);
+    s_store.velocity[slot] = velocity;
+    flock_cell_add(flock, slot);
+}
+
+static int flock_new(vec2_t target_xz, dest_id_t dest_id)
+{
+    struct flock new_flock = (struct flock) {
+        .ents = kh_init(entity),
+        .cells = kh_init(cell),
+        .target_xz = target_xz,
+        .dest_id = dest_id,
+        .max_radius = 0.0f,
+    };
+    if(!new_flock.ents || !new_flock.cells)
+        goto fail;
+
+    int ret;
+    khiter_t k = kh_put(dest, s_dest_flock_table, dest_id, &ret);
+    if(ret == -1 || ret == 0)
+        goto fail;
+
+    if(!vec_flock_push(&s_flocks, new_flock)) {
+        kh_del(dest, s_dest_flock_table, k);
+        goto fail;
+    }
+
+    kh_value(s_dest_flock_table, k) = vec_size(&s_flocks) - 1;
+    return vec_size(&s_flocks) - 1;
+
+fail:
+    if(new_flock.ents)
+        kh_destroy(entity, new_flock.ents);
+    if(new_flock.cells)
+        kh_destroy(cell, new_flock.cells);
+    return -1;
+}
+
+static void flock_set_index(struct flock *flock, int idx)
+{
+    uint32_t key;
+    struct entity *curr;
+    (void)key;
+
+    kh_foreach(flock->ents, key, curr, {
 
-        struct flock *curr_flock = &vec_AT(&s_flocks, i);            
-        if(curr_flock->dest_id == id)
-            return curr_flock;
+        int slot = slot_get(curr);
+        assert(slot >= 0);
+        s_store.flock[slot] = idx;
+    });
+
+    if(idx >= 0) {
+        khiter_t k = kh_get(dest, s_dest_flock_table, flock->dest_id);
+        assert(k != kh_end(s_dest_flock_table));
+        kh_value(s_dest_flock_table, k) = idx;
     }
-    return NULL;
 }
 
-static void entity_block(const struct entity *ent)
+static void flock_destroy(int idx)
+{
+    struct flock *flock = &vec_AT(&s_flocks, idx);
+    flock_set_index(flock, -1);
+
+    khiter_t k = kh_get(dest, s_dest_flock_table, flock->dest_id);
+    assert(k != kh_end(s_dest_flock_table));
+    kh_del(dest, s_dest_flock_table, k);
+
+    kh_destroy(entity, flock->ents);
+    kh_destroy(cell, flock->cells);
+
+    /* The last flock takes the place of the deleted one */
+    vec_flock_del(&s_flocks, idx);
+    if(idx < vec_size(&s_flocks)) {
+        flock_set_index(&vec_AT(&s_flocks, idx), idx);
+    }
+}
+
+static void flock_try_remove(int idx, const struct entity *ent)
+{
+    int slot = slot_get(ent);
+    if(slot < 0 || s_store.flock[slot] != idx)
+        return;
+
+    struct flock *flock = &vec_AT(&s_flocks, idx);
+    khiter_t k = kh_get(entity, flock->ents, ent->uid);
+    assert(k != kh_end(flock->ents));
+    kh_del(entity, flock->ents, k);
+
+    flock_cell_remove(flock, slot);
+    s_store.flock[slot] = -1;
+}
+
+static void flock_add(int idx, const struct entity *ent)
+{
+    int slot = slot_get(ent);
+    assert(slot >= 0);
+    assert(s_store.flock[slot] == -1);
+
+    struct flock *flock = &vec_AT(&s_flocks, idx);
+    int ret;
+    khiter_t k = kh_put(entity, flock->ents, ent->uid, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(flock->ents, k) = (struct entity*)ent;
+
+    s_store.flock[slot] = idx;
+    s_store.lod[slot] = MOVE_LOD_FULL;
+    flock_cell_add(flock, slot);
+    flock->max_radius = MAX(flock->max_radius, ent->selection_radius);
+}
+
+static struct flock *flock_for_ent(const struct entity *ent)
 {
-    M_NavBlockersIncref(G_Pos_GetXZ(ent->uid), ent->selection_radius, s_map);
+    int slot = slot_get(ent);
+    if(slot < 0 || s_store.flock[slot] < 0)
+        return NULL;
+    return &vec_AT(&s_flocks, s_store.flock[slot]);
+}
 
-    struct movestate *ms = movestate_get(ent);
+static int flock_idx_for_dest(dest_id_t id)
+{
+    khiter_t k = kh_get(dest, s_dest_flock_table, id);
+    if(k == kh_end(s_dest_flock_table))
+        return -1;
+    return kh_value(s_dest_flock_table, k);
+}
+
+static void entity_block(int slot)
+{
+    const struct entity *ent = s_store.ents[slot];
+    M_NavBlockersQueueIncref(s_store.xz_pos[slot], ent->selection_radius, s_map);
+
+    struct movestate *ms = &s_store.ms[slot];
     assert(!ms->blocking);
 
     ms->blocking = true;
-    ms->last_stop_pos = G_Pos_GetXZ(ent->uid);
+    ms->last_stop_pos = s_store.xz_pos[slot];
     ms->last_stop_radius = ent->selection_radius;
 }
 
-static void entity_unblock(const struct entity *ent)
+static void entity_unblock(int slot)
 {
-    struct movestate *ms = movestate_get(ent);
+    struct movestate *ms = &s_store.ms[slot];
     assert(ms->blocking);
 
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
+    M_NavBlockersQueueDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
     ms->blocking = false;
 }
 
@@ -267,31 +613,33 @@ static void vec2_truncate(vec2_t *inout, float max_len)
     }
 }
 
-static bool ent_still(const struct movestate *ms)
+static bool ent_still(int slot)
 {
-    return (ms->state == STATE_ARRIVED || ms->state == STATE_WAITING);
+    return (s_store.state[slot] == STATE_ARRIVED || s_store.state[slot] == STATE_WAITING);
 }
 
-static void entity_finish_moving(const struct entity *ent, enum arrival_state newstate)
+static void entity_finish_moving(int slot, enum arrival_state newstate)
 {
+    const struct entity *ent = s_store.ents[slot];
     E_Entity_Notify(EVENT_MOTION_END, ent->uid, NULL, ES_ENGINE);
     if(ent->flags & ENTITY_FLAG_COMBATABLE)
         G_Combat_SetStance(ent, COMBAT_STANCE_AGGRESSIVE);
 
-    struct movestate *ms = movestate_get(ent);
-    assert(!ent_still(ms));
+    struct movestate *ms = &s_store.ms[slot];
+    assert(!ent_still(slot));
 
     if(newstate == STATE_WAITING) {
-        ms->wait_prev = ms->state;
+        ms->wait_prev = s_store.state[slot];
         ms->wait_ticks_left = WAIT_TICKS;
     }
 
-    ms->state = newstate;
-    ms->velocity = (vec2_t){0.0f, 0.0f};
-    ms->vnew = (vec2_t){0.0f, 0.0f};
+    s_store.state[slot] = newstate;
+    set_velocity(slot, (vec2_t){0.0f, 0.0f});
+    s_store.vnew[slot] = (vec2_t){0.0f, 0.0f};
+    s_store.lod[slot] = MOVE_LOD_FULL;
 
-    entity_block(ent);
-    assert(ent_still(ms));
+    entity_block(slot);
+    assert(ent_still(slot));
 }
 
 static void on_marker_anim_finish(void *user, void *event)
@@ -321,21 +669,72 @@ static bool same_chunk_as_any_in_set(struct tile_desc desc, const struct tile_de
     return false;
 }
 
-static void remove_from_flocks(const struct entity *ent)
+static size_t corridor_max_flock_size(void)
 {
-    /* Remove any flocks which may have become empty. Iterate vector in backwards order 
-     * so that we can delete while iterating, since the last element in the vector takes
-     * the place of the deleted one. 
-     */
-    for(int i = vec_size(&s_flocks)-1; i >= 0; i--) {
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.corridor_max_flock_size", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    return setting.as_int;
+}
+
+/* Start making the entity's flow fields in the background. Until they are 
+ * ready, the entity follows the nearest field already made for the target, 
+ * or heads straight for it if there is none. Entities in small 
+ * flocks are guided by a corridor instead, which is made right away.
+ */
+static void request_path(const struct entity *ent, vec2_t target_xz, size_t flock_size)
+{
+    dest_id_t dest_id;
+    if(flock_size <= corridor_max_flock_size()
+    && M_NavRequestCorridor(s_map, G_Pos_GetXZ(ent->uid), target_xz, &dest_id))
+        return;
+
+    path_ticket_t ticket;
+    M_NavRequestPathAsync(s_map, G_Pos_GetXZ(ent->uid), target_xz, &ticket);
+}
 
-        struct flock *curr_flock = &vec_AT(&s_flocks, i);
-        flock_try_remove(curr_flock, ent);
+/* As 'request_path', for all the moving entities of the selection. A corridor 
+ * is made on the main thread, so only a single one is made for the flock, from 
+ * the position of its' first entity. The others join it from wherever it 
+ * passes close by, and have their fields made in the background otherwise. 
+ */
+static void request_paths(const vec_pentity_t *sel, vec2_t target_xz, size_t flock_size)
+{
+    bool corridor = false;
+    bool tried = (flock_size > corridor_max_flock_size());
 
-        if(kh_size(curr_flock->ents) == 0) {
-            kh_destroy(entity, curr_flock->ents);
-            vec_flock_del(&s_flocks, i);
+    for(int i = 0; i < vec_size(sel); i++) {
+
+        const struct entity *curr_ent = vec_AT(sel, i);
+        if(stationary(curr_ent))
+            continue;
+
+        if(!tried) {
+            dest_id_t dest_id;
+            tried = true;
+            corridor = M_NavRequestCorridor(s_map, G_Pos_GetXZ(curr_ent->uid), target_xz, &dest_id);
         }
+        if(corridor)
+            break;
+
+        path_ticket_t ticket;
+        M_NavRequestPathAsync(s_map, G_Pos_GetXZ(curr_ent->uid), target_xz, &ticket);
+    }
+}
+
+static void remove_from_flocks(const struct entity *ent)
+{
+    int slot = slot_get(ent);
+    if(slot < 0 || s_store.flock[slot] < 0)
+        return;
+
+    /* Remove the flock if it has become empty */
+    int idx = s_store.flock[slot];
+    flock_try_remove(idx, ent);
+
+    if(kh_size(vec_AT(&s_flocks, idx).ents) == 0) {
+        flock_destroy(idx);
     }
     assert(NULL == flock_for_ent(ent));
 }
@@ -361,12 +760,19 @@ static bool make_flock_from_selection(const vec_pentity_t *sel, vec2_t target_xz
         remove_from_flocks(curr_ent);
     }
 
-    struct flock new_flock = (struct flock) {
-        .ents = kh_init(entity),
-        .target_xz = target_xz,
-    };
+    size_t nmoving = 0;
+    for(int i = 0; i < vec_size(sel); i++) {
+        if(!stationary(vec_AT(sel, i)))
+            nmoving++;
+    }
+
+    if(nmoving == 0)
+        return false;
 
-    if(!new_flock.ents)
+    /* If there is another flock with the same dest_id, then the entities join that flock. */
+    dest_id_t dest_id = M_NavDestIDForPos(s_map, target_xz);
+    int idx = flock_idx_for_dest(dest_id);
+    if(idx < 0 && (idx = flock_new(target_xz, dest_id)) < 0)
         return false;
 
     for(int i = 0; i < vec_size(sel); i++) {
@@ -375,72 +781,58 @@ static bool make_flock_from_selection(const vec_pentity_t *sel, vec2_t target_xz
         if(stationary(curr_ent))
             continue;
 
-        struct movestate *ms = movestate_get(curr_ent);
-        assert(ms);
+        int slot = slot_get(curr_ent);
+        assert(slot >= 0);
 
-        if(ent_still(ms)) {
-            entity_unblock(curr_ent); 
+        if(ent_still(slot)) {
+            entity_unblock(slot); 
             E_Entity_Notify(EVENT_MOTION_START, curr_ent->uid, NULL, ES_ENGINE);
         }
 
-        flock_add(&new_flock, curr_ent);
-        ms->state = STATE_MOVING;
+        flock_add(idx, curr_ent);
+        s_store.state[slot] = STATE_MOVING;
     }
 
-    /* The flow fields will be computed on-demand during the next movement update tick */
-    new_flock.target_xz = target_xz;
-    new_flock.dest_id = M_NavDestIDForPos(s_map, target_xz);
-
-    if(kh_size(new_flock.ents) > 0) {
-
-        /* If there is another flock with the same dest_id, then we merge the two flocks. */
-        struct flock *merge_flock = flock_for_dest(new_flock.dest_id);
-        if(merge_flock) {
+    /* The selection may have joined a larger flock */
+    request_paths(sel, target_xz, kh_size(vec_AT(&s_flocks, idx).ents));
 
-            uint32_t key;
-            struct entity *curr;
-            (void)key;
-
-            kh_foreach(new_flock.ents, key, curr, { flock_add(merge_flock, curr); });
-            kh_destroy(entity, new_flock.ents);
-        
-        }else{
-            vec_flock_push(&s_flocks, new_flock);
-        }
-
-        s_last_cmd_dest_valid = true;
-        s_last_cmd_dest = new_flock.dest_id;
-
-        return true;
-    }else{
-        kh_destroy(entity, new_flock.ents);
-        return false;
-    }
+    s_last_cmd_dest_valid = true;
+    s_last_cmd_dest = dest_id;
+    return true;
 }
 
-size_t adjacent_flock_members(const struct entity *ent, const struct flock *flock, 
-                              struct entity *out[])
+/* Finds the other flock members within the adjacency distance of the entity, 
+ * using a spatial query sized by the flock's largest member. */
+static size_t adjacent_flock_members(int slot, const struct flock *flock, int out[], size_t maxout)
 {
-    vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
+    const struct entity *ent = s_store.ents[slot];
+    vec2_t ent_xz_pos = s_store.xz_pos[slot];
     size_t ret = 0;
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
+    struct entity *near_ents[512];
+    int num_near = G_Pos_EntsInCircle(ent_xz_pos, 
+        ent->selection_radius + flock->max_radius + ADJACENCY_SEP_DIST, 
+        near_ents, ARR_SIZE(near_ents));
 
-    kh_foreach(flock->ents, key, curr, {
+    for(int i = 0; i < num_near && ret < maxout; i++) {
 
+        struct entity *curr = near_ents[i];
         if(curr == ent)
             continue;
+        if(curr->flags & ENTITY_FLAG_STATIC)
+            continue;
 
-        vec2_t diff;
+        int curr_slot = slot_get(curr);
+        assert(curr_slot >= 0);
+        if(s_store.flock[curr_slot] != s_store.flock[slot])
+            continue;
 
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
-        PFM_Vec2_Sub(&ent_xz_pos, &curr_xz_pos, &diff);
+        vec2_t diff;
+        PFM_Vec2_Sub(&ent_xz_pos, &s_store.xz_pos[curr_slot], &diff);
 
         if(PFM_Vec2_Len(&diff) <= ent->selection_radius + curr->selection_radius + ADJACENCY_SEP_DIST)
-            out[ret++] = curr;  
-    });
+            out[ret++] = curr_slot;  
+    }
     return ret;
 }
 
@@ -533,12 +925,12 @@ static void on_render_3d(void *user, void *event)
     if(setting.as_bool && vec_size(sel) > 0) {
     
         const struct entity *ent = vec_AT(sel, 0);
-        struct movestate *ms = movestate_get(ent);
-        if(ms) {
+        int slot = slot_get(ent);
+        if(slot >= 0) {
 
             char strbuff[256];
             snprintf(strbuff, ARR_SIZE(strbuff), "Arrival State: %s Velocity: (%f, %f)", 
-                s_state_str[ms->state], ms->velocity.x, ms->velocity.z);
+                s_state_str[s_store.state[slot]], s_store.velocity[slot].x, s_store.velocity[slot].z);
             strbuff[ARR_SIZE(strbuff)-1] = '\0';
             struct rgba text_color = (struct rgba){255, 0, 0, 255};
             UI_DrawText(strbuff, (struct rect){5,5,450,50}, text_color);
@@ -546,7 +938,7 @@ static void on_render_3d(void *user, void *event)
             const struct camera *cam = G_GetActiveCamera();
             struct flock *flock = flock_for_ent(ent);
 
-            switch(ms->state) {
+            switch(s_store.state[slot]) {
             case STATE_MOVING:
                 assert(flock);
                 M_NavRenderVisiblePathFlowField(s_map, cam, flock->dest_id);
@@ -611,13 +1003,13 @@ static quat_t dir_quat_from_velocity(vec2_t velocity)
     };
 }
 
-static vec2_t ent_desired_velocity(const struct entity *ent)
+static vec2_t ent_desired_velocity(int slot)
 {
-    struct movestate *ms = movestate_get(ent);
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    const struct entity *ent = s_store.ents[slot];
+    vec2_t pos_xz = s_store.xz_pos[slot];
     struct flock *fl = flock_for_ent(ent);
 
-    switch(ms->state) {
+    switch(s_store.state[slot]) {
     case STATE_SEEK_ENEMIES: 
         return M_NavDesiredEnemySeekVelocity(s_map, pos_xz, ent->faction_id);
     default:
@@ -628,19 +1020,17 @@ static vec2_t ent_desired_velocity(const struct entity *ent)
 
 /* Seek behaviour makes the entity target and approach a particular destination point.
  */
-static vec2_t seek_force(const struct entity *ent, vec2_t target_xz)
+static vec2_t seek_force(int slot, vec2_t target_xz)
 {
+    const struct entity *ent = s_store.ents[slot];
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = s_store.xz_pos[slot];
 
     PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
     PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
     PFM_Vec2_Scale(&desired_velocity, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &s_store.velocity[slot], &ret);
     return ret;
 }
 
@@ -650,17 +1040,15 @@ static vec2_t seek_force(const struct entity *ent, vec2_t target_xz)
  * When not within line of sight of the destination, this will steer the entity along the 
  * flow field.
  */
-static vec2_t arrive_force(const struct entity *ent, dest_id_t dest_id, vec2_t target_xz)
+static vec2_t arrive_force(int slot, dest_id_t dest_id, vec2_t target_xz)
 {
+    const struct entity *ent = s_store.ents[slot];
     assert(0 == (ent->flags & ENTITY_FLAG_STATIC));
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = s_store.xz_pos[slot];
     float distance;
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    if(M_NavHasDestLOS(s_map, dest_id, pos_xz)) {
+    if(s_store.dest_los[slot]) {
 
         PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
@@ -673,87 +1061,87 @@ static vec2_t arrive_force(const struct entity *ent, dest_id_t dest_id, vec2_t t
 
     }else{
 
-        PFM_Vec2_Scale(&ms->vdes, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&s_store.vdes[slot], ent->max_speed / MOVE_TICK_RES, &desired_velocity);
     }
 
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &s_store.velocity[slot], &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Alignment is a behaviour that causes a particular agent to line up with agents close by.
+ * The neighbours are taken a grid cell at a time, using the flock's per-cell sums.
  */
-static vec2_t alignment_force(const struct entity *ent, const struct flock *flock)
+static vec2_t alignment_force(int slot, const struct flock *flock)
 {
     vec2_t ret = (vec2_t){0.0f};
     size_t neighbour_count = 0;
+    vec2_t ent_xz_pos = s_store.xz_pos[slot];
+    const uint64_t own_key = flock_cell_key(ent_xz_pos);
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
+    uint64_t key;
+    struct flock_cell cell;
 
-    kh_foreach(flock->ents, key, curr, {
+    kh_foreach(flock->cells, key, cell, {
 
-        if(curr == ent)
+        vec2_t centroid, diff;
+        PFM_Vec2_Scale(&cell.pos_sum, 1.0f / cell.count, &centroid);
+        PFM_Vec2_Sub(&centroid, &ent_xz_pos, &diff);
+        if(PFM_Vec2_Len(&diff) >= ALIGN_NEIGHBOUR_RADIUS)
             continue;
 
-        vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
-
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-        if(PFM_Vec2_Len(&diff) < ALIGN_NEIGHBOUR_RADIUS) {
-
-            struct movestate *ms = movestate_get(ent);
-            assert(ms);
-
-            if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
-                continue; 
-
-            PFM_Vec2_Add(&ret, &ms->velocity, &ret);
-            neighbour_count++;
+        /* Leave out the entity's own velocity */
+        if(key == own_key && PFM_Vec2_Len(&s_store.velocity[slot]) >= EPSILON) {
+            cell.nmoving--;
+            PFM_Vec2_Sub(&cell.vel_sum, &s_store.velocity[slot], &cell.vel_sum);
         }
+
+        PFM_Vec2_Add(&ret, &cell.vel_sum, &ret);
+        neighbour_count += cell.nmoving;
     });
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
     PFM_Vec2_Scale(&ret, 1.0f / neighbour_count, &ret);
-    PFM_Vec2_Sub(&ret, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&ret, &s_store.velocity[slot], &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
+ * The members in a grid cell are weighed by the distance to the cell's centroid, so the cost 
+ * depends on the number of occupied cells rather than on the number of flock members.
  */
-static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock)
+static vec2_t cohesion_force(int slot, const struct flock *flock)
 {
     vec2_t COM = (vec2_t){0.0f};
     size_t neighbour_count = 0;
-    vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
+    vec2_t ent_xz_pos = s_store.xz_pos[slot];
+    const uint64_t own_key = flock_cell_key(ent_xz_pos);
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
+    uint64_t key;
+    struct flock_cell cell;
 
-    kh_foreach(flock->ents, key, curr, {
+    kh_foreach(flock->cells, key, cell, {
 
-        if(curr == ent)
-            continue;
+        /* Leave out the entity's own position */
+        if(key == own_key) {
+            if(--cell.count == 0)
+                continue;
+            PFM_Vec2_Sub(&cell.pos_sum, &ent_xz_pos, &cell.pos_sum);
+        }
 
-        vec2_t diff;
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
+        vec2_t centroid, diff;
+        PFM_Vec2_Scale(&cell.pos_sum, 1.0f / cell.count, &centroid);
+        PFM_Vec2_Sub(&centroid, &ent_xz_pos, &diff);
 
         float t = (PFM_Vec2_Len(&diff) - COHESION_NEIGHBOUR_RADIUS*0.75) / COHESION_NEIGHBOUR_RADIUS;
         float scale = exp(-6.0f * t);
 
-        PFM_Vec2_Scale(&curr_xz_pos, scale, &curr_xz_pos);
-        PFM_Vec2_Add(&COM, &curr_xz_pos, &COM);
-        neighbour_count++;
+        PFM_Vec2_Scale(&cell.pos_sum, scale, &cell.pos_sum);
+        PFM_Vec2_Add(&COM, &cell.pos_sum, &COM);
+        neighbour_count += cell.count;
     });
 
     if(0 == neighbour_count)
@@ -768,11 +1156,12 @@ static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock
 
 /* Separation is a behaviour that causes agents to steer away from nearby agents.
  */
-static vec2_t separation_force(const struct entity *ent, float buffer_dist)
+static vec2_t separation_force(int slot, float buffer_dist)
 {
+    const struct entity *ent = s_store.ents[slot];
     vec2_t ret = (vec2_t){0.0f};
     struct entity *near_ents[128];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
+    int num_near = G_Pos_EntsInCircle(s_store.xz_pos[slot], 
         SEPARATION_NEIGHB_RADIUS, near_ents, ARR_SIZE(near_ents));
 
     for(int i = 0; i < num_near; i++) {
@@ -783,9 +1172,12 @@ static vec2_t separation_force(const struct entity *ent, float buffer_dist)
         if(curr->flags & ENTITY_FLAG_STATIC)
             continue;
 
+        int curr_slot = slot_get(curr);
+        assert(curr_slot >= 0);
+
         vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        vec2_t ent_xz_pos = s_store.xz_pos[slot];
+        vec2_t curr_xz_pos = s_store.xz_pos[curr_slot];
 
         float radius = ent->selection_radius + curr->selection_radius + buffer_dist;
         PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
@@ -809,21 +1201,18 @@ static vec2_t separation_force(const struct entity *ent, float buffer_dist)
     return ret;
 }
 
-static vec2_t point_seek_total_force(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_total_force(int slot, const struct flock *flock)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t arrive = arrive_force(ent, flock->dest_id, flock->target_xz);
-    vec2_t cohesion = cohesion_force(ent, flock);
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force(slot, flock->dest_id, flock->target_xz);
+    vec2_t cohesion = cohesion_force(slot, flock);
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&cohesion,   MOVE_COHESION_FORCE_SCALE, &cohesion);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
 
     vec2_t ret = (vec2_t){0.0f};
-    assert(!ent_still(ms));
+    assert(!ent_still(slot));
 
     PFM_Vec2_Add(&ret, &arrive, &ret);
     PFM_Vec2_Add(&ret, &separation, &ret);
@@ -833,13 +1222,10 @@ static vec2_t point_seek_total_force(const struct entity *ent, const struct floc
     return ret;
 }
 
-static vec2_t enemy_seek_total_force(const struct entity *ent)
+static vec2_t enemy_seek_total_force(int slot)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t arrive = arrive_force(ent, DEST_ID_INVALID, (vec2_t){0.0f, 0.0f});
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force(slot, DEST_ID_INVALID, (vec2_t){0.0f, 0.0f});
+    vec2_t separation = separation_force(slot, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
@@ -852,9 +1238,9 @@ static vec2_t enemy_seek_total_force(const struct entity *ent)
     return ret;
 }
 
-static vec2_t new_pos_for_vel(const struct entity *ent, vec2_t velocity)
+static vec2_t new_pos_for_vel(int slot, vec2_t velocity)
 {
-    vec2_t xz_pos = G_Pos_GetXZ(ent->uid);
+    vec2_t xz_pos = s_store.xz_pos[slot];
     vec2_t new_pos;
 
     PFM_Vec2_Add(&xz_pos, &velocity, &new_pos);
@@ -863,14 +1249,15 @@ static vec2_t new_pos_for_vel(const struct entity *ent, vec2_t velocity)
 
 /* Nullify the components of the force which would guide
  * the entity towards an impassable tile. */
-static void nullify_impass_components(const struct entity *ent, vec2_t *inout_force)
+static void nullify_impass_components(int slot, vec2_t *inout_force)
 {
     vec2_t nt_dims = N_TileDims();
+    vec2_t pos = s_store.xz_pos[slot];
 
-    vec2_t left =  (vec2_t){G_Pos_Get(ent->uid).x + nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t right = (vec2_t){G_Pos_Get(ent->uid).x - nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t top =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z + nt_dims.z};
-    vec2_t bot =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z - nt_dims.z};
+    vec2_t left =  (vec2_t){pos.x + nt_dims.x, pos.z};
+    vec2_t right = (vec2_t){pos.x - nt_dims.x, pos.z};
+    vec2_t top =   (vec2_t){pos.x, pos.z + nt_dims.z};
+    vec2_t bot =   (vec2_t){pos.x, pos.z - nt_dims.z};
 
     if((inout_force->x > 0 && !M_NavPositionPathable(s_map, left))
     || (inout_force->x < 0 && !M_NavPositionPathable(s_map, right)))
@@ -881,21 +1268,20 @@ static void nullify_impass_components(const struct entity *ent, vec2_t *inout_fo
         inout_force->z = 0.0f;
 }
 
-static vec2_t point_seek_vpref(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_vpref(int slot, const struct flock *flock)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    const struct entity *ent = s_store.ents[slot];
 
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
-        case 0: steer_force = point_seek_total_force(ent, flock); break;
-        case 1: steer_force = separation_force(ent, SEPARATION_BUFFER_DIST); break;
-        case 2: steer_force = arrive_force(ent, flock->dest_id, flock->target_xz); break;
+        case 0: steer_force = point_seek_total_force(slot, flock); break;
+        case 1: steer_force = separation_force(slot, SEPARATION_BUFFER_DIST); break;
+        case 2: steer_force = arrive_force(slot, flock->dest_id, flock->target_xz); break;
         }
 
-        nullify_impass_components(ent, &steer_force);
+        nullify_impass_components(slot, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
@@ -903,54 +1289,52 @@ static vec2_t point_seek_vpref(const struct entity *ent, const struct flock *flo
     vec2_t accel, new_vel; 
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&s_store.velocity[slot], &accel, &new_vel);
     vec2_truncate(&new_vel, ent->max_speed / MOVE_TICK_RES);
 
     return new_vel;
 }
 
-static vec2_t enemy_seek_vpref(const struct entity *ent)
+static vec2_t enemy_seek_vpref(int slot)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t steer_force = enemy_seek_total_force(ent);
+    const struct entity *ent = s_store.ents[slot];
+    vec2_t steer_force = enemy_seek_total_force(slot);
 
     vec2_t accel, new_vel; 
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
+    PFM_Vec2_Add(&s_store.velocity[slot], &accel, &new_vel);
     vec2_truncate(&new_vel, ent->max_speed / MOVE_TICK_RES);
 
     return new_vel;
 }
 
-static void update_vel_hist(struct movestate *ms, vec2_t vnew)
+static void update_vel_hist(struct vel_hist *hist, vec2_t vnew)
 {
-    assert(ms->vel_hist >= 0 && ms->vel_hist_idx < VEL_HIST_LEN);
-    ms->vel_hist[ms->vel_hist_idx] = vnew;
-    ms->vel_hist_idx = ((ms->vel_hist_idx+1) % VEL_HIST_LEN);
+    assert(hist->idx >= 0 && hist->idx < VEL_HIST_LEN);
+    hist->entries[hist->idx] = vnew;
+    hist->idx = ((hist->idx+1) % VEL_HIST_LEN);
 }
 
 /* Simple Moving Average */
-static vec2_t vel_sma(const struct movestate *ms)
+static vec2_t vel_sma(const struct vel_hist *hist)
 {
     vec2_t ret = {0};
     for(int i = 0; i < VEL_HIST_LEN; i++)
-        PFM_Vec2_Add(&ret, (vec2_t*)&ms->vel_hist[i], &ret); 
+        PFM_Vec2_Add(&ret, (vec2_t*)&hist->entries[i], &ret); 
     PFM_Vec2_Scale(&ret, 1.0f/VEL_HIST_LEN, &ret);
     return ret;
 }
 
 /* Weighted Moving Average */
-static vec2_t vel_wma(const struct movestate *ms)
+static vec2_t vel_wma(const struct vel_hist *hist)
 {
     vec2_t ret = {0};
     float denom = 0.0f;
 
     for(int i = 0; i < VEL_HIST_LEN; i++) {
 
-        vec2_t term = ms->vel_hist[i];
+        vec2_t term = hist->entries[i];
         PFM_Vec2_Scale(&term, VEL_HIST_LEN-i, &term);
         PFM_Vec2_Add(&ret, &term, &ret);
         denom += (VEL_HIST_LEN-i);
@@ -960,30 +1344,36 @@ static vec2_t vel_wma(const struct movestate *ms)
     return ret;
 }
 
-static void entity_update(struct entity *ent, vec2_t new_vel)
+static void entity_update(int slot, vec2_t new_vel)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    struct entity *ent = s_store.ents[slot];
+    struct movestate *ms = &s_store.ms[slot];
 
-    vec2_t new_pos_xz = new_pos_for_vel(ent, new_vel);
+    vec2_t new_pos_xz = new_pos_for_vel(slot, new_vel);
 
     if(PFM_Vec2_Len(&new_vel) > 0
     && M_NavPositionPathable(s_map, new_pos_xz)) {
     
         vec3_t new_pos = (vec3_t){new_pos_xz.x, M_HeightAtPoint(s_map, new_pos_xz), new_pos_xz.z};
         G_Pos_Set(ent, new_pos);
-        ms->velocity = new_vel;
+        set_velocity(slot, new_vel);
 
         /* Use a weighted average of past velocities ot set the entity's orientation. This means that 
          * the entity's visible orientation lags behind its' true orientation slightly. However, this 
          * greatly smooths the turning of the entity, giving a more natural look to the movemment. 
          */
-        vec2_t wma = vel_wma(ms);
+        vec2_t wma = vel_wma(&s_store.vel_hist[slot]);
         if(PFM_Vec2_Len(&wma) > EPSILON) {
             ent->rotation = dir_quat_from_velocity(wma);
         }
     }else{
-        ms->velocity = (vec2_t){0.0f, 0.0f}; 
+        set_velocity(slot, (vec2_t){0.0f, 0.0f});
+
+        /* The last velocity can't be kept, so compute a new one right away */
+        if(s_store.lod[slot] != MOVE_LOD_FULL) {
+            s_store.lod[slot] = MOVE_LOD_FULL;
+            s_move_stats.escalations++;
+        }
     }
 
     /* If the entity's current position isn't pathable, simply keep it 'stuck' there in
@@ -991,14 +1381,14 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
      * pathable terrain to non-pathable terrain, but an this violation is possible by 
      * forcefully setting the entity's position from a scripting call. 
      */
-    if(!M_NavPositionPathable(s_map, G_Pos_GetXZ(ent->uid)))
+    if(!M_NavPositionPathable(s_map, s_store.xz_pos[slot]))
         return;
 
-    switch(ms->state) {
+    switch(s_store.state[slot]) {
     case STATE_MOVING: {
 
         vec2_t diff_to_target;
-        vec2_t xz_pos = G_Pos_GetXZ(ent->uid);
+        vec2_t xz_pos = s_store.xz_pos[slot];
         struct flock *flock = flock_for_ent(ent);
         assert(flock);
 
@@ -1008,22 +1398,19 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
         if(PFM_Vec2_Len(&diff_to_target) < arrive_thresh
         || M_NavIsMaximallyClose(s_map, xz_pos, flock->target_xz, arrive_thresh)) {
 
-            entity_finish_moving(ent, STATE_ARRIVED);
+            entity_finish_moving(slot, STATE_ARRIVED);
             break;
         }
 
-        struct entity *adjacent[kh_size(flock->ents)];
-        size_t num_adj = adjacent_flock_members(ent, flock, adjacent);
+        int adjacent[512];
+        size_t num_adj = adjacent_flock_members(slot, flock, adjacent, ARR_SIZE(adjacent));
 
         bool done = false;
         for(int j = 0; j < num_adj; j++) {
 
-            struct movestate *adj_ms = movestate_get(adjacent[j]);
-            assert(adj_ms);
+            if(s_store.state[adjacent[j]] == STATE_ARRIVED) {
 
-            if(adj_ms->state == STATE_ARRIVED) {
-
-                entity_finish_moving(ent, STATE_ARRIVED);
+                entity_finish_moving(slot, STATE_ARRIVED);
                 done = true;
                 break;
             }
@@ -1037,19 +1424,19 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
          * the entity any closer to its' goal. Stop and wait, re-requesting the  path 
          * after some time. 
          */
-        if(PFM_Vec2_Len(&ms->vdes) < EPSILON) {
+        if(PFM_Vec2_Len(&s_store.vdes[slot]) < EPSILON) {
 
             assert(flock_for_ent(ent));
-            entity_finish_moving(ent, STATE_WAITING);
+            entity_finish_moving(slot, STATE_WAITING);
             break;
         }
         break;
     }
     case STATE_SEEK_ENEMIES: {
 
-        if(PFM_Vec2_Len(&ms->vdes) < EPSILON) {
+        if(PFM_Vec2_Len(&s_store.vdes[slot]) < EPSILON) {
 
-            entity_finish_moving(ent, STATE_WAITING);
+            entity_finish_moving(slot, STATE_WAITING);
         }
         break;
     }
@@ -1062,9 +1449,9 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
             assert(ms->wait_prev == STATE_MOVING 
                 || ms->wait_prev == STATE_SEEK_ENEMIES);
 
-            entity_unblock(ent);
+            entity_unblock(slot);
             E_Entity_Notify(EVENT_MOTION_START, ent->uid, NULL, ES_ENGINE);
-            ms->state = ms->wait_prev;
+            s_store.state[slot] = ms->wait_prev;
         }
         break;
     }
@@ -1075,9 +1462,10 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
     }
 }
 
-static void find_neighbours(const struct entity *ent,
-                            vec_cp_ent_t *out_dyn,
-                            vec_cp_ent_t *out_stat)
+static enum surroundings find_neighbours(int slot,
+                                         struct entity *const *near_ents, int num_near,
+                                         vec_cp_ent_t *out_dyn,
+                                         vec_cp_ent_t *out_stat)
 {
     /* For the ClearPath algorithm, we only consider entities without
      * ENTITY_FLAG_STATIC set, as they are the only ones that may need
@@ -1086,9 +1474,8 @@ static void find_neighbours(const struct entity *ent,
      * meaning they will not perform collision avoidance maneuvers of
      * their own. */
 
-    struct entity *near_ents[512];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
-        CLEARPATH_NEIGHBOUR_RADIUS, near_ents, ARR_SIZE(near_ents));
+    const struct entity *ent = s_store.ents[slot];
+    enum surroundings ret = SURROUND_CLEAR;
 
     for(int i = 0; i < num_near; i++) {
         struct entity *curr = near_ents[i];
@@ -1096,27 +1483,33 @@ static void find_neighbours(const struct entity *ent,
         if(curr->uid == ent->uid)
             continue;
 
-        if(curr->flags & ENTITY_FLAG_STATIC)
-            continue;
+        assert(!(curr->flags & ENTITY_FLAG_STATIC));
+        assert(curr->selection_radius > 0.0f);
 
-        if(curr->selection_radius == 0.0f)
-            continue;
+        int curr_slot = slot_get(curr);
+        assert(curr_slot >= 0);
 
-        struct movestate *ms = movestate_get(curr);
-        assert(ms);
+        /* The entities in the LOD margin are only counted */
+        vec2_t delta;
+        PFM_Vec2_Sub(&s_store.xz_pos[curr_slot], &s_store.xz_pos[slot], &delta);
+        if(PFM_Vec2_Len(&delta) > CLEARPATH_NEIGHBOUR_RADIUS) {
+            ret = MAX(ret, SURROUND_NEAR);
+            continue;
+        }
+        ret = SURROUND_CROWDED;
 
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
         struct cp_ent newdesc = (struct cp_ent) {
-            .xz_pos = curr_xz_pos,
-            .xz_vel = ms->velocity,
+            .xz_pos = s_store.xz_pos[curr_slot],
+            .xz_vel = s_store.velocity[curr_slot],
             .radius = curr->selection_radius
         };
 
-        if(ent_still(ms))
+        if(ent_still(curr_slot))
             vec_cp_ent_push(out_stat, newdesc);
         else
             vec_cp_ent_push(out_dyn, newdesc);
     }
+    return ret;
 }
 
 static void disband_empty_flocks(void)
@@ -1132,90 +1525,260 @@ static void disband_empty_flocks(void)
         bool disband = true;
         kh_foreach(vec_AT(&s_flocks, i).ents, key, curr, {
 
-            struct movestate *ms = movestate_get(curr);
-            assert(ms);
+            int slot = slot_get(curr);
+            assert(slot >= 0);
 
-            if(ms->state != STATE_ARRIVED) {
+            if(s_store.state[slot] != STATE_ARRIVED) {
                 disband = false;
                 break;
             }
         });
 
         if(disband) {
-
-            kh_destroy(entity, vec_AT(&s_flocks, i).ents);
-            vec_flock_del(&s_flocks, i);
+            flock_destroy(i);
         }
     }
 }
 
-static void on_20hz_tick(void *user, void *event)
+/* Whether the neighbours are also searched for in the LOD margin, to find out
+ * if the entity can be steered at a lower rate. Entities that were crowded the 
+ * last time will most likely stay at the full rate, so the smaller search is 
+ * made for them. */
+static bool steer_search_margin(int slot)
 {
-    PERF_ENTER();
+    return s_lod_enabled && (s_store.surround[slot] != SURROUND_CROWDED);
+}
+
+static float steer_search_radius(int slot)
+{
+    return steer_search_margin(slot) ? CLEARPATH_NEIGHBOUR_RADIUS + MOVE_LOD_MARGIN 
+                                     : CLEARPATH_NEIGHBOUR_RADIUS;
+}
+
+/* Computes the entity's new velocity from the steering forces acting on it and 
+ * the velocities of its' neighbours. This only reads the positions and the 
+ * velocities of the entities, which stay the same until all the new velocities 
+ * have been computed, and only writes the entity's own movestate. So it is safe 
+ * to do it for many entities in parallel, and the result does not depend on 
+ * the order in which they are processed.
+ */
+static void entity_compute_vnew(int slot, struct entity *const *near_ents, int num_near,
+                                vec_cp_ent_t *dyn, vec_cp_ent_t *stat)
+{
+    const struct entity *ent = s_store.ents[slot];
 
+    vec2_t vpref = (vec2_t){-1,-1};
+    switch(s_store.state[slot]) {
+    case STATE_SEEK_ENEMIES: 
+        vpref = enemy_seek_vpref(slot);
+        break;
+    default: {
+        const struct flock *flock = flock_for_ent(ent);
+        assert(flock);
+        vpref = point_seek_vpref(slot, flock);
+    }
+    }
+    assert(vpref.x != -1 || vpref.z != -1);
+
+    struct cp_ent ent_cp = (struct cp_ent) {
+        .xz_pos = s_store.xz_pos[slot],
+        .xz_vel = s_store.velocity[slot],
+        .radius = ent->selection_radius,
+    };
+
+    vec_cp_ent_reset(dyn);
+    vec_cp_ent_reset(stat);
+    const bool searched_margin = steer_search_margin(slot);
+    enum surroundings surround = find_neighbours(slot, near_ents, num_near, dyn, stat);
+    if(!searched_margin && surround == SURROUND_CLEAR)
+        surround = SURROUND_NEAR;
+    s_store.surround[slot] = surround;
+
+    vec2_t vnew = G_ClearPath_NewVelocity(ent_cp, ent->uid, vpref, *dyn, *stat);
+    update_vel_hist(&s_store.vel_hist[slot], vnew);
+
+    vec2_t vel_diff;
+    PFM_Vec2_Sub(&vnew, &s_store.velocity[slot], &vel_diff);
+
+    PFM_Vec2_Add(&s_store.velocity[slot], &vel_diff, &vnew);
+    vec2_truncate(&vnew, ent->max_speed / MOVE_TICK_RES);
+    s_store.vnew[slot] = vnew;
+}
+
+static void steer_task(void *arg, int idx)
+{
+    const vec_slot_t *slots = arg;
+    size_t begin = idx * STEER_BATCH_SIZE;
+    size_t end = MIN(begin + STEER_BATCH_SIZE, vec_size(slots));
+
+    const struct pos_filter filter = (struct pos_filter){
+        .flags_none = ENTITY_FLAG_STATIC,
+        .min_radius = FLT_MIN,
+    };
+
+    /* Every task has its' own scratch buffers for the neighbours */
     vec_cp_ent_t dyn, stat;
     vec_cp_ent_init(&dyn);
     vec_cp_ent_init(&stat);
 
-    uint32_t key;
-    struct entity *curr;
+    vec2_t points[STEER_BATCH_SIZE] = {0};
+    int batch[STEER_BATCH_SIZE];
+    int num_near[STEER_BATCH_SIZE];
+    struct entity **near_ents = malloc(STEER_BATCH_SIZE * MAX_NEAR_ENTS * sizeof(struct entity*));
+
+    if(near_ents) {
+
+        /* The neighbours of the whole batch are found with one query for each 
+         * search radius, which visits the entities in order of locality. The 
+         * entities searching the smaller radius are placed first. */
+        size_t nbatch = end - begin, nsmall = 0;
+        for(size_t i = begin; i < end; i++) {
+            if(!steer_search_margin(vec_AT(slots, i)))
+                batch[nsmall++] = vec_AT(slots, i);
+        }
+        for(size_t i = begin, j = nsmall; i < end; i++) {
+            if(steer_search_margin(vec_AT(slots, i)))
+                batch[j++] = vec_AT(slots, i);
+        }
+        for(size_t i = 0; i < nbatch; i++) {
+            points[i] = s_store.xz_pos[batch[i]];
+        }
+
+        G_Pos_EntsInCircleBatch(points, nsmall, CLEARPATH_NEIGHBOUR_RADIUS, 
+            &filter, 1, near_ents, MAX_NEAR_ENTS, num_near);
+        G_Pos_EntsInCircleBatch(points + nsmall, nbatch - nsmall, 
+            CLEARPATH_NEIGHBOUR_RADIUS + MOVE_LOD_MARGIN, &filter, 1, 
+            near_ents + nsmall * MAX_NEAR_ENTS, MAX_NEAR_ENTS, num_near + nsmall);
+
+        for(size_t i = 0; i < nbatch; i++) {
+            entity_compute_vnew(batch[i], near_ents + i * MAX_NEAR_ENTS, 
+                num_near[i], &dyn, &stat);
+        }
+    }else{
+
+        struct entity *near[MAX_NEAR_ENTS];
+        for(size_t i = begin; i < end; i++) {
+
+            int slot = vec_AT(slots, i);
+            int nnear = 0;
+            G_Pos_EntsInCircleBatch(&s_store.xz_pos[slot], 1, steer_search_radius(slot), 
+                &filter, 1, near, MAX_NEAR_ENTS, &nnear);
+            entity_compute_vnew(slot, near, nnear, &dyn, &stat);
+        }
+    }
+
+    free(near_ents);
+    vec_cp_ent_destroy(&dyn);
+    vec_cp_ent_destroy(&stat);
+}
+
+/* The entities at the same rate are spread evenly over the ticks by their UIDs */
+static bool lod_due(int slot)
+{
+    const int period = s_lod_period[s_store.lod[slot]];
+    return ((s_move_tick + s_store.ents[slot]->uid) % period) == 0;
+}
+
+/* An entity is stepped down one rate at a time for as long as it stays clear
+ * of others, and returns to the full rate as soon as it isn't. */
+static enum move_lod lod_next(int slot)
+{
+    const struct entity *ent = s_store.ents[slot];
+
+    if(!s_lod_enabled)
+        return MOVE_LOD_FULL;
+    if(s_store.surround[slot] != SURROUND_CLEAR)
+        return MOVE_LOD_FULL;
+    if(s_store.state[slot] != STATE_MOVING)
+        return MOVE_LOD_FULL;
+
+    /* Entities slow down and come to a halt close to the target */
+    assert(s_store.flock[slot] >= 0);
+    const struct flock *flock = &vec_AT(&s_flocks, s_store.flock[slot]);
+    vec2_t delta;
+    PFM_Vec2_Sub((vec2_t*)&flock->target_xz, &s_store.xz_pos[slot], &delta);
+    if(PFM_Vec2_Len(&delta) < ARRIVE_SLOWING_RADIUS + MOVE_LOD_MARGIN)
+        return MOVE_LOD_FULL;
+
+    /* The margin must cover the distance closed by the entity and another 
+     * one as fast as it between two of its' updates */
+    enum move_lod ret = MIN(s_store.lod[slot] + 1, MOVE_LOD_QUARTER);
+    const float tick_dist = ent->max_speed / MOVE_TICK_RES;
+    while(ret > MOVE_LOD_FULL && 2.0f * tick_dist * s_lod_period[ret] > MOVE_LOD_MARGIN)
+        ret--;
+    return ret;
+}
+
+static void on_20hz_tick(void *user, void *event)
+{
+    PERF_ENTER();
+
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.movement_lod", &setting);
+    assert(status == SS_OKAY);
+    (void)status;
+    s_lod_enabled = setting.as_bool;
 
     disband_empty_flocks();
+    vec_slot_reset(&s_steer_slots);
+    memset(s_move_stats.moving, 0, sizeof(s_move_stats.moving));
 
-    kh_foreach(G_GetDynamicEntsSet(), key, curr, {
+    /* The queries to the navigation system update its' caches, so they are 
+     * made up front, in a fixed order. Entities which are not due to be 
+     * steered in this tick keep their last velocity. */
+    for(int slot = 0; slot < s_store.size; slot++) {
+
+        if(ent_still(slot))
+            continue;
 
-        struct movestate *ms = movestate_get(curr);
-        assert(ms);
+        const enum move_lod lod = s_store.lod[slot];
+        s_move_stats.moving[lod]++;
 
-        if(ent_still(ms))
+        if(s_lod_enabled && !lod_due(slot)) {
+            s_move_stats.extrapolated[lod]++;
             continue;
+        }
+        s_move_stats.steered[lod]++;
 
-        struct flock *flock = flock_for_ent(curr);
-        vec2_t vpref = (vec2_t){-1,-1};
-        ms->vdes = ent_desired_velocity(curr);
+        const struct entity *curr = s_store.ents[slot];
+        vec2_t pos_xz = s_store.xz_pos[slot];
+        const struct flock *flock = flock_for_ent(curr);
+        s_store.vdes[slot] = ent_desired_velocity(slot);
 
-        switch(ms->state) {
+        switch(s_store.state[slot]) {
         case STATE_SEEK_ENEMIES: 
             assert(!flock);
-            vpref = enemy_seek_vpref(curr);
+            s_store.dest_los[slot] = M_NavHasDestLOS(s_map, DEST_ID_INVALID, pos_xz);
             break;
         default:
             assert(flock);
-            vpref = point_seek_vpref(curr, flock);
+            s_store.dest_los[slot] = M_NavHasDestLOS(s_map, flock->dest_id, pos_xz);
         }
-        assert(vpref.x != -1 || vpref.z != -1);
-
-        struct cp_ent curr_cp = (struct cp_ent) {
-            .xz_pos = G_Pos_GetXZ(curr->uid),
-            .xz_vel = ms->velocity,
-            .radius = curr->selection_radius,
-        };
-
-        vec_cp_ent_reset(&dyn);
-        vec_cp_ent_reset(&stat);
-        find_neighbours(curr, &dyn, &stat);
-
-        ms->vnew = G_ClearPath_NewVelocity(curr_cp, key, vpref, dyn, stat);
-        update_vel_hist(ms, ms->vnew);
+        vec_slot_push(&s_steer_slots, slot);
+    }
 
-        vec2_t vel_diff;
-        PFM_Vec2_Sub(&ms->vnew, &ms->velocity, &vel_diff);
+    size_t nents = vec_size(&s_steer_slots);
+    G_ClearPath_BeginTick();
+    G_Pos_BeginParallelRead();
+    Task_ParallelFor((nents + STEER_BATCH_SIZE - 1) / STEER_BATCH_SIZE, steer_task, &s_steer_slots);
+    G_Pos_EndParallelRead();
 
-        PFM_Vec2_Add(&ms->velocity, &vel_diff, &ms->vnew);
-        vec2_truncate(&ms->vnew, curr->max_speed / MOVE_TICK_RES);
-    });
+    for(int i = 0; i < nents; i++) {
 
-    kh_foreach(G_GetDynamicEntsSet(), key, curr, {
-    
-        struct movestate *ms = movestate_get(curr);
-        assert(ms);
+        int slot = vec_AT(&s_steer_slots, i);
+        enum move_lod next = lod_next(slot);
 
-        entity_update(curr, ms->vnew);
-    });
+        if(next == MOVE_LOD_FULL && s_store.lod[slot] != MOVE_LOD_FULL)
+            s_move_stats.escalations++;
+        s_store.lod[slot] = next;
+    }
 
-    vec_cp_ent_destroy(&dyn);
-    vec_cp_ent_destroy(&stat);
+    for(int slot = 0; slot < s_store.size; slot++) {
+        entity_update(slot, s_store.vnew[slot]);
+    }
 
+    s_move_tick++;
+    s_move_stats.ticks++;
     PERF_RETURN_VOID();
 }
 
@@ -1226,10 +1789,17 @@ static void on_20hz_tick(void *user, void *event)
 bool G_Move_Init(const struct map *map)
 {
     assert(map);
-    if(NULL == (s_entity_state_table = kh_init(state))) {
+    if(NULL == (s_slot_table = kh_init(slot))) {
         return false;
     }
+    if(NULL == (s_dest_flock_table = kh_init(dest))) {
+        kh_destroy(slot, s_slot_table);
+        return false;
+    }
+    memset(&s_store, 0, sizeof(s_store));
+    s_move_tick = 0;
     vec_pentity_init(&s_move_markers);
+    vec_slot_init(&s_steer_slots);
     vec_flock_init(&s_flocks);
 
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
@@ -1254,53 +1824,47 @@ void G_Move_Shutdown(void)
         G_SafeFree(vec_AT(&s_move_markers, i));
     }
 
+    while(vec_size(&s_flocks) > 0) {
+        flock_destroy(vec_size(&s_flocks) - 1);
+    }
     vec_flock_destroy(&s_flocks);
     vec_pentity_destroy(&s_move_markers);
-    kh_destroy(state, s_entity_state_table);
+    vec_slot_destroy(&s_steer_slots);
+    store_free();
+    kh_destroy(dest, s_dest_flock_table);
+    kh_destroy(slot, s_slot_table);
 }
 
 void G_Move_AddEntity(const struct entity *ent)
 {
-    struct movestate new_ms = (struct movestate) {
-        .velocity = {0.0f}, 
-        .blocking = false,
-        .state = STATE_ARRIVED,
-        .vel_hist_idx = 0,
-    };
-    memset(new_ms.vel_hist, 0, sizeof(new_ms.vel_hist));
-
-    int ret;
-    khiter_t k = kh_put(state, s_entity_state_table, ent->uid, &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(s_entity_state_table, k) = new_ms;
-
-    entity_block(ent);
+    int slot = store_add((struct entity*)ent);
+    assert(slot >= 0);
+    entity_block(slot);
 }
 
 void G_Move_RemoveEntity(const struct entity *ent)
 {
-    khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k == kh_end(s_entity_state_table))
+    if(slot_get(ent) < 0)
         return;
 
     G_Move_Stop(ent);
-    entity_unblock(ent);
-
-    kh_del(state, s_entity_state_table, k);
+    int slot = slot_get(ent);
+    entity_unblock(slot);
+    store_remove(slot);
 }
 
 void G_Move_Stop(const struct entity *ent)
 {
-    struct movestate *ms = movestate_get(ent);
-    if(!ms)
+    int slot = slot_get(ent);
+    if(slot < 0)
         return;
 
-    if(!ent_still(ms)) {
-        entity_finish_moving(ent, STATE_ARRIVED);
+    if(!ent_still(slot)) {
+        entity_finish_moving(slot, STATE_ARRIVED);
     }
 
     remove_from_flocks(ent);
-    ms->state = STATE_ARRIVED;
+    s_store.state[slot] = STATE_ARRIVED;
 }
 
 bool G_Move_GetDest(const struct entity *ent, vec2_t *out_xz)
@@ -1318,11 +1882,11 @@ void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz)
 
     /* If a flock already exists for the entity's destination, 
      * simply add the entity to the flock. If necessary, the
-     * right flow fields will be computed on-demand during the
-     * next movement update. 
+     * right flow fields will be requested for the entity. 
      */
     dest_id_t dest_id = M_NavDestIDForPos(s_map, dest_xz);
-    struct flock *fl = flock_for_dest(dest_id);
+    int idx = flock_idx_for_dest(dest_id);
+    struct flock *fl = (idx >= 0) ? &vec_AT(&s_flocks, idx) : NULL;
 
     if(fl && fl == flock_for_ent(ent))
         return;
@@ -1331,15 +1895,22 @@ void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz)
 
         assert(fl != flock_for_ent(ent));
         remove_from_flocks(ent);
-        flock_add(fl, ent);
 
-        struct movestate *ms = movestate_get(ent);
-        assert(ms);
-        if(ent_still(ms)) {
-            entity_unblock(ent);
+        /* Removing the entity may have moved the flock to a different index */
+        idx = flock_idx_for_dest(dest_id);
+        assert(idx >= 0);
+        fl = &vec_AT(&s_flocks, idx);
+
+        flock_add(idx, ent);
+        request_path(ent, fl->target_xz, kh_size(fl->ents));
+
+        int slot = slot_get(ent);
+        assert(slot >= 0);
+        if(ent_still(slot)) {
+            entity_unblock(slot);
             E_Entity_Notify(EVENT_MOTION_START, ent->uid, NULL, ES_ENGINE);
         }
-        ms->state = STATE_MOVING;
+        s_store.state[slot] = STATE_MOVING;
         assert(flock_for_ent(ent));
         return;
     }
@@ -1354,6 +1925,16 @@ void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz)
     vec_pentity_destroy(&to_add);
 }
 
+void G_Move_GetStats(struct move_stats *out_stats)
+{
+    *out_stats = s_move_stats;
+}
+
+void G_Move_ClearStats(void)
+{
+    memset(&s_move_stats, 0, sizeof(s_move_stats));
+}
+
 void G_Move_SetMoveOnLeftClick(void)
 {
     s_attack_on_lclick = false;
@@ -1370,56 +1951,64 @@ void G_Move_SetAttackOnLeftClick(void)
 
 void G_Move_SetSeekEnemies(const struct entity *ent)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    int slot = slot_get(ent);
+    assert(slot >= 0);
 
     /* Remove this entity from any existing flocks */
-    for(int i = vec_size(&s_flocks)-1; i >= 0; i--) {
-
-        struct flock *curr_flock = &vec_AT(&s_flocks, i);
-        flock_try_remove(curr_flock, ent);
-
-        if(kh_size(curr_flock->ents) == 0) {
-            kh_destroy(entity, curr_flock->ents);
-            vec_flock_del(&s_flocks, i);
-        }
-    }
-    assert(NULL == flock_for_ent(ent));
+    remove_from_flocks(ent);
 
-    if(ent_still(ms)) {
-        entity_unblock(ent);
+    if(ent_still(slot)) {
+        entity_unblock(slot);
         E_Entity_Notify(EVENT_MOTION_START, ent->uid, NULL, ES_ENGINE);
     }
 
-    ms->state = STATE_SEEK_ENEMIES;
+    s_store.state[slot] = STATE_SEEK_ENEMIES;
+    s_store.lod[slot] = MOVE_LOD_FULL;
 }
 
 void G_Move_UpdatePos(const struct entity *ent, vec2_t pos)
 {
-    struct movestate *ms = movestate_get(ent);
-    if(!ms)
+    int slot = slot_get(ent);
+    if(slot < 0)
         return;
 
+    if(s_store.flock[slot] >= 0) {
+
+        struct flock *flock = &vec_AT(&s_flocks, s_store.flock[slot]);
+        flock_cell_remove(flock, slot);
+        s_store.xz_pos[slot] = pos;
+        flock_cell_add(flock, slot);
+    }else{
+        s_store.xz_pos[slot] = pos;
+    }
+
+    struct movestate *ms = &s_store.ms[slot];
     if(!ms->blocking)
         return;
 
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
-    M_NavBlockersIncref(pos, ent->selection_radius, s_map);
+    M_NavBlockersQueueDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
+    M_NavBlockersQueueIncref(pos, ent->selection_radius, s_map);
     ms->last_stop_pos = pos;
     ms->last_stop_radius = ent->selection_radius;
 }
 
 void G_Move_UpdateSelectionRadius(const struct entity *ent, float sel_radius)
 {
-    struct movestate *ms = movestate_get(ent);
-    if(!ms)
+    int slot = slot_get(ent);
+    if(slot < 0)
         return;
 
+    if(s_store.flock[slot] >= 0) {
+        struct flock *flock = &vec_AT(&s_flocks, s_store.flock[slot]);
+        flock->max_radius = MAX(flock->max_radius, sel_radius);
+    }
+
+    struct movestate *ms = &s_store.ms[slot];
     if(!ms->blocking)
         return;
 
-    M_NavBlockersDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
-    M_NavBlockersIncref(ms->last_stop_pos, sel_radius, s_map);
+    M_NavBlockersQueueDecref(ms->last_stop_pos, ms->last_stop_radius, s_map);
+    M_NavBlockersQueueIncref(ms->last_stop_pos, sel_radius, s_map);
     ms->last_stop_radius = sel_radius;
 }
 
@@ -1471,42 +2060,42 @@ bool G_Move_SaveState(struct SDL_RWops *stream)
     /* save the movement state */
     struct attr num_ents = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_entity_state_table)
+        .val.as_int = s_store.size
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_ents, "num_ents"));
 
-    uint32_t key;
-    struct movestate curr;
+    for(int slot = 0; slot < s_store.size; slot++) {
 
-    kh_foreach(s_entity_state_table, key, curr, {
+        const struct movestate *curr = &s_store.ms[slot];
+        const struct vel_hist *hist = &s_store.vel_hist[slot];
 
         struct attr uid = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = key
+            .val.as_int = s_store.ents[slot]->uid
         };
         CHK_TRUE_RET(Attr_Write(stream, &uid, "uid"));
 
         struct attr state = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = curr.state
+            .val.as_int = s_store.state[slot]
         };
         CHK_TRUE_RET(Attr_Write(stream, &state, "state"));
 
         struct attr vdes = (struct attr){
             .type = TYPE_VEC2,
-            .val.as_vec2 = curr.vdes
+            .val.as_vec2 = s_store.vdes[slot]
         };
         CHK_TRUE_RET(Attr_Write(stream, &vdes, "vdes"));
 
         struct attr velocity = (struct attr){
             .type = TYPE_VEC2,
-            .val.as_vec2 = curr.velocity
+            .val.as_vec2 = s_store.velocity[slot]
         };
         CHK_TRUE_RET(Attr_Write(stream, &velocity, "velocity"));
 
         struct attr blocking = (struct attr){
             .type = TYPE_BOOL,
-            .val.as_bool = curr.blocking
+            .val.as_bool = curr->blocking
         };
         CHK_TRUE_RET(Attr_Write(stream, &blocking, "blocking"));
 
@@ -1516,13 +2105,13 @@ bool G_Move_SaveState(struct SDL_RWops *stream)
 
         struct attr wait_prev = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = curr.wait_prev
+            .val.as_int = curr->wait_prev
         };
         CHK_TRUE_RET(Attr_Write(stream, &wait_prev, "wait_prev"));
 
         struct attr wait_ticks_left = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = curr.wait_ticks_left
+            .val.as_int = curr->wait_ticks_left
         };
         CHK_TRUE_RET(Attr_Write(stream, &wait_ticks_left, "wait_ticks_left"));
 
@@ -1530,17 +2119,17 @@ bool G_Move_SaveState(struct SDL_RWops *stream)
         
             struct attr hist_entry = (struct attr){
                 .type = TYPE_VEC2,
-                .val.as_vec2 = curr.vel_hist[i]
+                .val.as_vec2 = hist->entries[i]
             };
             CHK_TRUE_RET(Attr_Write(stream, &hist_entry, "hist_entry"));
         }
 
         struct attr vel_hist_idx = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = curr.vel_hist_idx
+            .val.as_int = hist->idx
         };
         CHK_TRUE_RET(Attr_Write(stream, &vel_hist_idx, "vel_hist_idx"));
-    });
+    }
 
     return true;
 }
@@ -1556,9 +2145,9 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
     assert(vec_size(&s_flocks) == 0);
     for(int i = 0; i < num_flocks; i++) {
 
-        struct flock new_flock;
-        new_flock.ents = kh_init(entity);
-        CHK_TRUE_RET(new_flock.ents);
+        /* The members come before the flock's destination in the stream */
+        vec_pentity_t members;
+        vec_pentity_init(&members);
 
         CHK_TRUE_JMP(Attr_Parse(stream, &attr, true), fail_flock);
         CHK_TRUE_JMP(attr.type == TYPE_INT, fail_flock);
@@ -1570,25 +2159,33 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
             CHK_TRUE_JMP(attr.type == TYPE_INT, fail_flock);
 
             uint32_t flock_end_uid = attr.val.as_int;
-            const struct entity *ent = G_EntityForUID(flock_end_uid);
+            struct entity *ent = G_EntityForUID(flock_end_uid);
 
             CHK_TRUE_JMP(ent, fail_flock);
-            flock_add(&new_flock, ent);
+            CHK_TRUE_JMP(slot_get(ent) >= 0, fail_flock);
+            CHK_TRUE_JMP(vec_pentity_push(&members, ent), fail_flock);
         }
 
         CHK_TRUE_JMP(Attr_Parse(stream, &attr, true), fail_flock);
         CHK_TRUE_JMP(attr.type == TYPE_VEC2, fail_flock);
-        new_flock.target_xz = attr.val.as_vec2;
+        vec2_t target_xz = attr.val.as_vec2;
 
         CHK_TRUE_JMP(Attr_Parse(stream, &attr, true), fail_flock);
         CHK_TRUE_JMP(attr.type == TYPE_INT, fail_flock);
-        new_flock.dest_id = attr.val.as_int;
+        dest_id_t dest_id = attr.val.as_int;
+
+        int idx = flock_new(target_xz, dest_id);
+        CHK_TRUE_JMP(idx >= 0, fail_flock);
 
-        vec_flock_push(&s_flocks, new_flock);
+        for(int j = 0; j < vec_size(&members); j++) {
+            flock_add(idx, vec_AT(&members, j));
+        }
+
+        vec_pentity_destroy(&members);
         continue;
 
     fail_flock:
-        kh_destroy(entity, new_flock.ents);
+        vec_pentity_destroy(&members);
         return false;
     }
 
@@ -1600,27 +2197,30 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
 
         uint32_t uid;
         struct movestate *ms;
+        struct vel_hist *hist;
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
         uid = attr.val.as_int;
 
         /* The entity should have already been loaded by the scripting state */
-        khiter_t k = kh_get(state, s_entity_state_table, uid);
-        CHK_TRUE_RET(k != kh_end(s_entity_state_table));
-        ms = &kh_value(s_entity_state_table, k);
+        khiter_t k = kh_get(slot, s_slot_table, uid);
+        CHK_TRUE_RET(k != kh_end(s_slot_table));
+        const int slot = kh_value(s_slot_table, k);
+        ms = &s_store.ms[slot];
+        hist = &s_store.vel_hist[slot];
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
-        ms->state = attr.val.as_int;
+        s_store.state[slot] = attr.val.as_int;
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_VEC2);
-        ms->vdes = attr.val.as_vec2;
+        s_store.vdes[slot] = attr.val.as_vec2;
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_VEC2);
-        ms->velocity = attr.val.as_vec2;
+        set_velocity(slot, attr.val.as_vec2);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_BOOL);
@@ -1628,9 +2228,7 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
         const bool blocking = attr.val.as_bool;
         assert(ms->blocking);
         if(!blocking) {
-            const struct entity *ent = G_EntityForUID(uid);
-            assert(ent);
-            entity_unblock(ent);
+            entity_unblock(slot);
         }
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
@@ -1645,12 +2243,12 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
         
             CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
             CHK_TRUE_RET(attr.type == TYPE_VEC2);
-            ms->vel_hist[i] = attr.val.as_vec2;
+            hist->entries[i] = attr.val.as_vec2;
         }
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
-        ms->vel_hist_idx = attr.val.as_int;
+        hist->idx = attr.val.as_int;
     }
 
     return true;
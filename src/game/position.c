@@ -35,37 +35,101 @@
 
 #include "game_private.h"
 #include "movement.h"
+#include "position.h"
 #include "public/game.h"
 #include "../main.h"
 #include "../pf_math.h"
 #include "../perf.h"
+#include "../config.h"
+#include "../settings.h"
 #include "../lib/public/quadtree.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
 
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+#include <stdlib.h>
 
 
-QUADTREE_TYPE(ent, uint32_t)
-QUADTREE_PROTOTYPES(static, ent, uint32_t)
-QUADTREE_IMPL(static, ent, uint32_t)
+/* The record of an entity in the spatial index. It holds a copy of the 
+ * fields that the queries filter on, so that candidates can be rejected
+ * without touching the entity, and a pointer to the entity, so that the 
+ * results don't need to be looked up by their UID. The record has no 
+ * padding, as the quadtree compares records with 'memcmp'.
+ */
+struct pos_ent{
+    struct entity *ent;
+    uint32_t       uid;
+    uint32_t       flags;
+    int32_t        faction_id;
+    float          radius;
+};
+
+/* An entity in a cell of the grid. The position is kept along with the
+ * record so that the queries don't need to look it up. */
+struct grid_rec{
+    float          x, z;
+    struct pos_ent rec;
+};
+
+VEC_TYPE(rec, struct grid_rec)
+VEC_IMPL(static inline, rec, struct grid_rec)
+
+/* A uniform grid of square, tile-aligned cells, each holding the entities
+ * inside it. Positions outside of the map bounds are clamped to the closest
+ * cell. Moving an entity within the same cell only updates its' record.
+ */
+struct pos_grid{
+    float      xmin, zmin;
+    float      cell_size;
+    int        nrows, ncols;
+    vec_rec_t *cells;
+};
+
+/* The position of a query point along the Morton (Z-order) curve */
+struct morton_key{
+    uint32_t   code;
+    int        idx;
+};
+
+QUADTREE_TYPE(ent, struct pos_ent)
+QUADTREE_PROTOTYPES(static, ent, struct pos_ent)
+QUADTREE_IMPL(static, ent, struct pos_ent)
 
 KHASH_MAP_INIT_INT(pos, vec3_t)
+KHASH_MAP_INIT_INT(rec, struct pos_ent)
 
 #define POSBUF_INIT_SIZE (16384)
 #define MAX_SEARCH_ENTS  (8192)
-#define MAX(a, b)        ((a) < (b) ? (a) : (b))
+#define GRID_CELL_TILES  (2)
+/* The entity flags which are mirrored in the records of the spatial index */
+#define POS_ENT_FLAGS    (ENTITY_FLAG_STATIC | ENTITY_FLAG_COMBATABLE | ENTITY_FLAG_ZOMBIE)
+#define MAX(a, b)        ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi) ((a) < (lo) ? (lo) : ((a) > (hi) ? (hi) : (a)))
 #define ARR_SIZE(a)      (sizeof(a)/sizeof(a[0]))
 
+#define ASSERT_CAN_READ() \
+    assert(SDL_ThreadID() == g_main_thread_id || s_parallel_read)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static khash_t(pos) *s_postable;
-/* The quadtree is always synchronized with the postable, at function call boundaries */
-static qt_ent_t      s_postree;
+static khash_t(pos)  *s_postable;
+/* The spatial index which is in use, chosen at initialization. It is always
+ * synchronized with the postable, at function call boundaries */
+static enum pos_index s_index;
+static qt_ent_t       s_postree;
+/* The records currently in the quadtree, which are needed to delete them */
+static khash_t(rec)  *s_rectable;
+static struct pos_grid s_posgrid;
+/* The bounds of the map, in OpenGL coordinates */
+static float          s_xmin, s_xmax, s_zmin, s_zmax;
+/* Set while worker threads may be reading the positions */
+static bool           s_parallel_read = false;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -76,6 +140,431 @@ static bool any_ent(const struct entity *ent, void *arg)
     return true;
 }
 
+static struct pos_ent pos_ent_make(const struct entity *ent)
+{
+    return (struct pos_ent){
+        .ent = (struct entity*)ent,
+        .uid = ent->uid,
+        .flags = ent->flags & POS_ENT_FLAGS,
+        .faction_id = ent->faction_id,
+        .radius = ent->selection_radius,
+    };
+}
+
+static int grid_row(const struct pos_grid *grid, float z)
+{
+    int ret = floorf((z - grid->zmin) / grid->cell_size);
+    return CLAMP(ret, 0, grid->nrows - 1);
+}
+
+static int grid_col(const struct pos_grid *grid, float x)
+{
+    int ret = floorf((x - grid->xmin) / grid->cell_size);
+    return CLAMP(ret, 0, grid->ncols - 1);
+}
+
+static vec_rec_t *grid_cell(const struct pos_grid *grid, float x, float z)
+{
+    return &grid->cells[grid_row(grid, z) * grid->ncols + grid_col(grid, x)];
+}
+
+static bool grid_init(struct pos_grid *grid, float xmin, float xmax,
+                      float zmin, float zmax, float cell_size)
+{
+    grid->xmin = xmin;
+    grid->zmin = zmin;
+    grid->cell_size = cell_size;
+    grid->nrows = MAX(1, (int)ceilf((zmax - zmin) / cell_size));
+    grid->ncols = MAX(1, (int)ceilf((xmax - xmin) / cell_size));
+
+    grid->cells = malloc(grid->nrows * grid->ncols * sizeof(vec_rec_t));
+    if(!grid->cells)
+        return false;
+
+    for(int i = 0; i < grid->nrows * grid->ncols; i++) {
+        vec_rec_init(&grid->cells[i]);
+    }
+    return true;
+}
+
+static void grid_destroy(struct pos_grid *grid)
+{
+    for(int i = 0; i < grid->nrows * grid->ncols; i++) {
+        vec_rec_destroy(&grid->cells[i]);
+    }
+    free(grid->cells);
+}
+
+static int grid_find(const vec_rec_t *cell, uint32_t uid)
+{
+    for(int i = 0; i < vec_size(cell); i++) {
+        if(vec_AT(cell, i).rec.uid == uid)
+            return i;
+    }
+    return -1;
+}
+
+static bool grid_insert(struct pos_grid *grid, const struct entity *ent, float x, float z)
+{
+    vec_rec_t *cell = grid_cell(grid, x, z);
+    return vec_rec_push(cell, (struct grid_rec){x, z, pos_ent_make(ent)});
+}
+
+static bool grid_delete(struct pos_grid *grid, uint32_t uid, float x, float z)
+{
+    vec_rec_t *cell = grid_cell(grid, x, z);
+    int idx = grid_find(cell, uid);
+    if(idx < 0)
+        return false;
+    vec_rec_del(cell, idx);
+    return true;
+}
+
+static bool grid_move(struct pos_grid *grid, const struct entity *ent,
+                      float old_x, float old_z, float x, float z)
+{
+    vec_rec_t *old_cell = grid_cell(grid, old_x, old_z);
+    vec_rec_t *new_cell = grid_cell(grid, x, z);
+    int idx = grid_find(old_cell, ent->uid);
+    assert(idx >= 0);
+
+    if(old_cell == new_cell) {
+        vec_AT(old_cell, idx) = (struct grid_rec){x, z, pos_ent_make(ent)};
+        return true;
+    }
+
+    if(!vec_rec_push(new_cell, (struct grid_rec){x, z, pos_ent_make(ent)}))
+        return false;
+    vec_rec_del(old_cell, idx);
+    return true;
+}
+
+static bool filter_pass(const struct pos_filter *filter, const struct pos_ent *rec)
+{
+    if(!filter)
+        return true;
+
+    assert(!(filter->flags_all & ~POS_ENT_FLAGS));
+    assert(!(filter->flags_none & ~POS_ENT_FLAGS));
+
+    if((rec->flags & filter->flags_all) != filter->flags_all)
+        return false;
+    if(rec->flags & filter->flags_none)
+        return false;
+    if(filter->faction_mask && !(filter->faction_mask & (0x1 << rec->faction_id)))
+        return false;
+    if(rec->radius < filter->min_radius)
+        return false;
+    if(filter->predicate && !filter->predicate(rec->ent, filter->arg))
+        return false;
+    return true;
+}
+
+static int grid_inrange_circle(const struct pos_grid *grid, float x, float z, float range,
+                               const struct pos_filter *filter, struct entity **out, size_t maxout)
+{
+    int rmin = grid_row(grid, z - range), rmax = grid_row(grid, z + range);
+    int cmin = grid_col(grid, x - range), cmax = grid_col(grid, x + range);
+    int ret = 0;
+
+    for(int r = rmin; r <= rmax; r++) {
+    for(int c = cmin; c <= cmax; c++) {
+
+        const vec_rec_t *cell = &grid->cells[r * grid->ncols + c];
+        for(int i = 0; i < vec_size(cell); i++) {
+
+            const struct grid_rec *curr = &vec_AT(cell, i);
+            float dx = curr->x - x, dz = curr->z - z;
+            if(sqrtf(dx * dx + dz * dz) > range)
+                continue;
+            if(!filter_pass(filter, &curr->rec))
+                continue;
+
+            if(ret == maxout)
+                return ret;
+            out[ret++] = curr->rec.ent;
+        }
+    }}
+    return ret;
+}
+
+static int grid_inrange_rect(const struct pos_grid *grid, float xmin, float xmax,
+                             float zmin, float zmax, struct entity **out, size_t maxout)
+{
+    int rmin = grid_row(grid, zmin), rmax = grid_row(grid, zmax);
+    int cmin = grid_col(grid, xmin), cmax = grid_col(grid, xmax);
+    int ret = 0;
+
+    for(int r = rmin; r <= rmax; r++) {
+    for(int c = cmin; c <= cmax; c++) {
+
+        const vec_rec_t *cell = &grid->cells[r * grid->ncols + c];
+        for(int i = 0; i < vec_size(cell); i++) {
+
+            const struct grid_rec *curr = &vec_AT(cell, i);
+            if(curr->x < xmin || curr->x > xmax)
+                continue;
+            if(curr->z < zmin || curr->z > zmax)
+                continue;
+
+            if(ret == maxout)
+                return ret;
+            out[ret++] = curr->rec.ent;
+        }
+    }}
+    return ret;
+}
+
+/* Keeps the (up to) 'k' closest entities seen so far, sorted by distance */
+static void nearest_insert(struct entity **best, float *best_dist, int *inout_nbest, size_t k,
+                           struct entity *ent, float dist)
+{
+    int i = *inout_nbest;
+    if(i == k) {
+        if(dist >= best_dist[k - 1])
+            return;
+        i--;
+    }else{
+        (*inout_nbest)++;
+    }
+
+    for(; i > 0 && best_dist[i - 1] > dist; i--) {
+        best[i] = best[i - 1];
+        best_dist[i] = best_dist[i - 1];
+    }
+    best[i] = ent;
+    best_dist[i] = dist;
+}
+
+/* Visits the cells in rings of growing size around the point's cell. No entity
+ * in a ring can be closer than (ring - 1) cells, so the search ends as soon as
+ * that is further than the k-th closest entity found so far, or than the range.
+ */
+static int grid_nearest(const struct pos_grid *grid, float x, float z, float range,
+                        const struct pos_filter *filter, struct entity **out, size_t k)
+{
+    if(k == 0)
+        return 0;
+
+    float best_dist[k];
+    int nbest = 0;
+
+    const int r0 = grid_row(grid, z), c0 = grid_col(grid, x);
+    const int max_ring = MAX(MAX(r0, grid->nrows - 1 - r0), MAX(c0, grid->ncols - 1 - c0));
+
+    for(int ring = 0; ring <= max_ring; ring++) {
+
+        const float bound = (ring - 1) * grid->cell_size;
+        if(bound > range)
+            break;
+        if(nbest == k && best_dist[k - 1] <= bound)
+            break;
+
+        for(int r = r0 - ring; r <= r0 + ring; r++) {
+
+            if(r < 0 || r >= grid->nrows)
+                continue;
+            /* Only the first and last rows of the ring are visited in full */
+            const bool edge_row = (r == r0 - ring || r == r0 + ring);
+            const int step = edge_row ? 1 : MAX(2 * ring, 1);
+
+            for(int c = c0 - ring; c <= c0 + ring; c += step) {
+
+                if(c < 0 || c >= grid->ncols)
+                    continue;
+
+                const vec_rec_t *cell = &grid->cells[r * grid->ncols + c];
+                for(int i = 0; i < vec_size(cell); i++) {
+
+                    const struct grid_rec *curr = &vec_AT(cell, i);
+                    float dx = curr->x - x, dz = curr->z - z;
+                    float dist = sqrtf(dx * dx + dz * dz);
+
+                    if(dist > range)
+                        continue;
+                    if(nbest == k && dist >= best_dist[k - 1])
+                        continue;
+                    if(!filter_pass(filter, &curr->rec))
+                        continue;
+
+                    nearest_insert(out, best_dist, &nbest, k, curr->rec.ent, dist);
+                }
+            }
+        }
+    }
+    return nbest;
+}
+
+static int recs_to_ents(const struct pos_ent *recs, int nrecs, struct entity **out)
+{
+    for(int i = 0; i < nrecs; i++) {
+        out[i] = recs[i].ent;
+    }
+    return nrecs;
+}
+
+static bool qt_move(const struct entity *ent, vec3_t old_pos, vec3_t pos)
+{
+    khiter_t k = kh_get(rec, s_rectable, ent->uid);
+    assert(k != kh_end(s_rectable));
+
+    struct pos_ent old_rec = kh_val(s_rectable, k);
+    struct pos_ent new_rec = pos_ent_make(ent);
+
+    bool ret = qt_ent_delete(&s_postree, old_pos.x, old_pos.z, old_rec);
+    assert(ret);
+
+    if(!qt_ent_insert(&s_postree, pos.x, pos.z, new_rec)) {
+        qt_ent_insert(&s_postree, old_pos.x, old_pos.z, old_rec);
+        return false;
+    }
+    kh_val(s_rectable, k) = new_rec;
+    return true;
+}
+
+static bool qt_add(const struct entity *ent, vec3_t pos)
+{
+    struct pos_ent rec = pos_ent_make(ent);
+
+    int ret;
+    khiter_t k = kh_put(rec, s_rectable, ent->uid, &ret);
+    if(ret == -1)
+        return false;
+
+    if(!qt_ent_insert(&s_postree, pos.x, pos.z, rec)) {
+        kh_del(rec, s_rectable, k);
+        return false;
+    }
+    kh_val(s_rectable, k) = rec;
+    return true;
+}
+
+static bool qt_remove(uint32_t uid, vec3_t pos)
+{
+    khiter_t k = kh_get(rec, s_rectable, uid);
+    if(k == kh_end(s_rectable))
+        return false;
+
+    bool ret = qt_ent_delete(&s_postree, pos.x, pos.z, kh_val(s_rectable, k));
+    kh_del(rec, s_rectable, k);
+    return ret;
+}
+
+static int index_inrange_circle(vec2_t xz_point, float range, struct entity **out, size_t maxout)
+{
+    if(s_index == POS_INDEX_GRID)
+        return grid_inrange_circle(&s_posgrid, xz_point.x, xz_point.z, range, NULL, out, maxout);
+
+    struct pos_ent recs[maxout];
+    int ret = qt_ent_inrange_circle(&s_postree,
+        xz_point.x, xz_point.z, range, recs, maxout);
+    return recs_to_ents(recs, ret, out);
+}
+
+/* The quadtree can't evaluate the filter as it is traversed, so a larger number
+ * of candidates is fetched and filtered afterwards. */
+static int index_inrange_circle_filtered(vec2_t xz_point, float range, const struct pos_filter *filter,
+                                         struct entity **out, size_t maxout)
+{
+    if(s_index == POS_INDEX_GRID)
+        return grid_inrange_circle(&s_posgrid, xz_point.x, xz_point.z, range, filter, out, maxout);
+
+    struct pos_ent recs[MAX_SEARCH_ENTS];
+    int ncands = qt_ent_inrange_circle(&s_postree,
+        xz_point.x, xz_point.z, range, recs, ARR_SIZE(recs));
+    int ret = 0;
+
+    for(int i = 0; i < ncands && ret < maxout; i++) {
+        if(filter_pass(filter, &recs[i]))
+            out[ret++] = recs[i].ent;
+    }
+    return ret;
+}
+
+static int index_nearest(vec2_t xz_point, float range, const struct pos_filter *filter,
+                         struct entity **out, size_t k)
+{
+    if(s_index == POS_INDEX_GRID)
+        return grid_nearest(&s_posgrid, xz_point.x, xz_point.z, range, filter, out, k);
+
+    if(k == 0)
+        return 0;
+
+    struct pos_ent recs[MAX_SEARCH_ENTS];
+    int ncands = qt_ent_inrange_circle(&s_postree,
+        xz_point.x, xz_point.z, range, recs, ARR_SIZE(recs));
+
+    float best_dist[k];
+    int nbest = 0;
+
+    for(int i = 0; i < ncands; i++) {
+
+        if(!filter_pass(filter, &recs[i]))
+            continue;
+
+        vec2_t delta, pos = G_Pos_GetXZ(recs[i].uid);
+        PFM_Vec2_Sub(&xz_point, &pos, &delta);
+        nearest_insert(out, best_dist, &nbest, k, recs[i].ent, PFM_Vec2_Len(&delta));
+    }
+    return nbest;
+}
+
+static uint32_t morton_spread(uint32_t v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static int compare_morton_keys(const void *a, const void *b)
+{
+    const struct morton_key *ka = a, *kb = b;
+    if(ka->code != kb->code)
+        return (ka->code < kb->code) ? -1 : 1;
+    return ka->idx - kb->idx;
+}
+
+/* Returns the order in which to visit the points, or NULL if it could not be
+ * allocated, in which case they are visited in the order they are given. The
+ * points are keyed by the grid-sized cell that they are in. */
+static struct morton_key *morton_order(const vec2_t *points, size_t npoints)
+{
+    struct morton_key *ret = malloc(npoints * sizeof(struct morton_key));
+    if(!ret)
+        return NULL;
+
+    const float cell_size = GRID_CELL_TILES * X_COORDS_PER_TILE;
+    for(int i = 0; i < npoints; i++) {
+
+        float r = floorf((points[i].z - s_zmin) / cell_size);
+        float c = floorf((points[i].x - s_xmin) / cell_size);
+        uint32_t ur = CLAMP(r, 0.0f, 65535.0f);
+        uint32_t uc = CLAMP(c, 0.0f, 65535.0f);
+
+        ret[i] = (struct morton_key){
+            .code = (morton_spread(ur) << 1) | morton_spread(uc),
+            .idx = i,
+        };
+    }
+
+    qsort(ret, npoints, sizeof(struct morton_key), compare_morton_keys);
+    return ret;
+}
+
+static int index_inrange_rect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout)
+{
+    if(s_index == POS_INDEX_GRID)
+        return grid_inrange_rect(&s_posgrid, xz_min.x, xz_max.x, xz_min.z, xz_max.z, out, maxout);
+
+    struct pos_ent recs[maxout];
+    int ret = qt_ent_inrange_rect(&s_postree,
+        xz_min.x, xz_max.x, xz_min.z, xz_max.z, recs, maxout);
+    return recs_to_ents(recs, ret, out);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -83,39 +572,55 @@ static bool any_ent(const struct entity *ent, void *arg)
 bool G_Pos_Set(const struct entity *ent, vec3_t pos)
 {
     ASSERT_IN_MAIN_THREAD();
+    assert(!s_parallel_read);
 
     khiter_t k = kh_get(pos, s_postable, ent->uid);
     bool overwrite = (k != kh_end(s_postable));
 
-    if(overwrite) {
-        vec3_t old_pos = kh_val(s_postable, k);
-        bool ret = qt_ent_delete(&s_postree, old_pos.x, old_pos.z, ent->uid);
-        assert(ret);
-    }
+    if(s_index == POS_INDEX_GRID) {
 
-    if(!qt_ent_insert(&s_postree, pos.x, pos.z, ent->uid))
-        return false;
+        if(overwrite) {
+            vec3_t old_pos = kh_val(s_postable, k);
+            if(!grid_move(&s_posgrid, ent, old_pos.x, old_pos.z, pos.x, pos.z))
+                return false;
+        }else if(!grid_insert(&s_posgrid, ent, pos.x, pos.z)) {
+            return false;
+        }
+
+    }else{
+
+        if(overwrite) {
+            vec3_t old_pos = kh_val(s_postable, k);
+            if(!qt_move(ent, old_pos, pos))
+                return false;
+        }else if(!qt_add(ent, pos)) {
+            return false;
+        }
+    }
 
     if(!overwrite) {
         int ret;
-        kh_put(pos, s_postable, ent->uid, &ret); 
+        kh_put(pos, s_postable, ent->uid, &ret);
         if(ret == -1) {
-            qt_ent_delete(&s_postree, pos.x, pos.z, ent->uid);
+            if(s_index == POS_INDEX_GRID)
+                grid_delete(&s_posgrid, ent->uid, pos.x, pos.z);
+            else
+                qt_remove(ent->uid, pos);
             return false;
         }
         k = kh_get(pos, s_postable, ent->uid);
     }
 
     kh_val(s_postable, k) = pos;
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    assert(s_index == POS_INDEX_GRID || kh_size(s_postable) == s_postree.nrecs);
 
     G_Move_UpdatePos(ent, (vec2_t){pos.x, pos.z});
-    return true; 
+    return true;
 }
 
 vec3_t G_Pos_Get(uint32_t uid)
 {
-    ASSERT_IN_MAIN_THREAD();
+    ASSERT_CAN_READ();
 
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
@@ -124,7 +629,7 @@ vec3_t G_Pos_Get(uint32_t uid)
 
 vec2_t G_Pos_GetXZ(uint32_t uid)
 {
-    ASSERT_IN_MAIN_THREAD();
+    ASSERT_CAN_READ();
 
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
@@ -135,6 +640,7 @@ vec2_t G_Pos_GetXZ(uint32_t uid)
 void G_Pos_Delete(uint32_t uid)
 {
     ASSERT_IN_MAIN_THREAD();
+    assert(!s_parallel_read);
 
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
@@ -142,37 +648,80 @@ void G_Pos_Delete(uint32_t uid)
     vec3_t pos = kh_val(s_postable, k);
     kh_del(pos, s_postable, k);
 
-    bool ret = qt_ent_delete(&s_postree, pos.x, pos.z, uid);
+    bool ret;
+    if(s_index == POS_INDEX_GRID)
+        ret = grid_delete(&s_posgrid, uid, pos.x, pos.z);
+    else
+        ret = qt_remove(uid, pos);
+    assert(ret);
+    (void)ret;
+    assert(s_index == POS_INDEX_GRID || kh_size(s_postable) == s_postree.nrecs);
+}
+
+void G_Pos_UpdateAttrs(const struct entity *ent)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(!s_parallel_read);
+
+    khiter_t k = kh_get(pos, s_postable, ent->uid);
+    if(k == kh_end(s_postable))
+        return;
+
+    vec3_t pos = kh_val(s_postable, k);
+    bool ret = (s_index == POS_INDEX_GRID) 
+             ? grid_move(&s_posgrid, ent, pos.x, pos.z, pos.x, pos.z)
+             : qt_move(ent, pos, pos);
     assert(ret);
-    assert(kh_size(s_postable) == s_postree.nrecs);
 }
 
 bool G_Pos_Init(const struct map *map)
 {
     ASSERT_IN_MAIN_THREAD();
 
+    struct sval setting;
+    ss_e status = Settings_Get("pf.game.position_index", &setting);
+    s_index = (status == SS_OKAY) ? setting.as_int : CONFIG_POS_INDEX;
+
     if(NULL == (s_postable = kh_init(pos)))
         return false;
     if(kh_resize(pos, s_postable, POSBUF_INIT_SIZE) < 0)
-        return false;
+        goto fail_table;
 
     struct map_resolution res;
     M_GetResolution(map, &res);
 
     vec3_t center = M_GetCenterPos(map);
 
-    float xmin = center.x - (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
-    float xmax = center.x + (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
-    float zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
-    float zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+    s_xmin = center.x - (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    s_xmax = center.x + (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    s_zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+    s_zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
 
-    qt_ent_init(&s_postree, xmin, xmax, zmin, zmax);
-    if(!qt_ent_reserve(&s_postree, POSBUF_INIT_SIZE)) {
-        kh_destroy(pos, s_postable);
-        return false;
+    if(s_index == POS_INDEX_GRID) {
+
+        assert(X_COORDS_PER_TILE == Z_COORDS_PER_TILE);
+        if(!grid_init(&s_posgrid, s_xmin, s_xmax, s_zmin, s_zmax,
+            GRID_CELL_TILES * X_COORDS_PER_TILE))
+            goto fail_table;
+        return true;
     }
 
+    if(NULL == (s_rectable = kh_init(rec)))
+        goto fail_table;
+    if(kh_resize(rec, s_rectable, POSBUF_INIT_SIZE) < 0)
+        goto fail_rectable;
+
+    qt_ent_init(&s_postree, s_xmin, s_xmax, s_zmin, s_zmax);
+    if(!qt_ent_reserve(&s_postree, POSBUF_INIT_SIZE))
+        goto fail_rectable;
+
     return true;
+
+fail_rectable:
+    kh_destroy(rec, s_rectable);
+fail_table:
+    kh_destroy(pos, s_postable);
+    return false;
 }
 
 void G_Pos_Shutdown(void)
@@ -180,7 +729,12 @@ void G_Pos_Shutdown(void)
     ASSERT_IN_MAIN_THREAD();
 
     kh_destroy(pos, s_postable);
-    qt_ent_destroy(&s_postree);
+    if(s_index == POS_INDEX_GRID) {
+        grid_destroy(&s_posgrid);
+    }else{
+        qt_ent_destroy(&s_postree);
+        kh_destroy(rec, s_rectable);
+    }
 }
 
 int G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout)
@@ -198,19 +752,12 @@ int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out,
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[maxout];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
-
-    int ntotal = qt_ent_inrange_rect(&s_postree, 
-        xz_min.x, xz_max.x, xz_min.z, xz_max.z, ent_ids, maxout);
+    int ntotal = index_inrange_rect(xz_min, xz_max, out, maxout);
     int ret = 0;
 
     for(int i = 0; i < ntotal; i++) {
 
-        khiter_t k = kh_get(entity, ents, ent_ids[i]);
-        assert(k != kh_end(s_postable));
-        struct entity *curr = kh_val(ents, k);
-
+        struct entity *curr = out[i];
         if(!predicate(curr, arg))
             continue;
 
@@ -222,51 +769,94 @@ int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out,
 int G_Pos_EntsInCircle(vec2_t xz_point, float range, struct entity **out, size_t maxout)
 {
     PERF_ENTER();
-    ASSERT_IN_MAIN_THREAD();
+    ASSERT_CAN_READ();
+
+    int ret = index_inrange_circle(xz_point, range, out, maxout);
+    PERF_RETURN(ret);
+}
+
+void G_Pos_EntsInCircleBatch(const vec2_t *points, size_t npoints, float range,
+                             const struct pos_filter *filters, size_t nfilters,
+                             struct entity **out, size_t maxout, int *out_counts)
+{
+    PERF_ENTER();
+    ASSERT_CAN_READ();
+    assert(nfilters == 0 || nfilters == 1 || nfilters == npoints);
 
-    uint32_t ent_ids[maxout];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
-    for(int i = 0; i < maxout; i++)
-        ent_ids[i] = (uint32_t)-1;
+    struct morton_key *order = morton_order(points, npoints);
 
-    int ret = qt_ent_inrange_circle(&s_postree, 
-        xz_point.x, xz_point.z, range, ent_ids, maxout);
+    for(int i = 0; i < npoints; i++) {
 
-    for(int i = 0; i < ret; i++) {
-        assert(ent_ids[i] != (uint32_t)-1);
-        khiter_t k = kh_get(entity, ents, ent_ids[i]);
-        assert(k != kh_end(s_postable));
-        out[i] = kh_val(ents, k);
+        int idx = order ? order[i].idx : i;
+        const struct pos_filter *filter = (nfilters == 0) ? NULL
+                                        : (nfilters == 1) ? &filters[0]
+                                        : &filters[idx];
+
+        out_counts[idx] = index_inrange_circle_filtered(points[idx], range, filter,
+            out + idx * maxout, maxout);
     }
-    PERF_RETURN(ret);
+
+    free(order);
+    PERF_RETURN_VOID();
+}
+
+void G_Pos_KNearestBatch(const vec2_t *points, size_t npoints, float range,
+                         const struct pos_filter *filters, size_t nfilters,
+                         struct entity **out, size_t maxout, int *out_counts)
+{
+    PERF_ENTER();
+    ASSERT_CAN_READ();
+    assert(nfilters == 0 || nfilters == 1 || nfilters == npoints);
+
+    struct morton_key *order = morton_order(points, npoints);
+
+    for(int i = 0; i < npoints; i++) {
+
+        int idx = order ? order[i].idx : i;
+        const struct pos_filter *filter = (nfilters == 0) ? NULL
+                                        : (nfilters == 1) ? &filters[0]
+                                        : &filters[idx];
+
+        out_counts[idx] = index_nearest(points[idx], range, filter,
+            out + idx * maxout, maxout);
+    }
+
+    free(order);
+    PERF_RETURN_VOID();
 }
 
-struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
-                                     bool (*predicate)(const struct entity *ent, void *arg), 
+struct entity *G_Pos_NearestWithPred(vec2_t xz_point,
+                                     bool (*predicate)(const struct entity *ent, void *arg),
                                      void *arg)
 {
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[MAX_SEARCH_ENTS];
-    const khash_t(entity) *ents = G_GetAllEntsSet();
+    if(s_index == POS_INDEX_GRID) {
 
-    const float qt_len = MAX(s_postree.xmax - s_postree.xmin, s_postree.ymax - s_postree.ymin);
+        struct entity *ret;
+        struct pos_filter filter = (struct pos_filter){
+            .predicate = predicate,
+            .arg = arg,
+        };
+        int nret = grid_nearest(&s_posgrid, xz_point.x, xz_point.z, FLT_MAX, &filter, &ret, 1);
+        PERF_RETURN(nret ? ret : NULL);
+    }
+
+    struct entity *cands[MAX_SEARCH_ENTS];
+
+    const float map_len = MAX(s_xmax - s_xmin, s_zmax - s_zmin);
     float len = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f;
 
-    while(len < qt_len) {
+    while(len < map_len) {
         float min_dist = FLT_MAX;
         struct entity *ret = NULL;
 
-        int num_cands = qt_ent_inrange_circle(&s_postree, xz_point.x, xz_point.z,
-            len, ent_ids, ARR_SIZE(ent_ids));
+        int num_cands = index_inrange_circle(xz_point, len, cands, ARR_SIZE(cands));
 
         for(int i = 0; i < num_cands; i++) {
-        
-            khiter_t k = kh_get(entity, ents, ent_ids[i]);
-            assert(k != kh_end(s_postable));
-            struct entity *curr = kh_val(ents, k);
 
+            struct entity *curr = cands[i];
             vec2_t delta, can_pos_xz = G_Pos_GetXZ(curr->uid);
             PFM_Vec2_Sub(&xz_point, &can_pos_xz, &delta);
 
@@ -279,11 +869,25 @@ struct entity *G_Pos_NearestWithPred(vec2_t xz_point,
         if(ret)
             PERF_RETURN(ret);
 
-        len *= 2.0f; 
+        len *= 2.0f;
     }
     PERF_RETURN(NULL);
 }
 
+void G_Pos_BeginParallelRead(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(!s_parallel_read);
+    s_parallel_read = true;
+}
+
+void G_Pos_EndParallelRead(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(s_parallel_read);
+    s_parallel_read = false;
+}
+
 struct entity *G_Pos_Nearest(vec2_t xz_point)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -38,9 +38,24 @@
 
 struct map;
 
+/* The spatial index used for the position queries. It is chosen through
+ * the 'pf.game.position_index' setting when the map is loaded. The grid
+ * is cheaper to update and to query when there are many similarly sized 
+ * entities spread over the map and the query radii span a few tiles. */
+enum pos_index{
+    POS_INDEX_QUADTREE = 0,
+    POS_INDEX_GRID,
+};
+
 bool G_Pos_Init(const struct map *map);
 void G_Pos_Shutdown(void);
 void G_Pos_Delete(uint32_t uid);
 
+/* Between these calls, 'G_Pos_Get', 'G_Pos_GetXZ' and 'G_Pos_EntsInCircle' 
+ * may also be called from worker threads. No positions may be changed until
+ * the parallel reads are over. */
+void G_Pos_BeginParallelRead(void);
+void G_Pos_EndParallelRead(void);
+
 #endif
 
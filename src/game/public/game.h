@@ -92,6 +92,24 @@ struct render_input{
     vec_ranim_t         light_vis_anim;
 };
 
+/* Narrows down the results of the batched position queries. An entity 
+ * passes the filter when it has all of the 'flags_all' flags and none of 
+ * the 'flags_none' flags set, when its' faction has its' bit set in 
+ * 'faction_mask', when its' selection radius is at least 'min_radius', and
+ * when 'predicate' returns true for it. A zeroed mask and a NULL predicate 
+ * let all the entities through. Only the ENTITY_FLAG_STATIC, 
+ * ENTITY_FLAG_COMBATABLE and ENTITY_FLAG_ZOMBIE flags can be filtered on, 
+ * as these are checked against a copy kept in the spatial index.
+ */
+struct pos_filter{
+    uint32_t  flags_all;
+    uint32_t  flags_none;
+    uint16_t  faction_mask;
+    float     min_radius;
+    bool    (*predicate)(const struct entity *ent, void *arg);
+    void     *arg;
+};
+
 
 /*###########################################################################*/
 /* GAME GENERAL                                                              */
@@ -121,8 +139,9 @@ void   G_SetMinimapResizeMask(int mask);
 bool   G_MouseOverMinimap(void);
 bool   G_MapHeightAtPoint(vec2_t xz, float *out_height);
 bool   G_PointInsideMap(vec2_t xz);
+size_t G_NavMemoryUsage(void);
 
-void   G_BakeNavDataForScene(void);
+bool   G_BakeNavDataForScene(void);
 
 bool   G_AddEntity(struct entity *ent, vec3_t pos);
 bool   G_RemoveEntity(struct entity *ent);
@@ -191,6 +210,28 @@ void G_Move_SetAttackOnLeftClick(void);
 void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz);
 void G_Move_UpdateSelectionRadius(const struct entity *ent, float sel_radius);
 
+/* The rates at which moving entities are steered. Entities with no others 
+ * around them are steered less often, and keep their last velocity in the 
+ * ticks in between. */
+enum move_lod{
+    MOVE_LOD_FULL,      /* every tick */
+    MOVE_LOD_HALF,      /* every 2nd tick */
+    MOVE_LOD_QUARTER,   /* every 4th tick */
+    MOVE_NUM_LODS
+};
+
+/* The following are indexed by 'enum move_lod' */
+struct move_stats{
+    unsigned moving[MOVE_NUM_LODS];       /* entities moving in the last tick */
+    unsigned steered[MOVE_NUM_LODS];      /* entity ticks with new velocities computed */
+    unsigned extrapolated[MOVE_NUM_LODS]; /* entity ticks keeping the last velocity */
+    unsigned escalations;                 /* returns to the full rate */
+    unsigned ticks;
+};
+
+void G_Move_GetStats(struct move_stats *out_stats);
+void G_Move_ClearStats(void);
+
 
 /*###########################################################################*/
 /* GAME COMBAT                                                               */
@@ -217,6 +258,23 @@ float G_Combat_GetBaseArmour(const struct entity *ent);
 void  G_Combat_SetBaseDamage(const struct entity *ent, int dmg);
 int   G_Combat_GetBaseDamage(const struct entity *ent);
 
+/* Entities look for their closest enemy in a grid of all the potential 
+ * targets, which is built once per combat tick. */
+struct combat_stats{
+    unsigned searches;      /* searches answered by the grid, in place of a position query */
+    unsigned fallbacks;     /* searches answered by a position query */
+    unsigned cells_visited;
+    unsigned cells_skipped; /* visited cells with no enemies in them */
+    unsigned candidates;    /* enemies within range that were compared */
+    unsigned early_outs;    /* searches cut short by the closest enemy found so far */
+    unsigned targets_kept;  /* searches in which the last target was still the closest */
+    unsigned targets;       /* entities in the grid in the last tick */
+    unsigned ticks;
+};
+
+void  G_Combat_GetStats(struct combat_stats *out_stats);
+void  G_Combat_ClearStats(void);
+
 
 /*###########################################################################*/
 /* GAME POSITION                                                             */
@@ -225,6 +283,10 @@ int   G_Combat_GetBaseDamage(const struct entity *ent);
 bool   G_Pos_Set(const struct entity *ent, vec3_t pos);
 vec3_t G_Pos_Get(uint32_t uid);
 vec2_t G_Pos_GetXZ(uint32_t uid);
+/* Must be called after changing the flags, the faction or the selection 
+ * radius of an entity that has a position, so that the spatial index can
+ * update its' copy of them. */
+void   G_Pos_UpdateAttrs(const struct entity *ent);
 
 int    G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout);
 int    G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout,
@@ -235,5 +297,20 @@ struct entity *G_Pos_Nearest(vec2_t xz_point);
 struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
                                      bool (*predicate)(const struct entity *ent, void *arg), void *arg);
 
+/* The batched queries answer the queries for all the points in a single pass,
+ * visiting the points in Morton order so that consecutive queries touch the 
+ * same parts of the index. The results for the i-th point are written to 
+ * 'out + i * maxout' and their number to 'out_counts[i]'. 'filters' holds 
+ * no filter, one filter shared by all the points, or one filter per point, 
+ * as given by 'nfilters'. 'G_Pos_KNearestBatch' finds the (up to) 'maxout' 
+ * nearest entities within the range, sorted by their distance from the point.
+ */
+void   G_Pos_EntsInCircleBatch(const vec2_t *points, size_t npoints, float range,
+                               const struct pos_filter *filters, size_t nfilters,
+                               struct entity **out, size_t maxout, int *out_counts);
+void   G_Pos_KNearestBatch(const vec2_t *points, size_t npoints, float range,
+                           const struct pos_filter *filters, size_t nfilters,
+                           struct entity **out, size_t maxout, int *out_counts);
+
 #endif
 
@@ -50,6 +50,8 @@
         mp_ref_t next;                                                                          \
         mp_ref_t prev;                                                                          \
         khint64_t key;                                                                          \
+        /* The value of the cache's clock when the entry was inserted */                        \
+        uint32_t birth;                                                                         \
         type entry;                                                                             \
     } lru_##name##_node_t;                                                                      \
                                                                                                 \
@@ -65,6 +67,8 @@
         mp(name)       node_pool;                                                               \
         /* Optional hook to clean up entries' resources before eviction */                      \
         void           (*on_evict)(type *victim);                                               \
+        /* Maintained by the user in any units - used to timestamp inserted entries */          \
+        uint32_t       clock;                                                                   \
     } lru_##name##_t;
 
 /***********************************************************************************************/
@@ -90,6 +94,18 @@
         }                                                                                       \
     }while(0)
 
+/* Iterate over the entries from least to most recently used. The body may 'break' out of the  \
+ * loop but it must not modify the cache. */                                                    \
+#define LRU_FOREACH_REVERSE(name, _lru, _node, ...)                                             \
+    do{                                                                                         \
+        mp_ref_t curr_ref;                                                                      \
+        for(curr_ref = (_lru)->ilru_tail; curr_ref; curr_ref = _node->prev) {                   \
+            _node = mp_##name##_entry(&((_lru)->node_pool), curr_ref);                          \
+                                                                                                \
+            __VA_ARGS__                                                                         \
+        }                                                                                       \
+    }while(0)
+
 /***********************************************************************************************/
 
 #define LRU_CACHE_PROTOTYPES(scope, name, type)                                                 \
@@ -105,9 +121,15 @@
     scope  bool  lru_##name##_get      (lru(name) *lru, uint64_t key, type *out);               \
     /* Returned pointer is invalidated when new entries are added; it should not be cached  */  \
     scope  const type *lru_##name##_at (lru(name) *lru, uint64_t key);                          \
+    /* Same as 'at', but the entry is not referenced and it may be modified in place        */  \
+    scope  type *lru_##name##_peek     (lru(name) *lru, uint64_t key);                          \
+    /* Same as 'peek', but the node holding the entry is returned                           */  \
+    scope  lru_node(name) *lru_##name##_peek_node(lru(name) *lru, uint64_t key);                \
     scope  bool  lru_##name##_contains (lru(name) *lru, uint64_t key);                          \
     scope  void  lru_##name##_put      (lru(name) *lru, uint64_t key, const type *in);          \
     scope  bool  lru_##name##_remove   (lru(name) *lru, uint64_t key);                          \
+    /* Least recently used entries are evicted until the new capacity is met                */  \
+    scope  bool  lru_##name##_set_capacity(lru(name) *lru, size_t capacity);                    \
 
 /***********************************************************************************************/
 
@@ -221,6 +243,26 @@
         return &mpn->entry;                                                                     \
     }                                                                                           \
                                                                                                 \
+    scope type *lru_##name##_peek(lru(name) *lru, uint64_t key)                                 \
+    {                                                                                           \
+        khiter_t k;                                                                             \
+        if((k = kh_get(name, lru->key_node_table, key)) == kh_end(lru->key_node_table))         \
+            return NULL;                                                                        \
+                                                                                                \
+        mp_ref_t ref = kh_val(lru->key_node_table, k);                                          \
+        return &mp_##name##_entry(&lru->node_pool, ref)->entry;                                 \
+    }                                                                                           \
+                                                                                                \
+    scope lru_node(name) *lru_##name##_peek_node(lru(name) *lru, uint64_t key)                  \
+    {                                                                                           \
+        khiter_t k;                                                                             \
+        if((k = kh_get(name, lru->key_node_table, key)) == kh_end(lru->key_node_table))         \
+            return NULL;                                                                        \
+                                                                                                \
+        mp_ref_t ref = kh_val(lru->key_node_table, k);                                          \
+        return mp_##name##_entry(&lru->node_pool, ref);                                         \
+    }                                                                                           \
+                                                                                                \
     scope bool lru_##name##_contains(lru(name) *lru, uint64_t key)                              \
     {                                                                                           \
         return (lru_##name##_at(lru, key) != NULL);                                             \
@@ -272,6 +314,7 @@
                                                                                                 \
             new_node->entry = *in;                                                              \
             new_node->key = key;                                                                \
+            new_node->birth = lru->clock;                                                       \
                                                                                                 \
             int ret;                                                                            \
             k = kh_put(name, lru->key_node_table, key, &ret);                                   \
@@ -287,6 +330,7 @@
                 lru->on_evict(&mpn->entry);                                                     \
                                                                                                 \
             mpn->entry = *in;                                                                   \
+            mpn->birth = lru->clock;                                                            \
             _lru_##name##_reference(lru, ref);                                                  \
         }                                                                                       \
     }                                                                                           \
@@ -313,6 +357,22 @@
         --lru->used;                                                                            \
         kh_del(name, lru->key_node_table, k);                                                   \
         return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool lru_##name##_set_capacity(lru(name) *lru, size_t capacity)                       \
+    {                                                                                           \
+        if(!mp_##name##_reserve(&lru->node_pool, capacity))                                     \
+            return false;                                                                       \
+                                                                                                \
+        while(lru->used > capacity) {                                                           \
+                                                                                                \
+            lru_node(name) *vict = mp_##name##_entry(&lru->node_pool, lru->ilru_tail);          \
+            if(lru->on_evict)                                                                   \
+                lru->on_evict(&vict->entry);                                                    \
+            lru_##name##_remove(lru, vict->key);                                                \
+        }                                                                                       \
+        lru->capacity = capacity;                                                               \
+        return true;                                                                            \
     }                                                                                           \
 
 #endif
@@ -45,6 +45,8 @@
 /* Hold on to objects by their handles. Unlike pointers, they don't need to be */
 /* invalidated when a realloc takes place. */
 typedef uint16_t mp_ref_t;
+/* The largest number of objects that can be referenced by a handle */
+#define MP_MAX_CAPACITY (UINT16_MAX)
 
 /***********************************************************************************************/
 
@@ -95,25 +97,21 @@ typedef uint16_t mp_ref_t;
         size_t old_cap = mp->capacity;                                                          \
         if(new_cap <= old_cap)                                                                  \
             return true;                                                                        \
+        if(new_cap > MP_MAX_CAPACITY)                                                           \
+            return false;                                                                       \
                                                                                                 \
         mp_##name##_node_t *new_entry = realloc(mp->pool,                                       \
             (new_cap + 1) * sizeof(mp_##name##_node_t));                                        \
         if(!new_entry)                                                                          \
             return false;                                                                       \
                                                                                                 \
-        for(int i = old_cap; i < new_cap; ++i) {                                                \
+        for(int i = old_cap + 1; i < new_cap; ++i) {                                            \
             new_entry[i].inext_free = i + 1;                                                    \
         }                                                                                       \
-        new_entry[new_cap].inext_free = 0;                                                      \
-                                                                                                \
-        if(!mp->ifree_head) {                                                                   \
-            /* Skip the first node - index 0 is used as NULL */                                 \
-            mp->ifree_head = 1;                                                                 \
-        }else {                                                                                 \
-            /* Append at the front */                                                           \
-            new_entry[new_cap].inext_free = mp->ifree_head;                                     \
-            mp->ifree_head = old_cap + 1;                                                       \
-        }                                                                                       \
+        /* Index 0 is used as NULL. The new nodes are put at the front of the free list, */     \
+        /* which is empty when growing a full pool. */                                          \
+        new_entry[new_cap].inext_free = mp->ifree_head;                                         \
+        mp->ifree_head = old_cap + 1;                                                           \
                                                                                                 \
         mp->pool = new_entry;                                                                   \
         mp->capacity = new_cap;                                                                 \
@@ -129,7 +127,10 @@ typedef uint16_t mp_ref_t;
     scope mp_ref_t mp_##name##_alloc(mp(name) *mp)                                              \
     {                                                                                           \
         if(mp->num_allocd == mp->capacity) {                                                    \
-            if(!mp_##name##_reserve(mp, mp->capacity ? mp->capacity * 2 : 32))                  \
+            size_t new_cap = mp->capacity ? mp->capacity * 2 : 32;                              \
+            if(new_cap > MP_MAX_CAPACITY)                                                       \
+                new_cap = MP_MAX_CAPACITY;                                                      \
+            if(new_cap == mp->capacity || !mp_##name##_reserve(mp, new_cap))                    \
                 return 0;                                                                       \
         }                                                                                       \
                                                                                                 \
@@ -368,10 +368,10 @@
                                                                                                 \
     static bool _qt_##name##_node_sib_append(qt(name) *qt, mp_ref_t ref, type record)           \
     {                                                                                           \
-        qt_node(name) *node = mp_##name##_entry(&qt->node_pool, ref);                           \
-                                                                                                \
+        /* Allocating may move the pool, so the node is looked up afterwards */                 \
         mp_ref_t sib = mp_##name##_alloc(&qt->node_pool);                                       \
         _CHK_TRUE_RET(sib, false);                                                              \
+        qt_node(name) *node = mp_##name##_entry(&qt->node_pool, ref);                           \
                                                                                                 \
         qt_node(name) *sib_node = mp_##name##_entry(&qt->node_pool, sib);                       \
         _qt_##name##_node_init(sib_node, 0);                                                    \
@@ -499,6 +499,7 @@
         float saved_y = node->y;                                                                \
         type saved_record = node->record;                                                       \
         mp_ref_t saved_sibnext = node->sibling_next;                                            \
+        mp_ref_t child;                                                                         \
                                                                                                 \
         node->sibling_next = 0;                                                                 \
         node->has_record = false;                                                               \
@@ -514,10 +515,19 @@
             _qt_##name##_set_divide_coords(qt, parent, ref);                                    \
         }                                                                                       \
                                                                                                 \
-        _CHK_TRUE_JMP((node->nw = mp_##name##_alloc(&qt->node_pool)), fail);                    \
-        _CHK_TRUE_JMP((node->ne = mp_##name##_alloc(&qt->node_pool)), fail);                    \
-        _CHK_TRUE_JMP((node->sw = mp_##name##_alloc(&qt->node_pool)), fail);                    \
-        _CHK_TRUE_JMP((node->se = mp_##name##_alloc(&qt->node_pool)), fail);                    \
+        /* Allocating may move the pool, so the node is looked up again after each */           \
+        _CHK_TRUE_JMP((child = mp_##name##_alloc(&qt->node_pool)), fail);                       \
+        node = mp_##name##_entry(&qt->node_pool, ref);                                          \
+        node->nw = child;                                                                       \
+        _CHK_TRUE_JMP((child = mp_##name##_alloc(&qt->node_pool)), fail);                       \
+        node = mp_##name##_entry(&qt->node_pool, ref);                                          \
+        node->ne = child;                                                                       \
+        _CHK_TRUE_JMP((child = mp_##name##_alloc(&qt->node_pool)), fail);                       \
+        node = mp_##name##_entry(&qt->node_pool, ref);                                          \
+        node->sw = child;                                                                       \
+        _CHK_TRUE_JMP((child = mp_##name##_alloc(&qt->node_pool)), fail);                       \
+        node = mp_##name##_entry(&qt->node_pool, ref);                                          \
+        node->se = child;                                                                       \
                                                                                                 \
         /* NW node */                                                                           \
         curr = mp_##name##_entry(&qt->node_pool, node->nw);                                     \
@@ -689,6 +699,7 @@
         /* existing point and the new point lie in different quadrants */                       \
         do{                                                                                     \
             _CHK_TRUE_RET(_qt_##name##_partition(qt, curr_ref), false);                         \
+            curr_node = mp_##name##_entry(&qt->node_pool, curr_ref);                            \
             assert(!curr_node->has_record);                                                     \
                                                                                                 \
             curr_ref = _qt_##name##_quadrant(curr_node, x, y);                                  \
@@ -50,6 +50,7 @@
 #include "settings.h"
 #include "session.h"
 #include "perf.h"
+#include "task.h"
 
 #include <stdbool.h>
 #include <assert.h>
@@ -403,6 +404,11 @@ static bool engine_init(char **argv)
     Perf_RegisterThread(g_main_thread_id, "main");
     Perf_RegisterThread(g_render_thread_id, "render");
 
+    if(!Task_Init()) {
+        fprintf(stderr, "Failed to initialize the worker thread pool.\n");
+        goto fail_task;
+    }
+
     if(!AL_Init()) {
         fprintf(stderr, "Failed to initialize asset-loading module.\n");
         goto fail_al;
@@ -466,6 +472,8 @@ fail_render:
 fail_cursor:
     AL_Shutdown();
 fail_al:
+    Task_Shutdown();
+fail_task:
 fail_render_init:
     render_thread_quit();
 fail_rthread:
@@ -503,6 +511,7 @@ static void engine_shutdown(void)
 
     Cursor_FreeAll();
     AL_Shutdown();
+    Task_Shutdown();
     E_Shutdown();
     Perf_Shutdown();
 
@@ -376,9 +376,9 @@ void M_NavCutoutStaticObject(const struct map *map, const struct obb *obb)
     N_CutoutStaticObject(map->nav_private, map->pos, obb);
 }
 
-void M_NavUpdatePortals(const struct map *map)
+bool M_NavUpdatePortals(const struct map *map)
 {
-    N_UpdatePortals(map->nav_private);
+    return N_UpdatePortals(map->nav_private);
 }
 
 void M_NavUpdateIslandsField(const struct map *map)
@@ -386,12 +386,39 @@ void M_NavUpdateIslandsField(const struct map *map)
     N_UpdateIslandsField(map->nav_private);
 }
 
+bool M_NavLoadCachedData(const struct map *map)
+{
+    return N_LoadCachedNavData(map->nav_private);
+}
+
+void M_NavSaveCachedData(const struct map *map)
+{
+    N_SaveCachedNavData(map->nav_private);
+}
+
+size_t M_NavMemoryUsage(const struct map *map)
+{
+    return N_MemoryUsage(map->nav_private);
+}
+
 bool M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
                       dest_id_t *out_dest_id)
 {
     return N_RequestPath(map->nav_private, xz_src, xz_dest, map->pos, out_dest_id);
 }
 
+bool M_NavRequestPathAsync(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                           path_ticket_t *out_ticket)
+{
+    return N_RequestPathAsync(map->nav_private, xz_src, xz_dest, map->pos, out_ticket);
+}
+
+bool M_NavRequestCorridor(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                          dest_id_t *out_dest_id)
+{
+    return N_RequestCorridor(map->nav_private, xz_src, xz_dest, map->pos, out_dest_id);
+}
+
 void M_NavRenderVisiblePathFlowField(const struct map *map, const struct camera *cam, dest_id_t id)
 {
     struct frustum frustum;
@@ -483,6 +510,17 @@ vec2_t M_NavDesiredEnemySeekVelocity(const struct map *map, vec2_t curr_pos, int
     return N_DesiredEnemySeekVelocity(curr_pos, map->nav_private, map->pos, faction_id);
 }
 
+void M_NavUpdateFactionPresence(const struct map *map, uint32_t uid, int faction_id, 
+                                vec2_t xz_pos)
+{
+    N_UpdateFactionPresence(map->nav_private, map->pos, uid, faction_id, xz_pos);
+}
+
+void M_NavRemoveFactionPresence(const struct map *map, uint32_t uid)
+{
+    N_RemoveFactionPresence(map->nav_private, uid);
+}
+
 bool M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos)
 {
     return N_HasDestLOS(id, curr_pos, map->nav_private, map->pos);
@@ -519,6 +557,16 @@ void M_NavBlockersDecref(vec2_t xz_pos, float range, const struct map *map)
     N_BlockersDecref(xz_pos, range, map->pos, map->nav_private);
 }
 
+void M_NavBlockersQueueIncref(vec2_t xz_pos, float range, const struct map *map)
+{
+    N_BlockersQueueIncref(xz_pos, range, map->pos, map->nav_private);
+}
+
+void M_NavBlockersQueueDecref(vec2_t xz_pos, float range, const struct map *map)
+{
+    N_BlockersQueueDecref(xz_pos, range, map->pos, map->nav_private);
+}
+
 bool M_TileForDesc(const struct map *map, struct tile_desc desc, struct tile **out)
 {
     if(desc.chunk_r < 0 || desc.chunk_r >= map->height)
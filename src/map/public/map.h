@@ -212,9 +212,10 @@ void   M_NavCutoutStaticObject(const struct map *map, const struct obb *obb);
 /* ------------------------------------------------------------------------
  * Update navigation private data after changes to the cost field.
  * (ex. to remove a path in case it was blocked off by a placed object)
+ * Returns false on failure, in which case the portal data is incomplete.
  * ------------------------------------------------------------------------
  */
-void   M_NavUpdatePortals(const struct map *map);
+bool   M_NavUpdatePortals(const struct map *map);
 
 /* ------------------------------------------------------------------------
  * Update navigation private data (regarding which tile is reachanble from
@@ -223,6 +224,27 @@ void   M_NavUpdatePortals(const struct map *map);
  */
 void   M_NavUpdateIslandsField(const struct map *map);
 
+/* ------------------------------------------------------------------------
+ * Load the navigation data for the current cost field (accounting for all
+ * cut out static objects) from disk, in place of updating the portals and
+ * islands. Returns false if there is no data for the cost field.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavLoadCachedData(const struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Save the navigation data for the current cost field to disk, so that it
+ * can be loaded with 'M_NavLoadCachedData' the next time.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavSaveCachedData(const struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Returns the number of bytes used by the map's navigation data.
+ * ------------------------------------------------------------------------
+ */
+size_t M_NavMemoryUsage(const struct map *map);
+
 /* ------------------------------------------------------------------------
  * Makes a path request to the navigation subsystem, causing the required
  * flowfields to be generated and cached. Returns true if a successful path
@@ -232,6 +254,23 @@ void   M_NavUpdateIslandsField(const struct map *map);
 bool   M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
                         dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Like 'M_NavRequestPath', but the flowfields are generated over the next 
+ * frames. Returns false if the request could not be made.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavRequestPathAsync(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                             path_ticket_t *out_ticket);
+
+/* ------------------------------------------------------------------------
+ * Like 'M_NavRequestPath', but a corridor of waypoints is made in place of
+ * the flowfields. Meant for small groups. Returns false if the corridor 
+ * could not be made.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavRequestCorridor(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                            dest_id_t *out_dest_id);
+
 /* ------------------------------------------------------------------------
  * Render the flow field that will steer entities towards a particular 
  * destination over the map surface.
@@ -256,6 +295,21 @@ vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id,
  */
 vec2_t M_NavDesiredEnemySeekVelocity(const struct map *map, vec2_t curr_pos, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Update the position of a combatable entity, as used for guiding the 
+ * entities of other factions towards their enemies.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavUpdateFactionPresence(const struct map *map, uint32_t uid, int faction_id, 
+                                  vec2_t xz_pos);
+
+/* ------------------------------------------------------------------------
+ * Stop taking the entity into account when guiding entities towards their
+ * enemies.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavRemoveFactionPresence(const struct map *map, uint32_t uid);
+
 /* ------------------------------------------------------------------------
  * Returns true if the specified coordinate is in direct line of sight of 
  * the specified destination.
@@ -287,6 +341,15 @@ vec2_t M_NavClosestReachableDest(const struct map *map, vec2_t xz_src, vec2_t xz
 void   M_NavBlockersIncref(vec2_t xz_pos, float range, const struct map *map);
 void   M_NavBlockersDecref(vec2_t xz_pos, float range, const struct map *map);
 
+/* ------------------------------------------------------------------------
+ * Like the above, but the changes are queued up and applied together, once
+ * per tick. Changes that cancel out (such as an entity stopping and then 
+ * starting again in the same place) are dropped.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavBlockersQueueIncref(vec2_t xz_pos, float range, const struct map *map);
+void   M_NavBlockersQueueDecref(vec2_t xz_pos, float range, const struct map *map);
+
 /* ------------------------------------------------------------------------
  * Wrapper around navigation APIs.
  * ------------------------------------------------------------------------
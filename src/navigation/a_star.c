@@ -36,52 +36,249 @@
 #include "a_star.h"
 #include "nav_private.h"
 #include "../perf.h"
-#include "../lib/public/pqueue.h"
-#include "../lib/public/khash.h"
 #include "fieldcache.h"
+#include "landmarks.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <SDL.h>
+
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define GRID_NODES      (FIELD_RES_R * FIELD_RES_C)
+#define HEAP_ARITY      (4)
+#define NODE_NONE       (~((uint32_t)0))
+
+struct heap_node{
+    float    prio;
+    uint32_t node;
+};
+
+/* Search state, allocated once per thread. The per-node arrays are only
+ * valid for those nodes whose 'node_gen' matches the generation of the
+ * current search, so they never need to be cleared between searches.
+ * The open set is a 4-ary min-heap, with the heap position of every open
+ * node kept in 'heap_idx' so that its' priority can be decreased in place.
+ */
+struct astar_ctx{
+    uint32_t          gen;
+    size_t            capacity;
+    uint32_t         *node_gen;
+    float            *cost;
+    uint32_t         *came_from;
+    uint32_t         *heap_idx;
+    uint64_t         *closed;
+    struct heap_node *heap;
+    size_t            heap_size;
+};
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
-
-PQUEUE_TYPE(portal, const struct portal*)
-PQUEUE_IMPL(static, portal, const struct portal*)
-
-KHASH_MAP_INIT_INT64(key_coord, struct coord)
-KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
-KHASH_MAP_INIT_INT64(key_float, float)
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define kh_put_val(name, table, key, val)               \
-    do{                                                 \
-        int ret;                                        \
-        khiter_t k = kh_put(name, table, key, &ret);    \
-        assert(ret != -1);                              \
-        kh_value(table, k) = val;                       \
-    }while(0)
+static SDL_TLSID s_ctx_tls = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static uint64_t coord_to_key(struct coord c)
+static void ctx_free(void *arg)
+{
+    struct astar_ctx *ctx = arg;
+    if(!ctx)
+        return;
+
+    free(ctx->node_gen);
+    free(ctx->cost);
+    free(ctx->came_from);
+    free(ctx->heap_idx);
+    free(ctx->closed);
+    free(ctx->heap);
+    free(ctx);
+}
+
+static bool ctx_reserve(struct astar_ctx *ctx, size_t nnodes)
+{
+    if(ctx->capacity >= nnodes)
+        return true;
+
+    void *node_gen, *cost, *came_from, *heap_idx, *closed, *heap;
+    if(!(node_gen = realloc(ctx->node_gen, nnodes * sizeof(ctx->node_gen[0]))))
+        return false;
+    ctx->node_gen = node_gen;
+    if(!(cost = realloc(ctx->cost, nnodes * sizeof(ctx->cost[0]))))
+        return false;
+    ctx->cost = cost;
+    if(!(came_from = realloc(ctx->came_from, nnodes * sizeof(ctx->came_from[0]))))
+        return false;
+    ctx->came_from = came_from;
+    if(!(heap_idx = realloc(ctx->heap_idx, nnodes * sizeof(ctx->heap_idx[0]))))
+        return false;
+    ctx->heap_idx = heap_idx;
+    if(!(closed = realloc(ctx->closed, (nnodes + 63) / 64 * sizeof(ctx->closed[0]))))
+        return false;
+    ctx->closed = closed;
+    if(!(heap = realloc(ctx->heap, nnodes * sizeof(ctx->heap[0]))))
+        return false;
+    ctx->heap = heap;
+
+    /* Restart the generations for the resized arrays */
+    memset(ctx->node_gen, 0, nnodes * sizeof(ctx->node_gen[0]));
+    ctx->gen = 0;
+    ctx->capacity = nnodes;
+    return true;
+}
+
+static struct astar_ctx *ctx_get(size_t nnodes)
+{
+    struct astar_ctx *ctx = SDL_TLSGet(s_ctx_tls);
+    if(!ctx) {
+
+        ctx = calloc(1, sizeof(struct astar_ctx));
+        if(!ctx)
+            return NULL;
+        if(0 != SDL_TLSSet(s_ctx_tls, ctx, ctx_free)) {
+            free(ctx);
+            return NULL;
+        }
+    }
+
+    if(!ctx_reserve(ctx, nnodes))
+        return NULL;
+    return ctx;
+}
+
+static void ctx_begin(struct astar_ctx *ctx, size_t nnodes)
+{
+    assert(nnodes <= ctx->capacity);
+    if(++ctx->gen == 0) {
+        memset(ctx->node_gen, 0, ctx->capacity * sizeof(ctx->node_gen[0]));
+        ctx->gen = 1;
+    }
+    memset(ctx->closed, 0, (nnodes + 63) / 64 * sizeof(ctx->closed[0]));
+    ctx->heap_size = 0;
+}
+
+static bool ctx_seen(const struct astar_ctx *ctx, uint32_t node)
+{
+    return (ctx->node_gen[node] == ctx->gen);
+}
+
+static bool ctx_closed(const struct astar_ctx *ctx, uint32_t node)
+{
+    return !!(ctx->closed[node / 64] & (((uint64_t)1) << (node % 64)));
+}
+
+static void ctx_set_closed(struct astar_ctx *ctx, uint32_t node, bool closed)
+{
+    if(closed)
+        ctx->closed[node / 64] |= (((uint64_t)1) << (node % 64));
+    else
+        ctx->closed[node / 64] &= ~(((uint64_t)1) << (node % 64));
+}
+
+static void heap_place(struct astar_ctx *ctx, size_t idx, struct heap_node hn)
+{
+    ctx->heap[idx] = hn;
+    ctx->heap_idx[hn.node] = idx;
+}
+
+static void heap_sift_up(struct astar_ctx *ctx, size_t idx)
+{
+    struct heap_node hn = ctx->heap[idx];
+    while(idx > 0) {
+
+        size_t parent = (idx - 1) / HEAP_ARITY;
+        if(ctx->heap[parent].prio <= hn.prio)
+            break;
+        heap_place(ctx, idx, ctx->heap[parent]);
+        idx = parent;
+    }
+    heap_place(ctx, idx, hn);
+}
+
+static void heap_sift_down(struct astar_ctx *ctx, size_t idx)
+{
+    struct heap_node hn = ctx->heap[idx];
+    while(true) {
+
+        size_t first = idx * HEAP_ARITY + 1;
+        if(first >= ctx->heap_size)
+            break;
+
+        size_t last = MIN(first + HEAP_ARITY, ctx->heap_size);
+        size_t min = first;
+        for(size_t i = first + 1; i < last; i++) {
+            if(ctx->heap[i].prio < ctx->heap[min].prio)
+                min = i;
+        }
+
+        if(ctx->heap[min].prio >= hn.prio)
+            break;
+        heap_place(ctx, idx, ctx->heap[min]);
+        idx = min;
+    }
+    heap_place(ctx, idx, hn);
+}
+
+static uint32_t heap_pop(struct astar_ctx *ctx)
+{
+    assert(ctx->heap_size > 0);
+    uint32_t ret = ctx->heap[0].node;
+
+    if(--ctx->heap_size > 0) {
+        heap_place(ctx, 0, ctx->heap[ctx->heap_size]);
+        heap_sift_down(ctx, 0);
+    }
+    return ret;
+}
+
+/* Update the cost of reaching the node if the new cost is lower than the
+ * current one, (re-)inserting it into the open set as necessary. */
+static void relax(struct astar_ctx *ctx, uint32_t node, uint32_t parent,
+                  float cost, float prio)
+{
+    bool seen = ctx_seen(ctx, node);
+    if(seen && cost >= ctx->cost[node])
+        return;
+
+    bool in_heap = seen && !ctx_closed(ctx, node);
+    ctx->node_gen[node] = ctx->gen;
+    ctx->cost[node] = cost;
+    ctx->came_from[node] = parent;
+
+    if(in_heap) {
+        size_t idx = ctx->heap_idx[node];
+        ctx->heap[idx].prio = prio;
+        heap_sift_up(ctx, idx);
+    }else{
+        ctx_set_closed(ctx, node, false);
+        heap_place(ctx, ctx->heap_size++, (struct heap_node){prio, node});
+        heap_sift_up(ctx, ctx->heap_size - 1);
+    }
+}
+
+static uint32_t coord_to_node(struct coord c)
+{
+    return c.r * FIELD_RES_C + c.c;
+}
+
+static struct coord node_to_coord(uint32_t node)
 {
-    return (((uint64_t)c.r) << 32) | (((uint64_t)c.c) & ~((uint32_t)0));
+    return (struct coord){node / FIELD_RES_C, node % FIELD_RES_C};
 }
 
-static uint64_t portal_to_key(const struct portal *p)
+static uint32_t portal_to_node(const struct nav_private *priv, const struct portal *p)
 {
-    return (((uint64_t)p->chunk.r & 0xffff)      << 48)
-         | (((uint64_t)p->chunk.c & 0xffff)      << 32)
-         | (((uint64_t)p->endpoints[0].r & 0xff) << 24)
-         | (((uint64_t)p->endpoints[0].c & 0xff) << 16)
-         | (((uint64_t)p->endpoints[1].r & 0xff) <<  8)
-         | (((uint64_t)p->endpoints[1].c & 0xff) <<  0);
+    size_t chunk_idx = p->chunk.r * priv->width + p->chunk.c;
+    return chunk_idx * MAX_PORTALS_PER_CHUNK + (p - priv->chunks[chunk_idx].portals);
+}
+
+static const struct portal *node_to_portal(const struct nav_private *priv, uint32_t node)
+{
+    return &priv->chunks[node / MAX_PORTALS_PER_CHUNK].portals[node % MAX_PORTALS_PER_CHUNK];
 }
 
 static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
@@ -171,88 +368,49 @@ static float portal_node_penalty(void)
     return sqrt(pow(FIELD_RES_R, 2.0f) + pow(FIELD_RES_C, 2.0f));
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
-                    const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
-                    vec_coord_t *out_path, float *out_cost)
+static bool grid_path(struct coord start, struct coord finish,
+                      const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C],
+                      vec_coord_t *out_path, float *out_cost)
 {
-    PERF_ENTER();
-
-    struct grid_path_desc gp = {0};
-    vec_coord_init(&gp.path);
-
-    if(N_FC_GetGridPath(start, finish, chunk, &gp)) {
-
-        if(!gp.exists)
-            PERF_RETURN(false);
+    struct astar_ctx *ctx = ctx_get(GRID_NODES);
+    if(!ctx)
+        return false;
 
-        *out_cost = gp.cost;
-        vec_coord_copy(out_path, &gp.path);
-        PERF_RETURN(true);
-    }
+    ctx_begin(ctx, GRID_NODES);
+    relax(ctx, coord_to_node(start), NODE_NONE, 0.0f, 0.0f);
 
-    pq_coord_t          frontier;
-    khash_t(key_coord) *came_from;
-    khash_t(key_float) *running_cost;
-    
-    pq_coord_init(&frontier);
-    if(NULL == (came_from = kh_init(key_coord)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    const uint32_t finish_node = coord_to_node(finish);
+    while(ctx->heap_size > 0) {
 
-    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
-    pq_coord_push(&frontier, 0.0f, start);
+        uint32_t curr_node = heap_pop(ctx);
+        ctx_set_closed(ctx, curr_node, true);
 
-    while(pq_size(&frontier) > 0) {
-
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
-
-        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+        if(curr_node == finish_node)
             break;
 
         struct coord neighbours[8];
         float neighbour_costs[8];
-        int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+        int num_neighbours = neighbours_grid(cost_field, node_to_coord(curr_node),
+            neighbours, neighbour_costs);
 
         for(int i = 0; i < num_neighbours; i++) {
 
-            struct coord *next = &neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
-
-            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
-
-                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
-                float priority = new_cost + heuristic(finish, *next);
-                pq_coord_push(&frontier, priority, *next);
-                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
-            }
+            float new_cost = ctx->cost[curr_node] + neighbour_costs[i];
+            float priority = new_cost + heuristic(finish, neighbours[i]);
+            relax(ctx, coord_to_node(neighbours[i]), curr_node, new_cost, priority);
         }
     }
-    
-    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
-        goto fail_find_path;
+
+    if(!ctx_seen(ctx, finish_node) || ctx->came_from[finish_node] == NODE_NONE)
+        return false;
 
     vec_coord_reset(out_path);
 
-    /* We have our path at this point. Walk backwards along the path to build a 
+    /* We have our path at this point. Walk backwards along the path to build a
      * vector of the nodes along the path. */
-    struct coord curr = finish;
-    while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
-
-        vec_coord_push(out_path, curr);
-        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
-        assert(k != kh_end(came_from));
-        curr = kh_value(came_from, k);
+    for(uint32_t curr = finish_node; curr != NODE_NONE; curr = ctx->came_from[curr]) {
+        vec_coord_push(out_path, node_to_coord(curr));
     }
-    vec_coord_push(out_path, start);
 
     /* Reverse the path vector */
     for(int i = 0, j = vec_size(out_path) - 1; i < j; i++, j--) {
@@ -261,118 +419,140 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
         vec_AT(out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, coord_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
+    *out_cost = ctx->cost[finish_node];
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool AStar_Init(void)
+{
+    s_ctx_tls = SDL_TLSCreate();
+    return (s_ctx_tls != 0);
+}
+
+void AStar_Shutdown(void)
+{
+    ctx_free(SDL_TLSGet(s_ctx_tls));
+    SDL_TLSSet(s_ctx_tls, NULL, NULL);
+}
+
+bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
+                    const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                    vec_coord_t *out_path, float *out_cost)
+{
+    PERF_ENTER();
+
+    struct grid_path_desc gp = {0};
+    vec_coord_init(&gp.path);
+
+    if(N_FC_GetGridPath(start, finish, chunk, &gp)) {
+
+        if(!gp.exists)
+            PERF_RETURN(false);
 
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_coord, came_from);
+        *out_cost = gp.cost;
+        vec_coord_copy(out_path, &gp.path);
+        PERF_RETURN(true);
+    }
 
     /* Cache the result */
-    gp.exists = true;
-    vec_coord_copy(&gp.path, out_path);
-    gp.cost = *out_cost;
+    gp.exists = grid_path(start, finish, cost_field, out_path, out_cost);
+    if(gp.exists) {
+        vec_coord_copy(&gp.path, out_path);
+        gp.cost = *out_cost;
+    }
     N_FC_PutGridPath(start, finish, chunk, &gp);
-    PERF_RETURN(true);
+    PERF_RETURN(gp.exists);
+}
 
-fail_find_path:
-    gp.exists = false;
-    N_FC_PutGridPath(start, finish, chunk, &gp);
+bool AStar_GridPathUncached(struct coord start, struct coord finish,
+                            const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                            vec_coord_t *out_path, float *out_cost)
+{
+    PERF_ENTER();
+    bool ret = grid_path(start, finish, cost_field, out_path, out_cost);
+    PERF_RETURN(ret);
+}
 
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_coord, came_from);
-fail_came_from:
-    PERF_RETURN(false);
+float AStar_PortalHopCost(float edge_cost)
+{
+    return edge_cost + portal_node_penalty();
 }
 
-bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish, 
-                           const struct nav_private *priv, 
+bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish,
+                           const struct nav_private *priv,
                            vec_portal_t *out_path, float *out_cost)
 {
     PERF_ENTER();
 
-    pq_portal_t          frontier;
-    khash_t(key_portal) *came_from;
-    khash_t(key_float)  *running_cost;
-    
-    pq_portal_init(&frontier);
-    if(NULL == (came_from = kh_init(key_portal)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    const size_t nnodes = priv->width * priv->height * MAX_PORTALS_PER_CHUNK;
+    struct astar_ctx *ctx = ctx_get(nnodes);
+    if(!ctx)
+        PERF_RETURN(false);
 
+    ctx_begin(ctx, nnodes);
     const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
-    vec_coord_t path;
-    vec_coord_init(&path);
 
-    /* Intitialize the frontier with all the portals in the source chunk that are 
-     * reachable from the source tile. */
+    /* The landmark bounds never overestimate the cost to the finish, even as 
+     * edges become blocked, so the first path found is still the shortest. */
+    struct landmark_target lt;
+    bool use_landmarks = N_LandmarksTarget(priv, finish, &lt);
+
+    /* Intitialize the frontier with all the portals in the source chunk that are
+     * reachable from the source tile. Portals in other components than the finish
+     * can't lead to it, so if there are no others, no search is necessary. */
     for(int i = 0; i < chunk->num_portals; i++) {
 
         const struct portal *port = &chunk->portals[i];
         struct coord tile_coord = (struct coord){start_tile.tile_r, start_tile.tile_c};
 
+        if(port->component_id != finish->component_id)
+            continue;
+
         if(N_PortalReachableFromTile(port, tile_coord, chunk)) {
 
-            float cost = chunk->portal_travel_costs[i][tile_coord.r][tile_coord.c];
+            float cost = N_PortalTravelCost(chunk, i, tile_coord);
             if(cost != FLT_MAX) {
-            
-                kh_put_val(key_float, running_cost, portal_to_key(port), cost);
-                pq_portal_push(&frontier, cost, port);
+                float bound = use_landmarks ? N_LandmarksLowerBound(priv, &lt, port) : 0.0f;
+                relax(ctx, portal_to_node(priv, port), NODE_NONE, cost, cost + bound);
             }
         }
     }
-    vec_coord_destroy(&path);
 
-    while(pq_size(&frontier) > 0) {
+    const uint32_t finish_node = portal_to_node(priv, finish);
+    while(ctx->heap_size > 0) {
 
-        const struct portal *curr;
-        pq_portal_pop(&frontier, &curr);
+        uint32_t curr_node = heap_pop(ctx);
+        ctx_set_closed(ctx, curr_node, true);
 
-        if(curr == finish)
+        if(curr_node == finish_node)
             break;
 
         const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
         float neighbour_costs[MAX_PORTALS_PER_CHUNK];
-        int num_neighbours = neighbours_portal_graph(curr, neighbours, neighbour_costs);
+        int num_neighbours = neighbours_portal_graph(node_to_portal(priv, curr_node),
+            neighbours, neighbour_costs);
 
         for(int i = 0; i < num_neighbours; i++) {
 
-            const struct portal *next = neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i] + portal_node_penalty();
-
-            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
-
-                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
-                /* No heuristic used - effectively Dijkstra's algorithm */
-                float priority = new_cost;
-                pq_portal_push(&frontier, priority, next);
-                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
-            }
+            float new_cost = ctx->cost[curr_node] + AStar_PortalHopCost(neighbour_costs[i]);
+            float bound = use_landmarks ? N_LandmarksLowerBound(priv, &lt, neighbours[i]) : 0.0f;
+            relax(ctx, portal_to_node(priv, neighbours[i]), curr_node, new_cost, new_cost + bound);
         }
     }
-    
-    if(kh_get(key_portal, came_from, portal_to_key(finish)) == kh_end(came_from))
-        goto fail_find_path;
+
+    if(!ctx_seen(ctx, finish_node) || ctx->came_from[finish_node] == NODE_NONE)
+        PERF_RETURN(false);
 
     vec_portal_reset(out_path);
 
-    /* We have our path at this point. Walk backwards along the path to build a 
+    /* We have our path at this point. Walk backwards along the path to build a
      * vector of the nodes along the path. */
-    const struct portal *curr = finish;
-    while(true) {
-
-        vec_portal_push(out_path, (struct portal*)curr);
-        khiter_t k = kh_get(key_portal, came_from, portal_to_key(curr));
-        if(k == kh_end(came_from))
-            break;
-        curr = kh_value(came_from, k);
+    for(uint32_t curr = finish_node; curr != NODE_NONE; curr = ctx->came_from[curr]) {
+        vec_portal_push(out_path, (struct portal*)node_to_portal(priv, curr));
     }
 
     /* Reverse the path vector */
@@ -382,22 +562,6 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
         vec_AT(out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, portal_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
-
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_portal, came_from);
-
+    *out_cost = ctx->cost[finish_node];
     PERF_RETURN(true);
-
-fail_find_path:
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_portal, came_from);
-fail_came_from:
-    PERF_RETURN(false);
 }
-
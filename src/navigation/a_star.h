@@ -51,6 +51,13 @@ VEC_TYPE(portal, struct portal *)
 VEC_IMPL(static inline, portal, struct portal *)
 
 
+/* ------------------------------------------------------------------------
+ * Set up and tear down the per-thread search state.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_Init(void);
+void AStar_Shutdown(void);
+
 /* ------------------------------------------------------------------------
  * Finds the shortest path in a rectangular cost field. Returns true if a 
  * path is found, false otherwise. If returning true, 'out_path' holds the
@@ -61,6 +68,15 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
                     vec_coord_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * The same as 'AStar_GridPath', but bypasses the grid path cache. This 
+ * makes it safe to call concurrently from multiple threads.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_GridPathUncached(struct coord start, struct coord finish,
+                            const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                            vec_coord_t *out_path, float *out_cost);
+
 /* ------------------------------------------------------------------------
  * Finds the shortest path between a tile and a node in a portal graph. Returns 
  * true if a path is found, false otherwise. If returning true, 'out_path' holds 
@@ -71,5 +87,12 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
                            const struct nav_private *priv, 
                            vec_portal_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * The cost that is added to a path in the portal graph when it follows an
+ * edge with the specified cost.
+ * ------------------------------------------------------------------------
+ */
+float AStar_PortalHopCost(float edge_cost);
+
 #endif
 
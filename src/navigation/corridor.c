@@ -0,0 +1,541 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "corridor.h"
+#include "nav_private.h"
+#include "../lib/public/khash.h"
+#include "../config.h"
+#include "../perf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#define IDX(r, width, c)    ((r) * (width) + (c))
+#define SLOT_NONE           (-1)
+#define EPSILON             (1.0f / 1024)
+/* How far (in tiles) an entity can stray from a corridor before it
+ * has to fall back to the fields */
+#define MAX_DEVIATION       (2.5f)
+/* Entities closer than this (in tiles) to the line of the corridor 
+ * are trusted to be able to follow it without checking */
+#define ON_LINE_DIST        (0.45f)
+/* Entities this close (in tiles) to a waypoint head for the next one */
+#define WAYPOINT_REACHED    (0.5f)
+
+struct corridor{
+    dest_id_t id;
+    /* The next slot holding a corridor to the same destination */
+    int       next;
+    uint32_t  last_used;
+    size_t    npoints;
+    vec2_t   *points;
+};
+
+KHASH_MAP_INIT_INT(head, int)
+
+struct corridors{
+    /* The first slot holding a corridor to every destination */
+    khash_t(head)  *heads;
+    uint32_t        clock;
+    struct corridor slots[CONFIG_NAV_MAX_CORRIDORS];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static struct coord global_tile(struct tile_desc td)
+{
+    return (struct coord){
+        td.chunk_r * FIELD_RES_R + td.tile_r,
+        td.chunk_c * FIELD_RES_C + td.tile_c
+    };
+}
+
+/* The position in units of tiles from the map's corner, with X along the 
+ * columns and Z along the rows */
+static vec2_t tile_space_pos(vec3_t map_pos, vec2_t pos)
+{
+    vec2_t tile_dims = N_TileDims();
+    return (vec2_t){
+        (map_pos.x - pos.x) / tile_dims.x,
+        (pos.z - map_pos.z) / tile_dims.z
+    };
+}
+
+static vec2_t tile_space_center(struct coord tile)
+{
+    return (vec2_t){tile.c + 0.5f, tile.r + 0.5f};
+}
+
+static struct coord global_tile_for_pos(vec3_t map_pos, vec2_t pos)
+{
+    vec2_t tpos = tile_space_pos(map_pos, pos);
+    return (struct coord){floorf(tpos.z), floorf(tpos.x)};
+}
+
+static vec2_t tile_center(vec3_t map_pos, struct coord tile)
+{
+    vec2_t tile_dims = N_TileDims();
+    return (vec2_t){
+        map_pos.x - (tile.c + 0.5f) * tile_dims.x,
+        map_pos.z + (tile.r + 0.5f) * tile_dims.z
+    };
+}
+
+static bool tile_passable(const struct nav_private *priv, int r, int c)
+{
+    if(r < 0 || r >= priv->height * FIELD_RES_R)
+        return false;
+    if(c < 0 || c >= priv->width * FIELD_RES_C)
+        return false;
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(r / FIELD_RES_R, priv->width, c / FIELD_RES_C)];
+    return (chunk->cost_base[r % FIELD_RES_R][c % FIELD_RES_C] != COST_IMPASSABLE);
+}
+
+static bool tile_blocked(const struct nav_private *priv, struct coord tile)
+{
+    if(!tile_passable(priv, tile.r, tile.c))
+        return true;
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.r / FIELD_RES_R, priv->width, tile.c / FIELD_RES_C)];
+    return (chunk->blockers[tile.r % FIELD_RES_R][tile.c % FIELD_RES_C] > 0);
+}
+
+/* Walk every tile touched by the line between the two points, given in 
+ * units of tiles, including both of the tiles at any corner that it passes 
+ * through exactly.
+ */
+static bool ray_clear(const struct nav_private *priv, vec2_t a, vec2_t b)
+{
+    int r = floorf(a.z), c = floorf(a.x);
+    int end_r = floorf(b.z), end_c = floorf(b.x);
+    float dr = b.z - a.z, dc = b.x - a.x;
+
+    int step_r = (dr > 0.0f) ? 1 : -1;
+    int step_c = (dc > 0.0f) ? 1 : -1;
+    float delta_r = (fabsf(dr) > EPSILON) ? fabsf(1.0f / dr) : FLT_MAX;
+    float delta_c = (fabsf(dc) > EPSILON) ? fabsf(1.0f / dc) : FLT_MAX;
+    float max_r = (fabsf(dr) > EPSILON) ? ((dr > 0.0f) ? (r + 1 - a.z) : (a.z - r)) * delta_r : FLT_MAX;
+    float max_c = (fabsf(dc) > EPSILON) ? ((dc > 0.0f) ? (c + 1 - a.x) : (a.x - c)) * delta_c : FLT_MAX;
+
+    int nsteps = abs(end_r - r) + abs(end_c - c);
+    if(!tile_passable(priv, r, c))
+        return false;
+
+    for(int i = 0; i < nsteps && (r != end_r || c != end_c); i++) {
+
+        if(fabsf(max_r - max_c) < EPSILON) {
+
+            if(!tile_passable(priv, r + step_r, c) || !tile_passable(priv, r, c + step_c))
+                return false;
+            r += step_r; max_r += delta_r;
+            c += step_c; max_c += delta_c;
+            i++;
+
+        }else if(max_c < max_r) {
+            c += step_c; max_c += delta_c;
+        }else{
+            r += step_r; max_r += delta_r;
+        }
+
+        if(!tile_passable(priv, r, c))
+            return false;
+    }
+    return true;
+}
+
+/* An entity that is within 'ON_LINE_DIST' of the line between the two
+ * points must be able to head for the end of it in a straight line. So, 
+ * the lines along both edges of this band are checked as well.
+ */
+static bool leg_clear(const struct nav_private *priv, vec2_t a, vec2_t b)
+{
+    vec2_t dir;
+    PFM_Vec2_Sub(&b, &a, &dir);
+    if(PFM_Vec2_Len(&dir) < EPSILON)
+        return ray_clear(priv, a, b);
+
+    PFM_Vec2_Normal(&dir, &dir);
+    vec2_t off = (vec2_t){-dir.z * ON_LINE_DIST, dir.x * ON_LINE_DIST};
+
+    return ray_clear(priv, a, b)
+        && ray_clear(priv, (vec2_t){a.x + off.x, a.z + off.z}, (vec2_t){b.x + off.x, b.z + off.z})
+        && ray_clear(priv, (vec2_t){a.x - off.x, a.z - off.z}, (vec2_t){b.x - off.x, b.z - off.z});
+}
+
+static float segment_dist(vec2_t pos, vec2_t a, vec2_t b)
+{
+    vec2_t ab, ap;
+    PFM_Vec2_Sub(&b, &a, &ab);
+    PFM_Vec2_Sub(&pos, &a, &ap);
+
+    float len2 = PFM_Vec2_Dot(&ab, &ab);
+    float t = (len2 > EPSILON) ? PFM_Vec2_Dot(&ap, &ab) / len2 : 0.0f;
+    t = (t < 0.0f) ? 0.0f : (t > 1.0f) ? 1.0f : t;
+
+    vec2_t closest = (vec2_t){a.x + ab.x * t, a.z + ab.z * t};
+    vec2_t delta;
+    PFM_Vec2_Sub(&pos, &closest, &delta);
+    return PFM_Vec2_Len(&delta);
+}
+
+static void push_tile(const struct nav_private *priv, vec_coord_t *inout, struct coord tile)
+{
+    /* Diagonal steps past the corner of an impassable tile would have the 
+     * entities clip it, so they are made to go around it */
+    struct coord prev = vec_AT(inout, vec_size(inout) - 1);
+    if(abs(prev.r - tile.r) == 1 && abs(prev.c - tile.c) == 1) {
+
+        bool row_first = tile_passable(priv, tile.r, prev.c);
+        bool col_first = tile_passable(priv, prev.r, tile.c);
+        if(row_first != col_first)
+            vec_coord_push(inout, row_first ? (struct coord){tile.r, prev.c} 
+                                            : (struct coord){prev.r, tile.c});
+    }
+    vec_coord_push(inout, tile);
+}
+
+static bool append_grid_path(const struct nav_private *priv, struct coord chunk,
+                             struct coord start, struct coord finish, vec_coord_t *inout)
+{
+    if(start.r == finish.r && start.c == finish.c)
+        return true;
+
+    const struct nav_chunk *nchunk = &priv->chunks[IDX(chunk.r, priv->width, chunk.c)];
+    vec_coord_t path;
+    vec_coord_init(&path);
+    float cost;
+
+    bool ret = AStar_GridPath(start, finish, chunk, nchunk->cost_base, &path, &cost);
+    for(int i = 1; ret && i < vec_size(&path); i++) {
+
+        struct coord curr = vec_AT(&path, i);
+        push_tile(priv, inout, (struct coord){
+            chunk.r * FIELD_RES_R + curr.r, 
+            chunk.c * FIELD_RES_C + curr.c
+        });
+    }
+    vec_coord_destroy(&path);
+    return ret;
+}
+
+/* Get every tile along the way, following the grid paths between the 
+ * middles of the portals on the portal path. */
+static bool corridor_tiles(const struct nav_private *priv, struct tile_desc src, 
+                           struct tile_desc dst, const vec_portal_t *path, vec_coord_t *out)
+{
+    struct coord chunk = (struct coord){src.chunk_r, src.chunk_c};
+    struct coord curr = (struct coord){src.tile_r, src.tile_c};
+    vec_coord_push(out, global_tile(src));
+
+    for(int i = 0; path && i < vec_size(path); i++) {
+
+        const struct portal *port = vec_AT(path, i);
+        struct coord mid = (struct coord){
+            (port->endpoints[0].r + port->endpoints[1].r) / 2,
+            (port->endpoints[0].c + port->endpoints[1].c) / 2
+        };
+
+        /* Hops between connected portals cross over into the next chunk */
+        if(port->chunk.r != chunk.r || port->chunk.c != chunk.c) {
+
+            chunk = port->chunk;
+            curr = mid;
+            vec_coord_push(out, global_tile((struct tile_desc){chunk.r, chunk.c, mid.r, mid.c}));
+            continue;
+        }
+
+        if(!append_grid_path(priv, chunk, curr, mid, out))
+            return false;
+        curr = mid;
+    }
+
+    if(chunk.r != dst.chunk_r || chunk.c != dst.chunk_c)
+        return false;
+    return append_grid_path(priv, chunk, curr, (struct coord){dst.tile_r, dst.tile_c}, out);
+}
+
+/* Only keep the tiles where the line of sight to the next tile along the way
+ * is broken, so that the corridor is made up of the fewest straight legs.
+ */
+static size_t string_pull(const struct nav_private *priv, vec3_t map_pos, const vec_coord_t *tiles, 
+                          vec2_t xz_dest, vec2_t *out)
+{
+    size_t ret = 0;
+    int anchor = 0;
+    out[ret++] = tile_center(map_pos, vec_AT(tiles, 0));
+
+    for(int i = 1; i < vec_size(tiles) - 1; i++) {
+
+        if(leg_clear(priv, tile_space_center(vec_AT(tiles, anchor)), 
+                           tile_space_center(vec_AT(tiles, i + 1))))
+            continue;
+
+        out[ret++] = tile_center(map_pos, vec_AT(tiles, i));
+        anchor = i;
+    }
+
+    out[ret++] = xz_dest;
+    return ret;
+}
+
+static void unlink_slot(struct corridors *cors, int idx)
+{
+    struct corridor *cor = &cors->slots[idx];
+    khiter_t k = kh_get(head, cors->heads, cor->id);
+    assert(k != kh_end(cors->heads));
+
+    int *link = &kh_value(cors->heads, k);
+    while(*link != idx) {
+        assert(*link != SLOT_NONE);
+        link = &cors->slots[*link].next;
+    }
+    *link = cor->next;
+
+    if(kh_value(cors->heads, k) == SLOT_NONE)
+        kh_del(head, cors->heads, k);
+
+    free(cor->points);
+    cor->points = NULL;
+    cor->npoints = 0;
+    cor->next = SLOT_NONE;
+}
+
+/* Get an empty slot, evicting the least recently used corridor if they're 
+ * all taken */
+static int alloc_slot(struct corridors *cors)
+{
+    int lru = 0;
+    for(int i = 0; i < CONFIG_NAV_MAX_CORRIDORS; i++) {
+
+        if(!cors->slots[i].points)
+            return i;
+        if(cors->slots[i].last_used < cors->slots[lru].last_used)
+            lru = i;
+    }
+    unlink_slot(cors, lru);
+    return lru;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_CorridorsInit(struct nav_private *priv)
+{
+    struct corridors *cors = calloc(1, sizeof(struct corridors));
+    if(!cors)
+        goto fail_alloc;
+
+    if(!(cors->heads = kh_init(head)))
+        goto fail_heads;
+
+    for(int i = 0; i < CONFIG_NAV_MAX_CORRIDORS; i++)
+        cors->slots[i].next = SLOT_NONE;
+
+    priv->corridors = cors;
+    return true;
+
+fail_heads:
+    free(cors);
+fail_alloc:
+    return false;
+}
+
+void N_CorridorsFree(struct nav_private *priv)
+{
+    struct corridors *cors = priv->corridors;
+    if(!cors)
+        return;
+
+    for(int i = 0; i < CONFIG_NAV_MAX_CORRIDORS; i++)
+        free(cors->slots[i].points);
+    kh_destroy(head, cors->heads);
+    free(cors);
+    priv->corridors = NULL;
+}
+
+size_t N_CorridorsMemoryUsage(const struct nav_private *priv)
+{
+    const struct corridors *cors = priv->corridors;
+    if(!cors)
+        return 0;
+
+    size_t ret = sizeof(struct corridors);
+    ret += kh_n_buckets(cors->heads) * (sizeof(dest_id_t) + sizeof(int));
+
+    for(int i = 0; i < CONFIG_NAV_MAX_CORRIDORS; i++)
+        ret += cors->slots[i].npoints * sizeof(vec2_t);
+    return ret;
+}
+
+void N_CorridorsClear(struct nav_private *priv)
+{
+    struct corridors *cors = priv->corridors;
+    if(!cors)
+        return;
+
+    for(int i = 0; i < CONFIG_NAV_MAX_CORRIDORS; i++) {
+
+        free(cors->slots[i].points);
+        cors->slots[i].points = NULL;
+        cors->slots[i].npoints = 0;
+        cors->slots[i].next = SLOT_NONE;
+    }
+    kh_clear(head, cors->heads);
+}
+
+bool N_CorridorBuild(struct nav_private *priv, vec3_t map_pos, dest_id_t id,
+                     struct tile_desc src, struct tile_desc dst, vec2_t xz_dest,
+                     const vec_portal_t *path)
+{
+    PERF_ENTER();
+    struct corridors *cors = priv->corridors;
+
+    vec_coord_t tiles;
+    vec_coord_init(&tiles);
+
+    if(!corridor_tiles(priv, src, dst, path, &tiles))
+        goto fail_tiles;
+
+    vec2_t *points = malloc((vec_size(&tiles) + 1) * sizeof(vec2_t));
+    if(!points)
+        goto fail_tiles;
+
+    size_t npoints = string_pull(priv, map_pos, &tiles, xz_dest, points);
+    vec2_t *shrunk = realloc(points, npoints * sizeof(vec2_t));
+    if(shrunk)
+        points = shrunk;
+
+    int idx = alloc_slot(cors);
+    int status;
+    khiter_t k = kh_put(head, cors->heads, id, &status);
+    if(status == -1)
+        goto fail_put;
+    if(status != 0)
+        kh_value(cors->heads, k) = SLOT_NONE;
+
+    cors->slots[idx] = (struct corridor){
+        .id = id,
+        .next = kh_value(cors->heads, k),
+        .last_used = ++cors->clock,
+        .npoints = npoints,
+        .points = points
+    };
+    kh_value(cors->heads, k) = idx;
+
+    vec_coord_destroy(&tiles);
+    PERF_RETURN(true);
+
+fail_put:
+    free(points);
+fail_tiles:
+    vec_coord_destroy(&tiles);
+    PERF_RETURN(false);
+}
+
+bool N_CorridorSeek(struct nav_private *priv, vec3_t map_pos, dest_id_t id,
+                    vec2_t curr_pos, vec2_t *out_dir, bool *out_los)
+{
+    struct corridors *cors = priv->corridors;
+    khiter_t k = kh_get(head, cors->heads, id);
+    if(k == kh_end(cors->heads))
+        return false;
+
+    /* Find the closest leg of any of the corridors to the destination. On 
+     * ties, the later legs are preferred so that the waypoints are passed. */
+    struct corridor *best = NULL;
+    int best_leg = 0;
+    float best_dist = FLT_MAX;
+
+    for(int i = kh_value(cors->heads, k); i != SLOT_NONE; i = cors->slots[i].next) {
+
+        struct corridor *cor = &cors->slots[i];
+        for(int j = 0; j < cor->npoints - 1; j++) {
+
+            float dist = segment_dist(curr_pos, cor->points[j], cor->points[j + 1]);
+            if(dist <= best_dist) {
+                best = cor;
+                best_leg = j;
+                best_dist = dist;
+            }
+        }
+    }
+
+    float tile_len = N_TileDims().x;
+    if(!best || best_dist > MAX_DEVIATION * tile_len)
+        return false;
+
+    int target = best_leg + 1;
+    vec2_t delta;
+    PFM_Vec2_Sub(&best->points[target], &curr_pos, &delta);
+
+    if(target < best->npoints - 1 
+    && PFM_Vec2_Len(&delta) < WAYPOINT_REACHED * tile_len
+    && ray_clear(priv, tile_space_pos(map_pos, curr_pos), 
+                       tile_space_pos(map_pos, best->points[target + 1]))) {
+        target++;
+        PFM_Vec2_Sub(&best->points[target], &curr_pos, &delta);
+    }
+
+    /* Entities that have been pushed off the corridor may not be able to 
+     * make it to the waypoint in a straight line */
+    if(best_dist > ON_LINE_DIST * tile_len
+    && !ray_clear(priv, tile_space_pos(map_pos, curr_pos), 
+                        tile_space_pos(map_pos, best->points[target]))) {
+        return false;
+    }
+
+    vec2_t dir = (vec2_t){0.0f};
+    if(PFM_Vec2_Len(&delta) > EPSILON)
+        PFM_Vec2_Normal(&delta, &dir);
+
+    /* Only the fields lead around the stationary entities in the way */
+    vec2_t ahead = (vec2_t){curr_pos.x + dir.x * tile_len, curr_pos.z + dir.z * tile_len};
+    if(PFM_Vec2_Len(&delta) > tile_len
+    && tile_blocked(priv, global_tile_for_pos(map_pos, ahead)))
+        return false;
+
+    best->last_used = ++cors->clock;
+    *out_los = (target == best->npoints - 1);
+    *out_dir = dir;
+    return true;
+}
+
@@ -0,0 +1,89 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef CORRIDOR_H
+#define CORRIDOR_H
+
+#include "public/nav.h"
+#include "nav_data.h"
+#include "a_star.h"
+#include "../map/public/tile.h"
+#include "../pf_math.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct nav_private;
+
+/* A 'corridor' is a lightweight alternative to the fields for guiding 
+ * a small number of entities to a destination. It's a string-pulled 
+ * polyline of waypoints, made from the portal path and the grid paths 
+ * between the portals along it. Only the base costs are taken into 
+ * account, so it doesn't need to be updated as blockers come and go.
+ * A number of the most recently used corridors are kept around. */
+
+bool   N_CorridorsInit(struct nav_private *priv);
+void   N_CorridorsFree(struct nav_private *priv);
+size_t N_CorridorsMemoryUsage(const struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Drop all the corridors. Must be called whenever the base costs change.
+ * ------------------------------------------------------------------------
+ */
+void   N_CorridorsClear(struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Make a corridor from the source to the destination tile. 'path' is
+ * the portal path between them, or NULL if the destination can be 
+ * reached without leaving the source chunk. Returns false if no grid 
+ * path could be found for some part of it.
+ * ------------------------------------------------------------------------
+ */
+bool   N_CorridorBuild(struct nav_private *priv, vec3_t map_pos, dest_id_t id,
+                       struct tile_desc src, struct tile_desc dst, vec2_t xz_dest,
+                       const vec_portal_t *path);
+
+/* ------------------------------------------------------------------------
+ * Get the direction to head in to follow a corridor to the destination.
+ * Returns false if there is no corridor leading there which passes close 
+ * enough to the position. Otherwise, 'out_los' is set if the position is 
+ * on the last leg, with a clear line to the destination.
+ * ------------------------------------------------------------------------
+ */
+bool   N_CorridorSeek(struct nav_private *priv, vec3_t map_pos, dest_id_t id,
+                      vec2_t curr_pos, vec2_t *out_dir, bool *out_los);
+
+#endif
+
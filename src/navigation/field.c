@@ -38,9 +38,11 @@
 #include "../entity.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
-#include "../lib/public/pqueue.h"
+
+#include <SDL.h>
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 
@@ -50,14 +52,38 @@
 #define MAX_ENTS_PER_CHUNK  (4096)
 #define IDX(r, width, c)    ((r) * (width) + (c))
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
+/* Must be greater than the largest cost of moving between two tiles */
+#define NBUCKETS            (COST_IMPASSABLE + 1)
+#define NTILES              (FIELD_RES_R * FIELD_RES_C)
+#define BQ_NONE             (0xffff)
+
+/* Dial's algorithm frontier. The integration field costs are always whole 
+ * numbers and the frontier never holds tiles with costs differing by more 
+ * than the largest tile cost, so the tiles can be kept in a ring of buckets 
+ * indexed by cost instead of a heap. Every tile is present in at most one 
+ * bucket (as a node of an intrusive doubly-linked list), making decreasing 
+ * the cost of a queued tile a constant-time operation.
+ */
+struct bucket_queue{
+    uint32_t base;  /* the lowest cost that can still be in the queue */
+    size_t   size;
+    uint16_t head[NBUCKETS];
+    uint16_t next[NTILES];
+    uint16_t prev[NTILES];
+    uint16_t bucket[NTILES];
+};
 
 struct box_xz{
     float x_min, x_max;
     float z_min, z_max;
 };
 
+/* A tile to add to the frontier when repairing an integration field */
+struct repair_seed{
+    uint32_t cost;
+    uint16_t idx;
+};
+
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
 /*****************************************************************************/
@@ -74,10 +100,93 @@ vec2_t g_flow_dir_lookup[9] = {
     [FD_SE]   = (vec2_t){ -1.0f / sqrt(2.0f),  1.0f / sqrt(2.0f) },
 };
 
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Fields may be built from different threads */
+static SDL_SpinLock  s_stats_lock;
+static unsigned      s_fields_built;
+static uint64_t      s_build_ticks;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static void stats_add_build(uint64_t start_ticks)
+{
+    uint64_t elapsed = SDL_GetPerformanceCounter() - start_ticks;
+
+    SDL_AtomicLock(&s_stats_lock);
+    s_fields_built++;
+    s_build_ticks += elapsed;
+    SDL_AtomicUnlock(&s_stats_lock);
+}
+
+static void bq_init(struct bucket_queue *bq)
+{
+    bq->base = 0;
+    bq->size = 0;
+    memset(bq->head, 0xff, sizeof(bq->head));
+    memset(bq->bucket, 0xff, sizeof(bq->bucket));
+}
+
+static size_t bq_size(const struct bucket_queue *bq)
+{
+    return bq->size;
+}
+
+static void bq_remove(struct bucket_queue *bq, uint16_t idx)
+{
+    uint16_t bucket = bq->bucket[idx];
+    assert(bucket != BQ_NONE);
+
+    if(bq->prev[idx] != BQ_NONE)
+        bq->next[bq->prev[idx]] = bq->next[idx];
+    else
+        bq->head[bucket] = bq->next[idx];
+
+    if(bq->next[idx] != BQ_NONE)
+        bq->prev[bq->next[idx]] = bq->prev[idx];
+
+    bq->bucket[idx] = BQ_NONE;
+    bq->size--;
+}
+
+/* Insert the tile with the specified cost, or move it to the bucket 
+ * for the new cost if it's already queued. 
+ */
+static void bq_push(struct bucket_queue *bq, float cost, struct coord tile)
+{
+    uint32_t icost = cost;
+    assert(icost >= bq->base && icost < bq->base + NBUCKETS);
+
+    uint16_t idx = IDX(tile.r, FIELD_RES_C, tile.c);
+    if(bq->bucket[idx] != BQ_NONE)
+        bq_remove(bq, idx);
+
+    uint16_t bucket = icost % NBUCKETS;
+    bq->prev[idx] = BQ_NONE;
+    bq->next[idx] = bq->head[bucket];
+    if(bq->head[bucket] != BQ_NONE)
+        bq->prev[bq->head[bucket]] = idx;
+
+    bq->head[bucket] = idx;
+    bq->bucket[idx] = bucket;
+    bq->size++;
+}
+
+static struct coord bq_pop(struct bucket_queue *bq)
+{
+    assert(bq->size > 0);
+    while(bq->head[bq->base % NBUCKETS] == BQ_NONE)
+        bq->base++;
+
+    uint16_t idx = bq->head[bq->base % NBUCKETS];
+    bq_remove(bq, idx);
+    return (struct coord){idx / FIELD_RES_C, idx % FIELD_RES_C};
+}
+
 static bool tile_passable(const struct nav_chunk *chunk, struct coord tile)
 {
     if(chunk->cost_base[tile.r][tile.c] == COST_IMPASSABLE)
@@ -142,7 +251,7 @@ static int neighbours_grid_LOS(const struct nav_chunk *chunk,
             continue;
         if((r == c) || (r == -c)) /* diag */
             continue;
-        if(los->field[abs_r][abs_c].wavefront_blocked)
+        if(N_LOSWavefrontBlocked(los, abs_r, abs_c))
             continue;
 
         out_neighbours[ret] = (struct coord){abs_r, abs_c};
@@ -300,7 +409,7 @@ static void create_wavefront_blocked_line(struct tile_desc target, struct tile_d
     struct coord curr = (struct coord){corner.tile_r, corner.tile_c};
     do {
 
-        out_los->field[curr.r][curr.c].wavefront_blocked = 1;
+        N_LOSSetWavefrontBlocked(out_los, curr.r, curr.c, true);
 
         e2 = 2 * err;
         if(e2 >= dy) {
@@ -317,59 +426,138 @@ static void create_wavefront_blocked_line(struct tile_desc target, struct tile_d
 
 static void pad_wavefront(struct LOS_field *out_los)
 {
+    /* Clear the 'visible' flag of every tile within one tile of a 'wavefront 
+     * blocked' one, a row at a time */
     for(int r = 0; r < FIELD_RES_R; r++) {
-    for(int c = 0; c < FIELD_RES_C; c++) {
 
-        if(out_los->field[r][c].wavefront_blocked) {
-        
-            for(int rr = r-1; rr <= r+1; rr++) {
-            for(int cc = c-1; cc <= c+1; cc++) {
-            
-                if(rr < 0 || rr > FIELD_RES_R-1)
-                    continue;
-                if(cc < 0 || cc > FIELD_RES_C-1)
-                    continue;
-                out_los->field[rr][cc].visible = 0;
-            }}
+        uint64_t blocked = out_los->wavefront_blocked[r];
+        if(r > 0)
+            blocked |= out_los->wavefront_blocked[r - 1];
+        if(r < FIELD_RES_R-1)
+            blocked |= out_los->wavefront_blocked[r + 1];
+
+        blocked |= (blocked << 1) | (blocked >> 1);
+        out_los->visible[r] &= ~blocked;
+    }
+}
+
+static void copy_los_tile(struct LOS_field *out_los, struct coord tile, 
+                          const struct LOS_field *src_los, struct coord src_tile)
+{
+    N_LOSSetVisible(out_los, tile.r, tile.c, 
+        N_LOSVisible(src_los, src_tile.r, src_tile.c));
+    N_LOSSetWavefrontBlocked(out_los, tile.r, tile.c, 
+        N_LOSWavefrontBlocked(src_los, src_tile.r, src_tile.c));
+}
+
+static void relax_neighbours(struct bucket_queue *frontier, const struct nav_chunk *chunk, 
+                             struct coord curr, float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    struct coord neighbours[8];
+    uint8_t neighbour_costs[8];
+    int num_neighbours = neighbours_grid(chunk, curr, true, neighbours, neighbour_costs);
+
+    for(int i = 0; i < num_neighbours; i++) {
+
+        float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
+        if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
+
+            inout[neighbours[i].r][neighbours[i].c] = total_cost;
+            bq_push(frontier, total_cost, neighbours[i]);
         }
-    }}
+    }
 }
 
-static void build_integration_field(pq_coord_t *frontier, const struct nav_chunk *chunk, 
+static void build_integration_field(struct bucket_queue *frontier, const struct nav_chunk *chunk, 
                                     float inout[FIELD_RES_R][FIELD_RES_C])
 {
-    while(pq_size(frontier) > 0) {
+    while(bq_size(frontier) > 0) {
 
-        struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        struct coord curr = bq_pop(frontier);
+        relax_neighbours(frontier, chunk, curr, inout);
+    }
+}
 
-        struct coord neighbours[8];
-        uint8_t neighbour_costs[8];
-        int num_neighbours = neighbours_grid(chunk, curr, true, neighbours, neighbour_costs);
+static int compare_seeds(const void *a, const void *b)
+{
+    const struct repair_seed *sa = a, *sb = b;
+    if(sa->cost != sb->cost)
+        return (sa->cost < sb->cost) ? -1 : 1;
+    return (int)sa->idx - (int)sb->idx;
+}
 
-        for(int i = 0; i < num_neighbours; i++) {
+/* Same as 'build_integration_field', but the initial frontier may hold tiles 
+ * with costs that are arbitrarily far apart. They are fed to the bucket queue 
+ * in order of cost, as soon as they fall within its' range. 
+ */
+static void build_integration_field_seeded(struct bucket_queue *frontier, const struct nav_chunk *chunk,
+                                           struct repair_seed *seeds, size_t nseeds,
+                                           float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    qsort(seeds, nseeds, sizeof(struct repair_seed), compare_seeds);
+    size_t next = 0;
 
-            float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
-            if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
+    while(true) {
 
-                inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
-            }
+        if(bq_size(frontier) == 0) {
+            if(next == nseeds)
+                break;
+            frontier->base = seeds[next].cost;
+        }
+
+        for(; next < nseeds && seeds[next].cost < frontier->base + NBUCKETS; next++) {
+
+            struct coord tile = (struct coord){seeds[next].idx / FIELD_RES_C, seeds[next].idx % FIELD_RES_C};
+            /* The tile was reached more cheaply in the meantime */
+            if(inout[tile.r][tile.c] < seeds[next].cost)
+                continue;
+            bq_push(frontier, seeds[next].cost, tile);
         }
+
+        if(bq_size(frontier) == 0)
+            continue;
+
+        struct coord curr = bq_pop(frontier);
+        relax_neighbours(frontier, chunk, curr, inout);
     }
 }
 
+static bool pack_integration_field(const float intf[FIELD_RES_R][FIELD_RES_C], 
+                                   struct integration_field *out)
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(intf[r][c] == INFINITY) {
+            out->cost[r][c] = INTEGRATION_INFINITE;
+            continue;
+        }
+        if(intf[r][c] >= INTEGRATION_INFINITE)
+            return false;
+        out->cost[r][c] = intf[r][c];
+    }}
+    return true;
+}
+
+static void unpack_integration_field(const struct integration_field *in,
+                                     float out[FIELD_RES_R][FIELD_RES_C])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        out[r][c] = (in->cost[r][c] == INTEGRATION_INFINITE) ? INFINITY : in->cost[r][c];
+    }}
+}
+
 /* same as 'build_integration_field' but only impassable tiles 
  * will be added to the frontier 
  */
-static void build_integration_field_nonpass(pq_coord_t *frontier, const struct nav_chunk *chunk, 
+static void build_integration_field_nonpass(struct bucket_queue *frontier, const struct nav_chunk *chunk, 
                                             float inout[FIELD_RES_R][FIELD_RES_C])
 {
-    while(pq_size(frontier) > 0) {
+    while(bq_size(frontier) > 0) {
 
-        struct coord curr;
-        pq_coord_pop(frontier, &curr);
+        struct coord curr = bq_pop(frontier);
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -384,8 +572,7 @@ static void build_integration_field_nonpass(pq_coord_t *frontier, const struct n
             if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
 
                 inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
+                bq_push(frontier, total_cost, neighbours[i]);
             }
         }
     }
@@ -406,11 +593,11 @@ static void build_flow_field(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_f
 
         if(intf[r][c] == 0.0f) {
 
-            inout_flow->field[r][c].dir_idx = FD_NONE;
+            N_SetFlowDir(inout_flow, r, c, FD_NONE);
             continue;
         }
 
-        inout_flow->field[r][c].dir_idx = flow_dir(intf, (struct coord){r, c});
+        N_SetFlowDir(inout_flow, r, c, flow_dir(intf, (struct coord){r, c}));
     }}
 }
 
@@ -429,13 +616,13 @@ static void fixup_portal_edges(float intf[FIELD_RES_R][FIELD_RES_C], struct flow
         if(intf[r][c] == 0.0f) {
 
             if(up)
-                inout_flow->field[r][c].dir_idx = FD_N;
+                N_SetFlowDir(inout_flow, r, c, FD_N);
             else if(down)
-                inout_flow->field[r][c].dir_idx = FD_S;
+                N_SetFlowDir(inout_flow, r, c, FD_S);
             else if(left)
-                inout_flow->field[r][c].dir_idx = FD_W;
+                N_SetFlowDir(inout_flow, r, c, FD_W);
             else if(right)
-                inout_flow->field[r][c].dir_idx = FD_E;
+                N_SetFlowDir(inout_flow, r, c, FD_E);
             else
                 assert(0);
         }
@@ -640,7 +827,8 @@ static size_t enemies_initial_frontier(struct enemies_desc *enemies, const struc
         (vec2_t){bounds.x_max, bounds.z_max},
         ents, ARR_SIZE(ents)
     );
-    assert(num_ents);
+    /* The enemies may have moved on since the chunk was last known to hold
+     * any, in which case the field has no targets until it is remade */
 
     bool has_enemy[FIELD_RES_R][FIELD_RES_C] = {0};
     for(int i = 0; i < num_ents; i++) {
@@ -800,6 +988,43 @@ static size_t passable_frontier(const struct nav_chunk *chunk, struct coord star
     return ret;
 }
 
+static void flow_field_update(struct coord chunk_coord, const struct nav_private *priv,
+                              struct field_target target, struct flow_field *inout_flow,
+                              float integration_field[FIELD_RES_R][FIELD_RES_C])
+{
+    uint64_t start_ticks = SDL_GetPerformanceCounter();
+    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
+    struct bucket_queue frontier;
+    bq_init(&frontier);
+
+    for(int r = 0; r < FIELD_RES_R; r++)
+        for(int c = 0; c < FIELD_RES_C; c++)
+            integration_field[r][c] = INFINITY;
+
+    struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
+    size_t ninit = initial_frontier(target, chunk, priv, false, init_frontier, ARR_SIZE(init_frontier));
+
+    for(int i = 0; i < ninit; i++) {
+
+        struct coord curr = init_frontier[i];
+        bq_push(&frontier, 0.0f, curr); 
+        integration_field[curr.r][curr.c] = 0.0f;
+    }
+
+    inout_flow->target = target;
+    build_integration_field(&frontier, chunk, integration_field);
+    build_flow_field(integration_field, inout_flow);
+    fixup_field(target, integration_field, inout_flow, chunk);
+    stats_add_build(start_ticks);
+}
+
+static bool repairable_target(struct field_target target)
+{
+    /* Fields guiding to enemies depend on the entity positions and not only
+     * the navigation data */
+    return (target.type == TARGET_PORTAL || target.type == TARGET_TILE);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -838,54 +1063,201 @@ ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
 
 void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out)
 {
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
-
-            out->field[r][c].dir_idx = FD_NONE;
-        }
-    }
+    /* FD_NONE is zero */
+    memset(out->field, 0, sizeof(out->field));
     out->chunk = chunk_coord;
 }
 
 void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
                        struct field_target target, struct flow_field *inout_flow)
 {
+    float integration_field[FIELD_RES_R][FIELD_RES_C];
+    flow_field_update(chunk_coord, priv, target, inout_flow, integration_field);
+}
+
+bool N_FlowFieldBuild(struct coord chunk_coord, const struct nav_private *priv,
+                      struct field_target target, struct flow_field *out_flow,
+                      struct integration_field *out_intf)
+{
+    float integration_field[FIELD_RES_R][FIELD_RES_C];
+    N_FlowFieldInit(chunk_coord, priv, out_flow);
+    flow_field_update(chunk_coord, priv, target, out_flow, integration_field);
+
+    if(!repairable_target(target))
+        return false;
+    return pack_integration_field(integration_field, out_intf);
+}
+
+bool N_FlowFieldRepair(const struct nav_private *priv, const struct coord *tiles, size_t ntiles,
+                       struct flow_field *inout_flow, struct integration_field *inout_intf)
+{
+    struct coord chunk_coord = inout_flow->chunk;
     const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
 
+    if(!repairable_target(inout_flow->target))
+        return false;
+
+    /* The target tiles are only in the initial frontier when they are not blocked */
+    bool source[FIELD_RES_R][FIELD_RES_C] = {0};
+    struct coord targets[NTILES];
+    size_t ntargets = initial_frontier(inout_flow->target, chunk, priv, true, targets, ARR_SIZE(targets));
+
+    for(int i = 0; i < ntargets; i++) {
+        if(chunk->blockers[targets[i].r][targets[i].c] == 0)
+            source[targets[i].r][targets[i].c] = true;
+    }
+
+    float old[FIELD_RES_R][FIELD_RES_C];
     float integration_field[FIELD_RES_R][FIELD_RES_C];
-    for(int r = 0; r < FIELD_RES_R; r++)
-        for(int c = 0; c < FIELD_RES_C; c++)
-            integration_field[r][c] = INFINITY;
+    unpack_integration_field(inout_intf, old);
+    memcpy(integration_field, old, sizeof(old));
+
+    /* First, find all the tiles which may have been reached through any of
+     * the tiles that became blocked. This is a superset of the tiles whose
+     * cost has gone up. The costs of the remaining tiles are still valid (if
+     * possibly too high, in the case that some tiles have also become unblocked).
+     */
+    bool affected[FIELD_RES_R][FIELD_RES_C] = {0};
+    struct coord affected_list[NTILES];
+    size_t naffected = 0;
+
+    for(int i = 0; i < ntiles; i++) {
+
+        struct coord curr = tiles[i];
+        if(source[curr.r][curr.c] || tile_passable(chunk, curr))
+            continue;
+        if(old[curr.r][curr.c] == INFINITY || affected[curr.r][curr.c])
+            continue;
 
-    struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
-    size_t ninit = initial_frontier(target, chunk, priv, false, init_frontier, ARR_SIZE(init_frontier));
+        affected[curr.r][curr.c] = true;
+        affected_list[naffected++] = curr;
+    }
 
-    for(int i = 0; i < ninit; i++) {
+    for(int i = 0; i < naffected; i++) {
 
-        struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
-        integration_field[curr.r][curr.c] = 0.0f;
+        struct coord curr = affected_list[i];
+        struct coord deltas[] = {
+            { 0, -1},
+            { 0, +1},
+            {-1,  0},
+            {+1,  0},
+        };
+
+        for(int j = 0; j < ARR_SIZE(deltas); j++) {
+
+            struct coord neighb = (struct coord){
+                curr.r + deltas[j].r,
+                curr.c + deltas[j].c,
+            };
+            if(neighb.r < 0 || neighb.r >= FIELD_RES_R)
+                continue;
+            if(neighb.c < 0 || neighb.c >= FIELD_RES_C)
+                continue;
+
+            if(affected[neighb.r][neighb.c] || source[neighb.r][neighb.c])
+                continue;
+            if(old[neighb.r][neighb.c] == INFINITY)
+                continue;
+            if(old[neighb.r][neighb.c] != old[curr.r][curr.c] + chunk->cost_base[neighb.r][neighb.c])
+                continue;
+
+            affected[neighb.r][neighb.c] = true;
+            affected_list[naffected++] = neighb;
+        }
     }
 
-    inout_flow->target = target;
-    build_integration_field(&frontier, chunk, integration_field);
-    build_flow_field(integration_field, inout_flow);
-    fixup_field(target, integration_field, inout_flow, chunk);
+    for(int i = 0; i < naffected; i++)
+        integration_field[affected_list[i].r][affected_list[i].c] = INFINITY;
+
+    /* Then, seed the frontier with the affected tiles and the tiles that became
+     * unblocked, using the best cost that can be had from their neighbours
+     * with valid costs. From there, the costs are propagated outwards as usual.
+     */
+    struct repair_seed seeds[2 * NTILES];
+    size_t nseeds = 0;
+
+    for(int i = 0; i < naffected + ntiles; i++) {
+
+        struct coord curr = (i < naffected) ? affected_list[i] : tiles[i - naffected];
+        float best = INFINITY;
+
+        if(source[curr.r][curr.c]) {
+            best = 0.0f;
+        }else if(tile_passable(chunk, curr)) {
+
+            struct coord neighbours[8];
+            uint8_t neighbour_costs[8];
+            int num_neighbours = neighbours_grid(chunk, curr, false, neighbours, neighbour_costs);
+
+            for(int j = 0; j < num_neighbours; j++) {
+
+                float cost = integration_field[neighbours[j].r][neighbours[j].c];
+                best = MIN(best, cost + chunk->cost_base[curr.r][curr.c]);
+            }
+        }
+
+        if(!(best < integration_field[curr.r][curr.c]))
+            continue;
+
+        integration_field[curr.r][curr.c] = best;
+        seeds[nseeds++] = (struct repair_seed){best, IDX(curr.r, FIELD_RES_C, curr.c)};
+    }
+
+    struct bucket_queue frontier;
+    bq_init(&frontier);
+    build_integration_field_seeded(&frontier, chunk, seeds, nseeds, integration_field);
+
+    if(!pack_integration_field(integration_field, inout_intf))
+        return false;
 
-    pq_coord_destroy(&frontier);
+    /* Finally, update the directions of all the tiles that have a neighbour
+     * with a different cost than before */
+    bool dirty[FIELD_RES_R][FIELD_RES_C] = {0};
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(integration_field[r][c] == old[r][c])
+            continue;
+
+        for(int dr = -1; dr <= 1; dr++) {
+        for(int dc = -1; dc <= 1; dc++) {
+
+            if(r + dr < 0 || r + dr >= FIELD_RES_R)
+                continue;
+            if(c + dc < 0 || c + dc >= FIELD_RES_C)
+                continue;
+            dirty[r + dr][c + dc] = true;
+        }}
+    }}
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(!dirty[r][c])
+            continue;
+
+        if(integration_field[r][c] == INFINITY || integration_field[r][c] == 0.0f)
+            N_SetFlowDir(inout_flow, r, c, FD_NONE);
+        else
+            N_SetFlowDir(inout_flow, r, c, flow_dir(integration_field, (struct coord){r, c}));
+    }}
+
+    fixup_field(inout_flow->target, integration_field, inout_flow, chunk);
+    return true;
 }
 
+
 void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
                       const struct nav_private *priv, vec3_t map_pos, 
                       struct LOS_field *out_los, const struct LOS_field *prev_los)
 {
+    uint64_t start_ticks = SDL_GetPerformanceCounter();
     out_los->chunk = chunk_coord;
-    memset(out_los->field, 0x00, sizeof(out_los->field));
+    memset(out_los->visible, 0x00, sizeof(out_los->visible));
+    memset(out_los->wavefront_blocked, 0x00, sizeof(out_los->wavefront_blocked));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    struct bucket_queue frontier;
+    bq_init(&frontier);
     const struct nav_chunk *chunk = &priv->chunks[chunk_coord.r * priv->width + chunk_coord.c];
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
@@ -896,7 +1268,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
     /* Case 1: LOS for the destination chunk */
     if(chunk_coord.r == target.chunk_r && chunk_coord.c == target.chunk_c) {
 
-        pq_coord_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
+        bq_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
         integration_field[target.tile_r][target.tile_c] = 0.0f;
         assert(NULL == prev_los);
 
@@ -912,15 +1284,15 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
 
             for(int c = 0; c < FIELD_RES_C; c++) {
 
-                out_los->field[0][c] = prev_los->field[FIELD_RES_R-1][c];
-                if(out_los->field[0][c].wavefront_blocked) {
+                copy_los_tile(out_los, (struct coord){0, c}, prev_los, (struct coord){FIELD_RES_R-1, c});
+                if(N_LOSWavefrontBlocked(out_los, 0, c)) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, 0, c};
                     create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
                 }
-                if(out_los->field[0][c].visible) {
+                if(N_LOSVisible(out_los, 0, c)) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){0, c});
+                    bq_push(&frontier, 0.0f, (struct coord){0, c});
                     integration_field[0][c] = 0.0f; 
                 }
             }
@@ -928,15 +1300,15 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
 
             for(int c = 0; c < FIELD_RES_C; c++) {
 
-                out_los->field[FIELD_RES_R-1][c] = prev_los->field[0][c];
-                if(out_los->field[FIELD_RES_R-1][c].wavefront_blocked) {
+                copy_los_tile(out_los, (struct coord){FIELD_RES_R-1, c}, prev_los, (struct coord){0, c});
+                if(N_LOSWavefrontBlocked(out_los, FIELD_RES_R-1, c)) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, FIELD_RES_R-1, c};
                     create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
                 }
-                if(out_los->field[FIELD_RES_R-1][c].visible) {
+                if(N_LOSVisible(out_los, FIELD_RES_R-1, c)) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){FIELD_RES_R-1, c});
+                    bq_push(&frontier, 0.0f, (struct coord){FIELD_RES_R-1, c});
                     integration_field[FIELD_RES_R-1][c] = 0.0f;
                 }
             }
@@ -944,15 +1316,15 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
 
             for(int r = 0; r < FIELD_RES_R; r++) {
 
-                out_los->field[r][0] = prev_los->field[r][FIELD_RES_C-1];
-                if(out_los->field[r][0].wavefront_blocked) {
+                copy_los_tile(out_los, (struct coord){r, 0}, prev_los, (struct coord){r, FIELD_RES_C-1});
+                if(N_LOSWavefrontBlocked(out_los, r, 0)) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, 0};
                     create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
                 }
-                if(out_los->field[r][0].visible) {
+                if(N_LOSVisible(out_los, r, 0)) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, 0});
+                    bq_push(&frontier, 0.0f, (struct coord){r, 0});
                     integration_field[r][0] = 0.0f;
                 }
             }
@@ -960,15 +1332,15 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
 
             for(int r = 0; r < FIELD_RES_R; r++) {
 
-                out_los->field[r][FIELD_RES_C-1] = prev_los->field[r][0];
-                if(out_los->field[r][FIELD_RES_C-1].wavefront_blocked) {
+                copy_los_tile(out_los, (struct coord){r, FIELD_RES_C-1}, prev_los, (struct coord){r, 0});
+                if(N_LOSWavefrontBlocked(out_los, r, FIELD_RES_C-1)) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, FIELD_RES_C-1};
                     create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
                 }
-                if(out_los->field[r][FIELD_RES_C-1].visible) {
+                if(N_LOSVisible(out_los, r, FIELD_RES_C-1)) {
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, FIELD_RES_C-1});
+                    bq_push(&frontier, 0.0f, (struct coord){r, FIELD_RES_C-1});
                     integration_field[r][FIELD_RES_C-1] = 0.0f;
                 }
             }
@@ -977,10 +1349,9 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
         }
     }
 
-    while(pq_size(&frontier) > 0) {
+    while(bq_size(&frontier) > 0) {
 
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+        struct coord curr = bq_pop(&frontier);
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
@@ -1004,18 +1375,16 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
             }else{
 
                 float new_cost = integration_field[curr.r][curr.c] + 1;
-                out_los->field[nr][nc].visible = 1;
+                N_LOSSetVisible(out_los, nr, nc, true);
 
                 if(new_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
 
                     integration_field[nr][nc] = new_cost;
-                    if(!pq_coord_contains(&frontier, neighbours[i]))
-                        pq_coord_push(&frontier, new_cost, neighbours[i]);
+                    bq_push(&frontier, new_cost, neighbours[i]);
                 }
             }
         }
     }
-    pq_coord_destroy(&frontier);
 
     /* Add a single tile-wide padding of invisible tiles around the wavefront. This is 
      * because we want to be conservative and not mark any tiles visible from which we
@@ -1023,16 +1392,18 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
      * the ray going over impassable terrain. This is a nice property for the movement
      * code. */
     pad_wavefront(out_los);
+    stats_add_build(start_ticks);
 }
 
 void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
                                         struct flow_field *inout_flow)
 {
+    uint64_t start_ticks = SDL_GetPerformanceCounter();
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = passable_frontier(chunk, start, init_frontier, ARR_SIZE(init_frontier));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    struct bucket_queue frontier;
+    bq_init(&frontier);
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
@@ -1042,7 +1413,7 @@ void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct co
     for(int i = 0; i < ninit; i++) {
 
         struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        bq_push(&frontier, 0.0f, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
@@ -1055,20 +1426,20 @@ void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct co
             continue;
         if(integration_field[r][c] == 0.0f)
             continue;
-        inout_flow->field[r][c].dir_idx = flow_dir(integration_field, (struct coord){r, c});
+        N_SetFlowDir(inout_flow, r, c, flow_dir(integration_field, (struct coord){r, c}));
     }}
-
-    pq_coord_destroy(&frontier);
+    stats_add_build(start_ticks);
 }
 
 void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_private *priv,
                                       struct flow_field *inout_flow)
 {
+    uint64_t start_ticks = SDL_GetPerformanceCounter();
     struct coord chunk_coord = inout_flow->chunk;
     const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    struct bucket_queue frontier;
+    bq_init(&frontier);
 
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = initial_frontier(inout_flow->target, chunk, priv, false, init_frontier, ARR_SIZE(init_frontier));
@@ -1123,14 +1494,33 @@ void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_priva
     for(int i = 0; i < new_ninit; i++) {
 
         struct coord curr = new_init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
+        bq_push(&frontier, 0.0f, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
     build_integration_field(&frontier, chunk, integration_field);
     build_flow_field(integration_field, inout_flow);
     fixup_field(inout_flow->target, integration_field, inout_flow, chunk);
+    stats_add_build(start_ticks);
+}
+
+void N_FieldGetStats(unsigned *out_built, float *out_build_rate)
+{
+    SDL_AtomicLock(&s_stats_lock);
+    unsigned built = s_fields_built;
+    uint64_t ticks = s_build_ticks;
+    SDL_AtomicUnlock(&s_stats_lock);
+
+    *out_built = built;
+    *out_build_rate = !ticks ? 0.0f 
+        : ((double)built) * SDL_GetPerformanceFrequency() / ticks;
+}
 
-    pq_coord_destroy(&frontier);
+void N_FieldClearStats(void)
+{
+    SDL_AtomicLock(&s_stats_lock);
+    s_fields_built = 0;
+    s_build_ticks = 0;
+    SDL_AtomicUnlock(&s_stats_lock);
 }
 
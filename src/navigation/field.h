@@ -45,12 +45,16 @@
 typedef uint64_t ff_id_t;
 struct nav_private;
 
+#if FIELD_RES_C > 64
+#error "LOS field rows must fit in a 64-bit word"
+#endif
+
+/* The flags are kept in bit-planes, with bit 'c' of row 'r' being the flag
+ * for the tile at (r, c). Use the accessors below. */
 struct LOS_field{
     struct coord chunk;
-    struct{
-        unsigned int visible : 1;
-        unsigned int wavefront_blocked : 1;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    uint64_t     visible[FIELD_RES_R];
+    uint64_t     wavefront_blocked[FIELD_RES_R];
 };
 
 struct field_target{
@@ -69,17 +73,28 @@ struct field_target{
             int          faction_id;
             vec3_t       map_pos;
             struct coord chunk;
+            /* Changes whenever enemies enter or leave the chunk */
+            uint32_t     presence;
         }enemies;
         uint64_t portalmask;
     };
 };
 
+/* The direction of every tile is kept in a nibble, with the even columns in 
+ * the low nibbles. Use the accessors below. */
 struct flow_field{
     struct coord chunk;
     struct field_target target;
-    struct{
-        unsigned dir_idx : 4;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    uint8_t      field[FIELD_RES_R][FIELD_RES_C / 2];
+};
+
+/* The cost of reaching the field's target from every tile, in the units of
+ * the tile costs. Unreachable tiles have a cost of INTEGRATION_INFINITE. 
+ */
+#define INTEGRATION_INFINITE (0xffff)
+
+struct integration_field{
+    uint16_t cost[FIELD_RES_R][FIELD_RES_C];
 };
 
 enum flow_dir{
@@ -96,11 +111,63 @@ enum flow_dir{
 
 extern vec2_t g_flow_dir_lookup[];
 
+static inline enum flow_dir N_FlowDir(const struct flow_field *ff, int r, int c)
+{
+    return (ff->field[r][c / 2] >> ((c & 1) * 4)) & 0xf;
+}
+
+static inline void N_SetFlowDir(struct flow_field *ff, int r, int c, enum flow_dir dir)
+{
+    int shift = (c & 1) * 4;
+    ff->field[r][c / 2] = (ff->field[r][c / 2] & ~(0xf << shift)) | (dir << shift);
+}
+
+static inline bool N_LOSVisible(const struct LOS_field *lf, int r, int c)
+{
+    return (lf->visible[r] >> c) & 1;
+}
+
+static inline void N_LOSSetVisible(struct LOS_field *lf, int r, int c, bool on)
+{
+    lf->visible[r] = (lf->visible[r] & ~(((uint64_t)1) << c)) | (((uint64_t)on) << c);
+}
+
+static inline bool N_LOSWavefrontBlocked(const struct LOS_field *lf, int r, int c)
+{
+    return (lf->wavefront_blocked[r] >> c) & 1;
+}
+
+static inline void N_LOSSetWavefrontBlocked(struct LOS_field *lf, int r, int c, bool on)
+{
+    lf->wavefront_blocked[r] = (lf->wavefront_blocked[r] & ~(((uint64_t)1) << c)) | (((uint64_t)on) << c);
+}
+
 ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target);
 void    N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out);
 void    N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
                           struct field_target target, struct flow_field *inout_flow);
 
+/* ------------------------------------------------------------------------
+ * Build a new flow field, outputting the integration field it was made from
+ * as well. Returns false if the field cannot be repaired later on, in which
+ * case the integration field is not valid.
+ * ------------------------------------------------------------------------
+ */
+bool    N_FlowFieldBuild(struct coord chunk_coord, const struct nav_private *priv,
+                         struct field_target target, struct flow_field *out_flow,
+                         struct integration_field *out_intf);
+
+/* ------------------------------------------------------------------------
+ * Bring a flow field made with N_FlowFieldBuild up to date after the 
+ * blockers changed on the specified tiles of its' chunk. Only the costs that
+ * depend on the changed tiles are recomputed, but the result is the same as
+ * building the field anew. Returns false if the field could not be repaired,
+ * in which case both fields are left in an unspecified state.
+ * ------------------------------------------------------------------------
+ */
+bool    N_FlowFieldRepair(const struct nav_private *priv, const struct coord *tiles, size_t ntiles,
+                          struct flow_field *inout_flow, struct integration_field *inout_intf);
+
 /* ------------------------------------------------------------------------
  * Update all tiles with a specific local island ID from the
  * 'local_islands' field for the chunk. The new directions will guide to
@@ -137,5 +204,14 @@ void    N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_des
                          const struct nav_private *priv, vec3_t map_pos, 
                          struct LOS_field *out_los, const struct LOS_field *prev_los);
 
+/* ------------------------------------------------------------------------
+ * Get the number of (flow and LOS) fields built since the stats were last
+ * cleared, along with the build throughput in fields per second of time 
+ * spent building them.
+ * ------------------------------------------------------------------------
+ */
+void    N_FieldGetStats(unsigned *out_built, float *out_build_rate);
+void    N_FieldClearStats(void);
+
 #endif
 
@@ -39,8 +39,17 @@
 #include "../lib/public/vec.h"
 #include "../event.h"
 #include "../config.h"
+#include "../settings.h"
+#include "../lib/public/pf_string.h"
 
 #include <assert.h>
+#include <float.h>
+#include <SDL.h>
+
+/* Node references are 16 bits wide */
+#define MAX_ENTRIES     (UINT16_MAX - 1)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
 
 
 LRU_CACHE_TYPE(los, struct LOS_field)
@@ -51,6 +60,18 @@ LRU_CACHE_TYPE(flow, struct flow_field)
 LRU_CACHE_PROTOTYPES(static, flow, struct flow_field)
 LRU_CACHE_IMPL(static, flow, struct flow_field)
 
+/* The integration field of a cached flow field, which allows the flow field
+ * to be repaired in place when the blockers in its' chunk change. */
+struct repair_entry{
+    /* Set if the field was repaired, until the next time it's queried */
+    bool                     repaired;
+    struct integration_field intf;
+};
+
+LRU_CACHE_TYPE(intf, struct repair_entry)
+LRU_CACHE_PROTOTYPES(static, intf, struct repair_entry)
+LRU_CACHE_IMPL(static, intf, struct repair_entry)
+
 LRU_CACHE_TYPE(ffid, ff_id_t)
 LRU_CACHE_PROTOTYPES(static, ffid, ff_id_t)
 LRU_CACHE_IMPL(static, ffid, ff_id_t)
@@ -59,6 +80,10 @@ LRU_CACHE_TYPE(grid_path, struct grid_path_desc)
 LRU_CACHE_PROTOTYPES(static, grid_path, struct grid_path_desc)
 LRU_CACHE_IMPL(static, grid_path, struct grid_path_desc)
 
+LRU_CACHE_TYPE(closest, struct closest_tiles_desc)
+LRU_CACHE_PROTOTYPES(static, closest, struct closest_tiles_desc)
+LRU_CACHE_IMPL(static, closest, struct closest_tiles_desc)
+
 VEC_TYPE(id, uint64_t)
 VEC_PROTOTYPES(static, id, uint64_t)
 VEC_IMPL(static, id, uint64_t)
@@ -71,16 +96,38 @@ KHASH_MAP_INIT_INT64(idvec, vec_id_t)
 
 static lru(los)          s_los_cache;       /* key: (dest_id, chunk coord) */
 static lru(flow)         s_flow_cache;      /* key: (ffid) */
+static lru(intf)         s_intf_cache;      /* key: (ffid) */
 /* The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
  * which could be used to retreive the relevant field from the flow cache. 
  * The reason for this is that the same flow field chunk can be shared between
  * many different paths. */
 static lru(ffid)         s_ffid_cache;      /* key: (dest_id, chunk_coord) */
 static lru(grid_path)    s_grid_path_cache; /* key: (chunk coord, tile start coord, tile dest coord) */
+static lru(closest)      s_closest_cache;   /* key: (target tile coord, island ID, ignore blockers flag) */
 
 /* The following structures are maintained for efficient invalidation of entries:*/
 static khash_t(idvec)   *s_chunk_ffield_map; /* key: (chunk coord) */
 static khash_t(idvec)   *s_chunk_lfield_map; /* key: (chunk coord) */
+static khash_t(idvec)   *s_chunk_closest_map; /* key: (chunk coord) */
+
+/* Every cache is limited by the memory taken up by its' entries, 
+ * including any heap buffers that they own. */
+static struct cache_budget{
+    size_t budget;
+    size_t used;
+}s_budgets[FC_NUM_CACHES];
+
+static const struct budget_setting{
+    const char *name;
+    int         default_kb;
+}s_budget_settings[FC_NUM_CACHES] = {
+    [FC_LOS]         = {"pf.nav.los_cache_kb",          CONFIG_LOS_CACHE_KB         },
+    [FC_FLOW]        = {"pf.nav.flow_cache_kb",         CONFIG_FLOW_CACHE_KB        },
+    [FC_INTEGRATION] = {"pf.nav.integration_cache_kb",  CONFIG_INTEGRATION_CACHE_KB },
+    [FC_MAPPING]     = {"pf.nav.mapping_cache_kb",      CONFIG_MAPPING_CACHE_KB     },
+    [FC_GRID_PATH]   = {"pf.nav.grid_path_cache_kb",    CONFIG_GRID_PATH_CACHE_KB   },
+    [FC_CLOSEST]     = {"pf.nav.closest_cache_kb",      CONFIG_CLOSEST_CACHE_KB     },
+};
 
 static struct priv_fc_stats{
     unsigned los_query;
@@ -89,10 +136,18 @@ static struct priv_fc_stats{
     unsigned flow_query;
     unsigned flow_hit;
     unsigned flow_invalidated;
+    unsigned flow_repaired;
+    unsigned flow_repair_hits;
     unsigned ffid_query;
     unsigned ffid_hit;
     unsigned grid_path_query;
     unsigned grid_path_hit;
+    unsigned closest_query;
+    unsigned closest_hit;
+    unsigned closest_invalidated;
+    unsigned evictions[FC_NUM_CACHES][FC_NUM_EVICT_REASONS];
+    uint64_t evict_age_ms[FC_NUM_CACHES];
+    unsigned evict_aged[FC_NUM_CACHES];
 }s_perfstats = {0};
 
 /*****************************************************************************/
@@ -133,11 +188,225 @@ uint64_t grid_path_key(struct coord local_start, struct coord local_dest,
          |  (( ((uint64_t)chunk.c)       & 0xffff) << 48));
 }
 
+uint64_t closest_key(struct coord target, uint16_t global_iid, bool ignore_blockers)
+{
+    return ((( ((uint64_t)target.r)        & 0xffff) <<  0)
+         |  (( ((uint64_t)target.c)        & 0xffff) << 16)
+         |  (( ((uint64_t)global_iid)      & 0xffff) << 32)
+         |  (( ((uint64_t)ignore_blockers) & 0x1   ) << 48));
+}
+
 static void on_grid_path_evict(struct grid_path_desc *victim)
 {
     vec_coord_destroy(&victim->path);
 }
 
+static void on_closest_evict(struct closest_tiles_desc *victim)
+{
+    vec_coord_destroy(&victim->tiles);
+}
+
+static size_t los_bytes(const struct LOS_field *lf)
+{
+    return sizeof(lru_node(los));
+}
+
+static size_t flow_bytes(const struct flow_field *ff)
+{
+    return sizeof(lru_node(flow));
+}
+
+static size_t intf_bytes(const struct repair_entry *entry)
+{
+    return sizeof(lru_node(intf));
+}
+
+static size_t ffid_bytes(const ff_id_t *ffid)
+{
+    return sizeof(lru_node(ffid));
+}
+
+static size_t grid_path_bytes(const struct grid_path_desc *gp)
+{
+    return sizeof(lru_node(grid_path)) + gp->path.capacity * sizeof(struct coord);
+}
+
+static size_t closest_bytes(const struct closest_tiles_desc *ct)
+{
+    return sizeof(lru_node(closest)) + ct->tiles.capacity * sizeof(struct coord);
+}
+
+/* The cost of making an entry again, in arbitrary units. Only relative 
+ * costs of entries in the same cache matter. */
+
+static float los_cost(const struct LOS_field *lf)
+{
+    return 1.0f;
+}
+
+static float flow_cost(const struct flow_field *ff)
+{
+    return 1.0f;
+}
+
+static float intf_cost(const struct repair_entry *entry)
+{
+    return 1.0f;
+}
+
+static float ffid_cost(const ff_id_t *ffid)
+{
+    return 1.0f;
+}
+
+static float grid_path_cost(const struct grid_path_desc *gp)
+{
+    /* The number of tiles expanded by the search grows with the cost of the 
+     * path. When there is no path, the search had to exhaust all the tiles 
+     * that were reachable from the start. */
+    if(!gp->exists)
+        return FIELD_RES_R * FIELD_RES_C;
+    return MAX(gp->cost, 1.0f);
+}
+
+static float closest_cost(const struct closest_tiles_desc *ct)
+{
+    /* All the tiles of the searched chunks may have been expanded */
+    int nchunks = (ct->max_chunk.r - ct->min_chunk.r + 1) 
+                * (ct->max_chunk.c - ct->min_chunk.c + 1);
+    return nchunks * FIELD_RES_R * FIELD_RES_C;
+}
+
+static bool over_budget(enum fc_cache cache, size_t bytes)
+{
+    return (s_budgets[cache].used + bytes > s_budgets[cache].budget);
+}
+
+static void note_evict(enum fc_cache cache, size_t bytes, uint32_t birth, 
+                       enum fc_evict_reason reason)
+{
+    assert(s_budgets[cache].used >= bytes);
+    s_budgets[cache].used -= bytes;
+    s_perfstats.evictions[cache][reason]++;
+
+    s_perfstats.evict_age_ms[cache] += SDL_GetTicks() - birth;
+    s_perfstats.evict_aged[cache]++;
+}
+
+/* Generates the wrappers for modifying the cache 's_<name>_cache' which 
+ * keep track of the memory used by its' entries. When making room for a new 
+ * entry, the victim is the entry that is the cheapest to make again for the 
+ * memory it takes up out of the CONFIG_FC_EVICT_WINDOW least recently used 
+ * entries. When all entries cost the same, this is the least recently used 
+ * entry. */
+#define CACHE_BUDGET_IMPL(name, type, id)                                                       \
+                                                                                                \
+    static bool name##_evict(uint64_t key, enum fc_evict_reason reason)                         \
+    {                                                                                           \
+        lru_node(name) *node = lru_##name##_peek_node(&s_##name##_cache, key);                  \
+        if(!node)                                                                               \
+            return false;                                                                       \
+                                                                                                \
+        note_evict(id, name##_bytes(&node->entry), node->birth, reason);                        \
+        if(s_##name##_cache.on_evict)                                                           \
+            s_##name##_cache.on_evict(&node->entry);                                            \
+        return lru_##name##_remove(&s_##name##_cache, key);                                     \
+    }                                                                                           \
+                                                                                                \
+    static uint64_t name##_victim(void)                                                         \
+    {                                                                                           \
+        lru_node(name) *curr;                                                                   \
+        uint64_t ret = 0;                                                                       \
+        float best = FLT_MAX;                                                                   \
+        int nvisited = 0;                                                                       \
+                                                                                                \
+        LRU_FOREACH_REVERSE(name, &s_##name##_cache, curr, {                                    \
+                                                                                                \
+            if(nvisited++ == CONFIG_FC_EVICT_WINDOW)                                            \
+                break;                                                                          \
+            float value = name##_cost(&curr->entry) / name##_bytes(&curr->entry);               \
+            if(value < best) {                                                                  \
+                best = value;                                                                   \
+                ret = curr->key;                                                                \
+            }                                                                                   \
+        });                                                                                     \
+        return ret;                                                                             \
+    }                                                                                           \
+                                                                                                \
+    static void name##_make_room(size_t bytes, size_t max_entries)                              \
+    {                                                                                           \
+        while(s_##name##_cache.used > 0                                                         \
+           && (over_budget(id, bytes) || s_##name##_cache.used > max_entries)) {                \
+            name##_evict(name##_victim(), FC_EVICT_BUDGET);                                     \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static void name##_put(uint64_t key, const type *entry)                                     \
+    {                                                                                           \
+        lru_node(name) *node = lru_##name##_peek_node(&s_##name##_cache, key);                  \
+        if(node)                                                                                \
+            s_budgets[id].used -= name##_bytes(&node->entry);                                   \
+        else                                                                                    \
+            name##_make_room(name##_bytes(entry), s_##name##_cache.capacity - 1);               \
+                                                                                                \
+        s_##name##_cache.clock = SDL_GetTicks();                                                \
+        lru_##name##_put(&s_##name##_cache, key, entry);                                        \
+        s_budgets[id].used += name##_bytes(entry);                                              \
+    }                                                                                           \
+                                                                                                \
+    static void name##_clear(void)                                                              \
+    {                                                                                           \
+        s_perfstats.evictions[id][FC_EVICT_CLEARED] += s_##name##_cache.used;                   \
+        s_budgets[id].used = 0;                                                                 \
+        lru_##name##_clear(&s_##name##_cache);                                                  \
+    }                                                                                           \
+                                                                                                \
+    static bool name##_set_budget(size_t budget)                                                \
+    {                                                                                           \
+        /* No entry takes up less memory than its' node */                                      \
+        size_t max_entries = MAX(1, MIN(MAX_ENTRIES, budget / sizeof(lru_node(name))));         \
+        s_budgets[id].budget = budget;                                                          \
+        name##_make_room(0, max_entries);                                                       \
+        return lru_##name##_set_capacity(&s_##name##_cache, max_entries);                       \
+    }
+
+CACHE_BUDGET_IMPL(los, struct LOS_field, FC_LOS)
+CACHE_BUDGET_IMPL(flow, struct flow_field, FC_FLOW)
+CACHE_BUDGET_IMPL(intf, struct repair_entry, FC_INTEGRATION)
+CACHE_BUDGET_IMPL(ffid, ff_id_t, FC_MAPPING)
+CACHE_BUDGET_IMPL(grid_path, struct grid_path_desc, FC_GRID_PATH)
+CACHE_BUDGET_IMPL(closest, struct closest_tiles_desc, FC_CLOSEST)
+
+static bool set_budget(enum fc_cache cache, size_t budget)
+{
+    switch(cache) {
+    case FC_LOS:            return los_set_budget(budget);
+    case FC_FLOW:           return flow_set_budget(budget);
+    case FC_INTEGRATION:    return intf_set_budget(budget);
+    case FC_MAPPING:        return ffid_set_budget(budget);
+    case FC_GRID_PATH:      return grid_path_set_budget(budget);
+    case FC_CLOSEST:        return closest_set_budget(budget);
+    default: assert(0);     return false;
+    }
+}
+
+static bool budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int > 0);
+}
+
+static void budget_commit(const struct sval *new_val)
+{
+    /* We aren't told which of the settings changed, so apply all of them */
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+
+        struct sval val;
+        if(Settings_Get(s_budget_settings[i].name, &val) != SS_OKAY)
+            continue;
+        set_budget(i, (size_t)val.as_int * 1024);
+    }
+}
+
 static void destroy_all_entries(khash_t(idvec) *hash)
 {
     uint32_t key;
@@ -169,10 +438,62 @@ static void field_map_add(khash_t(idvec) *hash, uint64_t key, uint64_t id)
     }
 }
 
-static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
+static void note_flow_query_hit(ff_id_t ffid)
+{
+    struct repair_entry *entry = lru_intf_peek(&s_intf_cache, ffid);
+    if(!entry || !entry->repaired)
+        return;
+
+    /* Without the repair, this would have been a miss */
+    entry->repaired = false;
+    s_perfstats.flow_repair_hits++;
+}
+
+static void remove_flow_field(ff_id_t ffid)
 {
-    for(int i = 0; i < size; i++) {
-        if(array[i] == item)
+    bool found = flow_evict(ffid, FC_EVICT_INVALIDATED);
+    s_perfstats.flow_invalidated += !!found;
+    intf_evict(ffid, FC_EVICT_INVALIDATED);
+}
+
+static void invalidate_los_at_chunk(struct coord chunk)
+{
+    uint64_t key = key_for_chunk(chunk);
+
+    khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
+    if(k == kh_end(s_chunk_lfield_map))
+        return;
+
+    vec_id_t *keys = &kh_val(s_chunk_lfield_map, k);
+    for(int i = 0; i < vec_size(keys); i++) {
+        bool found = los_evict(vec_AT(keys, i), FC_EVICT_INVALIDATED);
+        s_perfstats.los_invalidated += !!found;
+    }
+    vec_id_destroy(keys);
+    kh_del(idvec, s_chunk_lfield_map, k);
+}
+
+static void invalidate_closest_at_chunk(struct coord chunk)
+{
+    uint64_t key = key_for_chunk(chunk);
+
+    khiter_t k = kh_get(idvec, s_chunk_closest_map, key);
+    if(k == kh_end(s_chunk_closest_map))
+        return;
+
+    vec_id_t *keys = &kh_val(s_chunk_closest_map, k);
+    for(int i = 0; i < vec_size(keys); i++) {
+        bool found = closest_evict(vec_AT(keys, i), FC_EVICT_INVALIDATED);
+        s_perfstats.closest_invalidated += !!found;
+    }
+    vec_id_destroy(keys);
+    kh_del(idvec, s_chunk_closest_map, k);
+}
+
+static bool dest_array_contains(const vec_id_t *array, dest_id_t item)
+{
+    for(int i = 0; i < vec_size(array); i++) {
+        if(vec_AT(array, i) == item)
             return true;
     }
     return false;
@@ -184,33 +505,76 @@ static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
 
 bool N_FC_Init(void)
 {
-    if(!lru_los_init(&s_los_cache, CONFIG_LOS_CACHE_SZ, NULL))
+    if(!lru_los_init(&s_los_cache, 0, NULL))
         goto fail_los;
 
-    if(!lru_flow_init(&s_flow_cache, CONFIG_FLOW_CAHCE_SZ, NULL))
+    if(!lru_flow_init(&s_flow_cache, 0, NULL))
         goto fail_flow;
 
-    if(!lru_ffid_init(&s_ffid_cache, CONFIG_MAPPING_CACHE_SZ, NULL))
+    if(!lru_intf_init(&s_intf_cache, 0, NULL))
+        goto fail_intf;
+
+    if(!lru_ffid_init(&s_ffid_cache, 0, NULL))
         goto fail_ffid;
 
-    if(!lru_grid_path_init(&s_grid_path_cache, CONFIG_GRID_PATH_CACHE_SZ, on_grid_path_evict))
+    if(!lru_grid_path_init(&s_grid_path_cache, 0, on_grid_path_evict))
         goto fail_grid_path;
 
+    if(!lru_closest_init(&s_closest_cache, 0, on_closest_evict))
+        goto fail_closest;
+
     if(NULL == (s_chunk_ffield_map = kh_init(idvec)))
         goto fail_chunk_ffield;
 
     if(NULL == (s_chunk_lfield_map = kh_init(idvec)))
         goto fail_chunk_lfield;
 
+    if(NULL == (s_chunk_closest_map = kh_init(idvec)))
+        goto fail_chunk_closest;
+
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+        if(!set_budget(i, (size_t)s_budget_settings[i].default_kb * 1024))
+            goto fail_budget;
+    }
+
+    ss_e status;
+    (void)status;
+
+    /* If the settings were already loaded, the saved budgets are applied */
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+
+        struct setting sett = (struct setting){
+            .val = (struct sval) {
+                .type = ST_TYPE_INT,
+                .as_int = s_budget_settings[i].default_kb
+            },
+            .prio = 0,
+            .validate = budget_validate,
+            .commit = budget_commit,
+        };
+        pf_strlcpy(sett.name, s_budget_settings[i].name, sizeof(sett.name));
+
+        status = Settings_Create(sett);
+        assert(status == SS_OKAY);
+    }
+
     return true;
 
+fail_budget:
+    kh_destroy(idvec, s_chunk_closest_map);
+fail_chunk_closest:
+    kh_destroy(idvec, s_chunk_lfield_map);
 fail_chunk_lfield:
     kh_destroy(idvec, s_chunk_ffield_map);
 fail_chunk_ffield:
+    lru_closest_destroy(&s_closest_cache);
+fail_closest:
     lru_grid_path_destroy(&s_grid_path_cache);
 fail_grid_path:
     lru_ffid_destroy(&s_ffid_cache);
 fail_ffid:
+    lru_intf_destroy(&s_intf_cache);
+fail_intf:
     lru_flow_destroy(&s_flow_cache);
 fail_flow:
     lru_los_destroy(&s_los_cache);
@@ -222,33 +586,45 @@ void N_FC_Shutdown(void)
 {
     lru_los_destroy(&s_los_cache);
     lru_flow_destroy(&s_flow_cache);
+    lru_intf_destroy(&s_intf_cache);
     lru_ffid_destroy(&s_ffid_cache);
     lru_grid_path_destroy(&s_grid_path_cache);
+    lru_closest_destroy(&s_closest_cache);
+    memset(s_budgets, 0, sizeof(s_budgets));
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_destroy(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_destroy(idvec, s_chunk_lfield_map);
+
+    destroy_all_entries(s_chunk_closest_map);
+    kh_destroy(idvec, s_chunk_closest_map);
 }
 
 void N_FC_ClearAll(void)
 {
-    lru_los_clear(&s_los_cache);
-    lru_flow_clear(&s_flow_cache);
-    lru_ffid_clear(&s_ffid_cache);
-    lru_grid_path_clear(&s_grid_path_cache);
+    los_clear();
+    flow_clear();
+    intf_clear();
+    ffid_clear();
+    grid_path_clear();
+    closest_clear();
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_clear(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_clear(idvec, s_chunk_lfield_map);
+
+    destroy_all_entries(s_chunk_closest_map);
+    kh_clear(idvec, s_chunk_closest_map);
 }
 
 void N_FC_ClearStats(void)
 {
     memset(&s_perfstats, 0, sizeof(s_perfstats));
+    N_FieldClearStats();
 }
 
 void N_FC_GetStats(struct fc_stats *out_stats)
@@ -264,6 +640,8 @@ void N_FC_GetStats(struct fc_stats *out_stats)
     out_stats->flow_hit_rate = !s_perfstats.flow_query ? 0
         : ((float)s_perfstats.flow_hit) / s_perfstats.flow_query;
     out_stats->flow_invalidated = s_perfstats.flow_invalidated;
+    out_stats->flow_repaired = s_perfstats.flow_repaired;
+    out_stats->flow_repair_hits = s_perfstats.flow_repair_hits;
 
     out_stats->ffid_used = s_ffid_cache.used;
     out_stats->ffid_max = s_ffid_cache.capacity;
@@ -274,6 +652,23 @@ void N_FC_GetStats(struct fc_stats *out_stats)
     out_stats->grid_path_max = s_grid_path_cache.capacity;
     out_stats->grid_path_hit_rate = !s_perfstats.grid_path_hit ? 0
         : ((float)s_perfstats.grid_path_hit) / s_perfstats.grid_path_query;
+
+    out_stats->closest_used = s_closest_cache.used;
+    out_stats->closest_max = s_closest_cache.capacity;
+    out_stats->closest_hit_rate = !s_perfstats.closest_hit ? 0
+        : ((float)s_perfstats.closest_hit) / s_perfstats.closest_query;
+    out_stats->closest_invalidated = s_perfstats.closest_invalidated;
+
+    N_FieldGetStats(&out_stats->fields_built, &out_stats->field_build_rate);
+
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+
+        out_stats->bytes_used[i] = s_budgets[i].used;
+        out_stats->bytes_max[i] = s_budgets[i].budget;
+        memcpy(out_stats->evictions[i], s_perfstats.evictions[i], sizeof(out_stats->evictions[i]));
+        out_stats->avg_evict_age[i] = !s_perfstats.evict_aged[i] ? 0
+            : (s_perfstats.evict_age_ms[i] / 1000.0f) / s_perfstats.evict_aged[i];
+    }
 }
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord)
@@ -295,7 +690,7 @@ const struct LOS_field *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord)
 void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    lru_los_put(&s_los_cache, key, lf);
+    los_put(key, lf);
     field_map_add(s_chunk_lfield_map, key_for_chunk(chunk_coord), key);
 }
 
@@ -305,17 +700,24 @@ bool N_FC_ContainsFlowField(ff_id_t ffid)
 
     s_perfstats.flow_query++;
     s_perfstats.flow_hit += !!ret;
+    if(ret)
+        note_flow_query_hit(ffid);
     return ret;
 }
 
 const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid)
 {
-    return lru_flow_at(&s_flow_cache, ffid);
+    const struct flow_field *ret = lru_flow_at(&s_flow_cache, ffid);
+    if(ret)
+        note_flow_query_hit(ffid);
+    return ret;
 }
 
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff)
 {
-    lru_flow_put(&s_flow_cache, ffid, ff);
+    flow_put(ffid, ff);
+    /* The integration field no longer matches */
+    intf_evict(ffid, FC_EVICT_INVALIDATED);
 
     struct coord chunk = (struct coord){(ffid >> 8) & 0xff, ffid & 0xff};
     field_map_add(s_chunk_ffield_map, key_for_chunk(chunk), ffid);
@@ -331,10 +733,19 @@ bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_
     return ret;
 }
 
+void N_FC_PutIntegrationField(ff_id_t ffid, const struct integration_field *intf)
+{
+    assert(lru_flow_peek(&s_flow_cache, ffid));
+
+    struct repair_entry entry = (struct repair_entry){ .repaired = false };
+    memcpy(&entry.intf, intf, sizeof(entry.intf));
+    intf_put(ffid, &entry);
+}
+
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid)
 {
     uint64_t key = key_for_dest_and_chunk(dest_id, chunk_coord);
-    lru_ffid_put(&s_ffid_cache, key, &ffid);
+    ffid_put(key, &ffid);
 }
 
 bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
@@ -352,7 +763,56 @@ void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, const struct grid_path_desc *in)
 {
     uint64_t key = grid_path_key(local_start, local_dest, chunk);
-    lru_grid_path_put(&s_grid_path_cache, key, in);
+    grid_path_put(key, in);
+}
+
+bool N_FC_GetClosestTiles(struct coord target, uint16_t global_iid, bool ignore_blockers,
+                          struct closest_tiles_desc *out)
+{
+    uint64_t key = closest_key(target, global_iid, ignore_blockers);
+    bool ret = lru_closest_get(&s_closest_cache, key, out);
+
+    s_perfstats.closest_query++;
+    s_perfstats.closest_hit += !!ret;
+    return ret;
+}
+
+void N_FC_PutClosestTiles(struct coord target, uint16_t global_iid, bool ignore_blockers,
+                          const struct closest_tiles_desc *in)
+{
+    uint64_t key = closest_key(target, global_iid, ignore_blockers);
+    closest_put(key, in);
+
+    /* The island IDs only change all at once, but the blockers change 
+     * chunk by chunk */
+    if(ignore_blockers)
+        return;
+
+    for(int r = in->min_chunk.r; r <= in->max_chunk.r; r++) {
+    for(int c = in->min_chunk.c; c <= in->max_chunk.c; c++) {
+        field_map_add(s_chunk_closest_map, key_for_chunk((struct coord){r, c}), key);
+    }}
+}
+
+void N_FC_InvalidateClosestTiles(void)
+{
+    uint64_t key;
+    struct closest_tiles_desc ct_val;
+
+    LRU_FOREACH_SAFE_REMOVE(closest, &s_closest_cache, key, ct_val, {
+
+        (void)ct_val;
+        bool found = closest_evict(key, FC_EVICT_INVALIDATED);
+        s_perfstats.closest_invalidated += !!found;
+    });
+
+    destroy_all_entries(s_chunk_closest_map);
+    kh_clear(idvec, s_chunk_closest_map);
+}
+
+void N_FC_InvalidateClosestTilesAtChunk(struct coord chunk)
+{
+    invalidate_closest_at_chunk(chunk);
 }
 
 void N_FC_InvalidateAllAtChunk(struct coord chunk)
@@ -364,27 +824,61 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk)
      * necessarily be in the caches. */
 
     uint64_t key = key_for_chunk(chunk);
+    invalidate_los_at_chunk(chunk);
+    invalidate_closest_at_chunk(chunk);
 
-    khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
-    if(k != kh_end(s_chunk_lfield_map)) {
+    khiter_t k = kh_get(idvec, s_chunk_ffield_map, key);
+    if(k != kh_end(s_chunk_ffield_map)) {
 
-        vec_id_t *keys = &kh_val(s_chunk_lfield_map, k);
-        for(int i = 0; i < vec_size(keys); i++) {
-            bool found = lru_los_remove(&s_los_cache, vec_AT(keys, i));
-            s_perfstats.los_invalidated += !!found;
-        }
+        vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
+        for(int i = 0; i < vec_size(keys); i++)
+            remove_flow_field(vec_AT(keys, i));
         vec_id_destroy(keys);
-        kh_del(idvec, s_chunk_lfield_map, k);
+        kh_del(idvec, s_chunk_ffield_map, k);
     }
+}
 
-    k = kh_get(idvec, s_chunk_ffield_map, key);
-    if(k != kh_end(s_chunk_ffield_map)) {
+void N_FC_RepairAllAtChunk(struct coord chunk, const struct nav_private *priv, 
+                           const struct coord *tiles, size_t ntiles)
+{
+    uint64_t key = key_for_chunk(chunk);
+    invalidate_los_at_chunk(chunk);
+    invalidate_closest_at_chunk(chunk);
 
-        vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
-        for(int i = 0; i < vec_size(keys); i++) {
-            bool found = lru_flow_remove(&s_flow_cache, vec_AT(keys, i));
-            s_perfstats.flow_invalidated += !!found;
+    khiter_t k = kh_get(idvec, s_chunk_ffield_map, key);
+    if(k == kh_end(s_chunk_ffield_map))
+        return;
+
+    /* Keep the keys of the fields that were repaired, dropping the rest */
+    vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
+    size_t nkept = 0;
+
+    for(int i = 0; i < vec_size(keys); i++) {
+
+        ff_id_t ffid = vec_AT(keys, i);
+        bool dup = false;
+        for(int j = 0; j < nkept; j++) {
+            if(vec_AT(keys, j) == ffid)
+                dup = true;
         }
+        if(dup)
+            continue;
+
+        struct flow_field *ff = lru_flow_peek(&s_flow_cache, ffid);
+        struct repair_entry *entry = lru_intf_peek(&s_intf_cache, ffid);
+
+        if(ff && entry && N_FlowFieldRepair(priv, tiles, ntiles, ff, &entry->intf)) {
+
+            entry->repaired = true;
+            s_perfstats.flow_repaired++;
+            vec_AT(keys, nkept++) = ffid;
+            continue;
+        }
+        remove_flow_field(ffid);
+    }
+
+    keys->size = nkept;
+    if(nkept == 0) {
         vec_id_destroy(keys);
         kh_del(idvec, s_chunk_ffield_map, k);
     }
@@ -392,8 +886,8 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk)
 
 void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 {
-    dest_id_t paths[CONFIG_FLOW_CAHCE_SZ];
-    size_t npaths = 0;
+    vec_id_t paths;
+    vec_id_init(&paths);
 
     uint64_t key;
     ff_id_t ffid_val;
@@ -407,9 +901,9 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
         struct coord curr_chunk = key_chunk(key);
 
         if(0 == memcmp(&curr_chunk, &chunk, sizeof(chunk))
-        && !dest_array_contains(paths, npaths, curr_dest)) {
+        && !dest_array_contains(&paths, curr_dest)) {
 
-            paths[npaths++] = curr_dest;
+            vec_id_push(&paths, curr_dest);
         }
     });
 
@@ -421,11 +915,8 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
         (void)ff_val;
         dest_id_t curr_dest = key_dest(key);
 
-        if(dest_array_contains(paths, npaths, curr_dest)) {
-        
-            bool found = lru_flow_remove(&s_flow_cache, key);
-            s_perfstats.flow_invalidated += !!found;
-        }
+        if(dest_array_contains(&paths, curr_dest))
+            remove_flow_field(key);
     });
 
     /* And remove all the LOS fields as well */
@@ -435,11 +926,13 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
         (void)los_val;
         dest_id_t curr_dest = key_dest(key);
 
-        if(dest_array_contains(paths, npaths, curr_dest)) {
+        if(dest_array_contains(&paths, curr_dest)) {
         
-            bool found = lru_los_remove(&s_los_cache, key);
+            bool found = los_evict(key, FC_EVICT_INVALIDATED);
             s_perfstats.los_invalidated += !!found;
         }
     });
+
+    vec_id_destroy(&paths);
 }
 
@@ -60,6 +60,13 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk);
  */
 void N_FC_InvalidateAllThroughChunk(struct coord chunk);
 
+/* Bring all the flow fields for a particular chunk up to date after the blockers 
+ * changed on the specified tiles. The fields that cannot be repaired and all the 
+ * LOS fields for the chunk are invalidated.
+ */
+void N_FC_RepairAllAtChunk(struct coord chunk, const struct nav_private *priv, 
+                           const struct coord *tiles, size_t ntiles);
+
 /*###########################################################################*/
 /* LOS FIELD CACHING                                                         */
 /*###########################################################################*/
@@ -82,6 +89,10 @@ const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid);
 
 bool N_FC_ContainsFlowField(ff_id_t ffid);
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff);
+/* Keep the integration field that the cached flow field was built from, so 
+ * that the flow field can be repaired. It is dropped when the flow field is
+ * replaced. */
+void N_FC_PutIntegrationField(ff_id_t ffid, const struct integration_field *intf);
 
 bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ff);
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid);
@@ -102,5 +113,37 @@ bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
 void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, const struct grid_path_desc *in);
 
+
+/*###########################################################################*/
+/* CLOSEST TILES CACHING                                                     */
+/*###########################################################################*/
+
+/* The tiles of an island which are the closest to a target tile. Tile
+ * coordinates are relative to the top left corner of the map.
+ */
+struct closest_tiles_desc{
+    vec_coord_t tiles;
+    /* The chunks that had to be searched. When the result depends on the 
+     * blockers, it is invalidated when they change in any of these chunks. */
+    struct coord min_chunk, max_chunk;
+};
+
+/* The 'tiles' buffer of the output still belongs to the cache and must not be
+ * modified. 
+ */
+bool N_FC_GetClosestTiles(struct coord target, uint16_t global_iid, bool ignore_blockers,
+                          struct closest_tiles_desc *out);
+/* The cache takes ownership of the 'tiles' buffer.
+ */
+void N_FC_PutClosestTiles(struct coord target, uint16_t global_iid, bool ignore_blockers,
+                          const struct closest_tiles_desc *in);
+/* Drop all the entries after the island IDs have been reassigned.
+ */
+void N_FC_InvalidateClosestTiles(void);
+/* Drop the entries that depend on the blockers of the chunk, right after 
+ * they have changed.
+ */
+void N_FC_InvalidateClosestTilesAtChunk(struct coord chunk);
+
 #endif
 
@@ -0,0 +1,425 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "influence.h"
+#include "nav_private.h"
+#include "a_star.h"
+#include "../game/public/game.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/pqueue.h"
+#include "../perf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+#define IDX(r, width, c)    ((r) * (width) + (c))
+#define SLOT(chunk_idx, i)  ((chunk_idx) * MAX_PORTALS_PER_CHUNK + (i))
+
+struct presence{
+    int      faction_id;
+    uint32_t chunk_idx;
+};
+
+KHASH_MAP_INIT_INT(presence, struct presence)
+
+PQUEUE_TYPE(slot, uint32_t)
+PQUEUE_IMPL(static, slot, uint32_t)
+
+struct seeker{
+    bool      valid;
+    /* The state that the portal masks were derived from */
+    uint16_t  enemies;
+    uint32_t  graph_gen;
+    uint32_t  layout_gen[MAX_FACTIONS];
+    /* For every chunk without enemies, the portals leading to the closest
+     * ones from each connected component of the chunk's portals */
+    uint64_t *portalmasks;
+};
+
+struct influence{
+    khash_t(presence) *ents;
+    size_t             nchunks;
+    /* The number of entities of every faction in every chunk, and the 
+     * number of times that any have entered or left the chunk */
+    uint16_t         (*counts)[MAX_FACTIONS];
+    uint32_t         (*stamps)[MAX_FACTIONS];
+    /* Incremented whenever a chunk gains its' first or loses its' last 
+     * entity of the faction */
+    uint32_t           layout_gen[MAX_FACTIONS];
+    uint32_t           graph_gen;
+    /* The cost of reaching the closest enemies from every portal slot,
+     * used while deriving the portal masks */
+    float             *dist;
+    struct seeker      seekers[MAX_FACTIONS];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void add_presence(struct influence *inf, int faction_id, uint32_t chunk_idx, int delta)
+{
+    uint16_t *count = &inf->counts[chunk_idx][faction_id];
+    bool had = (*count > 0);
+
+    *count += delta;
+    inf->stamps[chunk_idx][faction_id]++;
+
+    if(had != (*count > 0))
+        inf->layout_gen[faction_id]++;
+}
+
+static uint16_t enemy_factions(int faction_id)
+{
+    uint16_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+
+        enum diplomacy_state ds;
+        if(G_GetDiplomacyState(i, faction_id, &ds) && ds == DIPLOMACY_STATE_WAR)
+            ret |= (((uint16_t)1) << i);
+    }
+    return ret;
+}
+
+static bool has_enemies(const struct influence *inf, uint16_t enemies, uint32_t chunk_idx)
+{
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if((enemies & (((uint16_t)1) << i)) && inf->counts[chunk_idx][i] > 0)
+            return true;
+    }
+    return false;
+}
+
+static uint32_t enemy_presence(const struct influence *inf, uint16_t enemies, uint32_t chunk_idx)
+{
+    uint32_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(enemies & (((uint16_t)1) << i))
+            ret += inf->stamps[chunk_idx][i];
+    }
+    return ret;
+}
+
+static bool seeker_current(const struct influence *inf, const struct seeker *seeker, 
+                           uint16_t enemies)
+{
+    if(!seeker->valid)
+        return false;
+    if(seeker->enemies != enemies || seeker->graph_gen != inf->graph_gen)
+        return false;
+
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if((enemies & (((uint16_t)1) << i)) && seeker->layout_gen[i] != inf->layout_gen[i])
+            return false;
+    }
+    return true;
+}
+
+/* Find the cost of the path from every portal to the closest chunk holding
+ * enemies, with a multi-source Dijkstra search over the active links. The 
+ * costs of the links between two portals are treated as symmetric. */
+static bool enemy_dists(const struct nav_private *priv, const struct influence *inf, 
+                        uint16_t enemies, float *out)
+{
+    for(size_t i = 0; i < inf->nchunks * MAX_PORTALS_PER_CHUNK; i++)
+        out[i] = INFINITY;
+
+    pq(slot) frontier;
+    pq_slot_init(&frontier);
+    bool ret = true;
+
+    for(uint32_t i = 0; i < inf->nchunks; i++) {
+
+        if(!has_enemies(inf, enemies, i))
+            continue;
+
+        for(int j = 0; j < priv->chunks[i].num_portals; j++) {
+            out[SLOT(i, j)] = 0.0f;
+            if(!pq_slot_push(&frontier, 0.0f, SLOT(i, j)))
+                ret = false;
+        }
+    }
+
+    while(ret && pq_size(&frontier) > 0) {
+
+        uint32_t curr;
+        float prio = frontier.nodes[1].priority; /* The heap is 1-indexed */
+        pq_slot_pop(&frontier, &curr);
+
+        /* Stale entry, the slot was already reached more cheaply */
+        if(prio > out[curr])
+            continue;
+
+        const struct nav_chunk *chunk = &priv->chunks[curr / MAX_PORTALS_PER_CHUNK];
+        const struct portal *port = &chunk->portals[curr % MAX_PORTALS_PER_CHUNK];
+
+        for(int i = 0; i <= port->num_neighbours; i++) {
+
+            if(i < port->num_neighbours && port->edges[i].es == EDGE_STATE_BLOCKED)
+                continue;
+
+            const struct portal *next = (i < port->num_neighbours) 
+                                      ? port->edges[i].neighbour : port->connected;
+            float hop = (i < port->num_neighbours) 
+                      ? AStar_PortalHopCost(port->edges[i].cost) : AStar_PortalHopCost(1);
+
+            uint32_t next_chunk = IDX(next->chunk.r, priv->width, next->chunk.c);
+            uint32_t next_slot = SLOT(next_chunk, next - priv->chunks[next_chunk].portals);
+
+            float cost = out[curr] + hop;
+            if(!(cost < out[next_slot]))
+                continue;
+
+            out[next_slot] = cost;
+            if(!pq_slot_push(&frontier, cost, next_slot))
+                ret = false;
+        }
+    }
+
+    pq_slot_destroy(&frontier);
+    return ret;
+}
+
+static uint64_t chunk_portalmask(const struct nav_private *priv, const float *dist, 
+                                 uint32_t chunk_idx)
+{
+    const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    uint64_t ret = 0;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        if(dist[SLOT(chunk_idx, i)] == INFINITY)
+            continue;
+
+        /* Keep the first of the closest portals of every component */
+        bool best = true;
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            if(chunk->portals[j].component_id != chunk->portals[i].component_id)
+                continue;
+
+            float a = dist[SLOT(chunk_idx, i)], b = dist[SLOT(chunk_idx, j)];
+            if(b < a || (b == a && j < i)) {
+                best = false;
+                break;
+            }
+        }
+
+        if(best)
+            ret |= (((uint64_t)1) << i);
+    }
+    return ret;
+}
+
+static bool seeker_update(const struct nav_private *priv, struct influence *inf, 
+                          struct seeker *seeker, uint16_t enemies)
+{
+    PERF_ENTER();
+    seeker->valid = false;
+
+    if(!seeker->portalmasks) {
+        seeker->portalmasks = malloc(inf->nchunks * sizeof(uint64_t));
+        if(!seeker->portalmasks)
+            PERF_RETURN(false);
+    }
+
+    if(!enemy_dists(priv, inf, enemies, inf->dist))
+        PERF_RETURN(false);
+
+    for(uint32_t i = 0; i < inf->nchunks; i++) {
+        seeker->portalmasks[i] = has_enemies(inf, enemies, i) ? 0 
+                               : chunk_portalmask(priv, inf->dist, i);
+    }
+
+    seeker->valid = true;
+    seeker->enemies = enemies;
+    seeker->graph_gen = inf->graph_gen;
+    memcpy(seeker->layout_gen, inf->layout_gen, sizeof(seeker->layout_gen));
+    PERF_RETURN(true);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_InfluenceInit(struct nav_private *priv)
+{
+    struct influence *inf = calloc(1, sizeof(struct influence));
+    if(!inf)
+        goto fail_alloc;
+
+    inf->nchunks = priv->width * priv->height;
+    if(!(inf->ents = kh_init(presence)))
+        goto fail_ents;
+    if(!(inf->counts = calloc(inf->nchunks, sizeof(inf->counts[0]))))
+        goto fail_counts;
+    if(!(inf->stamps = calloc(inf->nchunks, sizeof(inf->stamps[0]))))
+        goto fail_stamps;
+    if(!(inf->dist = malloc(inf->nchunks * MAX_PORTALS_PER_CHUNK * sizeof(float))))
+        goto fail_dist;
+
+    priv->influence = inf;
+    return true;
+
+fail_dist:
+    free(inf->stamps);
+fail_stamps:
+    free(inf->counts);
+fail_counts:
+    kh_destroy(presence, inf->ents);
+fail_ents:
+    free(inf);
+fail_alloc:
+    return false;
+}
+
+void N_InfluenceFree(struct nav_private *priv)
+{
+    struct influence *inf = priv->influence;
+    if(!inf)
+        return;
+
+    for(int i = 0; i < MAX_FACTIONS; i++)
+        free(inf->seekers[i].portalmasks);
+    free(inf->dist);
+    free(inf->stamps);
+    free(inf->counts);
+    kh_destroy(presence, inf->ents);
+    free(inf);
+    priv->influence = NULL;
+}
+
+size_t N_InfluenceMemoryUsage(const struct nav_private *priv)
+{
+    const struct influence *inf = priv->influence;
+    if(!inf)
+        return 0;
+
+    size_t ret = sizeof(struct influence);
+    ret += kh_n_buckets(inf->ents) * (sizeof(uint32_t) + sizeof(struct presence));
+    ret += inf->nchunks * (sizeof(inf->counts[0]) + sizeof(inf->stamps[0]));
+    ret += inf->nchunks * MAX_PORTALS_PER_CHUNK * sizeof(float);
+
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(inf->seekers[i].portalmasks)
+            ret += inf->nchunks * sizeof(uint64_t);
+    }
+    return ret;
+}
+
+void N_InfluenceSetEntity(struct nav_private *priv, uint32_t uid, int faction_id, 
+                          struct coord chunk)
+{
+    struct influence *inf = priv->influence;
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+
+    struct presence new = (struct presence){
+        .faction_id = faction_id,
+        .chunk_idx = IDX(chunk.r, priv->width, chunk.c)
+    };
+
+    khiter_t k = kh_get(presence, inf->ents, uid);
+    if(k != kh_end(inf->ents)) {
+
+        struct presence *old = &kh_value(inf->ents, k);
+        if(old->faction_id == new.faction_id && old->chunk_idx == new.chunk_idx)
+            return;
+
+        add_presence(inf, old->faction_id, old->chunk_idx, -1);
+        *old = new;
+    }else{
+
+        int ret;
+        k = kh_put(presence, inf->ents, uid, &ret);
+        if(ret == -1)
+            return;
+        kh_value(inf->ents, k) = new;
+    }
+    add_presence(inf, new.faction_id, new.chunk_idx, +1);
+}
+
+void N_InfluenceRemoveEntity(struct nav_private *priv, uint32_t uid)
+{
+    struct influence *inf = priv->influence;
+
+    khiter_t k = kh_get(presence, inf->ents, uid);
+    if(k == kh_end(inf->ents))
+        return;
+
+    struct presence old = kh_value(inf->ents, k);
+    add_presence(inf, old.faction_id, old.chunk_idx, -1);
+    kh_del(presence, inf->ents, k);
+}
+
+void N_InfluenceGraphChanged(struct nav_private *priv)
+{
+    priv->influence->graph_gen++;
+}
+
+bool N_InfluenceSeekTarget(struct nav_private *priv, vec3_t map_pos, int faction_id, 
+                           struct coord chunk, struct field_target *out)
+{
+    struct influence *inf = priv->influence;
+    struct seeker *seeker = &inf->seekers[faction_id];
+    uint32_t chunk_idx = IDX(chunk.r, priv->width, chunk.c);
+
+    uint16_t enemies = enemy_factions(faction_id);
+    if(!seeker_current(inf, seeker, enemies) && !seeker_update(priv, inf, seeker, enemies))
+        return false;
+
+    if(has_enemies(inf, enemies, chunk_idx)) {
+
+        *out = (struct field_target){
+            .type = TARGET_ENEMIES,
+            .enemies.faction_id = faction_id,
+            .enemies.map_pos = map_pos,
+            .enemies.chunk = chunk,
+            .enemies.presence = enemy_presence(inf, enemies, chunk_idx)
+        };
+        return true;
+    }
+
+    if(seeker->portalmasks[chunk_idx] == 0)
+        return false;
+
+    *out = (struct field_target){
+        .type = TARGET_PORTALMASK,
+        .portalmask = seeker->portalmasks[chunk_idx]
+    };
+    return true;
+}
+
@@ -0,0 +1,88 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef INFLUENCE_H
+#define INFLUENCE_H
+
+#include "nav_data.h"
+#include "field.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct nav_private;
+
+/* The 'influence' of every faction is the number of its' combatable 
+ * entities in every chunk. This is kept up to date incrementally, as 
+ * the entities are moved between chunks. From it, the chunks holding 
+ * enemies of a faction, as well as the portal that leads towards the
+ * closest enemies from every other chunk, are derived. This is redone 
+ * only after the influence of an enemy faction has moved to different 
+ * chunks, or the portal graph has changed. */
+
+bool   N_InfluenceInit(struct nav_private *priv);
+void   N_InfluenceFree(struct nav_private *priv);
+size_t N_InfluenceMemoryUsage(const struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Record that the entity is in the chunk. This is a no-op unless the 
+ * entity has changed chunks or factions since it was last recorded.
+ * ------------------------------------------------------------------------
+ */
+void   N_InfluenceSetEntity(struct nav_private *priv, uint32_t uid, int faction_id, 
+                            struct coord chunk);
+void   N_InfluenceRemoveEntity(struct nav_private *priv, uint32_t uid);
+
+/* ------------------------------------------------------------------------
+ * Must be called whenever the portals or the states of the links between
+ * them change.
+ * ------------------------------------------------------------------------
+ */
+void   N_InfluenceGraphChanged(struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Get the target of the field guiding the faction's entities in the chunk
+ * towards the closest enemies. This is either the enemies in the chunk 
+ * itself, or a mask of the portals leading to the closest ones from every 
+ * part of the chunk. A field made for a different target is out of date.
+ * Returns false if no enemies can be reached from the chunk.
+ * ------------------------------------------------------------------------
+ */
+bool   N_InfluenceSeekTarget(struct nav_private *priv, vec3_t map_pos, int faction_id, 
+                             struct coord chunk, struct field_target *out);
+
+#endif
+
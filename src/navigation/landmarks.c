@@ -0,0 +1,464 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "landmarks.h"
+#include "nav_private.h"
+#include "a_star.h"
+#include "../lib/public/pqueue.h"
+#include "../perf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+/* The number of landmarks in every connected component of the portal graph.
+ * More landmarks give tighter bounds at the cost of memory and of the time 
+ * taken to compute every bound. */
+#define MAX_LANDMARKS   (8)
+#define IDX(r, width, c)((r) * (width) + (c))
+
+PQUEUE_TYPE(node, uint32_t)
+PQUEUE_IMPL(static, node, uint32_t)
+
+/* The portal graph, with all edges active, in compressed sparse row form */
+struct graph{
+    size_t    nnodes;
+    uint32_t *offsets; /* 'nnodes + 1' entries */
+    uint32_t *targets;
+    float    *costs;
+};
+
+struct landmarks{
+    size_t    nportals;
+    /* Index of the first portal of every chunk - the rest of the chunk's 
+     * portals follow it */
+    uint32_t *chunk_base;
+    /* The connected component of every portal, when all edges are active */
+    unsigned *component;
+    /* The cost of the path from every landmark of the portal's component 
+     * to the portal, and from the portal to every landmark */
+    float   (*from)[MAX_LANDMARKS];
+    float   (*to)[MAX_LANDMARKS];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t portal_index(const struct nav_private *priv, const struct landmarks *lm, 
+                             const struct portal *port)
+{
+    size_t chunk_idx = IDX(port->chunk.r, priv->width, port->chunk.c);
+    return lm->chunk_base[chunk_idx] + (port - priv->chunks[chunk_idx].portals);
+}
+
+static void graph_destroy(struct graph *graph)
+{
+    free(graph->offsets);
+    free(graph->targets);
+    free(graph->costs);
+}
+
+static bool graph_build(const struct nav_private *priv, const struct landmarks *lm, 
+                        bool reverse, struct graph *out)
+{
+    size_t nedges = 0;
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        for(int j = 0; j < chunk->num_portals; j++)
+            nedges += chunk->portals[j].num_neighbours + 1;
+    }
+
+    out->nnodes = lm->nportals;
+    out->offsets = calloc(lm->nportals + 1, sizeof(uint32_t));
+    out->targets = malloc(nedges * sizeof(uint32_t));
+    out->costs = malloc(nedges * sizeof(float));
+
+    if(!out->offsets || !out->targets || !out->costs) {
+        graph_destroy(out);
+        return false;
+    }
+
+    /* Count the edges leaving every node, and then place them */
+    for(int pass = 0; pass < 2; pass++) {
+        for(int i = 0; i < priv->width * priv->height; i++) {
+
+            const struct nav_chunk *chunk = &priv->chunks[i];
+            for(int j = 0; j < chunk->num_portals; j++) {
+
+                const struct portal *port = &chunk->portals[j];
+                for(int k = 0; k <= port->num_neighbours; k++) {
+
+                    const struct portal *neighb = (k < port->num_neighbours) 
+                                                ? port->edges[k].neighbour : port->connected;
+                    float cost = (k < port->num_neighbours) 
+                               ? AStar_PortalHopCost(port->edges[k].cost) : AStar_PortalHopCost(1);
+
+                    uint32_t src = portal_index(priv, lm, port);
+                    uint32_t dst = portal_index(priv, lm, neighb);
+                    if(reverse) {
+                        uint32_t tmp = src;
+                        src = dst;
+                        dst = tmp;
+                    }
+
+                    if(pass == 0) {
+                        out->offsets[src + 1]++;
+                    }else{
+                        uint32_t slot = out->offsets[src]++;
+                        out->targets[slot] = dst;
+                        out->costs[slot] = cost;
+                    }
+                }
+            }
+        }
+
+        if(pass == 0) {
+            for(int i = 0; i < lm->nportals; i++)
+                out->offsets[i + 1] += out->offsets[i];
+        }else{
+            /* Placing the edges advanced every offset to the next node's */
+            memmove(out->offsets + 1, out->offsets, lm->nportals * sizeof(uint32_t));
+            out->offsets[0] = 0;
+        }
+    }
+    return true;
+}
+
+/* Assign the same ID to the nodes that are connected by edges in either 
+ * direction. Returns the number of components. */
+static unsigned find_components(const struct graph *fwd, const struct graph *rev, 
+                                uint32_t *stack, unsigned *out_comp)
+{
+    for(int i = 0; i < fwd->nnodes; i++)
+        out_comp[i] = ~0u;
+
+    unsigned ret = 0;
+    for(uint32_t i = 0; i < fwd->nnodes; i++) {
+
+        if(out_comp[i] != ~0u)
+            continue;
+
+        size_t top = 0;
+        stack[top++] = i;
+        out_comp[i] = ret;
+
+        while(top > 0) {
+
+            uint32_t curr = stack[--top];
+            const struct graph *graphs[] = {fwd, rev};
+
+            for(int g = 0; g < 2; g++) {
+            for(uint32_t e = graphs[g]->offsets[curr]; e < graphs[g]->offsets[curr + 1]; e++) {
+
+                uint32_t next = graphs[g]->targets[e];
+                if(out_comp[next] != ~0u)
+                    continue;
+                out_comp[next] = ret;
+                stack[top++] = next;
+            }}
+        }
+        ret++;
+    }
+    return ret;
+}
+
+/* Writes the cost of reaching every one of the 'nodes' from the source 
+ * to 'out_dist', with the specified stride. */
+static bool dijkstra(const struct graph *graph, uint32_t source, const uint32_t *nodes, 
+                     size_t nnodes, float *out_dist, size_t stride)
+{
+    for(int i = 0; i < nnodes; i++)
+        out_dist[nodes[i] * stride] = INFINITY;
+
+    pq(node) frontier;
+    pq_node_init(&frontier);
+
+    bool ret = pq_node_push(&frontier, 0.0f, source);
+    out_dist[source * stride] = 0.0f;
+
+    while(ret && pq_size(&frontier) > 0) {
+
+        uint32_t curr;
+        float prio = frontier.nodes[1].priority; /* The heap is 1-indexed */
+        pq_node_pop(&frontier, &curr);
+
+        /* Stale entry, the node was already reached more cheaply */
+        if(prio > out_dist[curr * stride])
+            continue;
+
+        for(uint32_t e = graph->offsets[curr]; e < graph->offsets[curr + 1]; e++) {
+
+            uint32_t next = graph->targets[e];
+            float cost = out_dist[curr * stride] + graph->costs[e];
+            if(cost >= out_dist[next * stride])
+                continue;
+
+            out_dist[next * stride] = cost;
+            if(!pq_node_push(&frontier, cost, next))
+                ret = false;
+        }
+    }
+
+    pq_node_destroy(&frontier);
+    return ret;
+}
+
+/* Choose the landmarks of a component one at a time, each one as far as 
+ * possible from the ones chosen before it (the 'farthest' selection). This 
+ * spreads the landmarks around the edges of the component, where they give 
+ * the best bounds. */
+static bool place_landmarks(const struct graph *fwd, const struct graph *rev, 
+                            const uint32_t *nodes, size_t nnodes, 
+                            float *scratch, struct landmarks *lm)
+{
+    /* The first landmark is the node that's the farthest from an arbitrary one */
+    if(!dijkstra(fwd, nodes[0], nodes, nnodes, scratch, 1))
+        return false;
+
+    for(int i = 0; i < nnodes; i++) {
+        for(int j = 0; j < MAX_LANDMARKS; j++) {
+            lm->from[nodes[i]][j] = 0.0f;
+            lm->to[nodes[i]][j] = 0.0f;
+        }
+    }
+
+    for(int j = 0; j < MAX_LANDMARKS; j++) {
+
+        uint32_t landmark = nodes[0];
+        float max_dist = 0.0f;
+
+        for(int i = 0; i < nnodes; i++) {
+
+            float dist = scratch[nodes[i]];
+            if(isfinite(dist) && dist > max_dist) {
+                max_dist = dist;
+                landmark = nodes[i];
+            }
+        }
+
+        /* All the nodes are landmarks already */
+        if(j > 0 && max_dist == 0.0f)
+            break;
+
+        if(!dijkstra(fwd, landmark, nodes, nnodes, &lm->from[0][j], MAX_LANDMARKS))
+            return false;
+        if(!dijkstra(rev, landmark, nodes, nnodes, &lm->to[0][j], MAX_LANDMARKS))
+            return false;
+
+        /* Keep the distance from every node to the closest landmark so far */
+        for(int i = 0; i < nnodes; i++) {
+
+            uint32_t node = nodes[i];
+            float dist = lm->from[node][j] + lm->to[node][j];
+            scratch[node] = (j == 0) ? dist : fminf(scratch[node], dist);
+        }
+    }
+    return true;
+}
+
+static bool compute_landmarks(const struct nav_private *priv, struct landmarks *lm)
+{
+    bool ret = false;
+    struct graph fwd = {0}, rev = {0};
+    uint32_t *stack = malloc(lm->nportals * sizeof(uint32_t));
+    uint32_t *nodes = malloc(lm->nportals * sizeof(uint32_t));
+    uint32_t *comp_base = NULL;
+    float *scratch = malloc(lm->nportals * sizeof(float));
+
+    if(!stack || !nodes || !scratch)
+        goto out;
+    if(!graph_build(priv, lm, false, &fwd))
+        goto out;
+    if(!graph_build(priv, lm, true, &rev))
+        goto out;
+
+    unsigned ncomps = find_components(&fwd, &rev, stack, lm->component);
+    if(!(comp_base = calloc(ncomps + 1, sizeof(uint32_t))))
+        goto out;
+
+    /* Group the nodes by component */
+    for(int i = 0; i < lm->nportals; i++)
+        comp_base[lm->component[i] + 1]++;
+    for(int i = 0; i < ncomps; i++)
+        comp_base[i + 1] += comp_base[i];
+    for(uint32_t i = 0; i < lm->nportals; i++)
+        nodes[comp_base[lm->component[i]]++] = i;
+    memmove(comp_base + 1, comp_base, ncomps * sizeof(uint32_t));
+    comp_base[0] = 0;
+
+    for(int i = 0; i < ncomps; i++) {
+
+        size_t begin = comp_base[i], end = comp_base[i + 1];
+        if(!place_landmarks(&fwd, &rev, nodes + begin, end - begin, scratch, lm))
+            goto out;
+    }
+    ret = true;
+
+out:
+    graph_destroy(&fwd);
+    graph_destroy(&rev);
+    free(comp_base);
+    free(scratch);
+    free(nodes);
+    free(stack);
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_LandmarksUpdate(struct nav_private *priv)
+{
+    PERF_ENTER();
+    N_LandmarksFree(priv);
+
+    struct landmarks *lm = calloc(1, sizeof(struct landmarks));
+    if(!lm)
+        goto fail_alloc;
+
+    lm->chunk_base = malloc(priv->width * priv->height * sizeof(uint32_t));
+    if(!lm->chunk_base)
+        goto fail_chunk_base;
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        lm->chunk_base[i] = lm->nportals;
+        lm->nportals += priv->chunks[i].num_portals;
+    }
+
+    lm->component = malloc(lm->nportals * sizeof(lm->component[0]));
+    if(!lm->component)
+        goto fail_component;
+
+    lm->from = malloc(lm->nportals * sizeof(lm->from[0]));
+    if(!lm->from)
+        goto fail_from;
+
+    lm->to = malloc(lm->nportals * sizeof(lm->to[0]));
+    if(!lm->to)
+        goto fail_to;
+
+    if(!compute_landmarks(priv, lm))
+        goto fail_compute;
+
+    priv->landmarks = lm;
+    PERF_RETURN(true);
+
+fail_compute:
+    free(lm->to);
+fail_to:
+    free(lm->from);
+fail_from:
+    free(lm->component);
+fail_component:
+    free(lm->chunk_base);
+fail_chunk_base:
+    free(lm);
+fail_alloc:
+    PERF_RETURN(false);
+}
+
+void N_LandmarksFree(struct nav_private *priv)
+{
+    struct landmarks *lm = priv->landmarks;
+    if(!lm)
+        return;
+
+    free(lm->to);
+    free(lm->from);
+    free(lm->component);
+    free(lm->chunk_base);
+    free(lm);
+    priv->landmarks = NULL;
+}
+
+size_t N_LandmarksMemoryUsage(const struct nav_private *priv)
+{
+    const struct landmarks *lm = priv->landmarks;
+    if(!lm)
+        return 0;
+
+    return sizeof(struct landmarks)
+         + priv->width * priv->height * sizeof(lm->chunk_base[0])
+         + lm->nportals * (sizeof(lm->component[0]) + sizeof(lm->from[0]) + sizeof(lm->to[0]));
+}
+
+bool N_LandmarksTarget(const struct nav_private *priv, const struct portal *target, 
+                       struct landmark_target *out)
+{
+    const struct landmarks *lm = priv->landmarks;
+    if(!lm)
+        return false;
+
+    uint32_t idx = portal_index(priv, lm, target);
+    out->component = lm->component[idx];
+    out->from = lm->from[idx];
+    out->to = lm->to[idx];
+    return true;
+}
+
+float N_LandmarksLowerBound(const struct nav_private *priv, const struct landmark_target *target,
+                            const struct portal *port)
+{
+    const struct landmarks *lm = priv->landmarks;
+    uint32_t idx = portal_index(priv, lm, port);
+
+    if(lm->component[idx] != target->component)
+        return INFINITY;
+
+    /* By the triangle inequality, for any landmark L:
+     *     cost(port, target) >= cost(L, target) - cost(L, port)
+     *     cost(port, target) >= cost(port, L) - cost(target, L)
+     * When the target can't be reached from L or L from the port, the
+     * terms are not numbers, and they are ignored.
+     */
+    const float *from = lm->from[idx];
+    const float *to = lm->to[idx];
+    float ret = 0.0f;
+
+    for(int i = 0; i < MAX_LANDMARKS; i++) {
+
+        float a = target->from[i] - from[i];
+        float b = to[i] - target->to[i];
+        if(a > ret)
+            ret = a;
+        if(b > ret)
+            ret = b;
+    }
+    return ret;
+}
+
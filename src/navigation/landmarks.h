@@ -0,0 +1,83 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct nav_private;
+struct portal;
+
+/* A lower bound on the cost of travelling from any portal to a fixed target
+ * portal, computed using the distances to and from a set of 'landmark' 
+ * portals (the ALT heuristic). */
+struct landmark_target{
+    unsigned     component;
+    const float *from;
+    const float *to;
+};
+
+/* ------------------------------------------------------------------------
+ * (Re-)compute the distances between every portal and the landmarks of its'
+ * connected component of the portal graph. The distances are computed with
+ * all edges active, so that blocking edges can only make them more 
+ * conservative. Thus, the data only needs to be updated when the portal 
+ * graph itself is rebuilt and not when edge states change.
+ * ------------------------------------------------------------------------
+ */
+bool   N_LandmarksUpdate(struct nav_private *priv);
+void   N_LandmarksFree(struct nav_private *priv);
+size_t N_LandmarksMemoryUsage(const struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Returns false if the landmark distances are not available.
+ * ------------------------------------------------------------------------
+ */
+bool   N_LandmarksTarget(const struct nav_private *priv, const struct portal *target, 
+                         struct landmark_target *out);
+
+/* ------------------------------------------------------------------------
+ * Returns a lower bound on the cost of the path (as defined by 
+ * 'AStar_PortalHopCost') from the portal to the target. This may be 
+ * INFINITY if the target can never be reached from the portal.
+ * ------------------------------------------------------------------------
+ */
+float  N_LandmarksLowerBound(const struct nav_private *priv, const struct landmark_target *target,
+                             const struct portal *port);
+
+#endif
+
@@ -38,6 +38,10 @@
 #include "a_star.h"
 #include "field.h"
 #include "fieldcache.h"
+#include "landmarks.h"
+#include "nav_cache.h"
+#include "influence.h"
+#include "corridor.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
 #include "../render/public/render.h"
@@ -49,12 +53,14 @@
 #include "../main.h"
 #include "../perf.h"
 #include "../lib/public/queue.h"
+#include "../task.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
 #include <float.h>
+#include <limits.h>
 
 
 #define IDX(r, width, c)   ((r) * (width) + (c))
@@ -66,6 +72,10 @@
 
 #define EPSILON                  (1.0f / 1024)
 #define MAX_TILES_PER_LINE       (128)
+#define MAX_CHUNKS_PER_DIM       (256)
+/* The most tiles at the same distance from a destination that are considered 
+ * when checking if an entity got as close as it could to it */
+#define CLOSEST_TILES_MAX        (FIELD_RES_R*2 + FIELD_RES_C*2)
 
 #define CLAMP(a, min, max)       (MIN(MAX((a), (min)), (max)))
 
@@ -139,7 +149,184 @@ enum edge_type{
     EDGE_TOP   = (1 << 3),
 };
 
-KHASH_SET_INIT_INT(coord)
+/* The tiles of a chunk which changed between blocked and unblocked states, 
+ * one bit per tile */
+struct dirty_tiles{
+    uint64_t rows[FIELD_RES_R];
+};
+
+KHASH_MAP_INIT_INT(coord, struct dirty_tiles)
+
+struct build_costs_arg{
+    struct nav_private *priv;
+    size_t              chunk_w, chunk_h;
+    const struct tile **chunk_tiles;
+    bool                update;
+};
+
+struct link_portals_arg{
+    struct nav_private *priv;
+    SDL_atomic_t        nfailed;
+};
+
+struct label_islands_arg{
+    struct nav_private *priv;
+    /* The number of distinct islands found within each chunk */
+    uint16_t           *nlabels;
+    /* The index of the first label of each chunk in 'labels' */
+    uint32_t           *label_base;
+    /* Global island ID for every chunk-local label */
+    uint16_t           *labels;
+};
+
+/* The chunk-local islands of a chunk as they were before its' cost field
+ * was first modified, along with the global island ID of every label.
+ */
+struct island_snapshot{
+    uint16_t nlabels;
+    uint16_t labels[FIELD_RES_R][FIELD_RES_C];
+    uint16_t ids[(FIELD_RES_R * FIELD_RES_C + 1) / 2];
+};
+
+KHASH_MAP_INIT_INT(snapshot, struct island_snapshot*)
+
+struct island_edits{
+    /* Set when the 'islands' fields are in sync with the cost fields,
+     * not counting the changes to the chunks which have a snapshot */
+    bool                valid;
+    /* No tile has this or any greater global island ID */
+    uint16_t            next_id;
+    khash_t(snapshot)  *chunks;
+};
+
+/* The chunks taking part in an incremental update of the global island IDs:
+ * the modified chunks followed by the unmodified chunks bordering them.
+ */
+struct island_region{
+    size_t              ndirty, nring;
+    uint32_t           *chunk_idx;
+    /* Chunk-local labels of the current cost fields */
+    uint16_t          (*labels)[FIELD_RES_R][FIELD_RES_C];
+    uint16_t           *nlabels;
+    /* Index of the first label of each chunk, before and after the changes */
+    uint32_t           *old_base, *new_base;
+    /* The position of every chunk of the map in the region, or -1 */
+    int32_t            *slot;
+};
+
+/* Path requests are resolved and have their fields built in batches of 
+ * at most this many per tick, bounding the per-frame cost of pathing. */
+#define MAX_PATH_REQUESTS_PER_TICK  (32)
+#define MAX_PENDING_PATH_REQUESTS   (1024)
+/* The status is remembered for this many of the most recent tickets */
+#define TICKET_HISTORY              (2 * MAX_PENDING_PATH_REQUESTS)
+
+enum path_resolution{
+    /* The source and destination are on different islands */
+    PATH_RES_UNREACHABLE,
+    /* Only the fields for the destination chunk can be made */
+    PATH_RES_NO_PORTAL_PATH,
+    /* Only the fields for the destination chunk are needed */
+    PATH_RES_DEST_CHUNK,
+    PATH_RES_PORTAL_PATH,
+};
+
+/* A chunk along the path, along with the target for its' flow field */
+struct path_hop{
+    struct coord        chunk;
+    struct field_target target;
+};
+
+VEC_TYPE(hop, struct path_hop)
+VEC_IMPL(static inline, hop, struct path_hop)
+
+/* A flow field built ahead of publishing the path's fields to the field
+ * cache. If 'has_base' is set, the new field was layered on top of the 
+ * cached field with ID 'base_id' (a copy of which is kept in 'base'), and 
+ * it only applies if the cached field still matches it when published. 
+ */
+struct prebuilt_flow{
+    struct path_hop     hop;
+    ff_id_t             id;
+    bool                has_base;
+    ff_id_t             base_id;
+    struct flow_field   base;
+    struct flow_field   ff;
+    /* Set if the field can be repaired (only when it has no base) */
+    bool                has_intf;
+    struct integration_field intf;
+};
+
+struct prebuilt_los{
+    struct coord        chunk;
+    struct LOS_field    lf;
+};
+
+struct path_request{
+    path_ticket_t         ticket;
+    dest_id_t             dest_id;
+    vec3_t                map_pos;
+    struct tile_desc      src_desc, dst_desc;
+    /* Set when the request is resolved */
+    enum path_resolution  res;
+    const struct portal  *dst_port;
+    vec_hop_t             hops;
+    /* The fields that will be published to the field cache, if they are 
+     * still missing from it by the time the request is published */
+    size_t                nflow;
+    struct prebuilt_flow *flow;
+    /* The chain of LOS fields, starting from the chunk after the seed. 
+     * If there is no seed, the first field is for the destination chunk. 
+     * The seed is either a copy of a cached field or a field from the chain 
+     * of an earlier request in the same batch. */
+    const struct LOS_field *seed;
+    struct LOS_field      seed_copy;
+    size_t                nlos;
+    struct prebuilt_los  *los;
+};
+
+VEC_TYPE(preq, struct path_request*)
+VEC_IMPL(static inline, preq, struct path_request*)
+
+/* A unit of work for building the fields of a batch of path requests: either 
+ * a single flow field, or (if 'flow_idx' is negative) the LOS field chains of 
+ * all the requests to the same destination, starting with 'req_idx'. Chains 
+ * for the same destination may be seeded by one another, so they are built 
+ * in order by a single job. */
+struct path_job{
+    int                  req_idx;
+    int                  flow_idx;
+};
+
+struct path_batch{
+    const struct nav_private *priv;
+    size_t                    nreqs;
+    struct path_request     **reqs;
+    struct path_job          *jobs;
+};
+
+KHASH_MAP_INIT_INT64(ticket, path_ticket_t)
+
+/* A change of the blocker reference counts under a circle, waiting to be
+ * applied along with all the others made during the tick */
+struct blocker_op{
+    vec2_t xz_pos;
+    float  range;
+    int    delta;
+};
+
+VEC_TYPE(bop, struct blocker_op)
+VEC_IMPL(static inline, bop, struct blocker_op)
+
+/* The net change of the blocker reference count of every tile in a chunk */
+struct chunk_delta{
+    int16_t tiles[FIELD_RES_R][FIELD_RES_C];
+};
+
+VEC_TYPE(cdelta, struct chunk_delta)
+VEC_IMPL(static inline, cdelta, struct chunk_delta)
+
+KHASH_MAP_INIT_INT(cdelta, int)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -148,6 +335,31 @@ KHASH_SET_INIT_INT(coord)
 static khash_t(coord) *s_dirty_chunks;
 static bool            s_local_islands_dirty = false;
 
+static vec_preq_t      s_path_requests;
+/* Maps a (destination, source chunk) tuple to the ticket of the most recent 
+ * request made for it, so that the same fields are not requested repeatedly. 
+ */
+static khash_t(ticket) *s_path_tickets;
+/* Maps a (destination, source chunk, local island) tuple to the ticket of 
+ * the request made for the tiles of the island which the flow field does 
+ * not guide anywhere. These are kept until the navigation data changes. */
+static khash_t(ticket) *s_repath_tickets;
+static path_ticket_t    s_next_ticket = 1;
+static struct{
+    path_ticket_t    ticket;
+    enum path_status status;
+}s_ticket_status[TICKET_HISTORY];
+
+static vec_bop_t            s_blocker_ops;
+static struct nav_private  *s_blocker_ops_priv;
+static vec3_t               s_blocker_ops_map_pos;
+/* Maps a chunk to its' entry in 's_chunk_deltas' while the queued changes 
+ * are being applied */
+static khash_t(cdelta)     *s_chunk_delta_idx;
+static vec_cdelta_t         s_chunk_deltas;
+static struct blocker_stats s_blocker_stats;
+static bool                 s_disk_cache_enabled = true;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -249,6 +461,28 @@ static void n_clear_cost_for_tile(struct nav_chunk *chunk,
     }}
 }
 
+static void n_build_costs_task(void *arg, int idx)
+{
+    const struct build_costs_arg *bca = arg;
+    struct nav_chunk *chunk = &bca->priv->chunks[idx];
+    const struct tile *tiles = bca->chunk_tiles[idx];
+
+    chunk->num_portals = 0;
+    chunk->portal_travel_costs = NULL;
+
+    for(int tile_r = 0; tile_r < bca->chunk_h; tile_r++) {
+    for(int tile_c = 0; tile_c < bca->chunk_w; tile_c++) {
+
+        if(bca->update) {
+            const struct tile *curr_tile = &tiles[tile_r * bca->chunk_w + tile_c];
+            n_set_cost_for_tile(chunk, bca->chunk_w, bca->chunk_h, tile_r, tile_c, curr_tile);
+        }else{
+            n_clear_cost_for_tile(chunk, bca->chunk_w, bca->chunk_h, tile_r, tile_c);
+        }
+    }}
+    memset(chunk->blockers, 0, sizeof(chunk->blockers));
+}
+
 static void n_set_cost_edge(struct nav_chunk *chunk,
                             size_t chunk_w, size_t chunk_h,
                             size_t tile_r,  size_t tile_c,
@@ -464,7 +698,7 @@ static void n_create_portals(struct nav_private *priv)
     assert(n_links == (priv->height)*(priv->width-1) + (priv->width)*(priv->height-1));
 }
 
-static void n_link_chunk_portals(struct nav_chunk *chunk, struct coord chunk_coord)
+static void n_link_chunk_portals(struct nav_chunk *chunk)
 {
     vec_coord_t path;
     vec_coord_init(&path);
@@ -488,7 +722,7 @@ static void n_link_chunk_portals(struct nav_chunk *chunk, struct coord chunk_coo
             };
 
             float cost;
-            bool has_path = AStar_GridPath(a, b, chunk_coord, chunk->cost_base, &path, &cost);
+            bool has_path = AStar_GridPathUncached(a, b, chunk->cost_base, &path, &cost);
             if(has_path) {
                 port->edges[port->num_neighbours] = (struct edge){EDGE_STATE_ACTIVE, link_candidate, cost};
                 port->num_neighbours++;    
@@ -784,21 +1018,6 @@ static void n_visit_island_local(struct nav_chunk *chunk, uint16_t id, struct co
     queue_td_destroy(&frontier);
 }
 
-static bool enemy_ent(const struct entity *ent, void *arg)
-{
-    int faction_id = (uintptr_t)arg;
-    enum diplomacy_state ds;
-
-    if(!(ent->flags & ENTITY_FLAG_COMBATABLE))
-        return false;
-    if(ent->faction_id == faction_id)
-        return false;
-
-    bool result = G_GetDiplomacyState(ent->faction_id, faction_id, &ds);
-    assert(result);
-    return (ds == DIPLOMACY_STATE_WAR);
-}
-
 static void n_update_local_islands(struct nav_chunk *chunk)
 {
     int local_iid = 0;
@@ -817,24 +1036,37 @@ static void n_update_local_islands(struct nav_chunk *chunk)
     }}
 }
 
-static void n_update_dirty_local_islands(void *nav_private)
+static void n_blocker_state_changed(struct tile_desc td)
 {
-    struct nav_private *priv = nav_private;
-    if(!s_local_islands_dirty)
-        return;
+    int ret;
+    uint64_t key = ((td.chunk_r & 0xffff) << 16) | (td.chunk_c & 0xffff);
+    khiter_t k = kh_put(coord, s_dirty_chunks, key, &ret);
+    assert(ret != -1);
+    if(ret != 0)
+        memset(&kh_value(s_dirty_chunks, k), 0, sizeof(struct dirty_tiles));
+
+    /* A tile that flips back within the same update is still rechecked */
+    kh_value(s_dirty_chunks, k).rows[td.tile_r] |= ((uint64_t)1) << td.tile_c;
+
+    /* The blockers may be flushed in the middle of a tick, well before the 
+     * next update gets to the dirty chunks. The closest tiles are looked up 
+     * in the meantime, so they can't wait. */
+    N_FC_InvalidateClosestTilesAtChunk((struct coord){td.chunk_r, td.chunk_c});
+    s_local_islands_dirty = true;
+}
 
-    for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
+static void n_update_tile_blockers(struct nav_private *priv, struct tile_desc td, int ref_delta)
+{
+    struct nav_chunk *chunk = &priv->chunks[IDX(td.chunk_r, priv->width, td.chunk_c)];
 
-        if(!kh_exist(s_dirty_chunks, i))
-            continue;
+    assert(ref_delta < 0 ? chunk->blockers[td.tile_r][td.tile_c] >= -ref_delta : true);
+    assert(ref_delta > 0 ? chunk->blockers[td.tile_r][td.tile_c] < 256 - ref_delta : true);
 
-        uint32_t key = kh_key(s_dirty_chunks, i);
-        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+    int prev_val = chunk->blockers[td.tile_r][td.tile_c];
+    int val = chunk->blockers[td.tile_r][td.tile_c] += ref_delta;
 
-        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
-        n_update_local_islands(chunk);
-    }
-    s_local_islands_dirty = false;
+    if(!!val != !!prev_val) /* The tile changed states between occupied/non-occupied */
+        n_blocker_state_changed(td);
 }
 
 static void n_update_blockers(struct nav_private *priv, vec2_t xz_pos, float range, 
@@ -843,283 +1075,1775 @@ static void n_update_blockers(struct nav_private *priv, vec2_t xz_pos, float ran
     struct tile_desc tds[256];
     int ntds = N_TilesUnderCircle(priv, xz_pos, range, map_pos, tds, ARR_SIZE(tds));
 
-    for(int i = 0; i < ntds; i++) {
-    
-        struct tile_desc curr = tds[i];
-        struct nav_chunk *chunk = &priv->chunks[IDX(curr.chunk_r, priv->width, curr.chunk_c)];
-
-        assert(ref_delta < 0 ? chunk->blockers[curr.tile_r][curr.tile_c] >= -ref_delta : true);
-        assert(ref_delta > 0 ? chunk->blockers[curr.tile_r][curr.tile_c] < 256 - ref_delta : true);
-
-        int prev_val = chunk->blockers[curr.tile_r][curr.tile_c];
-        chunk->blockers[curr.tile_r][curr.tile_c] += ref_delta;
+    for(int i = 0; i < ntds; i++)
+        n_update_tile_blockers(priv, tds[i], ref_delta);
+}
 
-        int val = chunk->blockers[curr.tile_r][curr.tile_c] += ref_delta;
-        if(!!val != !!prev_val) { /* The tile changed states between occupied/non-occupied */
-            int ret;
-            uint64_t key = ((curr.chunk_r & 0xffff) << 16) | (curr.chunk_c & 0xffff);
-            kh_put(coord, s_dirty_chunks, key, &ret);
-            assert(ret != -1);
+static int n_compare_blocker_ops(const void *a, const void *b)
+{
+    const struct blocker_op *opa = a, *opb = b;
+    if(opa->xz_pos.x != opb->xz_pos.x)
+        return (opa->xz_pos.x < opb->xz_pos.x) ? -1 : 1;
+    if(opa->xz_pos.z != opb->xz_pos.z)
+        return (opa->xz_pos.z < opb->xz_pos.z) ? -1 : 1;
+    if(opa->range != opb->range)
+        return (opa->range < opb->range) ? -1 : 1;
+    return 0;
+}
 
-            s_local_islands_dirty = true;
+static struct chunk_delta *n_chunk_delta(struct tile_desc td)
+{
+    int ret;
+    uint32_t key = ((td.chunk_r & 0xffff) << 16) | (td.chunk_c & 0xffff);
+    khiter_t k = kh_put(cdelta, s_chunk_delta_idx, key, &ret);
+    if(ret == -1)
+        return NULL;
+
+    if(ret != 0) {
+        struct chunk_delta zero = {0};
+        if(!vec_cdelta_push(&s_chunk_deltas, zero)) {
+            kh_del(cdelta, s_chunk_delta_idx, k);
+            return NULL;
         }
+        kh_value(s_chunk_delta_idx, k) = vec_size(&s_chunk_deltas) - 1;
     }
+    return &vec_AT(&s_chunk_deltas, kh_value(s_chunk_delta_idx, k));
 }
 
-static int manhattan_dist(struct tile_desc a, struct tile_desc b)
+/* Apply all the queued blocker changes. Changes to the same circle are 
+ * summed up first, so that an entity stopping and starting again in the 
+ * same place cancels out. The net changes of all the remaining circles are 
+ * then added up per-tile, and every affected chunk is updated in a single 
+ * pass.
+ */
+static void n_flush_blockers(void)
 {
-    int dr = abs(
-        (a.chunk_r * TILES_PER_CHUNK_HEIGHT + a.tile_r) 
-      - (b.chunk_r * TILES_PER_CHUNK_HEIGHT + b.tile_r)
-    );
-    int dc = abs(
-        (a.chunk_c * TILES_PER_CHUNK_HEIGHT + a.tile_c) 
-      - (b.chunk_c * TILES_PER_CHUNK_HEIGHT + b.tile_c)
-    );
-    return dr + dc;
-}
+    if(vec_size(&s_blocker_ops) == 0)
+        return;
 
-int n_closest_island_tiles(const struct nav_private *priv, struct tile_desc target, 
-                           uint16_t global_iid, bool ignore_blockers,
-                           struct tile_desc *out, int maxout)
-{
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
+    PERF_ENTER();
+    struct nav_private *priv = s_blocker_ops_priv;
 
-    queue_td_t frontier;
-    queue_td_init(&frontier, 1024);
-    queue_td_push(&frontier, &target);
+    qsort(s_blocker_ops.array, vec_size(&s_blocker_ops), sizeof(struct blocker_op), 
+        n_compare_blocker_ops);
+    kh_clear(cdelta, s_chunk_delta_idx);
+    vec_cdelta_reset(&s_chunk_deltas);
 
-    bool visited[res.chunk_h][res.chunk_w][res.tile_h][res.tile_w];
-    memset(visited, 0, sizeof(visited));
-    visited[target.chunk_r][target.chunk_c][target.tile_r][target.tile_c] = true;
+    for(int i = 0; i < vec_size(&s_blocker_ops);) {
 
-    int ret = 0;
-    int first_mh_dist = -1;
+        const struct blocker_op *first = &vec_AT(&s_blocker_ops, i);
+        int net = 0, nops = 0;
 
-    while(queue_size(frontier) > 0) {
-    
-        struct tile_desc curr;
-        queue_td_pop(&frontier, &curr);
+        for(; i < vec_size(&s_blocker_ops); i++, nops++) {
+            const struct blocker_op *curr = &vec_AT(&s_blocker_ops, i);
+            if(n_compare_blocker_ops(first, curr))
+                break;
+            net += curr->delta;
+        }
 
-        struct coord deltas[] = {
-            { 0, -1},
-            { 0, +1},
-            {-1,  0},
-            {+1,  0},
-        };
+        if(net == 0) {
+            s_blocker_stats.cancelled += nops;
+            continue;
+        }
+        s_blocker_stats.coalesced += nops - 1;
+        s_blocker_stats.applied++;
+
+        struct tile_desc tds[256];
+        int ntds = N_TilesUnderCircle(priv, first->xz_pos, first->range, 
+            s_blocker_ops_map_pos, tds, ARR_SIZE(tds));
+        s_blocker_stats.tiles_touched += ntds;
+
+        for(int j = 0; j < ntds; j++) {
+
+            struct chunk_delta *cd = n_chunk_delta(tds[j]);
+            if(!cd) {
+                /* Fall back to updating the remaining tiles right away. The 
+                 * deltas of the tiles before them are already queued. Every 
+                 * circle's own contribution to a tile never drops below zero, 
+                 * so the order in which the circles are applied is free. */
+                for(; j < ntds; j++)
+                    n_update_tile_blockers(priv, tds[j], net);
+                break;
+            }
+            cd->tiles[tds[j].tile_r][tds[j].tile_c] += net;
+        }
+    }
 
-        for(int i = 0; i < ARR_SIZE(deltas); i++) {
-        
-            struct tile_desc neighb = curr;
-            if(!M_Tile_RelativeDesc(res, &neighb, deltas[i].c, deltas[i].r))
-                continue;
+    for(int i = kh_begin(s_chunk_delta_idx); i != kh_end(s_chunk_delta_idx); i++) {
 
-            assert(memcmp(&curr, &neighb, sizeof(struct tile_desc)) != 0);
-            const struct nav_chunk *chunk = &priv->chunks[IDX(neighb.chunk_r, priv->width, neighb.chunk_c)];
+        if(!kh_exist(s_chunk_delta_idx, i))
+            continue;
 
-            if(visited[neighb.chunk_r][neighb.chunk_c][neighb.tile_r][neighb.tile_c])
-                continue;
+        uint32_t key = kh_key(s_chunk_delta_idx, i);
+        struct tile_desc td = (struct tile_desc){ .chunk_r = key >> 16, .chunk_c = key & 0xffff };
+        struct nav_chunk *chunk = &priv->chunks[IDX(td.chunk_r, priv->width, td.chunk_c)];
+        const struct chunk_delta *cd = &vec_AT(&s_chunk_deltas, kh_value(s_chunk_delta_idx, i));
 
-            bool skip = (chunk->islands[neighb.tile_r][neighb.tile_c] != global_iid);
-            if(!ignore_blockers
-            && chunk->blockers[neighb.tile_r][neighb.tile_c] > 0)
-                skip = true;
+        for(td.tile_r = 0; td.tile_r < FIELD_RES_R; td.tile_r++) {
+        for(td.tile_c = 0; td.tile_c < FIELD_RES_C; td.tile_c++) {
 
-            int mh_dist = manhattan_dist(target, neighb);
-            if(first_mh_dist > 0 && mh_dist > first_mh_dist)
-                goto done; /* The mh distance is strictly increasing as we go outwards */
+            int delta = cd->tiles[td.tile_r][td.tile_c];
+            if(delta == 0)
+                continue;
 
-            if(!skip) {
-            
-                assert(ret < maxout);
-                out[ret++] = neighb;
+            int prev_val = chunk->blockers[td.tile_r][td.tile_c];
+            assert(prev_val + delta >= 0 && prev_val + delta < 256);
+            int val = chunk->blockers[td.tile_r][td.tile_c] = prev_val + delta;
 
-                if(first_mh_dist == -1)
-                    first_mh_dist = mh_dist;
-                if(ret == maxout)
-                    goto done;
+            s_blocker_stats.tiles_changed++;
+            if(!!val != !!prev_val) {
+                s_blocker_stats.tiles_flipped++;
+                n_blocker_state_changed(td);
             }
-
-            visited[neighb.chunk_r][neighb.chunk_c][neighb.tile_r][neighb.tile_c] = true;
-            queue_td_push(&frontier, &neighb);
-        }
+        }}
+        s_blocker_stats.chunk_passes++;
     }
 
-done:
-    queue_td_destroy(&frontier);
-    return ret; 
+    s_blocker_stats.flushes++;
+    vec_bop_reset(&s_blocker_ops);
+    PERF_RETURN_VOID();
 }
 
-static void n_build_portal_travel_index(struct nav_chunk *chunk)
+static void n_queue_blockers(struct nav_private *priv, vec2_t xz_pos, float range, 
+                             vec3_t map_pos, int ref_delta)
 {
-    queue_cc_t frontier;
-    queue_cc_init(&frontier, 1024);
+    /* All the queued changes must be made against the same map */
+    if(vec_size(&s_blocker_ops) > 0 
+    && (priv != s_blocker_ops_priv || memcmp(&map_pos, &s_blocker_ops_map_pos, sizeof(vec3_t))))
+        n_flush_blockers();
+
+    s_blocker_ops_priv = priv;
+    s_blocker_ops_map_pos = map_pos;
+    s_blocker_stats.queued++;
+
+    struct blocker_op op = (struct blocker_op){xz_pos, range, ref_delta};
+    if(!vec_bop_push(&s_blocker_ops, op))
+        n_update_blockers(priv, xz_pos, range, map_pos, ref_delta);
+}
 
-    for(int pi = 0; pi < chunk->num_portals; pi++) {
+static void n_update_dirty_local_islands(void *nav_private)
+{
+    struct nav_private *priv = nav_private;
+    n_flush_blockers();
 
-        bool visited[FIELD_RES_R][FIELD_RES_C] = {0};
-        assert(queue_size(frontier) == 0);
+    if(!s_local_islands_dirty)
+        return;
 
-        for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
+    for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
 
-            chunk->portal_travel_costs[pi][r][c] = FLT_MAX;
-        }}
+        if(!kh_exist(s_dirty_chunks, i))
+            continue;
 
-        const struct portal *port = &chunk->portals[pi];
-        for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
-        for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+        uint32_t key = kh_key(s_dirty_chunks, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
 
-            struct cost_coord cc = (struct cost_coord){0.0f, (struct coord){r,c}};
-            queue_cc_push(&frontier, &cc);
-            visited[r][c] = true;
-        }}
+        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
+        n_update_local_islands(chunk);
+    }
+    s_local_islands_dirty = false;
+}
 
-        while(queue_size(frontier) > 0) {
+/* Label the tiles of the chunk which are mutually reachable without leaving 
+ * the chunk. Labels are assigned in order of the first tile of the set, in 
+ * row-major order. Returns the number of labels used.
+ */
+static uint16_t n_label_chunk_islands(const uint8_t cost_base[FIELD_RES_R][FIELD_RES_C],
+                                      uint16_t out[FIELD_RES_R][FIELD_RES_C])
+{
+    struct coord frontier[FIELD_RES_R * FIELD_RES_C];
+    uint16_t ret = 0;
+    memset(out, 0xff, sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
 
-            struct cost_coord curr;
-            queue_cc_pop(&frontier, &curr);
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
 
-            chunk->portal_travel_costs[pi][curr.coord.r][curr.coord.c] = curr.cost;
+        if(out[r][c] != ISLAND_NONE)
+            continue;
+        if(cost_base[r][c] == COST_IMPASSABLE)
+            continue;
 
-            struct coord neighbours[8];
-            float costs[8];
-            int num_neighbours = N_GridNeighbours(chunk->cost_base, curr.coord, neighbours, costs);
+        size_t head = 0, tail = 0;
+        out[r][c] = ret;
+        frontier[tail++] = (struct coord){r, c};
 
-            for(int i = 0; i < num_neighbours; i++) {
+        while(head < tail) {
 
-                if(visited[neighbours[i].r][neighbours[i].c])
+            struct coord curr = frontier[head++];
+            struct coord deltas[] = {
+                { 0, -1},
+                { 0, +1},
+                {-1,  0},
+                {+1,  0},
+            };
+
+            for(int i = 0; i < ARR_SIZE(deltas); i++) {
+
+                struct coord neighb = (struct coord){curr.r + deltas[i].r, curr.c + deltas[i].c};
+                if(neighb.r < 0 || neighb.r >= FIELD_RES_R)
+                    continue;
+                if(neighb.c < 0 || neighb.c >= FIELD_RES_C)
+                    continue;
+                if(out[neighb.r][neighb.c] != ISLAND_NONE)
+                    continue;
+                if(cost_base[neighb.r][neighb.c] == COST_IMPASSABLE)
                     continue;
 
-                struct cost_coord cc = (struct cost_coord){curr.cost + costs[i], neighbours[i]};
-                queue_cc_push(&frontier, &cc);
-                visited[neighbours[i].r][neighbours[i].c] = true;
+                out[neighb.r][neighb.c] = ret;
+                frontier[tail++] = neighb;
             }
         }
-    }
+        ret++;
+    }}
+    return ret;
+}
 
-    queue_cc_destroy(&frontier);
+static void n_label_islands_task(void *arg, int idx)
+{
+    struct label_islands_arg *lia = arg;
+    struct nav_chunk *chunk = &lia->priv->chunks[idx];
+
+    lia->nlabels[idx] = n_label_chunk_islands(chunk->cost_base, chunk->islands);
+    n_update_local_islands(chunk);
 }
 
-static const struct portal *n_closest_reachable_portal(const struct nav_chunk *chunk, struct coord start)
+static void n_local_islands_task(void *arg, int idx)
 {
-    const struct portal *ret = NULL;
-    float min_cost = FLT_MAX;
+    struct nav_private *priv = arg;
+    n_update_local_islands(&priv->chunks[idx]);
+}
 
-    for(int i = 0; i < chunk->num_portals; i++) {
+static void n_assign_islands_task(void *arg, int idx)
+{
+    struct label_islands_arg *lia = arg;
+    struct nav_chunk *chunk = &lia->priv->chunks[idx];
+    const uint16_t *labels = lia->labels + lia->label_base[idx];
 
-        const struct portal *curr = &chunk->portals[i];
-        float cost = chunk->portal_travel_costs[i][start.r][start.c];
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
 
-        if(cost < min_cost) {
-            ret = curr;
-            min_cost = cost;
-        }
-    }
-    return ret;
+        if(chunk->islands[r][c] == ISLAND_NONE)
+            continue;
+        chunk->islands[r][c] = labels[chunk->islands[r][c]];
+    }}
 }
 
-static void chunk_bounds(vec3_t map_pos, struct coord chunk, 
-                         vec2_t *out_xz_min, vec2_t *out_xz_max)
+static uint32_t n_find_label(uint32_t *parent, uint32_t label)
 {
-    out_xz_min->x = map_pos.x - (chunk.c + 1) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH;
-    out_xz_max->x = map_pos.x - (chunk.c + 0) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH;
-
-    out_xz_min->z = map_pos.z + (chunk.r + 0) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT;
-    out_xz_max->z = map_pos.z + (chunk.r + 1) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT;
+    while(parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+    return label;
 }
 
-/* Every set bit in the returned value represents the index of a portal 
- * in the chunk that we can path to to find enemies on the other side. 
- */
-static uint64_t n_enemy_seek_portalmask(const struct nav_private *priv, vec3_t map_pos, 
-                                        struct coord chunk, int faction_id)
+/* Join the sets such that the root of every set is always its' lowest label */
+static void n_union_labels(uint32_t *parent, uint32_t a, uint32_t b)
 {
-    bool top = false, bot = false, left = false, right = false;
+    a = n_find_label(parent, a);
+    b = n_find_label(parent, b);
+    if(a < b)
+        parent[b] = a;
+    else if(b < a)
+        parent[a] = b;
+}
 
-    struct entity *ents[1];
-    vec2_t xz_min, xz_max;
-    struct coord curr;
+/* Join the sets of the labels touching across the bottom or right edge of
+ * chunk 'a', given the chunk-local labels of both chunks */
+static void n_union_chunk_edge(uint32_t *parent, enum edge_type a_type,
+                               const uint16_t a[FIELD_RES_R][FIELD_RES_C], uint32_t a_base,
+                               const uint16_t b[FIELD_RES_R][FIELD_RES_C], uint32_t b_base)
+{
+    assert(a_type == EDGE_BOT || a_type == EDGE_RIGHT);
 
-    if(chunk.r > 0) {
+    for(int i = 0; i < ((a_type == EDGE_BOT) ? FIELD_RES_C : FIELD_RES_R); i++) {
 
-        curr = (struct coord){chunk.r - 1, chunk.c};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+        uint16_t a_label = (a_type == EDGE_BOT) ? a[FIELD_RES_R-1][i] 
+                                                : a[i][FIELD_RES_C-1];
+        uint16_t b_label = (a_type == EDGE_BOT) ? b[0][i]
+                                                : b[i][0];
 
-        top = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
+        if(a_label == ISLAND_NONE || b_label == ISLAND_NONE)
+            continue;
+        n_union_labels(parent, a_base + a_label, b_base + b_label);
     }
+}
 
-    if(chunk.r < FIELD_RES_R-1) {
+static void n_merge_chunk_edge(const struct label_islands_arg *lia, uint32_t *parent,
+                               int a_idx, int b_idx, enum edge_type a_type)
+{
+    const struct nav_chunk *a = &lia->priv->chunks[a_idx];
+    const struct nav_chunk *b = &lia->priv->chunks[b_idx];
 
-        curr = (struct coord){chunk.r + 1, chunk.c};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+    n_union_chunk_edge(parent, a_type, a->islands, lia->label_base[a_idx], 
+                                       b->islands, lia->label_base[b_idx]);
+}
 
-        bot = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
-    }
+static void n_island_edits_reset(struct nav_private *priv, bool valid, uint16_t next_id)
+{
+    struct island_edits *edits = priv->island_edits;
+    struct island_snapshot *snap;
 
-    if(chunk.c > 0) {
+    kh_foreach_value(edits->chunks, snap, {
+        free(snap);
+    });
+    kh_clear(snapshot, edits->chunks);
 
-        curr = (struct coord){chunk.r, chunk.c - 1};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+    edits->valid = valid;
+    edits->next_id = next_id;
+}
+
+static uint16_t n_next_island_id(const struct nav_private *priv)
+{
+    uint16_t ret = 0;
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(chunk->islands[r][c] != ISLAND_NONE)
+                ret = MAX(ret, chunk->islands[r][c] + 1);
+        }}
+    }
+    return ret;
+}
+
+/* Remember the islands of the chunk before its' cost field is first changed,
+ * so that the global island IDs can be updated incrementally.
+ */
+static void n_snapshot_islands(struct nav_private *priv, uint32_t chunk_idx)
+{
+    struct island_edits *edits = priv->island_edits;
+    if(!edits->valid)
+        return;
+
+    khiter_t k = kh_get(snapshot, edits->chunks, chunk_idx);
+    if(k != kh_end(edits->chunks))
+        return;
+
+    const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    struct island_snapshot *snap = malloc(sizeof(struct island_snapshot));
+    if(!snap)
+        goto fail;
+
+    int ret;
+    k = kh_put(snapshot, edits->chunks, chunk_idx, &ret);
+    if(ret == -1) {
+        free(snap);
+        goto fail;
+    }
+    kh_value(edits->chunks, k) = snap;
+
+    snap->nlabels = n_label_chunk_islands(chunk->cost_base, snap->labels);
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+        if(snap->labels[r][c] != ISLAND_NONE)
+            snap->ids[snap->labels[r][c]] = chunk->islands[r][c];
+    }}
+    return;
+
+fail:
+    /* Fall back to re-labelling the whole map */
+    n_island_edits_reset(priv, false, 0);
+}
+
+static void n_region_free(struct island_region *reg)
+{
+    free(reg->chunk_idx);
+    free(reg->labels);
+    free(reg->nlabels);
+    free(reg->old_base);
+    free(reg->new_base);
+    free(reg->slot);
+}
+
+/* Gather the modified chunks along with the unmodified chunks cardinally
+ * adjacent to them and label the islands of each one.
+ */
+static bool n_region_init(const struct nav_private *priv, struct island_region *out)
+{
+    const struct island_edits *edits = priv->island_edits;
+    const size_t nchunks = priv->width * priv->height;
+    const size_t maxchunks = MIN(nchunks, kh_size(edits->chunks) * 5);
+
+    memset(out, 0, sizeof(*out));
+    out->chunk_idx = malloc(maxchunks * sizeof(out->chunk_idx[0]));
+    out->labels = malloc(maxchunks * sizeof(out->labels[0]));
+    out->nlabels = malloc(maxchunks * sizeof(out->nlabels[0]));
+    out->old_base = malloc(maxchunks * sizeof(out->old_base[0]));
+    out->new_base = malloc(maxchunks * sizeof(out->new_base[0]));
+    out->slot = malloc(nchunks * sizeof(out->slot[0]));
+
+    if(!out->chunk_idx || !out->labels || !out->nlabels 
+    || !out->old_base || !out->new_base || !out->slot) {
+        n_region_free(out);
+        return false;
+    }
+
+    for(int i = 0; i < nchunks; i++)
+        out->slot[i] = -1;
+
+    uint32_t idx;
+    struct island_snapshot *snap;
+    (void)snap;
+
+    kh_foreach(edits->chunks, idx, snap, {
+        out->slot[idx] = out->ndirty;
+        out->chunk_idx[out->ndirty++] = idx;
+    });
+
+    for(int i = 0; i < out->ndirty; i++) {
+
+        int r = out->chunk_idx[i] / priv->width;
+        int c = out->chunk_idx[i] % priv->width;
+        struct coord neighbs[] = {
+            {r - 1, c}, {r + 1, c}, {r, c - 1}, {r, c + 1}
+        };
+
+        for(int j = 0; j < ARR_SIZE(neighbs); j++) {
+
+            if(neighbs[j].r < 0 || neighbs[j].r >= priv->height)
+                continue;
+            if(neighbs[j].c < 0 || neighbs[j].c >= priv->width)
+                continue;
+
+            uint32_t neighb_idx = IDX(neighbs[j].r, priv->width, neighbs[j].c);
+            if(out->slot[neighb_idx] >= 0)
+                continue;
+
+            out->slot[neighb_idx] = out->ndirty + out->nring;
+            out->chunk_idx[out->ndirty + out->nring++] = neighb_idx;
+        }
+    }
+
+    uint32_t old_base = 0, new_base = 0;
+    for(int i = 0; i < out->ndirty + out->nring; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[out->chunk_idx[i]];
+        out->nlabels[i] = n_label_chunk_islands(chunk->cost_base, out->labels[i]);
+
+        uint16_t nold = out->nlabels[i];
+        if(i < out->ndirty) {
+            khiter_t k = kh_get(snapshot, edits->chunks, out->chunk_idx[i]);
+            nold = kh_value(edits->chunks, k)->nlabels;
+        }
+
+        out->old_base[i] = old_base;
+        out->new_base[i] = new_base;
+        old_base += nold;
+        new_base += out->nlabels[i];
+    }
+    return true;
+}
+
+/* Join the labels of all the pairs of adjacent chunks in the region, with at 
+ * least one of the pair being a modified chunk. The labels of the modified 
+ * chunks are taken from before or after the changes.
+ */
+static void n_region_union(const struct nav_private *priv, const struct island_region *reg,
+                           bool before, uint32_t *parent)
+{
+    const struct island_edits *edits = priv->island_edits;
+
+    for(int i = 0; i < reg->ndirty; i++) {
+
+        int r = reg->chunk_idx[i] / priv->width;
+        int c = reg->chunk_idx[i] % priv->width;
+        struct{
+            struct coord   chunk;
+            enum edge_type edge;
+            bool           flip;
+        }neighbs[] = {
+            {{r - 1, c}, EDGE_BOT,   true },
+            {{r + 1, c}, EDGE_BOT,   false},
+            {{r, c - 1}, EDGE_RIGHT, true },
+            {{r, c + 1}, EDGE_RIGHT, false},
+        };
+
+        for(int j = 0; j < ARR_SIZE(neighbs); j++) {
+
+            if(neighbs[j].chunk.r < 0 || neighbs[j].chunk.r >= priv->height)
+                continue;
+            if(neighbs[j].chunk.c < 0 || neighbs[j].chunk.c >= priv->width)
+                continue;
+
+            int other = reg->slot[IDX(neighbs[j].chunk.r, priv->width, neighbs[j].chunk.c)];
+            assert(other >= 0);
+
+            /* Every pair of modified chunks is only joined once */
+            if(other < reg->ndirty && neighbs[j].flip)
+                continue;
+
+            int slots[2] = {i, other};
+            const uint16_t (*labels[2])[FIELD_RES_C];
+            uint32_t bases[2];
+
+            for(int k = 0; k < 2; k++) {
+                if(before && slots[k] < reg->ndirty) {
+                    khiter_t it = kh_get(snapshot, edits->chunks, reg->chunk_idx[slots[k]]);
+                    labels[k] = (const uint16_t (*)[FIELD_RES_C])kh_value(edits->chunks, it)->labels;
+                    bases[k] = reg->old_base[slots[k]];
+                }else{
+                    labels[k] = (const uint16_t (*)[FIELD_RES_C])reg->labels[slots[k]];
+                    bases[k] = before ? reg->old_base[slots[k]] : reg->new_base[slots[k]];
+                }
+            }
+
+            int a = neighbs[j].flip ? 1 : 0;
+            n_union_chunk_edge(parent, neighbs[j].edge, labels[a], bases[a], labels[!a], bases[!a]);
+        }
+    }
+}
+
+/* Update the global island IDs of the modified chunks without visiting the 
+ * rest of the map. The chunks bordering the modified ones are unchanged, so 
+ * their' islands can stand in for all the paths going through the rest of 
+ * the map. As long as the same ones are joined through the modified chunks 
+ * as before, the rest of the islands are unaffected. Returns false when the 
+ * connectivity between the rest of the islands has changed, in which case 
+ * all the IDs must be re-assigned.
+ */
+static bool n_update_islands_incremental(struct nav_private *priv)
+{
+    struct island_edits *edits = priv->island_edits;
+    if(!edits->valid)
+        return false;
+    if(kh_size(edits->chunks) == 0)
+        return true;
+
+    struct island_region reg;
+    if(!n_region_init(priv, &reg))
+        return false;
+
+    bool ret = false;
+    size_t last = reg.ndirty + reg.nring - 1;
+    uint32_t nold = reg.old_base[last] + reg.nlabels[last];
+    uint32_t nnew = reg.new_base[last] + reg.nlabels[last];
+
+    uint32_t *old_parent = malloc(MAX(nold, 1) * sizeof(uint32_t));
+    uint32_t *new_parent = malloc(MAX(nnew, 1) * sizeof(uint32_t));
+    uint32_t *old_to_new = malloc(MAX(nold, 1) * sizeof(uint32_t));
+    uint16_t *new_ids = malloc(MAX(nnew, 1) * sizeof(uint16_t));
+
+    if(!old_parent || !new_parent || !old_to_new || !new_ids)
+        goto out;
+
+    for(uint32_t i = 0; i < nold; i++) {
+        old_parent[i] = i;
+        old_to_new[i] = UINT32_MAX;
+    }
+    for(uint32_t i = 0; i < nnew; i++) {
+        new_parent[i] = i;
+        new_ids[i] = ISLAND_NONE;
+    }
+
+    n_region_union(priv, &reg, true, old_parent);
+    n_region_union(priv, &reg, false, new_parent);
+
+    /* The islands of the bordering chunks which were joined must still be
+     * joined, and the ones that weren't must not have become joined unless 
+     * they were already on the same island by some other path */
+    for(int i = reg.ndirty; i < reg.ndirty + reg.nring; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[reg.chunk_idx[i]];
+        uint16_t ids[(FIELD_RES_R * FIELD_RES_C + 1) / 2];
+
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(reg.labels[i][r][c] != ISLAND_NONE)
+                ids[reg.labels[i][r][c]] = chunk->islands[r][c];
+        }}
+
+        for(int j = 0; j < reg.nlabels[i]; j++) {
+
+            uint32_t old_root = n_find_label(old_parent, reg.old_base[i] + j);
+            uint32_t new_root = n_find_label(new_parent, reg.new_base[i] + j);
+
+            if(old_to_new[old_root] == UINT32_MAX)
+                old_to_new[old_root] = new_root;
+            else if(old_to_new[old_root] != new_root)
+                goto out;
+
+            if(new_ids[new_root] == ISLAND_NONE)
+                new_ids[new_root] = ids[j];
+            else if(new_ids[new_root] != ids[j])
+                goto out;
+        }
+    }
+
+    /* The remaining islands are entirely within the modified chunks */
+    uint16_t next_id = edits->next_id;
+    for(int i = 0; i < reg.ndirty; i++) {
+        for(int j = 0; j < reg.nlabels[i]; j++) {
+
+            uint32_t root = n_find_label(new_parent, reg.new_base[i] + j);
+            if(new_ids[root] != ISLAND_NONE)
+                continue;
+            if(next_id == ISLAND_NONE)
+                goto out;
+            new_ids[root] = next_id++;
+        }
+    }
+
+    for(int i = 0; i < reg.ndirty; i++) {
+
+        struct nav_chunk *chunk = &priv->chunks[reg.chunk_idx[i]];
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+
+            uint16_t label = reg.labels[i][r][c];
+            chunk->islands[r][c] = (label == ISLAND_NONE) ? ISLAND_NONE
+                                 : new_ids[n_find_label(new_parent, reg.new_base[i] + label)];
+        }}
+        n_update_local_islands(chunk);
+    }
+
+    edits->next_id = next_id;
+    ret = true;
+
+out:
+    free(new_ids);
+    free(old_to_new);
+    free(new_parent);
+    free(old_parent);
+    n_region_free(&reg);
+    return ret;
+}
+
+static void n_make_impassable(struct nav_private *priv, struct tile_desc td)
+{
+    uint32_t chunk_idx = IDX(td.chunk_r, priv->width, td.chunk_c);
+    n_snapshot_islands(priv, chunk_idx);
+    priv->chunks[chunk_idx].cost_base[td.tile_r][td.tile_c] = COST_IMPASSABLE;
+}
+
+static int manhattan_dist(struct tile_desc a, struct tile_desc b)
+{
+    int dr = abs(
+        (a.chunk_r * TILES_PER_CHUNK_HEIGHT + a.tile_r) 
+      - (b.chunk_r * TILES_PER_CHUNK_HEIGHT + b.tile_r)
+    );
+    int dc = abs(
+        (a.chunk_c * TILES_PER_CHUNK_HEIGHT + a.tile_c) 
+      - (b.chunk_c * TILES_PER_CHUNK_HEIGHT + b.tile_c)
+    );
+    return dr + dc;
+}
+
+int n_closest_island_tiles(const struct nav_private *priv, struct tile_desc target, 
+                           uint16_t global_iid, bool ignore_blockers,
+                           struct tile_desc *out, int maxout)
+{
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    queue_td_t frontier;
+    queue_td_init(&frontier, 1024);
+    queue_td_push(&frontier, &target);
+
+    bool visited[res.chunk_h][res.chunk_w][res.tile_h][res.tile_w];
+    memset(visited, 0, sizeof(visited));
+    visited[target.chunk_r][target.chunk_c][target.tile_r][target.tile_c] = true;
+
+    int ret = 0;
+    int first_mh_dist = -1;
+
+    while(queue_size(frontier) > 0) {
+    
+        struct tile_desc curr;
+        queue_td_pop(&frontier, &curr);
+
+        struct coord deltas[] = {
+            { 0, -1},
+            { 0, +1},
+            {-1,  0},
+            {+1,  0},
+        };
+
+        for(int i = 0; i < ARR_SIZE(deltas); i++) {
+        
+            struct tile_desc neighb = curr;
+            if(!M_Tile_RelativeDesc(res, &neighb, deltas[i].c, deltas[i].r))
+                continue;
+
+            assert(memcmp(&curr, &neighb, sizeof(struct tile_desc)) != 0);
+            const struct nav_chunk *chunk = &priv->chunks[IDX(neighb.chunk_r, priv->width, neighb.chunk_c)];
+
+            if(visited[neighb.chunk_r][neighb.chunk_c][neighb.tile_r][neighb.tile_c])
+                continue;
+
+            bool skip = (chunk->islands[neighb.tile_r][neighb.tile_c] != global_iid);
+            if(!ignore_blockers
+            && chunk->blockers[neighb.tile_r][neighb.tile_c] > 0)
+                skip = true;
+
+            int mh_dist = manhattan_dist(target, neighb);
+            if(first_mh_dist > 0 && mh_dist > first_mh_dist)
+                goto done; /* The mh distance is strictly increasing as we go outwards */
+
+            if(!skip) {
+            
+                assert(ret < maxout);
+                out[ret++] = neighb;
+
+                if(first_mh_dist == -1)
+                    first_mh_dist = mh_dist;
+                if(ret == maxout)
+                    goto done;
+            }
+
+            visited[neighb.chunk_r][neighb.chunk_c][neighb.tile_r][neighb.tile_c] = true;
+            queue_td_push(&frontier, &neighb);
+        }
+    }
+
+done:
+    queue_td_destroy(&frontier);
+    return ret; 
+}
+
+/* Like 'n_closest_island_tiles', but the result is kept in the field cache, so 
+ * that the search is not repeated for every query about the same destination.
+ */
+static int n_closest_island_tiles_cached(const struct nav_private *priv, struct tile_desc target, 
+                                         uint16_t global_iid, bool ignore_blockers,
+                                         struct tile_desc *out, int maxout)
+{
+    struct coord tile = (struct coord){
+        target.chunk_r * FIELD_RES_R + target.tile_r,
+        target.chunk_c * FIELD_RES_C + target.tile_c
+    };
+    struct closest_tiles_desc ct;
+
+    if(!N_FC_GetClosestTiles(tile, global_iid, ignore_blockers, &ct)) {
+
+        struct tile_desc tds[CLOSEST_TILES_MAX];
+        int ntds = n_closest_island_tiles(priv, target, global_iid, ignore_blockers, tds, ARR_SIZE(tds));
+
+        /* Only the tiles no further than the closest ones were looked at */
+        int dist = (ntds > 0) ? manhattan_dist(target, tds[0]) 
+                              : (priv->width * FIELD_RES_C + priv->height * FIELD_RES_R);
+        ct.min_chunk = (struct coord){
+            MAX(tile.r - dist, 0) / FIELD_RES_R,
+            MAX(tile.c - dist, 0) / FIELD_RES_C
+        };
+        ct.max_chunk = (struct coord){
+            MIN(tile.r + dist, priv->height * FIELD_RES_R - 1) / FIELD_RES_R,
+            MIN(tile.c + dist, priv->width * FIELD_RES_C - 1) / FIELD_RES_C
+        };
+
+        vec_coord_init(&ct.tiles);
+        if(!vec_coord_resize(&ct.tiles, MAX(ntds, 1))) {
+            vec_coord_destroy(&ct.tiles);
+            memcpy(out, tds, MIN(ntds, maxout) * sizeof(struct tile_desc));
+            return MIN(ntds, maxout);
+        }
+
+        for(int i = 0; i < ntds; i++) {
+            vec_coord_push(&ct.tiles, (struct coord){
+                tds[i].chunk_r * FIELD_RES_R + tds[i].tile_r,
+                tds[i].chunk_c * FIELD_RES_C + tds[i].tile_c
+            });
+        }
+        N_FC_PutClosestTiles(tile, global_iid, ignore_blockers, &ct);
+    }
+
+    int ret = MIN(vec_size(&ct.tiles), maxout);
+    for(int i = 0; i < ret; i++) {
+        struct coord curr = vec_AT(&ct.tiles, i);
+        out[i] = (struct tile_desc){
+            .chunk_r = curr.r / FIELD_RES_R,
+            .chunk_c = curr.c / FIELD_RES_C,
+            .tile_r  = curr.r % FIELD_RES_R,
+            .tile_c  = curr.c % FIELD_RES_C,
+        };
+    }
+    return ret;
+}
+
+static uint16_t n_quantize_portal_cost(float cost)
+{
+    float scaled = roundf(cost * PORTAL_COST_SCALE);
+    if(scaled >= PORTAL_COST_UNREACHABLE)
+        return PORTAL_COST_UNREACHABLE - 1;
+    return (uint16_t)scaled;
+}
+
+static bool n_build_portal_travel_index(struct nav_chunk *chunk)
+{
+    if(chunk->num_portals == 0) {
+        free(chunk->portal_travel_costs);
+        chunk->portal_travel_costs = NULL;
+        return true;
+    }
+
+    void *tables = realloc(chunk->portal_travel_costs, 
+        chunk->num_portals * sizeof(chunk->portal_travel_costs[0]));
+    if(!tables)
+        return false;
+    chunk->portal_travel_costs = tables;
+
+    queue_cc_t frontier;
+    queue_cc_init(&frontier, 1024);
+
+    for(int pi = 0; pi < chunk->num_portals; pi++) {
+
+        bool visited[FIELD_RES_R][FIELD_RES_C] = {0};
+        assert(queue_size(frontier) == 0);
+
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+
+            chunk->portal_travel_costs[pi][r][c] = PORTAL_COST_UNREACHABLE;
+        }}
+
+        const struct portal *port = &chunk->portals[pi];
+        for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
+        for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+
+            struct cost_coord cc = (struct cost_coord){0.0f, (struct coord){r,c}};
+            queue_cc_push(&frontier, &cc);
+            visited[r][c] = true;
+        }}
+
+        while(queue_size(frontier) > 0) {
+
+            struct cost_coord curr;
+            queue_cc_pop(&frontier, &curr);
+
+            chunk->portal_travel_costs[pi][curr.coord.r][curr.coord.c] 
+                = n_quantize_portal_cost(curr.cost);
+
+            struct coord neighbours[8];
+            float costs[8];
+            int num_neighbours = N_GridNeighbours(chunk->cost_base, curr.coord, neighbours, costs);
+
+            for(int i = 0; i < num_neighbours; i++) {
+
+                if(visited[neighbours[i].r][neighbours[i].c])
+                    continue;
+
+                struct cost_coord cc = (struct cost_coord){curr.cost + costs[i], neighbours[i]};
+                queue_cc_push(&frontier, &cc);
+                visited[neighbours[i].r][neighbours[i].c] = true;
+            }
+        }
+    }
+
+    queue_cc_destroy(&frontier);
+    return true;
+}
+
+static void n_link_portals_task(void *arg, int idx)
+{
+    struct link_portals_arg *lpa = arg;
+    struct nav_chunk *chunk = &lpa->priv->chunks[idx];
+
+    n_link_chunk_portals(chunk);
+    if(!n_build_portal_travel_index(chunk))
+        SDL_AtomicAdd(&lpa->nfailed, 1);
+}
+
+/* Portals are linked to the portals of the neighbouring chunks, so a chunk
+ * cannot drop its' portals on its' own. Drop them all at once, leaving no
+ * links to portals that are gone. */
+static void n_clear_portals(struct nav_private *priv)
+{
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        struct nav_chunk *chunk = &priv->chunks[i];
+        free(chunk->portal_travel_costs);
+        chunk->portal_travel_costs = NULL;
+        chunk->num_portals = 0;
+    }
+}
+
+static bool n_update_portals(struct nav_private *priv)
+{
+    PERF_ENTER();
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+            
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        curr_chunk->num_portals = 0;
+    }}
+    
+    /* Portals are created in a serial pass over the chunks. This is cheap
+     * and gives every portal the same index within its' chunk regardless
+     * of how the rest of the work is scheduled. After this, the portals of 
+     * every chunk can be linked and indexed independently. */
+    n_create_portals(priv);
+
+    struct link_portals_arg lpa = (struct link_portals_arg){ .priv = priv };
+    SDL_AtomicSet(&lpa.nfailed, 0);
+    Task_ParallelFor(priv->width * priv->height, n_link_portals_task, &lpa);
+
+    if(SDL_AtomicGet(&lpa.nfailed) > 0) {
+        n_clear_portals(priv);
+        PERF_RETURN(false);
+    }
+
+    n_update_components(priv);
+    N_InfluenceGraphChanged(priv);
+    PERF_RETURN(N_LandmarksUpdate(priv));
+}
+
+/* The cache holds only the data that is independent of the blockers. The 
+ * rest is cheap to derive from it. */
+static bool n_load_cached(struct nav_private *priv, uint64_t key)
+{
+    PERF_ENTER();
+
+    if(!N_CacheLoad(priv, key))
+        PERF_RETURN(false);
+
+    n_island_edits_reset(priv, true, n_next_island_id(priv));
+    Task_ParallelFor(priv->width * priv->height, n_local_islands_task, priv);
+    n_update_components(priv);
+    N_InfluenceGraphChanged(priv);
+    PERF_RETURN(N_LandmarksUpdate(priv));
+}
+
+static const struct portal *n_closest_reachable_portal(const struct nav_chunk *chunk, struct coord start)
+{
+    const struct portal *ret = NULL;
+    float min_cost = FLT_MAX;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *curr = &chunk->portals[i];
+        float cost = N_PortalTravelCost(chunk, i, start);
+
+        if(cost < min_cost) {
+            ret = curr;
+            min_cost = cost;
+        }
+    }
+    return ret;
+}
+
+static bool n_same_seek_target(struct field_target a, struct field_target b)
+{
+    if(a.type != b.type)
+        return false;
+    if(a.type == TARGET_PORTALMASK)
+        return (a.portalmask == b.portalmask);
+
+    assert(a.type == TARGET_ENEMIES);
+    return (a.enemies.presence == b.enemies.presence);
+}
+
+/* Returns true if, in the abscence of any blockers, the tiles would be on the same local island */
+static bool n_normally_reachable(const struct nav_chunk *chunk, struct coord a, struct coord b)
+{
+    for(int i = 0; i < chunk->num_portals; i++) {
+    
+        bool areach = (chunk->portal_travel_costs[i][a.r][a.c] != PORTAL_COST_UNREACHABLE);
+        bool breach = (chunk->portal_travel_costs[i][b.r][b.c] != PORTAL_COST_UNREACHABLE);
+        if(areach != breach)
+            return false;
+    }
+    return true;
+}
+
+static uint16_t n_update_islands_serial(struct nav_private *priv)
+{
+    uint16_t island_id = 0;
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        /* Initialize every node as 'unvisited' */
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
+    }}
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+
+        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
+        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+
+            if(curr_chunk->islands[tile_r][tile_c] != ISLAND_NONE)
+                continue;
+
+            if(curr_chunk->cost_base[tile_r][tile_c] == COST_IMPASSABLE)
+                continue;
+
+            struct tile_desc td = {chunk_r, chunk_c, tile_r, tile_c};
+            n_visit_island(priv, island_id, td);
+            island_id++;
+        }}
+    }}
+    return island_id;
+}
+
+static uint64_t n_path_key(dest_id_t id, struct coord chunk)
+{
+    return (((uint64_t)id) << 32)
+         | (((uint64_t)chunk.r & 0xffff) << 16)
+         | (((uint64_t)chunk.c & 0xffff) <<  0);
+}
+
+static void n_set_ticket_status(path_ticket_t ticket, enum path_status status)
+{
+    s_ticket_status[ticket % TICKET_HISTORY].ticket = ticket;
+    s_ticket_status[ticket % TICKET_HISTORY].status = status;
+}
+
+static void n_path_init(const struct nav_private *priv, vec3_t map_pos, 
+                        vec2_t xz_src, vec2_t xz_dest, struct path_request *out)
+{
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    /* Convert source and destination positions to tile coordinates */
+    bool result;
+    (void)result;
+
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &out->src_desc);
+    assert(result);
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &out->dst_desc);
+    assert(result);
+
+    out->ticket = 0;
+    out->dest_id = n_dest_id(out->dst_desc);
+    out->map_pos = map_pos;
+    out->res = PATH_RES_UNREACHABLE;
+    out->dst_port = NULL;
+    vec_hop_init(&out->hops);
+    out->nflow = 0;
+    out->flow = NULL;
+    out->seed = NULL;
+    out->nlos = 0;
+    out->los = NULL;
+}
+
+static void n_path_fini(struct path_request *req)
+{
+    vec_hop_destroy(&req->hops);
+    free(req->flow);
+    free(req->los);
+}
+
+static void n_path_discard_prebuilt(struct path_request *req)
+{
+    free(req->flow);
+    free(req->los);
+    req->flow = NULL;
+    req->los = NULL;
+    req->nflow = 0;
+    req->nlos = 0;
+    req->seed = NULL;
+}
+
+/* Find the chunks that the path will take us through and the flow field
+ * targets for them. Only reads the navigation data, so it is safe to call 
+ * from multiple threads at once.
+ */
+static void n_path_resolve(const struct nav_private *priv, struct path_request *req)
+{
+    struct tile_desc src_desc = req->src_desc;
+    struct tile_desc dst_desc = req->dst_desc;
+
+    /* Handle the case where no path exists between the source and destination 
+     * (i.e. they are on different 'islands'). 
+     */
+    const struct nav_chunk *src_chunk = &priv->chunks[src_desc.chunk_r * priv->width + src_desc.chunk_c];
+    const struct nav_chunk *dst_chunk = &priv->chunks[dst_desc.chunk_r * priv->width + dst_desc.chunk_c];
+    uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
+    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
+
+    if(src_iid != dst_iid) {
+        req->res = PATH_RES_UNREACHABLE;
+        return;
+    }
+
+    /* Source and destination positions are in the same chunk, and a path exists
+     * between them. In this case, we only need a single flow field. .
+     */
+    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
+    && src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c] == src_chunk->local_islands[dst_desc.tile_r][dst_desc.tile_c]) {
+
+        req->res = PATH_RES_DEST_CHUNK;
+        return;
+    }
+
+    /* If the source and destination are on the same chunk and, in the absence of blockers,
+     * would be reachable from one another, that means that the destination is blocked in
+     * by blockers. In this case, get as close as possible. 
+     */
+    if((src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c)
+    && n_normally_reachable(src_chunk, 
+        (struct coord){src_desc.tile_r, src_desc.tile_c},
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c})) {
+        
+        req->res = PATH_RES_DEST_CHUNK;
+        return;
+    }
+
+    req->dst_port = n_closest_reachable_portal(dst_chunk, 
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c});
+
+    if(!req->dst_port) {
+        req->res = PATH_RES_NO_PORTAL_PATH;
+        return;
+    }
+
+    float cost;
+    vec_portal_t path;
+    vec_portal_init(&path);
+
+    bool path_exists = AStar_PortalGraphPath(src_desc, req->dst_port, priv, &path, &cost);
+    if(!path_exists) {
+        vec_portal_destroy(&path);
+        req->res = PATH_RES_NO_PORTAL_PATH;
+        return;
+    }
+
+    /* Traverse the portal path _backwards_ and find the chunks that need fields */
+    for(int i = vec_size(&path)-1; i > 0; i--) {
+
+        const struct portal *curr_node = vec_AT(&path, i - 1);
+        const struct portal *next_hop = vec_AT(&path, i);
+
+        /* If the very first hop takes us into another chunk, that means that the 'nearest portal'
+         * to the source borders the 'next' chunk already. In this case, we must remember to
+         * still generate a flow field for the current chunk steering to this portal. */
+        if(i == 1 && (next_hop->chunk.r != src_desc.chunk_r || next_hop->chunk.c != src_desc.chunk_c))
+            next_hop = vec_AT(&path, 0);
+
+        if(curr_node->connected == next_hop)
+            continue;
+
+        /* Since we are moving from 'closest portal' to 'closest portal', it 
+         * may be possible that the very last hop takes us from another portal in the 
+         * destination chunk to the destination portal. This is not needed and will
+         * overwrite the destination flow field made earlier. */
+        if(curr_node->chunk.r == dst_desc.chunk_r 
+        && curr_node->chunk.c == dst_desc.chunk_c
+        && next_hop == req->dst_port)
+            continue;
+
+        vec_hop_push(&req->hops, (struct path_hop){
+            .chunk = curr_node->chunk,
+            .target = (struct field_target){
+                .type = TARGET_PORTAL,
+                .port = next_hop
+            }
+        });
+    }
+    vec_portal_destroy(&path);
+    req->res = PATH_RES_PORTAL_PATH;
+}
+
+/* Find a flow field that an earlier request in the batch is going to build.
+ */
+static const struct prebuilt_flow *n_batch_find_flow(const struct path_batch *batch, int upto,
+                                                     ff_id_t id, bool has_base, ff_id_t base_id)
+{
+    for(int i = 0; i < upto; i++) {
+
+        const struct path_request *req = batch->reqs[i];
+        for(int j = 0; j < req->nflow; j++) {
+
+            const struct prebuilt_flow *curr = &req->flow[j];
+            if(curr->id != id || curr->has_base != has_base)
+                continue;
+            if(has_base && curr->base_id != base_id)
+                continue;
+            return curr;
+        }
+    }
+    return NULL;
+}
+
+/* Find a LOS field for the destination that an earlier request in the batch
+ * is going to build.
+ */
+static const struct prebuilt_los *n_batch_find_los(const struct path_batch *batch, int upto,
+                                                   dest_id_t id, struct coord chunk)
+{
+    for(int i = 0; i < upto; i++) {
+
+        const struct path_request *req = batch->reqs[i];
+        if(req->dest_id != id)
+            continue;
+
+        for(int j = 0; j < req->nlos; j++) {
+            if(req->los[j].chunk.r == chunk.r && req->los[j].chunk.c == chunk.c)
+                return &req->los[j];
+        }
+    }
+    return NULL;
+}
+
+static void n_path_plan_flow(const struct path_batch *batch, int idx, struct path_hop hop,
+                             ff_id_t id, bool has_base, ff_id_t base_id)
+{
+    struct path_request *req = batch->reqs[idx];
+    if(n_batch_find_flow(batch, idx, id, has_base, base_id))
+        return;
+
+    struct prebuilt_flow *pf = &req->flow[req->nflow++];
+    pf->hop = hop;
+    pf->id = id;
+    pf->has_base = has_base;
+    if(has_base) {
+        pf->base_id = base_id;
+        memcpy(&pf->base, N_FC_FlowFieldAt(base_id), sizeof(pf->base));
+    }
+}
+
+/* Decide which of the fields of a resolved request are missing from the
+ * field cache, so that they can be built ahead of publishing the path.
+ * Fields that an earlier request in the batch is going to build are not
+ * planned again.
+ */
+static bool n_path_plan(const struct path_batch *batch, int idx)
+{
+    struct path_request *req = batch->reqs[idx];
+    if(req->res == PATH_RES_UNREACHABLE)
+        return true;
+
+    struct coord dst_chunk = (struct coord){req->dst_desc.chunk_r, req->dst_desc.chunk_c};
+    size_t nhops = (req->res == PATH_RES_PORTAL_PATH) ? vec_size(&req->hops) : 0;
+
+    req->flow = malloc((nhops + 1) * sizeof(struct prebuilt_flow));
+    req->los = malloc((nhops + 1) * sizeof(struct prebuilt_los));
+    if(!req->flow || !req->los)
+        return false;
+
+    ff_id_t exist_id;
+    if(!N_FC_GetDestFFMapping(req->dest_id, dst_chunk, &exist_id)
+    || !N_FC_ContainsFlowField(exist_id)) {
+
+        struct path_hop hop = (struct path_hop){
+            .chunk = dst_chunk,
+            .target = (struct field_target){
+                .type = TARGET_TILE,
+                .tile = (struct coord){req->dst_desc.tile_r, req->dst_desc.tile_c}
+            }
+        };
+        ff_id_t id = N_FlowField_ID(hop.chunk, hop.target);
+
+        if(!N_FC_ContainsFlowField(id))
+            n_path_plan_flow(batch, idx, hop, id, false, 0);
+    }
+
+    for(int i = 0; i < nhops; i++) {
+
+        struct path_hop hop = vec_AT(&req->hops, i);
+        ff_id_t id = N_FlowField_ID(hop.chunk, hop.target);
+
+        if(N_FC_GetDestFFMapping(req->dest_id, hop.chunk, &exist_id)
+        && N_FC_ContainsFlowField(exist_id)) {
+
+            if(id == exist_id)
+                continue;
+            n_path_plan_flow(batch, idx, hop, id, true, exist_id);
+
+        }else if(!N_FC_ContainsFlowField(id)) {
+
+            n_path_plan_flow(batch, idx, hop, id, false, 0);
+        }
+    }
+
+    /* Each LOS field depends on the one for the previous chunk along the path,
+     * so build the chain starting from the first one that's missing. The chain
+     * ends if the path comes back to a chunk that will already have a field -
+     * any fields past that point are made when publishing. */
+    for(int i = 0; i <= nhops; i++) {
+
+        struct coord chunk = (i == 0) ? dst_chunk : vec_AT(&req->hops, i - 1).chunk;
+        bool exists = N_FC_ContainsLOSField(req->dest_id, chunk)
+                   || n_batch_find_los(batch, idx, req->dest_id, chunk);
+
+        for(int j = 0; j < req->nlos; j++) {
+            if(req->los[j].chunk.r == chunk.r && req->los[j].chunk.c == chunk.c)
+                exists = true;
+        }
+
+        if(exists && req->nlos > 0)
+            break;
+        if(exists)
+            continue;
+
+        if(req->nlos == 0 && i > 0) {
+
+            struct coord prev = (i == 1) ? dst_chunk : vec_AT(&req->hops, i - 2).chunk;
+            if(N_FC_ContainsLOSField(req->dest_id, prev)) {
+                memcpy(&req->seed_copy, N_FC_LOSFieldAt(req->dest_id, prev), sizeof(req->seed_copy));
+                req->seed = &req->seed_copy;
+            }else{
+                req->seed = &n_batch_find_los(batch, idx, req->dest_id, prev)->lf;
+            }
+        }
+        req->los[req->nlos++].chunk = chunk;
+    }
+    return true;
+}
+
+static void n_path_resolve_task(void *arg, int idx)
+{
+    struct path_batch *batch = arg;
+    n_path_resolve(batch->priv, batch->reqs[idx]);
+}
+
+static void n_path_build_los_chain(const struct nav_private *priv, struct path_request *req)
+{
+    for(int i = 0; i < req->nlos; i++) {
+
+        const struct LOS_field *prev = (i > 0) ? &req->los[i - 1].lf : req->seed;
+        N_LOSFieldCreate(req->dest_id, req->los[i].chunk, req->dst_desc, priv,
+            req->map_pos, &req->los[i].lf, prev);
+    }
+}
+
+static void n_path_build_task(void *arg, int idx)
+{
+    struct path_batch *batch = arg;
+    struct path_job *job = &batch->jobs[idx];
+    struct path_request *req = batch->reqs[job->req_idx];
+
+    if(job->flow_idx >= 0) {
+
+        struct prebuilt_flow *pf = &req->flow[job->flow_idx];
+        if(pf->has_base) {
+            memcpy(&pf->ff, &pf->base, sizeof(pf->ff));
+            N_FlowFieldUpdate(pf->hop.chunk, batch->priv, pf->hop.target, &pf->ff);
+            pf->has_intf = false;
+        }else{
+            pf->has_intf = N_FlowFieldBuild(pf->hop.chunk, batch->priv, pf->hop.target, 
+                &pf->ff, &pf->intf);
+        }
+        return;
+    }
+
+    for(int i = job->req_idx; i < batch->nreqs; i++) {
+
+        if(batch->reqs[i]->dest_id != req->dest_id)
+            continue;
+        n_path_build_los_chain(batch->priv, batch->reqs[i]);
+    }
+}
+
+/* Get the flow field for the hop, using one that was built ahead of time
+ * for the batch if it's still applicable. If 'base' is not NULL, the field
+ * is layered on top of it. Returns true if the field can be repaired using 
+ * the integration field written to 'out_intf'.
+ */
+static bool n_path_flow_field(const struct nav_private *priv, const struct path_batch *batch,
+                              struct path_hop hop, ff_id_t base_id, const struct flow_field *base,
+                              struct flow_field *out, struct integration_field *out_intf)
+{
+    ff_id_t id = N_FlowField_ID(hop.chunk, hop.target);
+    for(int i = 0; batch && i < batch->nreqs; i++) {
+
+        const struct path_request *req = batch->reqs[i];
+        for(int j = 0; j < req->nflow; j++) {
+
+            const struct prebuilt_flow *curr = &req->flow[j];
+            if(curr->id != id || curr->has_base != !!base)
+                continue;
+            if(base && (curr->base_id != base_id || memcmp(&curr->base, base, sizeof(*base))))
+                continue;
 
-        left = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
+            memcpy(out, &curr->ff, sizeof(*out));
+            if(curr->has_intf)
+                memcpy(out_intf, &curr->intf, sizeof(*out_intf));
+            return curr->has_intf;
+        }
     }
 
-    if(chunk.c < FIELD_RES_C-1) {
+    if(!base)
+        return N_FlowFieldBuild(hop.chunk, priv, hop.target, out, out_intf);
+
+    memcpy(out, base, sizeof(*out));
+    N_FlowFieldUpdate(hop.chunk, priv, hop.target, out);
+    return false;
+}
+
+/* Get the LOS field for the chunk, using one that was built ahead of time
+ * for the batch if it was made from the same previous LOS field.
+ */
+static void n_path_los_field(const struct nav_private *priv, const struct path_batch *batch,
+                             const struct path_request *req, struct coord chunk,
+                             const struct LOS_field *prev, struct LOS_field *out)
+{
+    for(int i = 0; batch && i < batch->nreqs; i++) {
+
+        const struct path_request *curr_req = batch->reqs[i];
+        if(curr_req->dest_id != req->dest_id)
+            continue;
+
+        for(int j = 0; j < curr_req->nlos; j++) {
+
+            const struct prebuilt_los *curr = &curr_req->los[j];
+            if(curr->chunk.r != chunk.r || curr->chunk.c != chunk.c)
+                continue;
 
-        curr = (struct coord){chunk.r, chunk.c + 1};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+            const struct LOS_field *built_prev = (j > 0) ? &curr_req->los[j - 1].lf
+                                                         : curr_req->seed;
+            if(!!built_prev != !!prev)
+                continue;
+            if(prev && memcmp(built_prev, prev, sizeof(*prev)))
+                continue;
 
-        right = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
+            memcpy(out, &curr->lf, sizeof(*out));
+            return;
+        }
     }
+    N_LOSFieldCreate(req->dest_id, chunk, req->dst_desc, priv, req->map_pos, out, prev);
+}
+
+/* Add all the fields of a resolved request to the field cache. Any fields 
+ * that were not built ahead of time are built on the spot. Returns true if
+ * pathing to the destination is possible.
+ */
+static bool n_path_publish(const struct nav_private *priv, const struct path_batch *batch,
+                           struct path_request *req)
+{
+    if(req->res == PATH_RES_UNREACHABLE)
+        return false;
+
+    dest_id_t ret = req->dest_id;
+    struct tile_desc dst_desc = req->dst_desc;
 
-    uint64_t ret = 0;
-    const struct nav_chunk *nchunk = &priv->chunks[IDX(chunk.r, priv->width, chunk.c)];
+    /* Even if a mapping exists, the actual flow field may have been evicted from
+     * the cache, due to space constraints or invalidation. */
+    ff_id_t id;
+    if(!N_FC_GetDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &id)
+    || !N_FC_ContainsFlowField(id)) {
 
-    for(int i = 0; i < nchunk->num_portals; i++) {
+        struct path_hop hop = (struct path_hop){
+            .chunk = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c},
+            .target = (struct field_target){
+                .type = TARGET_TILE,
+                .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
+            }
+        };
 
-        const struct portal *curr = &nchunk->portals[i];
+        struct flow_field ff;
+        struct integration_field intf;
+        id = N_FlowField_ID(hop.chunk, hop.target);
 
-        if(top && curr->endpoints[0].r == 0 
-               && curr->endpoints[1].r == 0)
-            ret |= (((uint64_t)1) << i);
+        if(!N_FC_ContainsFlowField(id)) {
+        
+            bool repairable = n_path_flow_field(priv, batch, hop, 0, NULL, &ff, &intf);
+            N_FC_PutFlowField(id, &ff);
+            if(repairable)
+                N_FC_PutIntegrationField(id, &intf);
+        }
 
-        if(bot && curr->endpoints[0].r == FIELD_RES_R-1 
-               && curr->endpoints[1].r == FIELD_RES_R-1)
-            ret |= (((uint64_t)1) << i);
+        N_FC_PutDestFFMapping(ret, hop.chunk, id);
+    }
 
-        if(left && curr->endpoints[0].c == 0 
-                && curr->endpoints[1].c == 0)
-            ret |= (((uint64_t)1) << i);
+    /* Create the LOS field for the destination chunk, if necessary */
+    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
 
-        if(right && curr->endpoints[0].c == FIELD_RES_C-1 
-                 && curr->endpoints[1].c == FIELD_RES_C-1)
-            ret |= (((uint64_t)1) << i);
+        struct LOS_field lf;
+        n_path_los_field(priv, batch, req, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, NULL, &lf);
+        N_FC_PutLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &lf);
     }
 
-    return ret;
+    if(req->res == PATH_RES_NO_PORTAL_PATH)
+        return false;
+    if(req->res == PATH_RES_DEST_CHUNK)
+        return true;
+
+    struct coord prev_los_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+
+    /* Generate the required fields along the path, if they are not already 
+     * cached. Add the results to the fieldcache. */
+    for(int i = 0; i < vec_size(&req->hops); i++) {
+
+        struct path_hop hop = vec_AT(&req->hops, i);
+        struct coord chunk_coord = hop.chunk;
+
+        ff_id_t new_id = N_FlowField_ID(chunk_coord, hop.target);
+        ff_id_t exist_id;
+        struct flow_field ff;
+
+        if(N_FC_GetDestFFMapping(ret, chunk_coord, &exist_id)
+        && N_FC_ContainsFlowField(exist_id)) {
+
+            /* The exact flow field we need has already been made */
+            if(new_id == exist_id)
+                goto ff_exists;
+
+            /* This is the edge case when a path to a particular target takes us through
+             * the same chunk more than once. This can happen if a chunk is divided into
+             * 'islands' by unpathable barriers. */
+            const struct flow_field *exist_ff  = N_FC_FlowFieldAt(exist_id);
+            n_path_flow_field(priv, batch, hop, exist_id, exist_ff, &ff, NULL);
+
+            /* We set the updated flow field for the new (least recently used) key. Since in 
+             * this case more than one flowfield ID maps to the same field but we only keep 
+             * one of the IDs, it may be possible that the same flowfield will be redundantly 
+             * updated at a later time. However, this is largely inconsequential. */
+            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+            N_FC_PutFlowField(new_id, &ff);
+
+            goto ff_exists;
+        }
+
+        N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+        if(!N_FC_ContainsFlowField(new_id)) {
+        
+            struct integration_field intf;
+            bool repairable = n_path_flow_field(priv, batch, hop, 0, NULL, &ff, &intf);
+            N_FC_PutFlowField(new_id, &ff);
+            if(repairable)
+                N_FC_PutIntegrationField(new_id, &intf);
+        }
+
+    ff_exists:
+        assert(N_FC_ContainsFlowField(new_id));
+        /* Reference field in the cache */
+        (void)N_FC_FlowFieldAt(new_id);
+
+        if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
+
+            assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
+            assert(N_FC_ContainsLOSField(ret, prev_los_coord));
+
+            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
+            assert(prev_los);
+            assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
+
+            struct LOS_field lf;
+            n_path_los_field(priv, batch, req, chunk_coord, prev_los, &lf);
+            N_FC_PutLOSField(ret, chunk_coord, &lf);
+        }
+
+        prev_los_coord = chunk_coord;
+    }
+    return true;
 }
 
-/* Returns true if, in the abscence of any blockers, the tiles would be on the same local island */
-static bool n_normally_reachable(const struct nav_chunk *chunk, struct coord a, struct coord b)
+/* Returns true if the request is the first in the batch with LOS fields to 
+ * build for its' destination.
+ */
+static bool n_los_leader(const struct path_batch *batch, int idx)
 {
-    for(int i = 0; i < chunk->num_portals; i++) {
-    
-        bool areach = (chunk->portal_travel_costs[i][a.r][a.c] != FLT_MAX);
-        bool breach = (chunk->portal_travel_costs[i][b.r][b.c] != FLT_MAX);
-        if(areach != breach)
+    const struct path_request *req = batch->reqs[idx];
+    if(req->nlos == 0)
+        return false;
+
+    for(int i = 0; i < idx; i++) {
+        if(batch->reqs[i]->dest_id == req->dest_id && batch->reqs[i]->nlos > 0)
             return false;
     }
     return true;
 }
 
+/* Service a batch of the pending path requests. The paths are found and 
+ * the missing fields are built on the worker threads, after which they are
+ * all published to the field cache.
+ */
+static void n_process_path_requests(const struct nav_private *priv)
+{
+    PERF_ENTER();
+
+    size_t nreqs = MIN(vec_size(&s_path_requests), MAX_PATH_REQUESTS_PER_TICK);
+    if(nreqs == 0)
+        PERF_RETURN_VOID();
+
+    struct path_request *reqs[MAX_PATH_REQUESTS_PER_TICK];
+    memcpy(reqs, s_path_requests.array, nreqs * sizeof(reqs[0]));
+    memmove(s_path_requests.array, s_path_requests.array + nreqs, 
+        (vec_size(&s_path_requests) - nreqs) * sizeof(reqs[0]));
+    s_path_requests.size -= nreqs;
+
+    struct path_batch batch = (struct path_batch){
+        .priv = priv,
+        .nreqs = nreqs,
+        .reqs = reqs,
+        .jobs = NULL
+    };
+    Task_ParallelFor(nreqs, n_path_resolve_task, &batch);
+
+    size_t njobs = 0;
+    bool planned = true;
+    for(int i = 0; i < nreqs; i++) {
+
+        /* Anything that couldn't be planned will be built when publishing. Later
+         * requests may depend on the fields planned for earlier ones, so stop 
+         * planning at the first failure. */
+        if(!(planned = planned && n_path_plan(&batch, i)))
+            n_path_discard_prebuilt(reqs[i]);
+        njobs += reqs[i]->nflow + n_los_leader(&batch, i);
+    }
+
+    if(njobs > 0 && (batch.jobs = malloc(njobs * sizeof(struct path_job)))) {
+
+        size_t nadded = 0;
+        for(int i = 0; i < nreqs; i++) {
+
+            for(int j = 0; j < reqs[i]->nflow; j++)
+                batch.jobs[nadded++] = (struct path_job){i, j};
+            if(n_los_leader(&batch, i))
+                batch.jobs[nadded++] = (struct path_job){i, -1};
+        }
+        assert(nadded == njobs);
+        Task_ParallelFor(njobs, n_path_build_task, &batch);
+
+    }else{
+
+        for(int i = 0; i < nreqs; i++)
+            n_path_discard_prebuilt(reqs[i]);
+    }
+
+    for(int i = 0; i < nreqs; i++) {
+
+        struct path_request *req = reqs[i];
+        bool result = n_path_publish(priv, &batch, req);
+        n_set_ticket_status(req->ticket, result ? PATH_READY : PATH_UNREACHABLE);
+
+        /* Keep unreachable results around so that they are not requested again
+         * until the navigation data changes */
+        if(result) {
+            uint64_t key = n_path_key(req->dest_id, 
+                (struct coord){req->src_desc.chunk_r, req->src_desc.chunk_c});
+            khiter_t k = kh_get(ticket, s_path_tickets, key);
+            if(k != kh_end(s_path_tickets) && kh_value(s_path_tickets, k) == req->ticket)
+                kh_del(ticket, s_path_tickets, k);
+        }
+    }
+
+    /* Requests may use the fields built for the ones before them */
+    for(int i = 0; i < nreqs; i++) {
+        n_path_fini(reqs[i]);
+        free(reqs[i]);
+    }
+
+    free(batch.jobs);
+    PERF_RETURN_VOID();
+}
+
+static void n_forget_finished_requests(void)
+{
+    for(khiter_t k = kh_begin(s_path_tickets); k != kh_end(s_path_tickets); k++) {
+
+        if(!kh_exist(s_path_tickets, k))
+            continue;
+        if(N_PathStatus(kh_value(s_path_tickets, k)) == PATH_PENDING)
+            continue;
+        kh_del(ticket, s_path_tickets, k);
+    }
+}
+
+static void n_clear_path_requests(void)
+{
+    for(int i = 0; i < vec_size(&s_path_requests); i++) {
+
+        struct path_request *req = vec_AT(&s_path_requests, i);
+        n_set_ticket_status(req->ticket, PATH_EXPIRED);
+        n_path_fini(req);
+        free(req);
+    }
+    vec_preq_reset(&s_path_requests);
+    if(s_path_tickets)
+        kh_clear(ticket, s_path_tickets);
+    if(s_repath_tickets)
+        kh_clear(ticket, s_repath_tickets);
+}
+
+static vec2_t n_provisional_velocity(vec2_t curr_pos, vec2_t xz_dest)
+{
+    vec2_t ret;
+    PFM_Vec2_Sub(&xz_dest, &curr_pos, &ret);
+
+    if(PFM_Vec2_Len(&ret) < EPSILON)
+        return (vec2_t){0.0f};
+
+    PFM_Vec2_Normal(&ret, &ret);
+    return ret;
+}
+
+/* Used while the field for the entity's chunk is being made. Follow the field 
+ * of the closest neighbouring chunk that already guides towards the same 
+ * destination, from its' tile nearest to the entity. This is usually the 
+ * chunk which the entity has just left. Head straight for the destination 
+ * only when no such field is cached. */
+static vec2_t n_fallback_velocity(const struct nav_private *priv, dest_id_t id, 
+                                  struct tile_desc tile, vec2_t curr_pos, vec2_t xz_dest)
+{
+    int min_dist = INT_MAX;
+    vec2_t ret = {0};
+
+    for(int dr = -1; dr <= 1; dr++) {
+    for(int dc = -1; dc <= 1; dc++) {
+
+        int r = tile.chunk_r + dr, c = tile.chunk_c + dc;
+        if((dr == 0 && dc == 0) || r < 0 || r >= priv->height || c < 0 || c >= priv->width)
+            continue;
+
+        ff_id_t ffid;
+        const struct flow_field *ff;
+        if(!N_FC_GetDestFFMapping(id, (struct coord){r, c}, &ffid)
+        || !(ff = N_FC_FlowFieldAt(ffid)))
+            continue;
+
+        int tile_r = (dr < 0) ? FIELD_RES_R - 1 : (dr > 0) ? 0 : tile.tile_r;
+        int tile_c = (dc < 0) ? FIELD_RES_C - 1 : (dc > 0) ? 0 : tile.tile_c;
+
+        enum flow_dir dir = N_FlowDir(ff, tile_r, tile_c);
+        if(dir == FD_NONE)
+            continue;
+
+        int dist = MAX(abs(tile.tile_r - tile_r - dr * FIELD_RES_R), 
+                       abs(tile.tile_c - tile_c - dc * FIELD_RES_C));
+        if(dist < min_dist) {
+            min_dist = dist;
+            ret = g_flow_dir_lookup[dir];
+        }
+    }}
+
+    if(min_dist < INT_MAX)
+        return ret;
+    return n_provisional_velocity(curr_pos, xz_dest);
+}
+
+/* Request the path from the tile's island in the background, unless that 
+ * was already done since the navigation data last changed. Tickets that 
+ * have expired are reported as 'PATH_READY'. So is a request that could 
+ * not be queued, leaving the caller to make do with the current field. */
+static enum path_status n_repath_status(struct nav_private *priv, dest_id_t id, vec3_t map_pos,
+                                        struct tile_desc tile, vec2_t curr_pos, vec2_t xz_dest)
+{
+    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
+    assert(IDX(tile.chunk_r, priv->width, tile.chunk_c) <= 0xffff);
+    uint64_t key = (((uint64_t)id) << 32)
+                 | (((uint64_t)IDX(tile.chunk_r, priv->width, tile.chunk_c)) << 16)
+                 | (((uint64_t)chunk->local_islands[tile.tile_r][tile.tile_c]) << 0);
+
+    path_ticket_t ticket;
+    khiter_t k = kh_get(ticket, s_repath_tickets, key);
+
+    if(k != kh_end(s_repath_tickets)) {
+        ticket = kh_value(s_repath_tickets, k);
+    }else{
+        if(!N_RequestPathAsync(priv, curr_pos, xz_dest, map_pos, &ticket))
+            return PATH_READY;
+
+        int status;
+        k = kh_put(ticket, s_repath_tickets, key, &status);
+        if(status != -1)
+            kh_value(s_repath_tickets, k) = ticket;
+    }
+
+    enum path_status ret = N_PathStatus(ticket);
+    return (ret == PATH_EXPIRED) ? PATH_READY : ret;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1129,9 +2853,24 @@ bool N_Init(void)
     if(!N_FC_Init())
         return false;
 
+    if(!AStar_Init())
+        return false;
+
     if((s_dirty_chunks = kh_init(coord)) == NULL)
         return false;
 
+    if((s_path_tickets = kh_init(ticket)) == NULL)
+        return false;
+
+    if((s_repath_tickets = kh_init(ticket)) == NULL)
+        return false;
+
+    if((s_chunk_delta_idx = kh_init(cdelta)) == NULL)
+        return false;
+
+    vec_preq_init(&s_path_requests);
+    vec_bop_init(&s_blocker_ops);
+    vec_cdelta_init(&s_chunk_deltas);
     return true;
 }
 
@@ -1142,6 +2881,8 @@ void N_Update(void *nav_private)
     struct nav_private *priv = nav_private;
     bool components_dirty = false;
 
+    n_flush_blockers();
+
     for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
 
         if(!kh_exist(s_dirty_chunks, i))
@@ -1149,73 +2890,135 @@ void N_Update(void *nav_private)
 
         uint32_t key = kh_key(s_dirty_chunks, i);
         struct coord curr = (struct coord){ key >> 16, key & 0xffff };
-        N_FC_InvalidateAllAtChunk(curr);
 
         struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
         int nflipped = n_update_edge_states(chunk);
 
+        /* When the portals are unchanged, the paths through the chunk stay 
+         * the same, and only the fields for the chunk itself need to be 
+         * brought up to date. */
         if(nflipped) {
             components_dirty = true;
+            N_FC_InvalidateAllAtChunk(curr);
             N_FC_InvalidateAllThroughChunk(curr);
+        }else{
+            const struct dirty_tiles *dirty = &kh_value(s_dirty_chunks, i);
+            struct coord tiles[FIELD_RES_R * FIELD_RES_C];
+            size_t ntiles = 0;
+
+            for(int r = 0; r < FIELD_RES_R; r++) {
+            for(int c = 0; c < FIELD_RES_C; c++) {
+                if(dirty->rows[r] & (((uint64_t)1) << c))
+                    tiles[ntiles++] = (struct coord){r, c};
+            }}
+            N_FC_RepairAllAtChunk(curr, priv, tiles, ntiles);
         }
     }
 
     n_update_dirty_local_islands(priv);
-    if(components_dirty)
+    if(components_dirty) {
         n_update_components(priv);
+        N_InfluenceGraphChanged(priv);
+    }
+
+    /* Destinations that were unreachable may not be anymore */
+    if(kh_size(s_dirty_chunks) > 0) {
+        n_forget_finished_requests();
+        kh_clear(ticket, s_repath_tickets);
+    }
 
     kh_clear(coord, s_dirty_chunks);
+    n_process_path_requests(priv);
     PERF_RETURN_VOID();
 }
 
 void N_Shutdown(void)
 {
+    n_clear_path_requests();
+    vec_preq_destroy(&s_path_requests);
+    vec_bop_destroy(&s_blocker_ops);
+    vec_cdelta_destroy(&s_chunk_deltas);
+    kh_destroy(cdelta, s_chunk_delta_idx);
+    kh_destroy(ticket, s_repath_tickets);
+    kh_destroy(ticket, s_path_tickets);
     kh_destroy(coord, s_dirty_chunks);
+    AStar_Shutdown();
     N_FC_Shutdown();
 }
 
+void N_SetDiskCacheEnabled(bool on)
+{
+    s_disk_cache_enabled = on;
+}
+
 void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
                         const struct tile **chunk_tiles, bool update)
 {
     struct nav_private *ret;
     size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
 
+    /* The destination IDs hold 8 bits of either chunk coordinate and the 
+     * repath keys hold 16 bits of the chunk index. Larger maps would make 
+     * distinct chunks share the same keys. */
+    if(w > MAX_CHUNKS_PER_DIM || h > MAX_CHUNKS_PER_DIM)
+        goto fail_alloc;
+
     ret = malloc(alloc_size);
     if(!ret)
         goto fail_alloc;
 
     ret->width = w;
     ret->height = h;
+    ret->landmarks = NULL;
+    ret->influence = NULL;
+    ret->corridors = NULL;
+
+    if(!(ret->island_edits = malloc(sizeof(struct island_edits))))
+        goto fail_edits;
+    if(!(ret->island_edits->chunks = kh_init(snapshot)))
+        goto fail_edits_chunks;
+    ret->island_edits->valid = false;
+    ret->island_edits->next_id = 0;
 
     assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
     assert(FIELD_RES_C >= chunk_w && FIELD_RES_C % chunk_w == 0);
 
     /* First build the base cost field based on terrain */
-    for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < ret->width;  chunk_c++){
-
-        struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
-        const struct tile *curr_tiles = chunk_tiles[IDX(chunk_r, ret->width, chunk_c)];
-        curr_chunk->num_portals = 0;
+    struct build_costs_arg bca = (struct build_costs_arg){
+        .priv = ret,
+        .chunk_w = chunk_w,
+        .chunk_h = chunk_h,
+        .chunk_tiles = chunk_tiles,
+        .update = update
+    };
+    Task_ParallelFor(w * h, n_build_costs_task, &bca);
 
-        for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
-        for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
+    if(!N_InfluenceInit(ret))
+        goto fail_build;
+    if(!N_CorridorsInit(ret))
+        goto fail_build;
+    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
 
-            if(update) {
-                const struct tile *curr_tile = &curr_tiles[tile_r * chunk_w + tile_c];
-                n_set_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c, curr_tile);
-            }else{
-                n_clear_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c);
-            }
-        }}
-        memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
-    }}
+    /* Everything else is derived from the cost fields, so it can be loaded 
+     * from the cache if the same cost fields have been seen before */
+    uint64_t key = N_CacheKey(ret);
+    if(s_disk_cache_enabled && n_load_cached(ret, key))
+        return ret;
 
-    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
-    N_UpdatePortals(ret);
+    if(!n_update_portals(ret))
+        goto fail_build;
     N_UpdateIslandsField(ret);
+    if(s_disk_cache_enabled)
+        N_CacheSave(ret, key);
     return ret;
 
+fail_build:
+    N_FreePrivate(ret);
+    return NULL;
+fail_edits_chunks:
+    free(ret->island_edits);
+fail_edits:
+    free(ret);
 fail_alloc:
     return NULL;
 }
@@ -1223,7 +3026,47 @@ fail_alloc:
 void N_FreePrivate(void *nav_private)
 {
     assert(nav_private);
+    struct nav_private *priv = nav_private;
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        free(curr_chunk->portal_travel_costs);
+    }}
+    N_LandmarksFree(priv);
+    N_InfluenceFree(priv);
+    N_CorridorsFree(priv);
+
+    n_island_edits_reset(priv, false, 0);
+    kh_destroy(snapshot, priv->island_edits->chunks);
+    free(priv->island_edits);
     free(nav_private);
+
+    /* Any pending requests were made against the freed data */
+    n_clear_path_requests();
+    if(s_blocker_ops_priv == priv)
+        vec_bop_reset(&s_blocker_ops);
+}
+
+size_t N_MemoryUsage(const void *nav_private)
+{
+    const struct nav_private *priv = nav_private;
+    size_t ret = sizeof(struct nav_private) + (priv->width * priv->height * sizeof(struct nav_chunk));
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+
+        const struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        ret += curr_chunk->num_portals * sizeof(curr_chunk->portal_travel_costs[0]);
+    }}
+    ret += N_LandmarksMemoryUsage(priv);
+    ret += N_InfluenceMemoryUsage(priv);
+    ret += N_CorridorsMemoryUsage(priv);
+
+    ret += sizeof(struct island_edits);
+    ret += kh_size(priv->island_edits->chunks) * sizeof(struct island_snapshot);
+    return ret;
 }
 
 void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
@@ -1313,7 +3156,7 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
     }}
 
     size_t count = FIELD_RES_R * FIELD_RES_C;
@@ -1366,7 +3209,7 @@ void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
-        *colors_base++ = lf->field[r][c].visible ? (vec3_t){1.0f, 1.0f, 0.0f}
+        *colors_base++ = N_LOSVisible(lf, r, c) ? (vec3_t){1.0f, 1.0f, 0.0f}
                                                  : (vec3_t){0.0f, 0.0f, 0.0f};
     }}
 
@@ -1432,14 +3275,14 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
 
         *corners_base++ = (vec2_t){square_x, square_z};
         *corners_base++ = (vec2_t){square_x, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
-        *colors_base++ = ff->field[r][c].dir_idx == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
+        *colors_base++ = N_FlowDir(ff, r, c) == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
                                                             : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
 
@@ -1603,8 +3446,7 @@ void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *o
         size_t num_tiles = M_Tile_LineSupercoverTilesSorted(res, map_pos, xz_line_segs[i], descs);
         for(int j = 0; j < num_tiles; j++) {
 
-            priv->chunks[IDX(descs[j].chunk_r, priv->width, descs[j].chunk_c)]
-                .cost_base[descs[j].tile_r][descs[j].tile_c] = COST_IMPASSABLE;
+            n_make_impassable(priv, descs[j]);
 
             if(HIGHER(descs[j], min_rows[i]))
                 min_rows[i] = (struct row_desc){descs[j].chunk_r, descs[j].tile_r};
@@ -1649,33 +3491,58 @@ void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *o
 
             if(C_PointInsideRect2D(center, bot_corners_2d[0], bot_corners_2d[1], 
                                                bot_corners_2d[2], bot_corners_2d[3])) {
-                priv->chunks[IDX(desc.chunk_r, priv->width, desc.chunk_c)]
-                    .cost_base[desc.tile_r][desc.tile_c] = COST_IMPASSABLE;
+                n_make_impassable(priv, desc);
             }
         }
     }
+
+    /* The corridors may now be leading through the object */
+    N_CorridorsClear(priv);
 }
 
-void N_UpdatePortals(void *nav_private)
+bool N_UpdatePortals(void *nav_private)
 {
     struct nav_private *priv = nav_private;
+    return n_update_portals(priv);
+}
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        curr_chunk->num_portals = 0;
-    }}
-    
-    n_create_portals(priv);
+bool N_LoadCachedNavData(void *nav_private)
+{
+    struct nav_private *priv = nav_private;
+    if(!n_load_cached(priv, N_CacheKey(priv)))
+        return false;
+
+    /* The island IDs may have been reassigned */
+    N_FC_InvalidateClosestTiles();
+    return true;
+}
+
+void N_SaveCachedNavData(const void *nav_private)
+{
+    const struct nav_private *priv = nav_private;
+    N_CacheSave(priv, N_CacheKey(priv));
+}
+
+void N_UpdateFactionPresence(void *nav_private, vec3_t map_pos, uint32_t uid, 
+                             int faction_id, vec2_t xz_pos)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc td;
+    if(!M_Tile_DescForPoint2D(res, map_pos, xz_pos, &td)) {
+        N_InfluenceRemoveEntity(priv, uid);
+        return;
+    }
+    N_InfluenceSetEntity(priv, uid, faction_id, (struct coord){td.chunk_r, td.chunk_c});
+}
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        n_link_chunk_portals(curr_chunk, (struct coord){chunk_r, chunk_c});
-        n_build_portal_travel_index(curr_chunk);
-    }}
+void N_RemoveFactionPresence(void *nav_private, uint32_t uid)
+{
+    N_InfluenceRemoveEntity(nav_private, uid);
 }
 
 void N_UpdateIslandsField(void *nav_private)
@@ -1686,38 +3553,87 @@ void N_UpdateIslandsField(void *nav_private)
      * To build the field, we treat every tile in the cost field as a node in
      * a graph, with cardinally adjacent pathable tiles being the 'neighbors'. 
      * Then we solve an instance of the 'coonected components' problem. 
+     *
+     * The components within every chunk are first found in parallel. Then the
+     * labels of the chunk-local components touching across chunk borders are
+     * joined. The lowest label of each set is always the chunk-local island 
+     * holding the first tile of the island in row-major order, so assigning 
+     * IDs in label order gives the same result as a serial flood fill. 
+     *
+     * When only some chunks have been modified since the last update, only 
+     * their' IDs are updated, unless this changes how the rest of the map is
+     * connected.
      */
+    PERF_ENTER();
+
+    /* The closest tiles of every island are cached by their' island ID */
+    N_FC_InvalidateClosestTiles();
 
     struct nav_private *priv = nav_private;
-    uint16_t island_id = 0;
+    if(n_update_islands_incremental(priv)) {
+        n_island_edits_reset(priv, true, priv->island_edits->next_id);
+        PERF_RETURN_VOID();
+    }
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+    const size_t nchunks = priv->width * priv->height;
+    struct label_islands_arg lia = (struct label_islands_arg){ .priv = priv };
 
-        /* Initialize every node as 'unvisited' */
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
-    }}
+    if(!(lia.nlabels = malloc(nchunks * sizeof(lia.nlabels[0]))))
+        goto fail_nlabels;
+    if(!(lia.label_base = malloc(nchunks * sizeof(lia.label_base[0]))))
+        goto fail_label_base;
+
+    Task_ParallelFor(nchunks, n_label_islands_task, &lia);
+
+    uint32_t nlabels = 0;
+    for(int i = 0; i < nchunks; i++) {
+        lia.label_base[i] = nlabels;
+        nlabels += lia.nlabels[i];
+    }
+
+    uint32_t *parent = malloc(MAX(nlabels, 1) * sizeof(uint32_t));
+    if(!parent)
+        goto fail_parent;
+    if(!(lia.labels = malloc(MAX(nlabels, 1) * sizeof(lia.labels[0]))))
+        goto fail_labels;
+
+    for(uint32_t i = 0; i < nlabels; i++)
+        parent[i] = i;
 
     for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
     for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
 
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        int idx = IDX(chunk_r, priv->width, chunk_c);
+        if(chunk_r < priv->height-1)
+            n_merge_chunk_edge(&lia, parent, idx, IDX(chunk_r + 1, priv->width, chunk_c), EDGE_BOT);
+        if(chunk_c < priv->width-1)
+            n_merge_chunk_edge(&lia, parent, idx, IDX(chunk_r, priv->width, chunk_c + 1), EDGE_RIGHT);
+    }}
 
-        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
-        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+    uint16_t island_id = 0;
+    for(uint32_t i = 0; i < nlabels; i++) {
+        uint32_t root = n_find_label(parent, i);
+        lia.labels[i] = (root == i) ? island_id++ : lia.labels[root];
+    }
 
-            if(curr_chunk->islands[tile_r][tile_c] != ISLAND_NONE)
-                continue;
+    Task_ParallelFor(nchunks, n_assign_islands_task, &lia);
+    n_island_edits_reset(priv, true, island_id);
 
-            if(curr_chunk->cost_base[tile_r][tile_c] == COST_IMPASSABLE)
-                continue;
+    free(lia.labels);
+    free(parent);
+    free(lia.label_base);
+    free(lia.nlabels);
+    PERF_RETURN_VOID();
 
-            struct tile_desc td = {chunk_r, chunk_c, tile_r, tile_c};
-            n_visit_island(priv, island_id, td);
-            island_id++;
-        }}
-    }}
+fail_labels:
+    free(parent);
+fail_parent:
+    free(lia.label_base);
+fail_label_base:
+    free(lia.nlabels);
+fail_nlabels:
+    n_island_edits_reset(priv, true, n_update_islands_serial(priv));
+    PERF_RETURN_VOID();
 }
 
 dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos)
@@ -1741,202 +3657,143 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
     PERF_ENTER();
 
     struct nav_private *priv = nav_private;
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
-
     n_update_dirty_local_islands(nav_private);
 
-    /* Convert source and destination positions to tile coordinates */
-    bool result;
-    (void)result;
-
-    struct tile_desc src_desc, dst_desc;
-    result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
-    assert(result);
-    result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
-    assert(result);
+    struct path_request req;
+    n_path_init(priv, map_pos, xz_src, xz_dest, &req);
+    n_path_resolve(priv, &req);
 
-    dest_id_t ret = n_dest_id(dst_desc);
+    bool ret = n_path_publish(priv, NULL, &req);
+    if(ret)
+        *out_dest_id = req.dest_id;
 
-    /* Handle the case where no path exists between the source and destination 
-     * (i.e. they are on different 'islands'). 
-     */
-    const struct nav_chunk *src_chunk = &priv->chunks[src_desc.chunk_r * priv->width + src_desc.chunk_c];
-    const struct nav_chunk *dst_chunk = &priv->chunks[dst_desc.chunk_r * priv->width + dst_desc.chunk_c];
-    uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
-    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
+    n_path_fini(&req);
+    PERF_RETURN(ret);
+}
 
-    if(src_iid != dst_iid)
-        PERF_RETURN(false); 
+bool N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                        vec3_t map_pos, path_ticket_t *out_ticket)
+{
+    struct nav_private *priv = nav_private;
+    struct path_request req;
+    n_path_init(priv, map_pos, xz_src, xz_dest, &req);
 
-    /* Even if a mapping exists, the actual flow field may have been evicted from
-     * the cache, due to space constraints or invalidation. */
-    ff_id_t id;
-    if(!N_FC_GetDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &id)
-    || !N_FC_ContainsFlowField(id)) {
+    uint64_t key = n_path_key(req.dest_id, (struct coord){req.src_desc.chunk_r, req.src_desc.chunk_c});
+    khiter_t k = kh_get(ticket, s_path_tickets, key);
 
-        struct field_target target = (struct field_target){
-            .type = TARGET_TILE,
-            .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
-        };
+    if(k != kh_end(s_path_tickets)) {
 
-        struct flow_field ff;
-        id = N_FlowField_ID((struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, target);
+        path_ticket_t prev = kh_value(s_path_tickets, k);
+        enum path_status status = N_PathStatus(prev);
 
-        if(!N_FC_ContainsFlowField(id)) {
-        
-            struct coord chunk = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, target, &ff);
-            N_FC_PutFlowField(id, &ff);
+        if(status == PATH_PENDING || status == PATH_UNREACHABLE) {
+            *out_ticket = prev;
+            return true;
         }
-
-        N_FC_PutDestFFMapping(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, id);
-    }
-
-    /* Create the LOS field for the destination chunk, if necessary */
-    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
-
-        struct LOS_field lf;
-        N_LOSFieldCreate(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, dst_desc, priv, map_pos, &lf, NULL);
-        N_FC_PutLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &lf);
-    }
-
-    /* Source and destination positions are in the same chunk, and a path exists
-     * between them. In this case, we only need a single flow field. .
-     */
-    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
-    && src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c] == src_chunk->local_islands[dst_desc.tile_r][dst_desc.tile_c]) {
-
-        *out_dest_id = ret;
-        PERF_RETURN(true);
-    }
-
-    /* If the source and destination are on the same chunk and, in the absence of blockers,
-     * would be reachable from one another, that means that the destination is blocked in
-     * by blockers. In this case, get as close as possible. 
-     */
-    if((src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c)
-    && n_normally_reachable(src_chunk, 
-        (struct coord){src_desc.tile_r, src_desc.tile_c},
-        (struct coord){dst_desc.tile_r, dst_desc.tile_c})) {
-        
-        *out_dest_id = ret;
-        PERF_RETURN(true);
     }
 
-    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, 
-        (struct coord){dst_desc.tile_r, dst_desc.tile_c});
-
-    if(!dst_port)
-        PERF_RETURN(false); 
-
-    float cost;
-    vec_portal_t path;
-    vec_portal_init(&path);
-
-    bool path_exists = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost);
-    if(!path_exists) {
-        vec_portal_destroy(&path);
-        PERF_RETURN(false); 
-    }
+    if(vec_size(&s_path_requests) == MAX_PENDING_PATH_REQUESTS)
+        goto fail_full;
 
-    struct coord prev_los_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+    struct path_request *queued = malloc(sizeof(struct path_request));
+    if(!queued)
+        goto fail_alloc;
 
-    /* Traverse the portal path _backwards_ and generate the required fields, if they are not already 
-     * cached. Add the results to the fieldcache. */
-    for(int i = vec_size(&path)-1; i > 0; i--) {
+    memcpy(queued, &req, sizeof(struct path_request));
+    queued->ticket = s_next_ticket++;
+    if(s_next_ticket == 0)
+        s_next_ticket = 1;
 
-        const struct portal *curr_node = vec_AT(&path, i - 1);
-        const struct portal *next_hop = vec_AT(&path, i);
+    if(!vec_preq_push(&s_path_requests, queued))
+        goto fail_push;
 
-        /* If the very first hop takes us into another chunk, that means that the 'nearest portal'
-         * to the source borders the 'next' chunk already. In this case, we must remember to
-         * still generate a flow field for the current chunk steering to this portal. */
-        if(i == 1 && (next_hop->chunk.r != src_desc.chunk_r || next_hop->chunk.c != src_desc.chunk_c))
-            next_hop = vec_AT(&path, 0);
+    int status;
+    k = kh_put(ticket, s_path_tickets, key, &status);
+    if(status == -1)
+        goto fail_put;
 
-        if(curr_node->connected == next_hop)
-            continue;
+    kh_value(s_path_tickets, k) = queued->ticket;
+    n_set_ticket_status(queued->ticket, PATH_PENDING);
 
-        /* Since we are moving from 'closest portal' to 'closest portal', it 
-         * may be possible that the very last hop takes us from another portal in the 
-         * destination chunk to the destination portal. This is not needed and will
-         * overwrite the destination flow field made earlier. */
-        if(curr_node->chunk.r == dst_desc.chunk_r 
-        && curr_node->chunk.c == dst_desc.chunk_c
-        && next_hop == dst_port)
-            continue;
+    *out_ticket = queued->ticket;
+    return true;
 
-        struct coord chunk_coord = curr_node->chunk;
-        struct field_target target = (struct field_target){
-            .type = TARGET_PORTAL,
-            .port = next_hop
-        };
+fail_put:
+    vec_preq_pop(&s_path_requests);
+fail_push:
+    free(queued);
+fail_alloc:
+fail_full:
+    n_path_fini(&req);
+    return false;
+}
 
-        ff_id_t new_id = N_FlowField_ID(chunk_coord, target);
-        ff_id_t exist_id;
-        struct flow_field ff;
+bool N_RequestCorridor(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                       vec3_t map_pos, dest_id_t *out_dest_id)
+{
+    PERF_ENTER();
 
-        if(N_FC_GetDestFFMapping(ret, chunk_coord, &exist_id)
-        && N_FC_ContainsFlowField(exist_id)) {
+    struct nav_private *priv = nav_private;
+    n_update_dirty_local_islands(nav_private);
 
-            /* The exact flow field we need has already been made */
-            if(new_id == exist_id)
-                goto ff_exists;
+    struct path_request req;
+    n_path_init(priv, map_pos, xz_src, xz_dest, &req);
 
-            /* This is the edge case when a path to a particular target takes us through
-             * the same chunk more than once. This can happen if a chunk is divided into
-             * 'islands' by unpathable barriers. */
-            const struct flow_field *exist_ff  = N_FC_FlowFieldAt(exist_id);
-            memcpy(&ff, exist_ff, sizeof(struct flow_field));
+    dest_id_t id = req.dest_id;
+    struct tile_desc src_desc = req.src_desc;
+    struct tile_desc dst_desc = req.dst_desc;
+    n_path_fini(&req);
 
-            N_FlowFieldUpdate(chunk_coord, priv, target, &ff);
-            /* We set the updated flow field for the new (least recently used) key. Since in 
-             * this case more than one flowfield ID maps to the same field but we only keep 
-             * one of the IDs, it may be possible that the same flowfield will be redundantly 
-             * updated at a later time. However, this is largely inconsequential. */
-            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-            N_FC_PutFlowField(new_id, &ff);
+    /* An existing corridor to the destination can be joined from here */
+    vec2_t dir;
+    bool los;
+    if(N_CorridorSeek(priv, map_pos, id, xz_src, &dir, &los)) {
+        *out_dest_id = id;
+        PERF_RETURN(true);
+    }
 
-            goto ff_exists;
-        }
+    const struct nav_chunk *src_chunk = &priv->chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)];
+    const struct nav_chunk *dst_chunk = &priv->chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)];
+    struct coord src_tile = (struct coord){src_desc.tile_r, src_desc.tile_c};
+    struct coord dst_tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c};
 
-        N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
-        if(!N_FC_ContainsFlowField(new_id)) {
-        
-            N_FlowFieldInit(chunk_coord, priv, &ff);
-            N_FlowFieldUpdate(chunk_coord, priv, target, &ff);
-            N_FC_PutFlowField(new_id, &ff);
-        }
+    if(src_chunk->islands[src_tile.r][src_tile.c] != dst_chunk->islands[dst_tile.r][dst_tile.c])
+        PERF_RETURN(false);
 
-    ff_exists:
-        assert(N_FC_ContainsFlowField(new_id));
-        /* Reference field in the cache */
-        (void)N_FC_FlowFieldAt(new_id);
+    /* The corridor is made without regard for the blockers, so the destination 
+     * is reached without leaving the chunk in the same cases as in 'n_path_resolve' */
+    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
+    && (src_chunk->local_islands[src_tile.r][src_tile.c] == src_chunk->local_islands[dst_tile.r][dst_tile.c]
+        || n_normally_reachable(src_chunk, src_tile, dst_tile))) {
 
-        if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
+        bool ret = N_CorridorBuild(priv, map_pos, id, src_desc, dst_desc, xz_dest, NULL);
+        if(ret)
+            *out_dest_id = id;
+        PERF_RETURN(ret);
+    }
 
-            assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
-            assert(N_FC_ContainsLOSField(ret, prev_los_coord));
+    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, dst_tile);
+    if(!dst_port)
+        PERF_RETURN(false);
 
-            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
-            assert(prev_los);
-            assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
+    float cost;
+    vec_portal_t path;
+    vec_portal_init(&path);
 
-            struct LOS_field lf;
-            N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
-            N_FC_PutLOSField(ret, chunk_coord, &lf);
-        }
+    bool ret = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost)
+            && N_CorridorBuild(priv, map_pos, id, src_desc, dst_desc, xz_dest, &path);
+    if(ret)
+        *out_dest_id = id;
 
-        prev_los_coord = chunk_coord;
-    }
     vec_portal_destroy(&path);
+    PERF_RETURN(ret);
+}
 
-    *out_dest_id = ret; 
-    PERF_RETURN(true);
+enum path_status N_PathStatus(path_ticket_t ticket)
+{
+    if(ticket == 0 || s_ticket_status[ticket % TICKET_HISTORY].ticket != ticket)
+        return PATH_EXPIRED;
+    return s_ticket_status[ticket % TICKET_HISTORY].status;
 }
 
 vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
@@ -1954,29 +3811,59 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
     bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
     assert(result);
 
+    /* Small groups are guided by a corridor, for as long as they keep to it */
+    vec2_t corridor_dir;
+    bool corridor_los;
+    if(N_CorridorSeek(priv, map_pos, id, curr_pos, &corridor_dir, &corridor_los))
+        return corridor_dir;
+
+    /* The fields for this chunk are not available (yet). Request them to be 
+     * made in the background and make do with the nearest field until they 
+     * are ready. 
+     */
     ff_id_t ffid;
-    if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)) {
+    const struct flow_field *ff = NULL;
 
-        dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
+    if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)
+    || !(ff = N_FC_FlowFieldAt(ffid))) {
+
+        path_ticket_t ticket;
+        if(N_RequestPathAsync(nav_private, curr_pos, xz_dest, map_pos, &ticket)
+        && N_PathStatus(ticket) == PATH_UNREACHABLE)
             return (vec2_t){0.0f};
-        assert(ret == id);
-        N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+        return n_fallback_velocity(priv, id, tile, curr_pos, xz_dest);
     }
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
-    if(!ff || ff->field[tile.tile_r][tile.tile_c].dir_idx == FD_NONE) {
+    /* The flow field outlived the LOS field after being repaired. Have it
+     * remade in the background. */
+    if(!N_FC_ContainsLOSField(id, (struct coord){tile.chunk_r, tile.chunk_c})) {
 
-        dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
-            return (vec2_t){0.0f};
-        assert(ret == id);
-        N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+        path_ticket_t ticket;
+        N_RequestPathAsync(nav_private, curr_pos, xz_dest, map_pos, &ticket);
     }
 
-    ff = N_FC_FlowFieldAt(ffid);
+    /* The path from the current tile may differ from the one the field was 
+     * made for. Have it made in the background, as above. */
+    if(N_FlowDir(ff, tile.tile_r, tile.tile_c) == FD_NONE) {
+
+        switch(n_repath_status(priv, id, map_pos, tile, curr_pos, xz_dest)) {
+        case PATH_UNREACHABLE:
+            return (vec2_t){0.0f};
+        case PATH_PENDING:
+            return n_fallback_velocity(priv, id, tile, curr_pos, xz_dest);
+        default:
+            break;
+        }
+
+        /* The field may have been evicted in the meantime */
+        if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)
+        || !(ff = N_FC_FlowFieldAt(ffid))) {
+
+            path_ticket_t ticket;
+            N_RequestPathAsync(nav_private, curr_pos, xz_dest, map_pos, &ticket);
+            return n_fallback_velocity(priv, id, tile, curr_pos, xz_dest);
+        }
+    }
     assert(ff);
 
     /*   1. The original path took us through another global 'island' in
@@ -1985,7 +3872,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      would have updated the flow field with a valid direction for
      *      the current tile.
      */
-    if(ff->field[tile.tile_r][tile.tile_c].dir_idx != FD_NONE)
+    if(N_FlowDir(ff, tile.tile_r, tile.tile_c) != FD_NONE)
         goto ff_found;
 
     const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
@@ -2024,7 +3911,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
 
 ff_found:
     assert(ff);
-    dir_idx = ff->field[tile.tile_r][tile.tile_c].dir_idx;
+    dir_idx = N_FlowDir(ff, tile.tile_r, tile.tile_c);
     return g_flow_dir_lookup[dir_idx];
 }
 
@@ -2042,107 +3929,34 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map
 
     struct coord chunk = (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
 
-    struct field_target target = (struct field_target){
+    /* All the fields guiding the faction's entities towards enemies are 
+     * cached under the same ID for the chunk, regardless of the target */
+    struct field_target id_target = (struct field_target){
         .type = TARGET_ENEMIES,
         .enemies.faction_id = faction_id,
-        .enemies.map_pos = map_pos,
-        .enemies.chunk = chunk
     };
+    ff_id_t ffid = N_FlowField_ID(chunk, id_target);
 
-    ff_id_t ffid = N_FlowField_ID(chunk, target);
-    struct flow_field ff;
-
-    if(!N_FC_ContainsFlowField(ffid)) {
-
-        vec2_t chunk_center = (vec2_t){
-            map_pos.x - (chunk.c + 0.5f) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH,
-            map_pos.z + (chunk.r + 0.5f) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT,
-        };
-        struct entity *nearest_enemy = G_Pos_NearestWithPred(chunk_center, enemy_ent, 
-                                                             (void*)(uintptr_t)target.enemies.faction_id);
-        if(!nearest_enemy)
-            return (vec2_t){0.0f, 0.0f};
-
-        struct tile_desc target_tile;
-        bool result = M_Tile_DescForPoint2D(res, map_pos, G_Pos_GetXZ(nearest_enemy->uid), &target_tile);
-        assert(result);
-        bool done = false;
-
-        /* If there are enemies on this chunk, guide towards them. 
-         */
-        if(target_tile.chunk_r == curr_tile.chunk_r
-        && target_tile.chunk_c == curr_tile.chunk_c) {
-        
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-            done = true;
-        }
-
-        /* Else, if there are enemies on the cardinally adjacent chunks, guide
-         * towards all portals that will lead to them. 
-         */
-        uint64_t pm = n_enemy_seek_portalmask(priv, map_pos, chunk, faction_id);
-        if(!done && pm) {
-
-            struct field_target pm_target = (struct field_target){
-                .type = TARGET_PORTALMASK,
-                .portalmask = pm,
-            };
-
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, pm_target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-            done = true;
-        }
-
-        /* Lastly, resort towards pathing towards the closest entity 
-         */
-        if(!done) {
-
-            assert(target_tile.chunk_r != curr_tile.chunk_r || target_tile.chunk_c != curr_tile.chunk_c);
+    /* Guide towards the enemies in this chunk if there are any. Else, guide
+     * towards the portals that lead to the closest ones. */
+    struct field_target target;
+    if(!N_InfluenceSeekTarget(priv, map_pos, faction_id, chunk, &target))
+        return (vec2_t){0.0f, 0.0f};
 
-            /* The closest enemy is in another chunk. In this case, compute the
-             * field that will take us to the next chunk in the path and store
-             * that with the computed ID as the key. The rest of the fields will
-             * be computed on-the-fly, if necessary.
-             */
-            struct nav_chunk *target_chunk = &priv->chunks[IDX(target_tile.chunk_r, priv->width, target_tile.chunk_c)];
-            const struct portal *dst_port = n_closest_reachable_portal(target_chunk, 
-                (struct coord){target_tile.tile_r, target_tile.tile_c});
-
-            if(!dst_port)
-                return (vec2_t){0.0f, 0.0f};
-
-            float cost;
-            vec_portal_t path;
-            vec_portal_init(&path);
-
-            bool path_exists = AStar_PortalGraphPath(curr_tile, dst_port, priv, &path, &cost);
-            if(!path_exists) {
-                vec_portal_destroy(&path);
-                return (vec2_t){0.0f, 0.0f}; 
-            }
-
-            struct field_target portal_target = (struct field_target){
-                .type = TARGET_PORTAL,
-                .port = vec_AT(&path, 0)
-            };
-
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, portal_target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-
-            vec_portal_destroy(&path);
-        }
+    if(!N_FC_ContainsFlowField(ffid) 
+    || !n_same_seek_target(N_FC_FlowFieldAt(ffid)->target, target)) {
 
+        struct flow_field ff;
+        N_FlowFieldInit(chunk, priv, &ff);
+        N_FlowFieldUpdate(chunk, priv, target, &ff);
+        N_FC_PutFlowField(ffid, &ff);
         assert(N_FC_ContainsFlowField(ffid));
     }
 
     const struct flow_field *pff = N_FC_FlowFieldAt(ffid);
     assert(pff);
 
-    int dir_idx = pff->field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+    int dir_idx = N_FlowDir(pff, curr_tile.tile_r, curr_tile.tile_c);
     if(dir_idx == FD_NONE) {
 
         const struct nav_chunk *nchunk = &priv->chunks[IDX(curr_tile.chunk_r, priv->width, curr_tile.chunk_c)];
@@ -2152,7 +3966,7 @@ vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map
         N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff);
         N_FC_PutFlowField(ffid, &exist_ff);
 
-        dir_idx = exist_ff.field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+        dir_idx = N_FlowDir(&exist_ff, curr_tile.tile_r, curr_tile.tile_c);
     }
 
     return g_flow_dir_lookup[dir_idx];
@@ -2170,12 +3984,17 @@ bool N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_p
     bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
     assert(result);
 
+    vec2_t corridor_dir;
+    bool corridor_los;
+    if(N_CorridorSeek(priv, map_pos, id, curr_pos, &corridor_dir, &corridor_los))
+        return corridor_los;
+
     if(!N_FC_ContainsLOSField(id, (struct coord){tile.chunk_r, tile.chunk_c}))
         return false;
 
     const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){tile.chunk_r, tile.chunk_c});
     assert(lf);
-    return lf->field[tile.tile_r][tile.tile_c].visible;
+    return N_LOSVisible(lf, tile.tile_r, tile.tile_c);
 }
 
 bool N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
@@ -2202,6 +4021,8 @@ bool N_PositionBlocked(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
         FIELD_RES_C, FIELD_RES_R
     };
 
+    n_flush_blockers();
+
     struct tile_desc tile;
     bool result = M_Tile_DescForPoint2D(res, map_pos, xz_pos, &tile);
     assert(result);
@@ -2239,7 +4060,7 @@ vec2_t N_ClosestReachableDest(void *nav_private, vec3_t map_pos, vec2_t xz_src,
     /* Get the worldspace coordinates of the tile's center */
     vec2_t tile_dims = N_TileDims(); 
     struct tile_desc closest_td;
-    int ntd = n_closest_island_tiles(priv, dst_desc, src_iid, true, &closest_td, 1);
+    int ntd = n_closest_island_tiles_cached(priv, dst_desc, src_iid, true, &closest_td, 1);
     if(!ntd)
         return xz_src;
      
@@ -2262,14 +4083,41 @@ vec2_t N_TileDims(void)
 
 void N_BlockersIncref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private)
 {
+    n_flush_blockers();
     n_update_blockers(nav_private, xz_pos, range, map_pos, +1);
 }
 
 void N_BlockersDecref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private)
 {
+    n_flush_blockers();
     n_update_blockers(nav_private, xz_pos, range, map_pos, -1);
 }
 
+void N_BlockersQueueIncref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private)
+{
+    n_queue_blockers(nav_private, xz_pos, range, map_pos, +1);
+}
+
+void N_BlockersQueueDecref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private)
+{
+    n_queue_blockers(nav_private, xz_pos, range, map_pos, -1);
+}
+
+void N_BlockersFlush(void *nav_private)
+{
+    n_flush_blockers();
+}
+
+void N_GetBlockerStats(struct blocker_stats *out_stats)
+{
+    *out_stats = s_blocker_stats;
+}
+
+void N_ClearBlockerStats(void)
+{
+    memset(&s_blocker_stats, 0, sizeof(s_blocker_stats));
+}
+
 bool N_IsMaximallyClose(void *nav_private, vec3_t map_pos, 
                         vec2_t xz_pos, vec2_t xz_dest, float tolerance)
 {
@@ -2283,11 +4131,11 @@ bool N_IsMaximallyClose(void *nav_private, vec3_t map_pos,
     bool result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dest_td);
     assert(result);
 
-    struct tile_desc tds[FIELD_RES_R*2 + FIELD_RES_C*2];
+    struct tile_desc tds[CLOSEST_TILES_MAX];
     struct nav_chunk *chunk = &priv->chunks[IDX(dest_td.chunk_r, priv->width, dest_td.chunk_c)];
 
     uint16_t giid = chunk->islands[dest_td.tile_r][dest_td.tile_c];
-    int ntds = n_closest_island_tiles(priv, dest_td, giid, false, tds, ARR_SIZE(tds));
+    int ntds = n_closest_island_tiles_cached(priv, dest_td, giid, false, tds, ARR_SIZE(tds));
 
     for(int i = 0; i < ntds; i++) {
 
@@ -2307,6 +4155,15 @@ bool N_IsMaximallyClose(void *nav_private, vec3_t map_pos,
     return false;
 }
 
+float N_PortalTravelCost(const struct nav_chunk *chunk, int port_idx, struct coord tile)
+{
+    assert(port_idx >= 0 && port_idx < chunk->num_portals);
+    uint16_t cost = chunk->portal_travel_costs[port_idx][tile.r][tile.c];
+    if(cost == PORTAL_COST_UNREACHABLE)
+        return FLT_MAX;
+    return ((float)cost) / PORTAL_COST_SCALE;
+}
+
 bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, const struct nav_chunk *chunk)
 {
     for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
@@ -0,0 +1,505 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "nav_cache.h"
+#include "nav_private.h"
+#include "../main.h"
+#include "../perf.h"
+#include "../config.h"
+#include "../lib/public/pf_string.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+    #include <direct.h>
+    #define MKDIR(_path) _mkdir(_path)
+    /* 'rename' fails when the target exists */
+    #define REPLACE(_from, _to) (remove(_to), rename((_from), (_to)))
+#else
+    #include <sys/stat.h>
+    #define MKDIR(_path) mkdir((_path), 0755)
+    #define REPLACE(_from, _to) rename((_from), (_to))
+#endif
+
+#define CHK_TRUE(_pred, _label) do{ if(!(_pred)) goto _label; }while(0)
+#define ARR_SIZE(a)             (sizeof(a)/sizeof(a[0]))
+#define MIN(a, b)               ((a) < (b) ? (a) : (b))
+
+#define CACHE_MAGIC     (0x564e4650) /* 'PFNV' */
+#define CACHE_VERSION   (1)
+#define FNV_OFFSET      (0xcbf29ce484222325ull)
+#define FNV_PRIME       (0x100000001b3ull)
+
+/* Entries are only ever read back on the machine that wrote them, so values
+ * are stored in native byte order. A byte order mismatch shows up as a bad
+ * magic number. All fields are 4 or 8 bytes wide, so there is no padding. 
+ * The header is followed by the data of every chunk, in row-major order, and
+ * a checksum of everything that comes after the header. */
+struct cache_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t width, height;
+    uint32_t field_res_r, field_res_c;
+    uint32_t max_portals;
+    uint32_t cost_scale;
+};
+
+/* Portals are referred to by their slot in the map's portal array: 
+ * the chunk index times 'MAX_PORTALS_PER_CHUNK', plus the index within 
+ * the chunk. */
+struct cache_portal{
+    int32_t  endpoints[2][2];
+    uint32_t connected;
+    uint32_t num_neighbours;
+};
+
+struct cache_edge{
+    uint32_t neighbour;
+    float    cost;
+};
+
+struct cache_stream{
+    SDL_RWops *rw;
+    uint64_t   checksum;
+};
+
+/* The data of a chunk, as read from an entry. It only replaces the chunk's 
+ * current data once the whole entry has been read and verified. */
+struct cache_chunk{
+    uint16_t            islands[FIELD_RES_R][FIELD_RES_C];
+    uint32_t            num_portals;
+    struct cache_portal portals[MAX_PORTALS_PER_CHUNK];
+    /* The edges of all the portals, in order */
+    size_t              num_edges;
+    struct cache_edge  *edges;
+    uint16_t          (*portal_travel_costs)[FIELD_RES_R][FIELD_RES_C];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* FNV-1a, consuming 8 bytes at a time. The result depends on how the data
+ * is split between calls, which is always the same for reading and writing 
+ * an entry. */
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    size_t i = 0;
+
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= FNV_PRIME;
+    }
+    for(; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool cs_write(struct cache_stream *cs, const void *data, size_t size)
+{
+    if(size == 0)
+        return true;
+    cs->checksum = hash_bytes(cs->checksum, data, size);
+    return (SDL_RWwrite(cs->rw, data, size, 1) == 1);
+}
+
+static bool cs_read(struct cache_stream *cs, void *data, size_t size)
+{
+    if(size == 0)
+        return true;
+    if(SDL_RWread(cs->rw, data, size, 1) != 1)
+        return false;
+    cs->checksum = hash_bytes(cs->checksum, data, size);
+    return true;
+}
+
+static struct cache_hdr cache_header(const struct nav_private *priv, uint64_t key)
+{
+    return (struct cache_hdr){
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .key = key,
+        .width = priv->width,
+        .height = priv->height,
+        .field_res_r = FIELD_RES_R,
+        .field_res_c = FIELD_RES_C,
+        .max_portals = MAX_PORTALS_PER_CHUNK,
+        .cost_scale = PORTAL_COST_SCALE,
+    };
+}
+
+static void cache_path(uint64_t key, char *out, size_t maxout)
+{
+    pf_snprintf(out, maxout, "%s/%s/%016llx.pfnav", g_basepath, CONFIG_NAV_CACHE_DIR, 
+        (unsigned long long)key);
+}
+
+static uint32_t portal_slot(const struct nav_private *priv, const struct portal *port)
+{
+    size_t chunk_idx = port->chunk.r * priv->width + port->chunk.c;
+    const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    return chunk_idx * MAX_PORTALS_PER_CHUNK + (port - chunk->portals);
+}
+
+static struct portal *slot_portal(struct nav_private *priv, uint32_t slot)
+{
+    if(slot >= priv->width * priv->height * MAX_PORTALS_PER_CHUNK)
+        return NULL;
+    return &priv->chunks[slot / MAX_PORTALS_PER_CHUNK].portals[slot % MAX_PORTALS_PER_CHUNK];
+}
+
+static bool write_chunk(struct cache_stream *cs, const struct nav_private *priv, 
+                        const struct nav_chunk *chunk)
+{
+    uint32_t num_portals = chunk->num_portals;
+
+    CHK_TRUE(cs_write(cs, chunk->cost_base, sizeof(chunk->cost_base)), fail);
+    CHK_TRUE(cs_write(cs, chunk->islands, sizeof(chunk->islands)), fail);
+    CHK_TRUE(cs_write(cs, &num_portals, sizeof(num_portals)), fail);
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        struct cache_portal cport = (struct cache_portal){
+            .endpoints = {
+                {port->endpoints[0].r, port->endpoints[0].c},
+                {port->endpoints[1].r, port->endpoints[1].c},
+            },
+            .connected = portal_slot(priv, port->connected),
+            .num_neighbours = port->num_neighbours,
+        };
+        CHK_TRUE(cs_write(cs, &cport, sizeof(cport)), fail);
+
+        struct cache_edge edges[ARR_SIZE(port->edges)];
+        for(int j = 0; j < port->num_neighbours; j++) {
+            edges[j] = (struct cache_edge){
+                portal_slot(priv, port->edges[j].neighbour),
+                port->edges[j].cost
+            };
+        }
+        CHK_TRUE(cs_write(cs, edges, port->num_neighbours * sizeof(edges[0])), fail);
+    }
+
+    CHK_TRUE(cs_write(cs, chunk->portal_travel_costs, 
+        chunk->num_portals * sizeof(chunk->portal_travel_costs[0])), fail);
+    return true;
+
+fail:
+    return false;
+}
+
+static bool read_chunk(struct cache_stream *cs, struct nav_private *priv, int chunk_idx,
+                       struct cache_chunk *out)
+{
+    const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    uint8_t cost_base[FIELD_RES_R][FIELD_RES_C];
+
+    /* Guard against hash collisions */
+    CHK_TRUE(cs_read(cs, cost_base, sizeof(cost_base)), fail);
+    CHK_TRUE(0 == memcmp(cost_base, chunk->cost_base, sizeof(cost_base)), fail);
+
+    CHK_TRUE(cs_read(cs, out->islands, sizeof(out->islands)), fail);
+    CHK_TRUE(cs_read(cs, &out->num_portals, sizeof(out->num_portals)), fail);
+    CHK_TRUE(out->num_portals <= MAX_PORTALS_PER_CHUNK, fail);
+
+    for(int i = 0; i < out->num_portals; i++) {
+
+        struct cache_portal *cport = &out->portals[i];
+        CHK_TRUE(cs_read(cs, cport, sizeof(*cport)), fail);
+        CHK_TRUE(cport->num_neighbours <= ARR_SIZE(chunk->portals[i].edges), fail);
+        CHK_TRUE(slot_portal(priv, cport->connected), fail);
+
+        if(cport->num_neighbours == 0)
+            continue;
+
+        void *edges = realloc(out->edges, 
+            (out->num_edges + cport->num_neighbours) * sizeof(struct cache_edge));
+        CHK_TRUE(edges, fail);
+        out->edges = edges;
+
+        struct cache_edge *first = out->edges + out->num_edges;
+        CHK_TRUE(cs_read(cs, first, cport->num_neighbours * sizeof(struct cache_edge)), fail);
+        out->num_edges += cport->num_neighbours;
+
+        for(int j = 0; j < cport->num_neighbours; j++) {
+            CHK_TRUE(slot_portal(priv, first[j].neighbour), fail);
+        }
+    }
+
+    if(out->num_portals > 0) {
+        out->portal_travel_costs = malloc(out->num_portals * sizeof(out->portal_travel_costs[0]));
+        CHK_TRUE(out->portal_travel_costs, fail);
+    }
+    CHK_TRUE(cs_read(cs, out->portal_travel_costs, 
+        out->num_portals * sizeof(out->portal_travel_costs[0])), fail);
+    return true;
+
+fail:
+    return false;
+}
+
+static void cache_chunk_free(struct cache_chunk *cc)
+{
+    free(cc->edges);
+    free(cc->portal_travel_costs);
+}
+
+/* Takes ownership of the portal travel cost tables */
+static void commit_chunk(struct nav_private *priv, int chunk_idx, struct cache_chunk *cc)
+{
+    struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    memcpy(chunk->islands, cc->islands, sizeof(chunk->islands));
+
+    const struct cache_edge *edge = cc->edges;
+    for(int i = 0; i < cc->num_portals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        const struct cache_portal *cport = &cc->portals[i];
+
+        port->component_id = 0;
+        port->chunk = (struct coord){chunk_idx / priv->width, chunk_idx % priv->width};
+        port->endpoints[0] = (struct coord){cport->endpoints[0][0], cport->endpoints[0][1]};
+        port->endpoints[1] = (struct coord){cport->endpoints[1][0], cport->endpoints[1][1]};
+        port->connected = slot_portal(priv, cport->connected);
+        port->num_neighbours = cport->num_neighbours;
+
+        for(int j = 0; j < cport->num_neighbours; j++, edge++) {
+            port->edges[j] = (struct edge){
+                EDGE_STATE_ACTIVE, 
+                slot_portal(priv, edge->neighbour), 
+                edge->cost
+            };
+        }
+    }
+    assert(edge == cc->edges + cc->num_edges);
+
+    free(chunk->portal_travel_costs);
+    chunk->portal_travel_costs = cc->portal_travel_costs;
+    chunk->num_portals = cc->num_portals;
+    cc->portal_travel_costs = NULL;
+}
+
+static void index_path(char *out, size_t maxout)
+{
+    pf_snprintf(out, maxout, "%s/%s/index", g_basepath, CONFIG_NAV_CACHE_DIR);
+}
+
+/* The index lists the keys of the entries, most recently used first */
+static size_t read_index(uint64_t *out_keys, size_t maxkeys)
+{
+    char path[512];
+    index_path(path, sizeof(path));
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        return 0;
+
+    uint32_t nkeys = 0;
+    if(!SDL_RWread(stream, &nkeys, sizeof(nkeys), 1))
+        nkeys = 0;
+
+    nkeys = MIN(nkeys, maxkeys);
+    size_t ret = (nkeys > 0) ? SDL_RWread(stream, out_keys, sizeof(uint64_t), nkeys) : 0;
+    SDL_RWclose(stream);
+    return ret;
+}
+
+static void write_index(const uint64_t *keys, size_t nkeys)
+{
+    char path[512], tmp_path[512];
+    index_path(path, sizeof(path));
+    pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        return;
+
+    uint32_t count = nkeys;
+    bool ok = SDL_RWwrite(stream, &count, sizeof(count), 1) == 1
+           && (nkeys == 0 || SDL_RWwrite(stream, keys, sizeof(uint64_t), nkeys) == nkeys);
+
+    if(SDL_RWclose(stream) < 0 || !ok || REPLACE(tmp_path, path) != 0)
+        remove(tmp_path);
+}
+
+/* Make the entry the most recently used one, and delete the least recently
+ * used entries that no longer fit in the cache. */
+static void touch_entry(uint64_t key)
+{
+    uint64_t keys[CONFIG_NAV_CACHE_MAX_ENTRIES + 1];
+    size_t nkeys = read_index(keys + 1, CONFIG_NAV_CACHE_MAX_ENTRIES);
+
+    size_t nkept = 0;
+    for(int i = 0; i < nkeys; i++) {
+        if(keys[i + 1] != key)
+            keys[++nkept] = keys[i + 1];
+    }
+    keys[0] = key;
+    nkept++;
+
+    for(int i = CONFIG_NAV_CACHE_MAX_ENTRIES; i < nkept; i++) {
+        char path[512];
+        cache_path(keys[i], path, sizeof(path));
+        remove(path);
+    }
+    write_index(keys, MIN(nkept, CONFIG_NAV_CACHE_MAX_ENTRIES));
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+uint64_t N_CacheKey(const struct nav_private *priv)
+{
+    PERF_ENTER();
+    uint32_t dims[2] = {priv->width, priv->height};
+    uint64_t ret = hash_bytes(FNV_OFFSET, dims, sizeof(dims));
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        ret = hash_bytes(ret, chunk->cost_base, sizeof(chunk->cost_base));
+    }
+    PERF_RETURN(ret);
+}
+
+bool N_CacheLoad(struct nav_private *priv, uint64_t key)
+{
+    PERF_ENTER();
+
+    char path[512];
+    cache_path(key, path, sizeof(path));
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        goto fail_open;
+
+    const size_t nchunks = priv->width * priv->height;
+    struct cache_chunk *chunks = calloc(nchunks, sizeof(struct cache_chunk));
+    if(!chunks)
+        goto fail_alloc;
+
+    struct cache_hdr hdr, expected = cache_header(priv, key);
+    CHK_TRUE(SDL_RWread(stream, &hdr, sizeof(hdr), 1), fail_read);
+    CHK_TRUE(0 == memcmp(&hdr, &expected, sizeof(hdr)), fail_read);
+
+    struct cache_stream cs = (struct cache_stream){stream, FNV_OFFSET};
+    for(int i = 0; i < nchunks; i++) {
+        CHK_TRUE(read_chunk(&cs, priv, i, &chunks[i]), fail_read);
+    }
+
+    uint64_t checksum;
+    CHK_TRUE(SDL_RWread(stream, &checksum, sizeof(checksum), 1), fail_read);
+    CHK_TRUE(checksum == cs.checksum, fail_read);
+
+    for(int i = 0; i < nchunks; i++) {
+        commit_chunk(priv, i, &chunks[i]);
+        cache_chunk_free(&chunks[i]);
+    }
+    free(chunks);
+    SDL_RWclose(stream);
+
+    touch_entry(key);
+    PERF_RETURN(true);
+
+fail_read:
+    for(int i = 0; i < nchunks; i++) {
+        cache_chunk_free(&chunks[i]);
+    }
+    free(chunks);
+    SDL_RWclose(stream);
+    /* Don't pay for reading a bad entry again. The data rebuilt in its' 
+     * place will be saved under the same key. */
+    remove(path);
+    PERF_RETURN(false);
+
+fail_alloc:
+    SDL_RWclose(stream);
+fail_open:
+    PERF_RETURN(false);
+}
+
+bool N_CacheSave(const struct nav_private *priv, uint64_t key)
+{
+    PERF_ENTER();
+
+    char dir[512], path[512], tmp_path[512];
+    pf_snprintf(dir, sizeof(dir), "%s/%s", g_basepath, CONFIG_NAV_CACHE_DIR);
+    cache_path(key, path, sizeof(path));
+    pf_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    /* Fails harmlessly if the directory already exists */
+    MKDIR(dir);
+
+    /* Write the entry under a temporary name first so that an interrupted 
+     * write never leaves behind a truncated entry */
+    SDL_RWops *stream = SDL_RWFromFile(tmp_path, "wb");
+    if(!stream)
+        goto fail_open;
+
+    struct cache_hdr hdr = cache_header(priv, key);
+    CHK_TRUE(SDL_RWwrite(stream, &hdr, sizeof(hdr), 1), fail_write);
+
+    struct cache_stream cs = (struct cache_stream){stream, FNV_OFFSET};
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        CHK_TRUE(write_chunk(&cs, priv, &priv->chunks[i]), fail_write);
+    }
+    CHK_TRUE(SDL_RWwrite(stream, &cs.checksum, sizeof(cs.checksum), 1), fail_write);
+
+    if(SDL_RWclose(stream) < 0)
+        goto fail_close;
+    if(REPLACE(tmp_path, path) != 0)
+        goto fail_close;
+
+    touch_entry(key);
+    PERF_RETURN(true);
+
+fail_write:
+    SDL_RWclose(stream);
+fail_close:
+    remove(tmp_path);
+fail_open:
+    PERF_RETURN(false);
+}
+
@@ -0,0 +1,78 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef NAV_CACHE_H
+#define NAV_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct nav_private;
+
+/* The portals, the links between them, the portal travel costs and the 
+ * islands are all derived from the cost fields alone, which are in turn fully
+ * determined by the map tiles and the static objects cut out of them. This 
+ * data can be written to a binary file and later read back instead of being 
+ * rebuilt, so long as the cost fields are the same. Data that depends on the 
+ * blockers is not stored. */
+
+/* ------------------------------------------------------------------------
+ * Returns a hash of the dimensions and cost fields of the navigation data,
+ * identifying the cache entry for it.
+ * ------------------------------------------------------------------------
+ */
+uint64_t N_CacheKey(const struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Read the portals, portal travel costs and islands for the key from the 
+ * cache. The cost fields stored with the entry are checked against the 
+ * current ones, and the rest of the entry against its' checksum. Returns 
+ * false if there is no valid entry, in which case the portal and island 
+ * data are left untouched and must be rebuilt. An invalid entry is deleted.
+ * The portal components and the landmarks are not stored.
+ * ------------------------------------------------------------------------
+ */
+bool     N_CacheLoad(struct nav_private *priv, uint64_t key);
+
+/* ------------------------------------------------------------------------
+ * Write the portals, portal travel costs and islands to the cache entry
+ * for the key. Only the 'CONFIG_NAV_CACHE_MAX_ENTRIES' most recently used
+ * entries are kept.
+ * ------------------------------------------------------------------------
+ */
+bool     N_CacheSave(const struct nav_private *priv, uint64_t key);
+
+#endif
+
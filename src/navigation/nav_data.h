@@ -45,6 +45,11 @@
 #define COST_IMPASSABLE       0xff
 #define ISLAND_NONE           0xffff
 
+/* Portal travel costs are stored as fixed-point values with 
+ * PORTAL_COST_SCALE steps per unit of cost. */
+#define PORTAL_COST_SCALE       8
+#define PORTAL_COST_UNREACHABLE 0xffff
+
 struct coord{
     int r, c;
 };
@@ -83,10 +88,15 @@ struct nav_chunk{
      */
     uint8_t         cost_base[FIELD_RES_R][FIELD_RES_C]; 
     /* Holds the cost to travel from every tile to every portal,
-     * when the portal is reachable from the tile. This field is 
-     * synchronized with the 'cost_base' field.
+     * when the portal is reachable from the tile. There is one table
+     * for each of the 'num_portals' portals, allocated on the heap.
+     * Entries are quantized to 'PORTAL_COST_SCALE' steps per unit of
+     * cost, with 'PORTAL_COST_UNREACHABLE' marking the tiles from 
+     * which the portal cannot be reached. Use 'N_PortalTravelCost' 
+     * for lookups. This field is synchronized with the 'cost_base' 
+     * field.
      */
-    float           portal_travel_costs[MAX_PORTALS_PER_CHUNK][FIELD_RES_R][FIELD_RES_C];
+    uint16_t      (*portal_travel_costs)[FIELD_RES_R][FIELD_RES_C];
     /* Every tile in the 'blockers' holds a reference count for
      * how many stationary entities are currently 'retaining' that 
      * tile by being positioned on it. 'Blocked' tiles are treated 
@@ -41,12 +41,27 @@
 #include <stddef.h>
 
 struct portal;
+struct landmarks;
+struct influence;
+struct island_edits;
+struct corridors;
 
 struct nav_private{
-    size_t           width, height;
-    struct nav_chunk chunks[];
+    size_t               width, height;
+    /* Bounds on the costs of paths in the portal graph */
+    struct landmarks    *landmarks;
+    /* The locations of the entities of every faction */
+    struct influence    *influence;
+    /* The chunks modified since the global island IDs were last updated */
+    struct island_edits *island_edits;
+    /* Waypoint paths for small groups */
+    struct corridors    *corridors;
+    struct nav_chunk     chunks[];
 };
 
+/* Returns FLT_MAX if the portal cannot be reached from the tile */
+float N_PortalTravelCost(const struct nav_chunk *chunk, int port_idx, struct coord tile);
+
 bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, 
                                const struct nav_chunk *chunk);
 
@@ -46,6 +46,32 @@ struct obb;
 struct entity;
 
 typedef uint32_t dest_id_t;
+typedef uint32_t path_ticket_t;
+
+enum path_status{
+    PATH_PENDING,
+    PATH_READY,
+    PATH_UNREACHABLE,
+    /* The ticket is too old for its' status to still be known */
+    PATH_EXPIRED,
+};
+
+enum fc_cache{
+    FC_LOS,
+    FC_FLOW,
+    FC_INTEGRATION,
+    FC_MAPPING,
+    FC_GRID_PATH,
+    FC_CLOSEST,
+    FC_NUM_CACHES
+};
+
+enum fc_evict_reason{
+    FC_EVICT_BUDGET,        /* to make room for a new entry */
+    FC_EVICT_INVALIDATED,   /* the navigation data the entry was made from changed */
+    FC_EVICT_CLEARED,       /* all entries were dropped */
+    FC_NUM_EVICT_REASONS
+};
 
 struct fc_stats{
     unsigned los_used;
@@ -56,12 +82,37 @@ struct fc_stats{
     unsigned flow_max;
     float    flow_hit_rate;
     unsigned flow_invalidated;
+    unsigned flow_repaired;    /* repaired in place instead of being invalidated */
+    unsigned flow_repair_hits; /* queries that hit a repaired field */
     unsigned ffid_used;
     unsigned ffid_max;
     float    ffid_hit_rate;
     unsigned grid_path_used;
     unsigned grid_path_max;
     float    grid_path_hit_rate;
+    unsigned closest_used;
+    unsigned closest_max;
+    float    closest_hit_rate;
+    unsigned closest_invalidated;
+    unsigned fields_built;
+    float    field_build_rate; /* fields per second of build time */
+    /* The following are indexed by 'enum fc_cache' */
+    size_t   bytes_used[FC_NUM_CACHES];
+    size_t   bytes_max[FC_NUM_CACHES];
+    unsigned evictions[FC_NUM_CACHES][FC_NUM_EVICT_REASONS];
+    float    avg_evict_age[FC_NUM_CACHES]; /* seconds, not counting cleared entries */
+};
+
+struct blocker_stats{
+    unsigned queued;        /* changes queued with 'N_BlockersQueue*' */
+    unsigned cancelled;     /* queued changes cancelled out by opposite ones */
+    unsigned coalesced;     /* queued changes merged into others for the same circle */
+    unsigned applied;       /* circles walked after cancelling and merging */
+    unsigned tiles_touched; /* per-tile changes made by the applied circles */
+    unsigned tiles_changed; /* tiles with a non-zero net change */
+    unsigned tiles_flipped; /* tiles that became blocked or unblocked */
+    unsigned chunk_passes;  /* chunks updated, once per flush */
+    unsigned flushes;
 };
 
 #define DEST_ID_INVALID (~((uint32_t)0))
@@ -88,6 +139,13 @@ void      N_Update(void *nav_private);
  */
 void      N_Shutdown(void);
 
+/* ------------------------------------------------------------------------
+ * Turn on or off the loading and saving of the navigation data from the 
+ * cache on disk, under the base path. It is on by default.
+ * ------------------------------------------------------------------------
+ */
+void      N_SetDiskCacheEnabled(bool on);
+
 /* ------------------------------------------------------------------------
  * Return a new navigation context for a map, containing pathability
  * information. 'w' and 'h' are the number of chunk columns/rows per map.
@@ -104,6 +162,13 @@ void     *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
  */
 void      N_FreePrivate(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Returns the number of bytes of heap memory held by the navigation 
+ * context.
+ * ------------------------------------------------------------------------
+ */
+size_t    N_MemoryUsage(const void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Draw a translucent overlay over the map chunk, showing the pathable and 
  * non-pathable regions. 'chunk_x_dim' and 'chunk_z_dim' are the chunk
@@ -168,18 +233,37 @@ void      N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct o
 /* ------------------------------------------------------------------------
  * Update portals and the links between them after there have been 
  * changes to the cost field, as new obstructions could have closed off 
- * paths or removed obstructions could have opened up new ones.
+ * paths or removed obstructions could have opened up new ones. Returns
+ * false if there was not enough memory for the portal data.
  * ------------------------------------------------------------------------
  */
-void      N_UpdatePortals(void *nav_private);
+bool      N_UpdatePortals(void *nav_private);
 
 /* ------------------------------------------------------------------------
  * Update the islands (sets of tiles which are reachable from one another)
- * information after there have been changes to the cost field.
+ * information after there have been changes to the cost field. Only the 
+ * chunks changed by 'N_CutoutStaticObject' since the last update are 
+ * visited, unless the changes have split or joined existing islands.
  * ------------------------------------------------------------------------
  */
 void      N_UpdateIslandsField(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Load the data that 'N_UpdatePortals' and 'N_UpdateIslandsField' build 
+ * from the navigation data cache, if it holds an entry for the current 
+ * cost field. Returns false otherwise, in which case the data must be
+ * rebuilt. 
+ * ------------------------------------------------------------------------
+ */
+bool      N_LoadCachedNavData(void *nav_private);
+
+/* ------------------------------------------------------------------------
+ * Store the data built by 'N_UpdatePortals' and 'N_UpdateIslandsField' 
+ * in the navigation data cache, keyed by the current cost field.
+ * ------------------------------------------------------------------------
+ */
+void      N_SaveCachedNavData(const void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Returns a unique ID that is used to associated all flow fields guiding 
  * to this (at tile granularity) position.
@@ -197,9 +281,42 @@ dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos);
 bool      N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
                         vec3_t map_pos, dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Queue up a path request, returning a ticket for it right away. A bounded
+ * number of pending requests is serviced during every 'N_Update', with the 
+ * fields being built on worker threads and then added to the field cache.
+ * Requests for the same destination from the same chunk share a ticket
+ * while pending. Returns false if the request could not be queued.
+ * ------------------------------------------------------------------------
+ */
+bool      N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                             vec3_t map_pos, path_ticket_t *out_ticket);
+
+/* ------------------------------------------------------------------------
+ * Make a corridor of waypoints leading to the destination, instead of the
+ * fields. This is cheaper for guiding a small number of entities, and the
+ * corridor is followed by 'N_DesiredPointSeekVelocity' for as long as the 
+ * entities keep close to it. Returns false if a corridor could not be made, 
+ * in which case the fields should be requested instead.
+ * ------------------------------------------------------------------------
+ */
+bool      N_RequestCorridor(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                            vec3_t map_pos, dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Returns the status of the path request with the specified ticket.
+ * ------------------------------------------------------------------------
+ */
+enum path_status N_PathStatus(path_ticket_t ticket);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
- * towards a particular destination.
+ * towards a particular destination. A corridor to the destination that 
+ * passes close by is followed if there is one. Otherwise, if the fields for 
+ * the current chunk are not available, they are requested asynchronously. In 
+ * the meantime, the velocity follows the field of a neighbouring chunk for
+ * the same destination, or points directly towards the destination if there
+ * is none.
  * ------------------------------------------------------------------------
  */
 vec2_t    N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
@@ -207,12 +324,28 @@ vec2_t    N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_de
 
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
- * towards the closest enemy units within the same chunk.
+ * towards the closest enemy units, as known from the positions last given
+ * to 'N_UpdateFactionPresence'.
  * ------------------------------------------------------------------------
  */
 vec2_t    N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, 
                                      vec3_t map_pos, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Record the position of a combatable entity, for finding the enemies of
+ * its' faction. Only the chunk the entity is in is tracked, so it is 
+ * cheap to call this for entities that have not moved far.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateFactionPresence(void *nav_private, vec3_t map_pos, uint32_t uid, 
+                                  int faction_id, vec2_t xz_pos);
+
+/* ------------------------------------------------------------------------
+ * Stop tracking an entity given to 'N_UpdateFactionPresence'.
+ * ------------------------------------------------------------------------
+ */
+void      N_RemoveFactionPresence(void *nav_private, uint32_t uid);
+
 /* ------------------------------------------------------------------------
  * Returns true if the particular destination is in direct line of sight 
  * of the specified position.
@@ -250,6 +383,29 @@ vec2_t    N_ClosestReachableDest(void *nav_private, vec3_t map_pos, vec2_t xz_sr
 void      N_BlockersIncref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private);
 void      N_BlockersDecref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Like 'N_BlockersIncref' and 'N_BlockersDecref', but the change is only
+ * queued up. All the queued changes are applied together on the next 
+ * 'N_Update', or earlier if the blockers are needed for a query. Changes
+ * for the same circle that add up to nothing are dropped.
+ * ------------------------------------------------------------------------
+ */
+void      N_BlockersQueueIncref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private);
+void      N_BlockersQueueDecref(vec2_t xz_pos, float range, vec3_t map_pos, void *nav_private);
+
+/* ------------------------------------------------------------------------
+ * Apply all the queued blocker changes right away.
+ * ------------------------------------------------------------------------
+ */
+void      N_BlockersFlush(void *nav_private);
+
+/* ------------------------------------------------------------------------
+ * Get and reset the counters for the queued blocker changes.
+ * ------------------------------------------------------------------------
+ */
+void      N_GetBlockerStats(struct blocker_stats *out_stats);
+void      N_ClearBlockerStats(void);
+
 /* ------------------------------------------------------------------------
  * Returns true if the entity position (xz_pos) is within a 'tolerance' 
  * range of the closest non-blocked tile that is reachable from the
@@ -603,6 +603,7 @@ static int PyEntity_set_selection_radius(PyEntityObject *self, PyObject *value,
 
     self->ent->selection_radius = PyFloat_AsDouble(value);
     G_Move_UpdateSelectionRadius(self->ent, self->ent->selection_radius);
+    G_Pos_UpdateAttrs(self->ent);
     return 0;
 }
 
@@ -644,6 +645,7 @@ static int PyEntity_set_faction_id(PyEntityObject *self, PyObject *value, void *
     }
 
     self->ent->faction_id = PyInt_AS_LONG(value);
+    G_Pos_UpdateAttrs(self->ent);
     return 0;
 }
 
@@ -917,6 +919,7 @@ static PyObject *PyEntity_unpickle(PyObject *cls, PyObject *args)
     CHK_TRUE((-1 != (rawflags = PyInt_AsLong(flags))), fail_unpickle_atts);
     G_SetStatic(ent, rawflags & ENTITY_FLAG_STATIC);
     ent->flags = rawflags;
+    G_Pos_UpdateAttrs(ent);
 
     status = PyObject_SetAttrString(entobj, "selection_radius", sel_radius);
     CHK_TRUE(0 == status, fail_unpickle_atts);
@@ -86,6 +86,8 @@ static PyObject *PyPf_get_native_resolution(PyObject *self);
 static PyObject *PyPf_get_basedir(PyObject *self);
 static PyObject *PyPf_get_render_info(PyObject *self);
 static PyObject *PyPf_get_nav_perfstats(PyObject *self);
+static PyObject *PyPf_get_move_perfstats(PyObject *self);
+static PyObject *PyPf_get_combat_perfstats(PyObject *self);
 static PyObject *PyPf_get_mouse_pos(PyObject *self);
 static PyObject *PyPf_mouse_over_ui(PyObject *self);
 static PyObject *PyPf_ui_text_edit_has_focus(PyObject *self);
@@ -224,6 +226,16 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_get_nav_perfstats, METH_NOARGS,
     "Returns a dictionary holding various performance couners for the navigation subsystem."},
 
+    {"get_move_perfstats", 
+    (PyCFunction)PyPf_get_move_perfstats, METH_NOARGS,
+    "Returns a dictionary holding the counts of moving entities and of their steering updates, "
+    "for each of the rates ('full', 'half', 'quarter') at which they are steered."},
+
+    {"get_combat_perfstats", 
+    (PyCFunction)PyPf_get_combat_perfstats, METH_NOARGS,
+    "Returns a dictionary holding various performance counters for the target acquisition of "
+    "combatable entities."},
+
     {"get_mouse_pos", 
     (PyCFunction)PyPf_get_mouse_pos, METH_NOARGS,
     "Get the (x, y) cursor position on the screen."},
@@ -512,8 +524,9 @@ static PyObject *PyPf_load_scene(PyObject *self, PyObject *args, PyObject *kwarg
         return NULL;
     }
 
-    if(update_navgrid) {
-        G_BakeNavDataForScene();
+    if(update_navgrid && !G_BakeNavDataForScene()) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to build the navigation data for the scene.");
+        return NULL;
     }
 
     return S_Entity_GetLoaded();
@@ -777,12 +790,126 @@ static PyObject *PyPf_get_nav_perfstats(PyObject *self)
     rval |= PyDict_SetItemString(ret, "flow_max",           Py_BuildValue("i", stats.flow_max));
     rval |= PyDict_SetItemString(ret, "flow_hit_rate",      Py_BuildValue("f", stats.flow_hit_rate));
     rval |= PyDict_SetItemString(ret, "flow_invalidated",   Py_BuildValue("i", stats.flow_invalidated));
+    rval |= PyDict_SetItemString(ret, "flow_repaired",      Py_BuildValue("i", stats.flow_repaired));
+    rval |= PyDict_SetItemString(ret, "flow_repair_hits",   Py_BuildValue("i", stats.flow_repair_hits));
     rval |= PyDict_SetItemString(ret, "ffid_used",          Py_BuildValue("i", stats.ffid_used));
     rval |= PyDict_SetItemString(ret, "ffid_max",           Py_BuildValue("i", stats.ffid_max));
     rval |= PyDict_SetItemString(ret, "ffid_hit_rate",      Py_BuildValue("f", stats.ffid_hit_rate));
     rval |= PyDict_SetItemString(ret, "grid_path_used",     Py_BuildValue("i", stats.grid_path_used));
     rval |= PyDict_SetItemString(ret, "grid_path_max",      Py_BuildValue("i", stats.grid_path_max));
     rval |= PyDict_SetItemString(ret, "grid_path_hit_rate", Py_BuildValue("f", stats.grid_path_hit_rate));
+    rval |= PyDict_SetItemString(ret, "closest_used",       Py_BuildValue("i", stats.closest_used));
+    rval |= PyDict_SetItemString(ret, "closest_max",        Py_BuildValue("i", stats.closest_max));
+    rval |= PyDict_SetItemString(ret, "closest_hit_rate",   Py_BuildValue("f", stats.closest_hit_rate));
+    rval |= PyDict_SetItemString(ret, "closest_invalidated", Py_BuildValue("i", stats.closest_invalidated));
+    rval |= PyDict_SetItemString(ret, "fields_built",       Py_BuildValue("i", stats.fields_built));
+    rval |= PyDict_SetItemString(ret, "field_build_rate",   Py_BuildValue("f", stats.field_build_rate));
+    rval |= PyDict_SetItemString(ret, "nav_mem_bytes",      Py_BuildValue("K", (unsigned long long)G_NavMemoryUsage()));
+
+    const char *cache_names[FC_NUM_CACHES] = {
+        [FC_LOS]         = "los",
+        [FC_FLOW]        = "flow",
+        [FC_INTEGRATION] = "intf",
+        [FC_MAPPING]     = "ffid",
+        [FC_GRID_PATH]   = "grid_path",
+        [FC_CLOSEST]     = "closest",
+    };
+
+    PyObject *caches = PyDict_New();
+    if(!caches) {
+        Py_DECREF(ret);
+        return NULL;
+    }
+
+    for(int i = 0; i < FC_NUM_CACHES; i++) {
+        rval |= PyDict_SetItemString(caches, cache_names[i], Py_BuildValue("{s:K, s:K, s:i, s:i, s:i, s:f}",
+            "bytes_used",           (unsigned long long)stats.bytes_used[i],
+            "bytes_max",            (unsigned long long)stats.bytes_max[i],
+            "evicted_budget",       stats.evictions[i][FC_EVICT_BUDGET],
+            "evicted_invalidated",  stats.evictions[i][FC_EVICT_INVALIDATED],
+            "evicted_cleared",      stats.evictions[i][FC_EVICT_CLEARED],
+            "avg_evict_age",        stats.avg_evict_age[i]));
+    }
+    rval |= PyDict_SetItemString(ret, "caches", caches);
+    Py_DECREF(caches);
+
+    struct blocker_stats bstats;
+    N_GetBlockerStats(&bstats);
+
+    rval |= PyDict_SetItemString(ret, "blockers", Py_BuildValue("{s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i}",
+        "queued",           bstats.queued,
+        "cancelled",        bstats.cancelled,
+        "coalesced",        bstats.coalesced,
+        "applied",          bstats.applied,
+        "tiles_touched",    bstats.tiles_touched,
+        "tiles_changed",    bstats.tiles_changed,
+        "tiles_flipped",    bstats.tiles_flipped,
+        "chunk_passes",     bstats.chunk_passes,
+        "flushes",          bstats.flushes));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *PyPf_get_move_perfstats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    struct move_stats stats;
+    G_Move_GetStats(&stats);
+
+    const char *lod_names[MOVE_NUM_LODS] = {
+        [MOVE_LOD_FULL]    = "full",
+        [MOVE_LOD_HALF]    = "half",
+        [MOVE_LOD_QUARTER] = "quarter",
+    };
+
+    PyObject *lods = PyDict_New();
+    if(!lods) {
+        Py_DECREF(ret);
+        return NULL;
+    }
+
+    int rval = 0;
+    for(int i = 0; i < MOVE_NUM_LODS; i++) {
+        rval |= PyDict_SetItemString(lods, lod_names[i], Py_BuildValue("{s:i, s:i, s:i}",
+            "moving",       stats.moving[i],
+            "steered",      stats.steered[i],
+            "extrapolated", stats.extrapolated[i]));
+    }
+    rval |= PyDict_SetItemString(ret, "lods", lods);
+    Py_DECREF(lods);
+
+    rval |= PyDict_SetItemString(ret, "escalations", Py_BuildValue("i", stats.escalations));
+    rval |= PyDict_SetItemString(ret, "ticks",       Py_BuildValue("i", stats.ticks));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *PyPf_get_combat_perfstats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    struct combat_stats stats;
+    G_Combat_GetStats(&stats);
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "searches",      Py_BuildValue("i", stats.searches));
+    rval |= PyDict_SetItemString(ret, "fallbacks",     Py_BuildValue("i", stats.fallbacks));
+    rval |= PyDict_SetItemString(ret, "cells_visited", Py_BuildValue("i", stats.cells_visited));
+    rval |= PyDict_SetItemString(ret, "cells_skipped", Py_BuildValue("i", stats.cells_skipped));
+    rval |= PyDict_SetItemString(ret, "candidates",    Py_BuildValue("i", stats.candidates));
+    rval |= PyDict_SetItemString(ret, "early_outs",    Py_BuildValue("i", stats.early_outs));
+    rval |= PyDict_SetItemString(ret, "targets_kept",  Py_BuildValue("i", stats.targets_kept));
+    rval |= PyDict_SetItemString(ret, "targets",       Py_BuildValue("i", stats.targets));
+    rval |= PyDict_SetItemString(ret, "ticks",         Py_BuildValue("i", stats.ticks));
     assert(0 == rval);
 
     return ret;
@@ -0,0 +1,213 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "task.h"
+#include "perf.h"
+#include "lib/public/pf_string.h"
+
+#include <SDL.h>
+#include <assert.h>
+
+#define MAX_WORKERS     (64)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+
+struct batch{
+    task_func_t  func;
+    void        *arg;
+    int          count;
+    SDL_atomic_t next;
+    /* The number of worker threads currently executing invocations 
+     * from this batch. Protected by 's_lock'. */
+    int          nactive;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_Thread   *s_workers[MAX_WORKERS];
+static size_t        s_nworkers = 0;
+
+static SDL_mutex    *s_lock;
+static SDL_cond     *s_work_cond;
+static SDL_cond     *s_done_cond;
+/* The following are protected by 's_lock' */
+static struct batch *s_batch = NULL;
+static unsigned      s_generation = 0;
+static bool          s_quit = false;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void task_run_batch(struct batch *batch)
+{
+    int idx;
+    while((idx = SDL_AtomicAdd(&batch->next, 1)) < batch->count) {
+        batch->func(batch->arg, idx);
+    }
+}
+
+static int task_worker(void *arg)
+{
+    unsigned seen = 0;
+    SDL_LockMutex(s_lock);
+
+    while(true) {
+
+        while(!s_quit && (s_generation == seen || !s_batch))
+            SDL_CondWait(s_work_cond, s_lock);
+
+        if(s_quit)
+            break;
+
+        seen = s_generation;
+        struct batch *batch = s_batch;
+        batch->nactive++;
+        SDL_UnlockMutex(s_lock);
+
+        task_run_batch(batch);
+
+        SDL_LockMutex(s_lock);
+        if(--batch->nactive == 0)
+            SDL_CondSignal(s_done_cond);
+    }
+
+    SDL_UnlockMutex(s_lock);
+    return 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Task_Init(void)
+{
+    if(NULL == (s_lock = SDL_CreateMutex()))
+        goto fail_lock;
+    if(NULL == (s_work_cond = SDL_CreateCond()))
+        goto fail_work_cond;
+    if(NULL == (s_done_cond = SDL_CreateCond()))
+        goto fail_done_cond;
+
+    /* Leave one core for the main thread, which takes part in every batch */
+    size_t nworkers = MIN(MAX(SDL_GetCPUCount() - 1, 1), MAX_WORKERS);
+    s_quit = false;
+
+    for(s_nworkers = 0; s_nworkers < nworkers; s_nworkers++) {
+
+        char name[32];
+        pf_snprintf(name, sizeof(name), "worker-%zu", s_nworkers);
+        s_workers[s_nworkers] = SDL_CreateThread(task_worker, name, NULL);
+        if(!s_workers[s_nworkers])
+            goto fail_threads;
+    }
+    return true;
+
+fail_threads:
+    Task_Shutdown();
+    return false;
+fail_done_cond:
+    SDL_DestroyCond(s_work_cond);
+fail_work_cond:
+    SDL_DestroyMutex(s_lock);
+fail_lock:
+    return false;
+}
+
+void Task_Shutdown(void)
+{
+    SDL_LockMutex(s_lock);
+    s_quit = true;
+    SDL_CondBroadcast(s_work_cond);
+    SDL_UnlockMutex(s_lock);
+
+    for(int i = 0; i < s_nworkers; i++) {
+        SDL_WaitThread(s_workers[i], NULL);
+    }
+    s_nworkers = 0;
+
+    SDL_DestroyCond(s_done_cond);
+    SDL_DestroyCond(s_work_cond);
+    SDL_DestroyMutex(s_lock);
+}
+
+size_t Task_NumWorkers(void)
+{
+    return s_nworkers;
+}
+
+void Task_ParallelFor(int count, task_func_t func, void *arg)
+{
+    PERF_ENTER();
+
+    struct batch batch = (struct batch){
+        .func = func,
+        .arg = arg,
+        .count = count,
+        .nactive = 0
+    };
+    SDL_AtomicSet(&batch.next, 0);
+
+    if(s_nworkers == 0 || count <= 1) {
+        task_run_batch(&batch);
+        PERF_RETURN_VOID();
+    }
+
+    SDL_LockMutex(s_lock);
+    if(s_batch) {
+        SDL_UnlockMutex(s_lock);
+        task_run_batch(&batch);
+        PERF_RETURN_VOID();
+    }
+    s_batch = &batch;
+    s_generation++;
+    SDL_CondBroadcast(s_work_cond);
+    SDL_UnlockMutex(s_lock);
+
+    task_run_batch(&batch);
+
+    /* All the invocations have been claimed at this point. Once there are 
+     * no more workers executing invocations of this batch, it is complete. */
+    SDL_LockMutex(s_lock);
+    s_batch = NULL;
+    while(batch.nactive > 0)
+        SDL_CondWait(s_done_cond, s_lock);
+    SDL_UnlockMutex(s_lock);
+
+    PERF_RETURN_VOID();
+}
+
@@ -0,0 +1,75 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*task_func_t)(void *arg, int idx);
+
+/* ------------------------------------------------------------------------
+ * Spawns the pool of worker threads used for data-parallel work.
+ * ------------------------------------------------------------------------
+ */
+bool   Task_Init(void);
+
+/* ------------------------------------------------------------------------
+ * Joins all the worker threads.
+ * ------------------------------------------------------------------------
+ */
+void   Task_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Returns the number of worker threads in the pool (not counting the
+ * calling thread).
+ * ------------------------------------------------------------------------
+ */
+size_t Task_NumWorkers(void);
+
+/* ------------------------------------------------------------------------
+ * Invokes 'func' once for every index in the range [0, count), spreading 
+ * the invocations over the worker threads and the calling thread. Blocks 
+ * until all the invocations have completed. No ordering is guaranteed 
+ * between the invocations, so they must not write to any shared state.
+ * When the pool is not initialized, or is already busy with another 
+ * batch of work, the invocations are run serially on the calling thread.
+ * ------------------------------------------------------------------------
+ */
+void   Task_ParallelFor(int count, task_func_t func, void *arg);
+
+#endif
+